@@ -0,0 +1,380 @@
+#include "game.h"
+#include "archive.h"
+#include "board_features.h"
+#include "replay.h"
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <unistd.h>
+
+// Offline analytics over recorded games. Replays every game given (single
+// replays and whole archives, see replay.h and archive.h) through
+// `next_gamestate` on a pool of threads and reports:
+//     - stack height over time
+//     - holes left under the stack
+//     - the piece distribution
+//     - clears by size, with the points each size earned
+//     - DAS use
+//
+// Games are handed out one at a time. Each thread keeps its own partial
+// totals and they are only added up once every thread is done, so the
+// workers never touch shared memory while replaying. Per frame there are
+// just a few compares; the board is only looked at when a piece locks.
+//
+// usage: ./analytics [-j threads] (replay | archive)...
+
+#define HEIGHT_MINUTES   (size_t) 30 // the last one holds everything later
+#define NUM_HOLE_BUCKETS (size_t) 32 // the last one holds everything more
+#define FRAMES_PER_MINUTE (unsigned long long) (60 * 60)
+
+typedef enum {
+    HELD_LEFT,
+    HELD_RIGHT,
+    HELD_DOWN,
+    NUM_HELD_DIRECTIONS
+} HeldDirection;
+
+static char const*const held_direction_names[NUM_HELD_DIRECTIONS]
+    = { "left", "right", "down" };
+
+typedef struct {
+    size_t games;
+    size_t desyncs; // replays that went off their recorded hashes
+    unsigned long long frames;
+    unsigned long long pieces;
+    unsigned long long pieces_by_type[NUM_TETROMINO_TYPES];
+    unsigned long long clears[MAX_COMPLETED_ROWS + 1]; // placements by rows
+    unsigned long long clear_points[MAX_COMPLETED_ROWS + 1];
+    unsigned long long height_sum[HEIGHT_MINUTES];
+    unsigned long long height_samples[HEIGHT_MINUTES];
+    size_t max_height[HEIGHT_MINUTES];
+    unsigned long long holes[NUM_HOLE_BUCKETS];
+    unsigned long long held_frames[NUM_HELD_DIRECTIONS];
+    unsigned long long charged_frames[NUM_HELD_DIRECTIONS]; // DAS past its delay
+    unsigned long long das_shifts[NUM_HELD_DIRECTIONS];
+} AnalyticsStats;
+
+// one game: a replay file read by the worker or a game in a mapped archive
+typedef struct {
+    char const* replay_path;
+    ReplayArchive const* archive;
+    size_t game;
+} AnalyticsJob;
+
+typedef struct {
+    AnalyticsJob const* jobs;
+    size_t num_jobs;
+    _Atomic size_t next_job;
+    _Atomic bool failed;
+} AnalyticsQueue;
+
+typedef struct {
+    AnalyticsQueue *queue;
+    pthread_t thread;
+    AnalyticsStats stats; // this thread's partial results
+} AnalyticsWorker;
+
+// Gathering //////////////////////////////////////////////////////////////////
+static inline size_t _min(size_t const a, size_t const b) {
+    return a < b? a : b;
+}
+
+// locked boards waiting for their features, which are worked out a batch at
+// a time (see board_features.h)
+typedef struct {
+    BoardRows boards[FEATURE_LANES];
+    size_t minutes[FEATURE_LANES];
+    size_t count;
+} PendingBoards;
+
+static void _record_boards(AnalyticsStats *const stats, PendingBoards *const pending) {
+    BoardFeatures features[FEATURE_LANES];
+    extract_board_features(pending->boards, pending->count, features);
+    for (size_t i = 0; i < pending->count; ++i) {
+        size_t const minute = pending->minutes[i];
+        size_t const height = features[i].max_height;
+        stats->height_sum[minute] += height;
+        stats->height_samples[minute]++;
+        if (height > stats->max_height[minute]) stats->max_height[minute] = height;
+        stats->holes[_min(features[i].holes, NUM_HOLE_BUCKETS - 1)]++;
+    }
+    pending->count = 0;
+}
+
+static void _record_placement(
+    AnalyticsStats *const stats,
+    PendingBoards *const pending,
+    GameState const*const game_state,
+    size_t const points
+) {
+    stats->pieces++;
+    stats->pieces_by_type[game_state->last_placed.type]++;
+    stats->clears[game_state->num_cleared_rows]++;
+    stats->clear_points[game_state->num_cleared_rows] += points;
+
+    pending->boards[pending->count] = pack_board_rows(game_state->board);
+    pending->minutes[pending->count] = _min(
+        game_state->frame_number / FRAMES_PER_MINUTE,
+        HEIGHT_MINUTES - 1
+    );
+    if (++pending->count == FEATURE_LANES) _record_boards(stats, pending);
+}
+
+// only one direction counts per frame, in the order `next_gamestate` checks
+static inline void _record_input(
+    AnalyticsStats *const stats,
+    GameState const*const game_state,
+    GameInput const*const input
+) {
+    HeldDirection direction;
+    if      (input->down & INPUT_LEFT)  direction = HELD_LEFT;
+    else if (input->down & INPUT_RIGHT) direction = HELD_RIGHT;
+    else if (input->down & INPUT_DOWN)  direction = HELD_DOWN;
+    else return;
+
+    // `game_state` is after the frame, frame_number has moved on by one
+    stats->held_frames[direction]++;
+    if (game_state->delayed_autoshift_frames <= AUTOSHIFT_FRAMES_DELAY) return;
+    stats->charged_frames[direction]++;
+    if ((game_state->frame_number - 1) % AUTOSHIFT_FRAMESKIP == 0)
+        stats->das_shifts[direction]++;
+}
+
+static void _replay_game(
+    AnalyticsStats *const stats,
+    size_t const level,
+    unsigned long long const seed,
+    size_t const num_frames,
+    unsigned char const*const inputs,
+    Replay const*const replay // for its hashes, NULL for archived games
+) {
+    GameState game_state = init_gamestate_seeded(level, seed);
+    PendingBoards pending = { .count = 0 };
+    bool desynced = false;
+    for (size_t frame = 0; frame < num_frames; ++frame) {
+        unsigned long long const pieces_placed = game_state.pieces_placed;
+        size_t const score = game_state.score;
+        GameInput const input = unpack_replay_input(inputs[frame]);
+        next_gamestate(&game_state, &input);
+        desynced = desynced || (replay != NULL && !matches_replay(replay, frame + 1, &game_state));
+
+        if (input.down) _record_input(stats, &game_state, &input);
+        if (game_state.pieces_placed != pieces_placed)
+            _record_placement(stats, &pending, &game_state, game_state.score - score);
+    }
+    _record_boards(stats, &pending);
+
+    stats->games++;
+    stats->frames += num_frames;
+    desynced = desynced || (replay != NULL
+        && replay->final_hash != 0 && hash_gamestate(&game_state) != replay->final_hash);
+    if (desynced) stats->desyncs++;
+}
+
+static void *_run_worker(void *const arg) {
+    AnalyticsWorker *const worker = arg;
+    AnalyticsQueue *const queue = worker->queue;
+    for (;;) {
+        size_t const i = atomic_fetch_add(&queue->next_job, 1);
+        if (i >= queue->num_jobs) return NULL;
+        AnalyticsJob const*const job = &queue->jobs[i];
+
+        if (job->archive != NULL) {
+            ArchiveEntry const*const entry = &job->archive->index[job->game];
+            _replay_game(
+                &worker->stats,
+                entry->level,
+                entry->seed,
+                entry->num_frames,
+                job->archive->data + entry->inputs_offset,
+                NULL
+            );
+            continue;
+        }
+
+        Replay replay = { .inputs = NULL };
+        if (!read_replay(&replay, job->replay_path)) {
+            fprintf(stderr, "Error: could not read replay %s.\n", job->replay_path);
+            atomic_store(&queue->failed, true);
+            continue;
+        }
+        _replay_game(
+            &worker->stats,
+            replay.level,
+            replay.seed,
+            replay.num_frames,
+            replay.inputs,
+            &replay
+        );
+        free_replay(&replay);
+    }
+}
+
+// Merging ////////////////////////////////////////////////////////////////////
+static void _merge_stats(AnalyticsStats *const total, AnalyticsStats const*const part) {
+    total->games += part->games;
+    total->desyncs += part->desyncs;
+    total->frames += part->frames;
+    total->pieces += part->pieces;
+    for (size_t i = 0; i < NUM_TETROMINO_TYPES; ++i)
+        total->pieces_by_type[i] += part->pieces_by_type[i];
+    for (size_t i = 0; i <= MAX_COMPLETED_ROWS; ++i) {
+        total->clears[i] += part->clears[i];
+        total->clear_points[i] += part->clear_points[i];
+    }
+    for (size_t i = 0; i < HEIGHT_MINUTES; ++i) {
+        total->height_sum[i] += part->height_sum[i];
+        total->height_samples[i] += part->height_samples[i];
+        if (part->max_height[i] > total->max_height[i])
+            total->max_height[i] = part->max_height[i];
+    }
+    for (size_t i = 0; i < NUM_HOLE_BUCKETS; ++i) total->holes[i] += part->holes[i];
+    for (size_t i = 0; i < NUM_HELD_DIRECTIONS; ++i) {
+        total->held_frames[i] += part->held_frames[i];
+        total->charged_frames[i] += part->charged_frames[i];
+        total->das_shifts[i] += part->das_shifts[i];
+    }
+}
+
+// Reporting //////////////////////////////////////////////////////////////////
+static inline double _percent(unsigned long long const part, unsigned long long const whole) {
+    return whole > 0? 100.0 * part / whole : 0;
+}
+
+static void _report_stats(AnalyticsStats const*const stats, double const seconds) {
+    static char const piece_names[NUM_TETROMINO_TYPES] = "LJTOIZS";
+
+    printf("games %zu, frames %llu, pieces %llu in %.2fs (%.2fM frames/s)\n",
+        stats->games, stats->frames, stats->pieces,
+        seconds, stats->frames / seconds * 1e-6);
+    if (stats->desyncs > 0)
+        printf("WARNING: %zu replays did not match their recorded hashes\n",
+            stats->desyncs);
+
+    printf("\nstack height by minute (at each lock)\n");
+    printf("%8s %10s %8s %6s\n", "minute", "locks", "mean", "max");
+    for (size_t i = 0; i < HEIGHT_MINUTES; ++i) {
+        if (stats->height_samples[i] == 0) continue;
+        printf("%7zu%s %10llu %8.2f %6zu\n",
+            i, i == HEIGHT_MINUTES - 1? "+" : " ",
+            stats->height_samples[i],
+            (double)stats->height_sum[i] / stats->height_samples[i],
+            stats->max_height[i]);
+    }
+
+    printf("\nholes under the stack (at each lock)\n");
+    for (size_t i = 0; i < NUM_HOLE_BUCKETS; ++i) {
+        if (stats->holes[i] == 0) continue;
+        printf("%7zu%s %10llu %6.2f%%\n",
+            i, i == NUM_HOLE_BUCKETS - 1? "+" : " ",
+            stats->holes[i], _percent(stats->holes[i], stats->pieces));
+    }
+
+    printf("\npieces\n");
+    for (size_t i = 0; i < NUM_TETROMINO_TYPES; ++i)
+        printf("%8c %10llu %6.2f%%\n", piece_names[i],
+            stats->pieces_by_type[i],
+            _percent(stats->pieces_by_type[i], stats->pieces));
+
+    printf("\nclears %10s %8s %12s\n", "count", "locks", "points");
+    for (size_t i = 0; i <= MAX_COMPLETED_ROWS; ++i)
+        printf("%6zu %10llu %7.2f%% %12llu\n", i,
+            stats->clears[i],
+            _percent(stats->clears[i], stats->pieces),
+            stats->clear_points[i]);
+
+    printf("\nDAS %12s %12s %12s\n", "held", "charged", "shifts");
+    for (size_t i = 0; i < NUM_HELD_DIRECTIONS; ++i)
+        printf("%-6s %12llu %12llu %12llu  (%.1f%% of held frames charged)\n",
+            held_direction_names[i],
+            stats->held_frames[i],
+            stats->charged_frames[i],
+            stats->das_shifts[i],
+            _percent(stats->charged_frames[i], stats->held_frames[i]));
+}
+
+// Options ////////////////////////////////////////////////////////////////////
+static inline double _seconds_since(struct timespec const*const start) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - start->tv_sec) + (now.tv_nsec - start->tv_nsec) * 1e-9;
+}
+
+int main(int argc, char **argv) {
+    long const num_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    size_t num_workers = num_cpus > 0? num_cpus : 1;
+    int first_path = 1;
+    if (argc > 2 && strcmp(argv[1], "-j") == 0) {
+        num_workers = strtoul(argv[2], NULL, 10);
+        first_path = 3;
+    }
+    if (first_path >= argc || num_workers == 0) {
+        fprintf(stderr, "usage: %s [-j threads] (replay | archive)...\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    // archives are mapped here and split into one job per game, replays are
+    // left for the workers to read
+    size_t const num_paths = argc - first_path;
+    ReplayArchive *const archives = calloc(num_paths, sizeof(ReplayArchive));
+    if (archives == NULL) {
+        fprintf(stderr, "Error: could not allocate %zu archives.\n", num_paths);
+        return EXIT_FAILURE;
+    }
+    size_t num_jobs = 0;
+    for (size_t i = 0; i < num_paths; ++i) {
+        char const*const path = argv[first_path + i];
+        if (open_replay_archive(&archives[i], path)) {
+            madvise((void*)archives[i].data, archives[i].size, MADV_SEQUENTIAL);
+            num_jobs += archives[i].num_games;
+        }
+        else num_jobs++;
+    }
+
+    AnalyticsJob *const jobs = malloc(num_jobs * sizeof(AnalyticsJob));
+    AnalyticsWorker *const workers = calloc(num_workers, sizeof(AnalyticsWorker));
+    if (jobs == NULL || workers == NULL) {
+        fprintf(stderr, "Error: could not allocate %zu jobs.\n", num_jobs);
+        return EXIT_FAILURE;
+    }
+
+    size_t job = 0;
+    for (size_t i = 0; i < num_paths; ++i) {
+        if (archives[i].data == NULL) {
+            jobs[job++] = (AnalyticsJob){ .replay_path = argv[first_path + i] };
+            continue;
+        }
+        for (size_t game = 0; game < archives[i].num_games; ++game)
+            jobs[job++] = (AnalyticsJob){ .archive = &archives[i], .game = game };
+    }
+
+    AnalyticsQueue queue = { .jobs = jobs, .num_jobs = num_jobs, .next_job = 0 };
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (size_t i = 0; i < num_workers; ++i) {
+        workers[i].queue = &queue;
+        if (pthread_create(&workers[i].thread, NULL, _run_worker, &workers[i])) {
+            fprintf(stderr, "Error: could not start worker thread.\n");
+            exit(1);
+        }
+    }
+
+    AnalyticsStats total = { .games = 0 };
+    for (size_t i = 0; i < num_workers; ++i) {
+        pthread_join(workers[i].thread, NULL);
+        _merge_stats(&total, &workers[i].stats);
+    }
+    _report_stats(&total, _seconds_since(&start));
+
+    for (size_t i = 0; i < num_paths; ++i)
+        if (archives[i].data != NULL) close_replay_archive(&archives[i]);
+    free(archives);
+    free(jobs);
+    free(workers);
+    return atomic_load(&queue.failed) || total.desyncs > 0? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,224 @@
+#include "archive.h"
+#include "game.h"
+#include "replay.h"
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define ARCHIVE_INIT_GAMES (size_t) 64
+
+// Writing ////////////////////////////////////////////////////////////////////
+static bool _pad_to_alignment(FILE *const file) {
+    long const offset = ftell(file);
+    if (offset < 0) return false;
+    static unsigned char const zeros[ARCHIVE_ALIGNMENT] = {0};
+    size_t const padding = (ARCHIVE_ALIGNMENT - offset % ARCHIVE_ALIGNMENT)
+                         % ARCHIVE_ALIGNMENT;
+    return fwrite(zeros, 1, padding, file) == padding;
+}
+
+extern bool open_archive_writer(
+    ArchiveWriter *const writer,
+    char const*const path,
+    size_t const keyframe_interval
+) {
+    *writer = (ArchiveWriter){
+        .file = fopen(path, "wb"),
+        .keyframe_interval = keyframe_interval,
+        .capacity = ARCHIVE_INIT_GAMES,
+        .index = malloc(ARCHIVE_INIT_GAMES * sizeof(ArchiveEntry))
+    };
+    if (writer->file == NULL || writer->index == NULL) return false;
+
+    ArchiveHeader header = {
+        .version = ARCHIVE_VERSION,
+        .state_size = sizeof(GameState),
+        .keyframe_interval = keyframe_interval
+    };
+    memcpy(header.magic, ARCHIVE_MAGIC, 4);
+    return fwrite(&header, sizeof(header), 1, writer->file) == 1;
+}
+
+// simulates the replay once, saving a keyframe every interval on the way
+extern bool add_archive_replay(
+    ArchiveWriter *const writer,
+    Replay const*const replay
+) {
+    if (writer->num_games == writer->capacity) {
+        size_t const capacity = writer->capacity * 2;
+        ArchiveEntry *const index
+            = realloc(writer->index, capacity * sizeof(ArchiveEntry));
+        if (index == NULL) return false;
+        writer->index = index;
+        writer->capacity = capacity;
+    }
+
+    if (!_pad_to_alignment(writer->file)) return false;
+    ArchiveEntry *const entry = &writer->index[writer->num_games];
+    *entry = (ArchiveEntry){
+        .level = replay->level,
+        .seed = replay->seed,
+        .num_frames = replay->num_frames,
+        .num_keyframes = replay->num_frames / writer->keyframe_interval + 1,
+        .keyframes_offset = ftell(writer->file)
+    };
+
+    GameState game_state = init_gamestate_seeded(replay->level, replay->seed);
+    size_t desynced_by = 0; // the first frame found off, 0 while none is
+    for (size_t frame = 0; frame <= replay->num_frames; ++frame) {
+        if (desynced_by == 0 && !matches_replay(replay, frame, &game_state))
+            desynced_by = frame;
+        if (frame % writer->keyframe_interval == 0
+        &&  fwrite(&game_state, sizeof(GameState), 1, writer->file) != 1
+        ) return false;
+        if (frame == replay->num_frames) break;
+
+        GameInput const input = unpack_replay_input(replay->inputs[frame]);
+        next_gamestate(&game_state, &input);
+    }
+    if (desynced_by > 0) fprintf(stderr,
+        "Warning: replay (seed %016llx) desynced by frame %zu.\n", replay->seed, desynced_by);
+    else if (replay->final_hash != 0 && hash_gamestate(&game_state) != replay->final_hash)
+        fprintf(stderr, "Warning: replay (seed %016llx) desynced.\n", replay->seed);
+
+    entry->inputs_offset = ftell(writer->file);
+    if (fwrite(replay->inputs, 1, replay->num_frames, writer->file)
+        != replay->num_frames
+    ) return false;
+
+    writer->num_games++;
+    return true;
+}
+
+extern bool close_archive_writer(ArchiveWriter *const writer) {
+    bool ok = _pad_to_alignment(writer->file);
+
+    ArchiveTrailer trailer = {
+        .index_offset = ftell(writer->file),
+        .num_games = writer->num_games
+    };
+    memcpy(trailer.magic, ARCHIVE_TRAILER_MAGIC, 4);
+
+    ok = ok
+      && fwrite(writer->index, sizeof(ArchiveEntry), writer->num_games, writer->file)
+         == writer->num_games
+      && fwrite(&trailer, sizeof(trailer), 1, writer->file) == 1;
+    ok = fclose(writer->file) == 0 && ok;
+
+    free(writer->index);
+    writer->index = NULL;
+    return ok;
+}
+
+// Reading ////////////////////////////////////////////////////////////////////
+// `count` items of `item_size` from `offset` lie within `size` bytes,
+// without overflowing on the way
+static inline bool _fits(
+    size_t const size,
+    uint64_t const offset,
+    uint64_t const count,
+    size_t const item_size
+) {
+    return offset <= size && count <= (size - offset) / item_size;
+}
+
+// a keyframe for every interval up to and including the last frame, and an
+// input for every frame, all inside the file
+static bool _is_entry_valid(
+    ReplayArchive const*const archive,
+    ArchiveEntry const*const entry
+) {
+    return entry->keyframes_offset % ARCHIVE_ALIGNMENT == 0
+        && entry->num_frames < SIZE_MAX
+        && entry->num_keyframes > entry->num_frames / archive->keyframe_interval
+        && _fits(archive->size, entry->keyframes_offset, entry->num_keyframes, sizeof(GameState))
+        && _fits(archive->size, entry->inputs_offset, entry->num_frames, 1);
+}
+
+extern bool open_replay_archive(
+    ReplayArchive *const archive,
+    char const*const path
+) {
+    int const fd = open(path, O_RDONLY);
+    if (fd < 0) return false;
+
+    struct stat status;
+    if (fstat(fd, &status) != 0
+    ||  (size_t)status.st_size < sizeof(ArchiveHeader) + sizeof(ArchiveTrailer)
+    ) {
+        close(fd);
+        return false;
+    }
+
+    void *const data = mmap(NULL, status.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) return false;
+
+    *archive = (ReplayArchive){ .data = data, .size = status.st_size };
+
+    ArchiveHeader const*const header = data;
+    ArchiveTrailer const*const trailer = (ArchiveTrailer const*)
+        (archive->data + archive->size - sizeof(ArchiveTrailer));
+    bool const is_valid
+        =  memcmp(header->magic, ARCHIVE_MAGIC, 4) == 0
+        && header->version == ARCHIVE_VERSION
+        && header->state_size == sizeof(GameState)
+        && header->keyframe_interval > 0
+        && memcmp(trailer->magic, ARCHIVE_TRAILER_MAGIC, 4) == 0
+        && trailer->index_offset % ARCHIVE_ALIGNMENT == 0
+        && _fits(archive->size, trailer->index_offset, trailer->num_games, sizeof(ArchiveEntry));
+    if (!is_valid) {
+        close_replay_archive(archive);
+        return false;
+    }
+
+    archive->keyframe_interval = header->keyframe_interval;
+    archive->num_games = trailer->num_games;
+    archive->index = (ArchiveEntry const*)(archive->data + trailer->index_offset);
+
+    // readers index straight into the mapping, one bad entry and it's out
+    for (size_t i = 0; i < archive->num_games; ++i) {
+        if (_is_entry_valid(archive, &archive->index[i])) continue;
+        close_replay_archive(archive);
+        return false;
+    }
+
+    // random seeks jump all over the file, read-ahead would be wasted
+    madvise(data, archive->size, MADV_RANDOM);
+    return true;
+}
+
+extern void close_replay_archive(ReplayArchive *const archive) {
+    munmap((void*)archive->data, archive->size);
+    archive->data = NULL;
+}
+
+extern bool seek_replay_archive(
+    ReplayArchive const*const archive,
+    size_t const game,
+    size_t const frame,
+    GameState *const game_state
+) {
+    if (game >= archive->num_games) return false;
+    ArchiveEntry const*const entry = &archive->index[game];
+    if (frame > entry->num_frames) return false;
+
+    size_t const keyframe = frame / archive->keyframe_interval;
+    GameState const*const keyframes
+        = (GameState const*)(archive->data + entry->keyframes_offset);
+    unsigned char const*const inputs = archive->data + entry->inputs_offset;
+
+    *game_state = keyframes[keyframe];
+    for (size_t i = keyframe * archive->keyframe_interval; i < frame; ++i) {
+        GameInput const input = unpack_replay_input(inputs[i]);
+        next_gamestate(game_state, &input);
+    }
+    return true;
+}
@@ -0,0 +1,90 @@
+#ifndef ARCHIVE_H
+#define ARCHIVE_H
+
+#include "game.h"
+#include "replay.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+// Replay archive: many recorded games in one file, read through mmap. Every
+// game stores a full GameState keyframe every `keyframe_interval` frames plus
+// its per-frame inputs, so any frame is at most one interval of
+// `next_gamestate` calls away from a keyframe.
+//
+// File layout (native byte order, keyframes are raw GameState structs so the
+// archive is tied to the build that wrote it, `state_size` guards that):
+//     ArchiveHeader
+//     per game: keyframes (8 byte aligned) | inputs
+//     ArchiveEntry index[num_games]
+//     ArchiveTrailer
+
+#define ARCHIVE_MAGIC          "TRAR"
+#define ARCHIVE_TRAILER_MAGIC  "TRAI"
+#define ARCHIVE_VERSION        (uint32_t) 1
+#define ARCHIVE_KEYFRAME_INTERVAL (size_t) 256
+#define ARCHIVE_ALIGNMENT      (size_t) 8
+
+typedef struct {
+    char magic[4];
+    uint32_t version;
+    uint32_t state_size;
+    uint32_t keyframe_interval;
+} ArchiveHeader;
+
+typedef struct {
+    uint64_t level;
+    uint64_t seed;
+    uint64_t num_frames;
+    uint64_t num_keyframes;
+    uint64_t keyframes_offset;
+    uint64_t inputs_offset;
+} ArchiveEntry;
+
+typedef struct {
+    uint64_t index_offset;
+    uint64_t num_games;
+    char magic[4];
+    uint32_t reserved;
+} ArchiveTrailer;
+
+typedef struct {
+    unsigned char const* data;
+    size_t size;
+    size_t keyframe_interval;
+    size_t num_games;
+    ArchiveEntry const* index;
+} ReplayArchive;
+
+typedef struct {
+    FILE *file;
+    size_t keyframe_interval;
+    size_t num_games;
+    size_t capacity;
+    ArchiveEntry *index;
+} ArchiveWriter;
+
+// Writing ////////////////////////////////////////////////////////////////////
+bool open_archive_writer(
+    ArchiveWriter *const writer,
+    char const*const path,
+    size_t const keyframe_interval
+);
+bool add_archive_replay(ArchiveWriter *const writer, Replay const*const replay);
+bool close_archive_writer(ArchiveWriter *const writer);
+
+// Reading ////////////////////////////////////////////////////////////////////
+bool open_replay_archive(ReplayArchive *const archive, char const*const path);
+void close_replay_archive(ReplayArchive *const archive);
+
+// rebuilds frame `frame` (the state after that many inputs, 0 is the start)
+// of game `game` from the nearest keyframe at or before it.
+bool seek_replay_archive(
+    ReplayArchive const*const archive,
+    size_t const game,
+    size_t const frame,
+    GameState *const game_state
+);
+
+#endif // ARCHIVE_H
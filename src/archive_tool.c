@@ -0,0 +1,186 @@
+#include "game.h"
+#include "archive.h"
+#include "counters.h"
+#include "debug.h"
+#include "replay.h"
+#include "transposition.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// Replay archive tool (see archive.h).
+// usage: ./archive pack archive.tra replay...
+//        ./archive info archive.tra
+//        ./archive seek archive.tra game frame
+//        ./archive bench archive.tra [seeks]
+//        ./archive positions archive.tra
+
+#define BENCH_SEEKS (size_t) 100000
+
+static inline double _seconds_since(struct timespec const*const start) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - start->tv_sec) + (now.tv_nsec - start->tv_nsec) * 1e-9;
+}
+
+static int _pack(int const num_replays, char **replay_paths, char const*const path) {
+    ArchiveWriter writer;
+    if (!open_archive_writer(&writer, path, ARCHIVE_KEYFRAME_INTERVAL)) {
+        fprintf(stderr, "Error: could not create %s.\n", path);
+        return EXIT_FAILURE;
+    }
+
+    for (int i = 0; i < num_replays; ++i) {
+        Replay replay = { .inputs = NULL };
+        if (!read_replay(&replay, replay_paths[i])) {
+            fprintf(stderr, "Error: could not read replay %s.\n", replay_paths[i]);
+            return EXIT_FAILURE;
+        }
+        if (!add_archive_replay(&writer, &replay)) {
+            fprintf(stderr, "Error: could not write %s.\n", path);
+            return EXIT_FAILURE;
+        }
+        free_replay(&replay);
+    }
+
+    if (!close_archive_writer(&writer)) {
+        fprintf(stderr, "Error: could not finish %s.\n", path);
+        return EXIT_FAILURE;
+    }
+    printf("packed %d games into %s\n", num_replays, path);
+    return EXIT_SUCCESS;
+}
+
+static int _info(ReplayArchive const*const archive) {
+    printf("games %zu, keyframe every %zu frames\n",
+        archive->num_games, archive->keyframe_interval);
+    for (size_t i = 0; i < archive->num_games; ++i) {
+        ArchiveEntry const*const entry = &archive->index[i];
+        printf("%6zu  level %2llu  frames %8llu  seed %016llx\n",
+            i,
+            (unsigned long long)entry->level,
+            (unsigned long long)entry->num_frames,
+            (unsigned long long)entry->seed);
+    }
+    return EXIT_SUCCESS;
+}
+
+static int _seek(
+    ReplayArchive const*const archive,
+    size_t const game,
+    size_t const frame
+) {
+    GameState game_state;
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    if (!seek_replay_archive(archive, game, frame, &game_state)) {
+        fprintf(stderr, "Error: no frame %zu in game %zu.\n", frame, game);
+        return EXIT_FAILURE;
+    }
+    double const seconds = _seconds_since(&start);
+
+    print_game_state(&game_state);
+    fprintf(stderr, "\nseek took %.2f us\n", seconds * 1e6);
+    return EXIT_SUCCESS;
+}
+
+static int _bench(ReplayArchive const*const archive, size_t const num_seeks) {
+    if (archive->num_games == 0) return EXIT_FAILURE;
+
+    unsigned long long checksum = 0;
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (size_t i = 0; i < num_seeks; ++i) {
+        size_t const game = rand() % archive->num_games;
+        size_t const frame = rand() % (archive->index[game].num_frames + 1);
+        GameState game_state;
+        seek_replay_archive(archive, game, frame, &game_state);
+        checksum += game_state.score + game_state.frame_number;
+    }
+    double const seconds = _seconds_since(&start);
+
+    printf("%zu random seeks, %.2f us each (checksum %llu)\n",
+        num_seeks, seconds / num_seeks * 1e6, checksum);
+    return EXIT_SUCCESS;
+}
+
+// plays every game through and counts positions (board and falling piece)
+// already seen earlier in the archive. The table can forget, so repeats are
+// a lower bound.
+static int _positions(ReplayArchive const*const archive) {
+    TranspositionTable table;
+    if (!create_transposition_table(&table, TRANSPOSITION_DEFAULT_ENTRIES)) {
+        fprintf(stderr, "Error: could not allocate the transposition table.\n");
+        return EXIT_FAILURE;
+    }
+
+    size_t num_positions = 0;
+    size_t num_repeats = 0;
+    for (size_t game = 0; game < archive->num_games; ++game) {
+        ArchiveEntry const*const entry = &archive->index[game];
+        GameState game_state;
+        seek_replay_archive(archive, game, 0, &game_state);
+        unsigned char const*const inputs = archive->data + entry->inputs_offset;
+
+        for (size_t frame = 0; frame <= entry->num_frames; ++frame) {
+            uint64_t const key = hash_gamestate(&game_state);
+            uint64_t seen;
+            if (probe_transposition_table(&table, key, &seen)) num_repeats++;
+            else store_transposition_table(&table, key, frame);
+            num_positions++;
+
+            if (frame == entry->num_frames) break;
+            GameInput const input = unpack_replay_input(inputs[frame]);
+            next_gamestate(&game_state, &input);
+        }
+    }
+
+    printf("positions %zu, repeats %zu (%.1f%%)\n",
+        num_positions, num_repeats, 100.0 * num_repeats / num_positions);
+    free_transposition_table(&table);
+    return EXIT_SUCCESS;
+}
+
+int main(int argc, char **argv) {
+    if (argc >= 4 && strcmp(argv[1], "pack") == 0)
+        return _pack(argc - 3, argv + 3, argv[2]);
+
+    if (argc < 3) {
+        fprintf(stderr,
+            "usage: %s pack archive.tra replay...\n"
+            "       %s info archive.tra\n"
+            "       %s seek archive.tra game frame\n"
+            "       %s bench archive.tra [seeks]\n"
+            "       %s positions archive.tra\n",
+            argv[0], argv[0], argv[0], argv[0], argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    ReplayArchive archive;
+    if (!open_replay_archive(&archive, argv[2])) {
+        fprintf(stderr, "Error: %s is not a readable archive.\n", argv[2]);
+        return EXIT_FAILURE;
+    }
+
+    int exit_code = EXIT_FAILURE;
+    if (strcmp(argv[1], "info") == 0) exit_code = _info(&archive);
+    else if (strcmp(argv[1], "seek") == 0 && argc >= 5) exit_code = _seek(
+        &archive,
+        strtoul(argv[3], NULL, 10),
+        strtoul(argv[4], NULL, 10)
+    );
+    else if (strcmp(argv[1], "bench") == 0) exit_code = _bench(
+        &archive,
+        argc >= 4? strtoul(argv[3], NULL, 10) : BENCH_SEEKS
+    );
+    else if (strcmp(argv[1], "positions") == 0) exit_code = _positions(&archive);
+    else fprintf(stderr, "Error: unknown command %s.\n", argv[1]);
+
+    GameCounters counters;
+    read_game_counters(&counters);
+    if (counters.enabled) print_game_counters(&counters);
+
+    close_replay_archive(&archive);
+    return exit_code;
+}
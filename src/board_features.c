@@ -0,0 +1,170 @@
+#include "board_features.h"
+#include "game.h"
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#define FULL_ROW    (uint16_t) ((1u << COLS) - 1)
+#define WALLED_ROW  (uint16_t) ((1u << (COLS + 1)) - 1) // a row with a wall each side
+
+// Bits ///////////////////////////////////////////////////////////////////////
+
+// SWAR, no popcount instruction needed so it vectorizes on plain SSE2
+static inline uint16_t _popcount(uint16_t x) {
+    x = x - ((x >> 1) & 0x5555);
+    x = (x & 0x3333) + ((x >> 2) & 0x3333);
+    x = (x + (x >> 4)) & 0x0F0F;
+    return (x + (x >> 8)) & 0x001F;
+}
+
+// the classic byte table, for one board at a time where a lookup beats SWAR
+#define _B2(n) n, n + 1, n + 1, n + 2
+#define _B4(n) _B2(n), _B2(n + 1), _B2(n + 1), _B2(n + 2)
+#define _B6(n) _B4(n), _B4(n + 1), _B4(n + 1), _B4(n + 2)
+static uint8_t const byte_popcounts[256] = { _B6(0), _B6(1), _B6(1), _B6(2) };
+
+static inline uint16_t _popcount_one(uint16_t const x) {
+    return byte_popcounts[x & 0xFF] + byte_popcounts[x >> 8];
+}
+
+// Packing ////////////////////////////////////////////////////////////////////
+extern BoardRows pack_board_rows(TetrominoType const board[ROWS][COLS]) {
+    BoardRows packed;
+    for (size_t y = 0; y < ROWS; ++y) {
+        uint16_t row = 0;
+        for (size_t x = 0; x < COLS; ++x)
+            row |= (uint16_t)(board[y][x] != NO_TETROMINO) << x;
+        packed.rows[y] = row;
+    }
+    return packed;
+}
+
+extern BoardRows place_on_board_rows(
+    BoardRows const*const before,
+    Tetromino const*const placed
+) {
+    BoardRows after = *before;
+    for (size_t i = 0; i < NUM_TETROMINO_BLOCKS; ++i) {
+        size_t const x = placed->positions[i][X_AXIS] + placed->x;
+        size_t const y = placed->positions[i][Y_AXIS] + placed->y;
+        after.rows[y] |= (uint16_t)(1u << x);
+    }
+    return after;
+}
+
+// Extraction /////////////////////////////////////////////////////////////////
+
+// one group, top row down. Every inner loop is over the lanes only.
+static void _extract_lanes(
+    uint16_t const rows[ROWS][FEATURE_LANES],
+    BoardFeatures features[FEATURE_LANES]
+) {
+    uint16_t covered[FEATURE_LANES] = { 0 };  // OR of the rows so far
+    uint16_t previous[FEATURE_LANES] = { 0 }; // the row above, open at the top
+    uint16_t holes[FEATURE_LANES] = { 0 };
+    uint16_t total_height[FEATURE_LANES] = { 0 };
+    uint16_t row_transitions[FEATURE_LANES] = { 0 };
+    uint16_t column_transitions[FEATURE_LANES] = { 0 };
+    uint16_t wells[FEATURE_LANES] = { 0 };
+    uint16_t heights[COLS][FEATURE_LANES] = { { 0 } };
+
+    for (size_t y = 0; y < ROWS; ++y) {
+        for (size_t i = 0; i < FEATURE_LANES; ++i) {
+            uint16_t const row = rows[y][i];
+            holes[i] += _popcount(covered[i] & ~row);
+            covered[i] |= row;
+            total_height[i] += _popcount(covered[i]);
+
+            uint16_t const walled = row << 1 | 1 | 1 << (COLS + 1);
+            row_transitions[i] += _popcount((walled ^ walled >> 1) & WALLED_ROW);
+            column_transitions[i] += _popcount(previous[i] ^ row);
+            previous[i] = row;
+
+            uint16_t const left = covered[i] << 1 | 1;
+            uint16_t const right = covered[i] >> 1 | 1 << (COLS - 1);
+            wells[i] += _popcount(~covered[i] & left & right & FULL_ROW);
+        }
+        for (size_t x = 0; x < COLS; ++x) {
+            for (size_t i = 0; i < FEATURE_LANES; ++i)
+                heights[x][i] += covered[i] >> x & 1;
+        }
+    }
+
+    uint16_t bumpiness[FEATURE_LANES] = { 0 };
+    uint16_t max_height[FEATURE_LANES] = { 0 };
+    for (size_t x = 0; x < COLS; ++x) {
+        for (size_t i = 0; i < FEATURE_LANES; ++i) max_height[i]
+            = heights[x][i] > max_height[i]? heights[x][i] : max_height[i];
+    }
+    for (size_t x = 0; x + 1 < COLS; ++x) {
+        for (size_t i = 0; i < FEATURE_LANES; ++i) bumpiness[i]
+            += heights[x][i] > heights[x + 1][i]
+             ? heights[x][i] - heights[x + 1][i]
+             : heights[x + 1][i] - heights[x][i];
+    }
+
+    for (size_t i = 0; i < FEATURE_LANES; ++i) {
+        BoardFeatures *const out = &features[i];
+        for (size_t x = 0; x < COLS; ++x) out->heights[x] = heights[x][i];
+        out->total_height = total_height[i];
+        out->max_height = max_height[i];
+        out->holes = holes[i];
+        out->row_transitions = row_transitions[i];
+        // the floor is filled
+        out->column_transitions = column_transitions[i]
+                                + _popcount(~previous[i] & FULL_ROW);
+        out->wells = wells[i];
+        out->bumpiness = bumpiness[i];
+    }
+}
+
+// the same on one board, for what is left over after the full groups. The
+// heights come from the columns each row covers first.
+static void _extract_board(BoardRows const*const board, BoardFeatures *const out) {
+    uint16_t covered = 0;
+    uint16_t previous = 0;
+    *out = (BoardFeatures){ .holes = 0 };
+
+    for (size_t y = 0; y < ROWS; ++y) {
+        uint16_t const row = board->rows[y];
+        out->holes += _popcount_one(covered & ~row);
+        for (uint16_t first = row & ~covered; first != 0; first &= first - 1)
+            out->heights[__builtin_ctz(first)] = ROWS - y;
+        covered |= row;
+        out->total_height += _popcount_one(covered);
+
+        uint16_t const walled = row << 1 | 1 | 1 << (COLS + 1);
+        out->row_transitions += _popcount_one((walled ^ walled >> 1) & WALLED_ROW);
+        out->column_transitions += _popcount_one(previous ^ row);
+        previous = row;
+
+        uint16_t const left = covered << 1 | 1;
+        uint16_t const right = covered >> 1 | 1 << (COLS - 1);
+        out->wells += _popcount_one(~covered & left & right & FULL_ROW);
+    }
+    out->column_transitions += _popcount_one(~previous & FULL_ROW);
+
+    for (size_t x = 0; x < COLS; ++x) {
+        if (out->heights[x] > out->max_height) out->max_height = out->heights[x];
+        if (x + 1 < COLS) out->bumpiness += out->heights[x] > out->heights[x + 1]
+            ? out->heights[x] - out->heights[x + 1]
+            : out->heights[x + 1] - out->heights[x];
+    }
+}
+
+// Exposed ////////////////////////////////////////////////////////////////////
+extern void extract_board_features(
+    BoardRows const*const boards,
+    size_t const count,
+    BoardFeatures *const features
+) {
+    size_t first = 0;
+    for (; first + FEATURE_LANES <= count; first += FEATURE_LANES) {
+        uint16_t rows[ROWS][FEATURE_LANES];
+        for (size_t i = 0; i < FEATURE_LANES; ++i) {
+            for (size_t y = 0; y < ROWS; ++y) rows[y][i] = boards[first + i].rows[y];
+        }
+        _extract_lanes(rows, &features[first]);
+    }
+    for (; first < count; ++first) _extract_board(&boards[first], &features[first]);
+}
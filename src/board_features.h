@@ -0,0 +1,69 @@
+#ifndef BOARD_FEATURES_H
+#define BOARD_FEATURES_H
+
+#include "game.h"
+#include <stddef.h>
+#include <stdint.h>
+
+// Board features for evaluation, many boards at a time. Every bot, analysis
+// and trainer scoring boards should go through `extract_board_features` so
+// they agree on what the features mean.
+//
+// Boards are first packed into row masks (see `pack_board_rows`). The batch
+// is then worked through in groups of FEATURE_LANES boards transposed so one
+// row of every board in the group sits side by side, and every feature is
+// built from whole-row bit operations on those (OR down the rows for what is
+// covered, XOR for transitions, shifts for neighbours, a SWAR popcount) in
+// straight loops over the lanes that the compiler turns into SIMD. Boards
+// left over after the last full group get the same operations one at a
+// time, so a batch of one costs no more than it should.
+//
+// Definitions, with the walls and the floor counting as blocks:
+//     height              rows from the floor up to a column's top block
+//     holes               empty cells with a block somewhere above them
+//     row transitions     filled/empty changes along each row
+//     column transitions  filled/empty changes down each column, open at
+//                         the top
+//     wells               empty cells above their column's top whose
+//                         neighbours on both sides are covered as high
+//     bumpiness           sum of height differences between neighbours
+
+// Constants //////////////////////////////////////////////////////////////////
+#define FEATURE_LANES (size_t) 16 // boards worked on together
+
+// Structs ////////////////////////////////////////////////////////////////////
+
+// bit x of rows[y] is set if the cell at (x, y) has a block
+typedef struct {
+    uint16_t rows[ROWS];
+} BoardRows;
+
+typedef struct {
+    uint8_t heights[COLS];
+    uint16_t total_height;
+    uint16_t max_height;
+    uint16_t holes;
+    uint16_t row_transitions;
+    uint16_t column_transitions;
+    uint16_t wells;
+    uint16_t bumpiness;
+} BoardFeatures;
+
+// Functions //////////////////////////////////////////////////////////////////
+BoardRows pack_board_rows(TetrominoType const board[ROWS][COLS]);
+
+// the rows once `placed` is deposited on `before`, for placements that
+// complete no rows (clear those through the game and pack the board again).
+// Far cheaper than packing every board a search looks at.
+BoardRows place_on_board_rows(
+    BoardRows const*const before,
+    Tetromino const*const placed
+);
+
+void extract_board_features(
+    BoardRows const*const boards,
+    size_t const count,
+    BoardFeatures *const features
+);
+
+#endif // BOARD_FEATURES_H
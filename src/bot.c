@@ -0,0 +1,275 @@
+#include "bot.h"
+#include "board_features.h"
+#include "finesse.h"
+#include "game.h"
+#include "transposition.h"
+#include <float.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+// Evaluation /////////////////////////////////////////////////////////////////
+extern double score_board_features(
+    BotConfig const*const config,
+    BoardFeatures const*const features,
+    size_t const num_completed_rows
+) {
+    return config->height_weight    * features->total_height
+         + config->lines_weight     * num_completed_rows
+         + config->holes_weight     * features->holes
+         + config->bumpiness_weight * features->bumpiness;
+}
+
+extern double evaluate_board(
+    BotConfig const*const config,
+    TetrominoType const board[ROWS][COLS],
+    size_t const num_completed_rows
+) {
+    BoardRows const rows = pack_board_rows(board);
+    BoardFeatures features;
+    extract_board_features(&rows, 1, &features);
+    return score_board_features(config, &features, num_completed_rows);
+}
+
+// the cells and the rows cleared on the way, splitmix64 finalised
+static inline uint64_t _evaluation_key(BoardRows const*const board, size_t const rows) {
+    uint64_t key = rows;
+    for (size_t y = 0; y < ROWS; ++y) key = (key ^ board->rows[y]) * 0x9E3779B97F4A7C15ULL;
+    key = (key ^ (key >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    key = (key ^ (key >> 27)) * 0x94D049BB133111EBULL;
+    return key ^ (key >> 31);
+}
+
+extern void score_boards(
+    BotConfig const*const config,
+    TranspositionTable *const evaluations,
+    BoardRows const*const boards,
+    size_t const*const rows,
+    size_t const count,
+    double *const scores
+) {
+    // the ones the table doesn't have, gathered for one batch
+    size_t missing[MAX_PLACEMENTS];
+    uint64_t keys[MAX_PLACEMENTS];
+    BoardRows batch[MAX_PLACEMENTS];
+    size_t num_missing = 0;
+    for (size_t i = 0; i < count; ++i) {
+        uint64_t value;
+        if (evaluations != NULL) {
+            keys[num_missing] = _evaluation_key(&boards[i], rows[i]);
+            if (probe_transposition_table(evaluations, keys[num_missing], &value)) {
+                memcpy(&scores[i], &value, sizeof(double));
+                continue;
+            }
+        }
+        missing[num_missing] = i;
+        batch[num_missing++] = boards[i];
+    }
+
+    if (num_missing == 0) return;
+    BoardFeatures features[MAX_PLACEMENTS];
+    extract_board_features(batch, num_missing, features);
+    for (size_t j = 0; j < num_missing; ++j) {
+        size_t const i = missing[j];
+        scores[i] = score_board_features(config, &features[j], rows[i]);
+        if (evaluations == NULL) continue;
+        uint64_t value;
+        memcpy(&value, &scores[i], sizeof(double));
+        store_transposition_table(evaluations, keys[j], value);
+    }
+}
+
+// Placements /////////////////////////////////////////////////////////////////
+
+// pieces that spawn partly above the board can't turn until they have fallen
+// a bit, the same thing happens when the bot holds rotate in a real game.
+static bool _rotate_or_fall(GameState *const game_state) {
+    while (!rotate_tetromino(game_state)) {
+        if (!move_tetromino(game_state, MOVE_DOWN)) return false;
+    }
+    return true;
+}
+
+// the cells a landed piece covers, whatever rotation and offsets got it
+// there: its top row and a bitmask of the EDGE_SIZE rows from there down.
+static inline uint64_t _cells_key(Tetromino const*const tetromino) {
+    size_t top = ROWS;
+    for (size_t i = 0; i < NUM_TETROMINO_BLOCKS; ++i) {
+        size_t const y = tetromino->positions[i][Y_AXIS] + tetromino->y;
+        if (y < top) top = y;
+    }
+    uint64_t cells = 0;
+    for (size_t i = 0; i < NUM_TETROMINO_BLOCKS; ++i) {
+        size_t const x = tetromino->positions[i][X_AXIS] + tetromino->x;
+        size_t const y = tetromino->positions[i][Y_AXIS] + tetromino->y;
+        cells |= UINT64_C(1) << ((y - top) * COLS + x);
+    }
+    return (uint64_t)top << (EDGE_SIZE * COLS) | cells;
+}
+
+// tries every rotation, then every column reachable from there, and drops a
+// copy of the piece from each. Rotations of O, I, S and Z that only shift
+// the shape land on the same cells, only the first (fewest rotations) of
+// those is kept. With `landed` the dropped pieces are kept too.
+static size_t _list_placements(
+    GameState const*const game_state,
+    Placement placements[MAX_PLACEMENTS],
+    Tetromino landed[MAX_PLACEMENTS]
+) {
+    uint64_t keys[MAX_PLACEMENTS];
+    size_t num_placements = 0;
+    GameState rotated = *game_state;
+    for (size_t rotation = 0; rotation < MAX_NUM_ROTATIONS; ++rotation) {
+        if (rotation > 0 && !_rotate_or_fall(&rotated)) break;
+
+        GameState slid = rotated;
+        while (move_tetromino(&slid, MOVE_LEFT));
+        do {
+            Tetromino const before = slid.current_tetromino;
+            drop_tetromino(&slid);
+            Tetromino const dropped = slid.current_tetromino;
+            slid.current_tetromino = before;
+
+            uint64_t const key = _cells_key(&dropped);
+            bool is_duplicate = false;
+            for (size_t i = 0; i < num_placements && !is_duplicate; ++i)
+                is_duplicate = keys[i] == key;
+            if (is_duplicate) continue;
+
+            keys[num_placements] = key;
+            placements[num_placements] = (Placement){
+                .rotation = before.rotation,
+                .x = before.x
+            };
+            if (landed != NULL) landed[num_placements] = dropped;
+            num_placements++;
+        } while (move_tetromino(&slid, MOVE_RIGHT));
+    }
+    return num_placements;
+}
+
+extern size_t list_placements(
+    GameState const*const game_state,
+    Placement placements[MAX_PLACEMENTS]
+) {
+    return _list_placements(game_state, placements, NULL);
+}
+
+// the same moves `list_placements` made to find it
+extern size_t play_placement(
+    GameState *const game_state,
+    Placement const*const placement
+) {
+    Tetromino const*const tetromino = &game_state->current_tetromino;
+    while (tetromino->rotation != placement->rotation) {
+        if (!_rotate_or_fall(game_state)) break;
+    }
+    while (move_tetromino(game_state, MOVE_LEFT));
+    while (tetromino->x != placement->x) {
+        if (!move_tetromino(game_state, MOVE_RIGHT)) break;
+    }
+    drop_tetromino(game_state);
+    return place_tetromino(game_state);
+}
+
+// one button per tick: rotate, then shift, then soft drop. x is compared
+// signed since it can wrap to "-1" (see Tetromino).
+extern GameInput input_toward_placement(
+    GameState const*const game_state,
+    Placement const*const target
+) {
+    Tetromino const*const tetromino = &game_state->current_tetromino;
+    ptrdiff_t const x = tetromino->x;
+    ptrdiff_t const target_x = target->x;
+
+    GameInput input = { .pressed = 0, .down = 0 };
+    if      (tetromino->rotation != target->rotation) input.pressed = INPUT_ROTATE;
+    else if (x > target_x) input.pressed = INPUT_LEFT;
+    else if (x < target_x) input.pressed = INPUT_RIGHT;
+    else                   input.pressed = INPUT_DOWN;
+    return input;
+}
+
+static inline bool _completes_rows(BoardRows const*const board) {
+    for (size_t y = 0; y < ROWS; ++y) {
+        if (board->rows[y] == (1u << COLS) - 1) return true;
+    }
+    return false;
+}
+
+// keeps the best looking board of every placement, the boards are scored
+// together in one batch
+static void _plan_placement(Bot *const bot, GameState const*const game_state) {
+    Placement placements[MAX_PLACEMENTS];
+    Tetromino landed[MAX_PLACEMENTS];
+    size_t const num_placements = _list_placements(game_state, placements, landed);
+    bot->target = (Placement){
+        .rotation = game_state->current_tetromino.rotation,
+        .x = game_state->current_tetromino.x
+    };
+    if (num_placements == 0) return;
+
+    // only placements that clear rows get played out on a copy of the game
+    BoardRows const before = pack_board_rows(game_state->board);
+    BoardRows boards[MAX_PLACEMENTS];
+    size_t num_completed_rows[MAX_PLACEMENTS];
+    for (size_t i = 0; i < num_placements; ++i) {
+        boards[i] = place_on_board_rows(&before, &landed[i]);
+        num_completed_rows[i] = 0;
+        if (!_completes_rows(&boards[i])) continue;
+
+        GameState placed = *game_state;
+        placed.pending_garbage = 0; // same for every placement, leave it out
+        num_completed_rows[i] = play_placement(&placed, &placements[i]);
+        boards[i] = pack_board_rows(placed.board);
+    }
+    double scores[MAX_PLACEMENTS];
+    score_boards(bot->config, bot->evaluations, boards, num_completed_rows, num_placements, scores);
+
+    double best_score = -DBL_MAX;
+    for (size_t i = 0; i < num_placements; ++i) {
+        if (scores[i] > best_score) {
+            best_score = scores[i];
+            bot->target = placements[i];
+        }
+    }
+}
+
+// where the piece locks if it's played to the target, then the fastest way
+// to get it there
+static void _plan_path(Bot *const bot, GameState const*const game_state) {
+    bot->has_path = false;
+    if (bot->finesse == NULL) return;
+
+    GameState placed = *game_state;
+    play_placement(&placed, &bot->target);
+    Finesse finesse;
+    if (!find_finesse(bot->finesse, game_state, &placed.last_placed, &finesse)) return;
+    bot->has_path = true;
+    bot->path_frame = game_state->frame_number;
+    bot->path_board = game_state->board_hash;
+    bot->path = finesse.fastest;
+}
+
+// Exposed ////////////////////////////////////////////////////////////////////
+extern Bot init_bot(BotConfig const*const config) {
+    return (Bot){ .config = config, .has_plan = false, .finesse = NULL, .evaluations = NULL };
+}
+
+extern GameInput next_bot_input(Bot *const bot, GameState const*const game_state) {
+    if (!bot->has_plan || bot->planned_piece != game_state->pieces_placed) {
+        _plan_placement(bot, game_state);
+        bot->has_plan = true;
+        bot->planned_piece = game_state->pieces_placed;
+        _plan_path(bot, game_state);
+    }
+
+    // the path only holds on the board it was found on, if that changed
+    // (a rollback, an edited game) it taps the rest of the way from there
+    if (bot->has_path && game_state->board_hash == bot->path_board) {
+        unsigned long long const frame = game_state->frame_number - bot->path_frame;
+        if (frame < bot->path.num_frames) return finesse_input(&bot->path, frame);
+    }
+    return input_toward_placement(game_state, &bot->target);
+}
@@ -0,0 +1,116 @@
+#ifndef BOT_H
+#define BOT_H
+
+#include "game.h"
+#include "board_features.h"
+#include "finesse.h"
+#include "transposition.h"
+#include <stdbool.h>
+#include <stddef.h>
+
+// A simple placement bot. When a new piece appears it tries every rotation
+// and column on a copy of the game (with `rotate_tetromino`, `move_tetromino`,
+// `drop_tetromino` and `place_tetromino`), scores the resulting boards with a
+// weighted sum of a few board features and then plays inputs, one per tick,
+// to get the piece there. Different weights make different bot "versions".
+// Given a finesse cache (see finesse.h) it plays the fastest path there
+// instead of one button a tick, while the board stays as it was planned on.
+//
+// Given a transposition table (see transposition.h) it keeps the score of
+// every board it evaluates there and looks boards up before scoring them.
+// Boards are keyed on their cells and the rows the placement cleared, so the
+// same board however it came about is scored once. One table per BotConfig.
+//
+// The placement search and evaluation are exposed for other bots to build
+// on (see mcts.h).
+
+// Constants //////////////////////////////////////////////////////////////////
+#define MAX_PLACEMENTS (MAX_NUM_ROTATIONS * COLS)
+
+// Structs ////////////////////////////////////////////////////////////////////
+typedef struct {
+    char const* name;
+    double height_weight;    // sum of column heights
+    double lines_weight;     // rows cleared by the placement
+    double holes_weight;     // empty cells with a block above them
+    double bumpiness_weight; // height differences between neighbours
+} BotConfig;
+
+// where the falling piece ends up: turned to `rotation`, then slid all the
+// way left and back right to `x`, then dropped
+typedef struct {
+    unsigned char rotation;
+    size_t x; // can be "-1", see Tetromino
+} Placement;
+
+typedef struct {
+    BotConfig const* config;
+    bool has_plan;
+    unsigned long long planned_piece; // pieces_placed when the plan was made
+    Placement target;
+
+    FinesseCache *finesse;          // NULL to tap its way there instead
+    TranspositionTable *evaluations; // NULL to score every board afresh
+    bool has_path;
+    unsigned long long path_frame;  // frame_number the path starts on
+    unsigned long long path_board;  // board_hash it was found on
+    FinessePath path;
+} Bot;
+
+// weights from Yiyuan Lee's genetic search, then a few worse variants so
+// rankings have something to separate.
+static BotConfig const bot_configs[] = {
+    { "lee",      -0.510066, 0.760666, -0.35663, -0.184483 },
+    { "flat",     -0.2,      0.5,      -0.3,     -0.6      },
+    { "holey",    -0.5,      0.8,      -0.05,    -0.2      },
+    { "greedy",   -0.05,     1.0,      -0.1,     -0.05     }
+};
+#define NUM_BOT_CONFIGS (sizeof(bot_configs) / sizeof(bot_configs[0]))
+
+// Functions //////////////////////////////////////////////////////////////////
+Bot init_bot(BotConfig const*const config);
+GameInput next_bot_input(Bot *const bot, GameState const*const game_state);
+
+// every placement of the falling piece, rotation by rotation and left to
+// right, once for each set of cells it lands on. Returns how many.
+size_t list_placements(
+    GameState const*const game_state,
+    Placement placements[MAX_PLACEMENTS]
+);
+
+// moves the piece to `placement` and locks it (see place_tetromino). Returns
+// the rows cleared.
+size_t play_placement(GameState *const game_state, Placement const*const placement);
+
+// higher is better. Scoring many boards, extract their features in one
+// batch (see board_features.h) and score each with `score_board_features`.
+double evaluate_board(
+    BotConfig const*const config,
+    TetrominoType const board[ROWS][COLS],
+    size_t const num_completed_rows
+);
+double score_board_features(
+    BotConfig const*const config,
+    BoardFeatures const*const features,
+    size_t const num_completed_rows
+);
+
+// scores `count` boards like `score_board_features`, with `rows` the rows
+// each placement cleared. Boards found in `evaluations` (may be NULL) aren't
+// evaluated again, the rest are in one batch and then kept there.
+void score_boards(
+    BotConfig const*const config,
+    TranspositionTable *const evaluations,
+    BoardRows const*const boards,
+    size_t const*const rows,
+    size_t const count,
+    double *const scores
+);
+
+// the one button to press this tick to get the piece to `target`
+GameInput input_toward_placement(
+    GameState const*const game_state,
+    Placement const*const target
+);
+
+#endif // BOT_H
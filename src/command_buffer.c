@@ -0,0 +1,381 @@
+#include "game.h"
+#include <limits.h>
+#include <math.h>
+#include <raylib.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <string.h>
+
+// see CommandBuffer. Set by `bind_command_buffer`, per thread like the
+// display's own primitives.
+static _Thread_local CommandBuffer *_buffer;
+
+#define NO_COMMAND UINT_MAX
+
+// Bounds /////////////////////////////////////////////////////////////////////
+
+// left, top, right, bottom of what a command can touch, a little generous
+// where the backend decides the exact pixels
+static void _command_bounds(
+    DrawCommand const*const command,
+    char const*const text,
+    int bounds[4]
+) {
+    switch (command->kind) {
+        case DRAW_RECTANGLE: {
+            int const*const r = command->rectangle;
+            bounds[0] = r[2] < 0? r[0] + r[2] : r[0];
+            bounds[1] = r[3] < 0? r[1] + r[3] : r[1];
+            bounds[2] = r[2] < 0? r[0] : r[0] + r[2];
+            bounds[3] = r[3] < 0? r[1] : r[1] + r[3];
+            return;
+        }
+        case DRAW_LINE: {
+            int const*const l = command->line;
+            bounds[0] = (l[0] < l[2]? l[0] : l[2]) - 1;
+            bounds[1] = (l[1] < l[3]? l[1] : l[3]) - 1;
+            bounds[2] = (l[0] < l[2]? l[2] : l[0]) + 2;
+            bounds[3] = (l[1] < l[3]? l[3] : l[1]) + 2;
+            return;
+        }
+        case DRAW_LINE_EX: {
+            float const*const l = command->line_ex;
+            float const pad = command->thickness / 2 + 1;
+            bounds[0] = floorf((l[0] < l[2]? l[0] : l[2]) - pad);
+            bounds[1] = floorf((l[1] < l[3]? l[1] : l[3]) - pad);
+            bounds[2] = ceilf((l[0] < l[2]? l[2] : l[0]) + pad);
+            bounds[3] = ceilf((l[1] < l[3]? l[3] : l[1]) + pad);
+            return;
+        }
+        case DRAW_TEXT: {
+            // no font metrics here, but no glyph is wider than the font size
+            // and no line further apart than twice that
+            int const*const t = command->text;
+            size_t length = 0;
+            size_t lines = 1;
+            for (char const* c = text + t[3]; *c != '\0'; ++c, ++length)
+                lines += *c == '\n';
+            bounds[0] = t[0];
+            bounds[1] = t[1];
+            bounds[2] = t[0] + length * t[2];
+            bounds[3] = t[1] + lines * 2 * t[2];
+            return;
+        }
+    }
+}
+
+static inline bool _overlaps(int const a[4], int const b[4]) {
+    return a[0] < b[2] && b[0] < a[2] && a[1] < b[3] && b[1] < a[3];
+}
+
+static bool _batch_overlaps(
+    CommandBuffer const*const buffer,
+    DrawBatch const*const batch,
+    int const bounds[4]
+) {
+    if (!_overlaps(batch->bounds, bounds)) return false;
+
+    char const*const text = buffer->frames[buffer->current].text;
+    for (unsigned i = batch->first; i != NO_COMMAND; i = buffer->next_in_batch[i]) {
+        int command_bounds[4];
+        _command_bounds(&buffer->recorded[i], text, command_bounds);
+        if (_overlaps(command_bounds, bounds)) return true;
+    }
+    return false;
+}
+
+// Playback ///////////////////////////////////////////////////////////////////
+
+// two rectangles of one colour that make a single one, side by side in a row
+// or stacked in a column
+static inline bool _merge(DrawCommand *const into, DrawCommand const*const command) {
+    if (into->kind != DRAW_RECTANGLE || command->kind != DRAW_RECTANGLE
+    ||  memcmp(&into->color, &command->color, sizeof(Color)) != 0
+    ) return false;
+
+    int *const a = into->rectangle;
+    int const*const b = command->rectangle;
+    if (a[2] <= 0 || a[3] <= 0 || b[2] <= 0 || b[3] <= 0) return false;
+    if (a[1] == b[1] && a[3] == b[3] && a[0] + a[2] == b[0]) {
+        a[2] += b[2];
+        return true;
+    }
+    if (a[0] == b[0] && a[2] == b[2] && a[1] + a[3] == b[1]) {
+        a[3] += b[3];
+        return true;
+    }
+    return false;
+}
+
+// moves the recorded commands into `frame` batch by batch. Neighbouring
+// batches are never of the same kind, so merging never crosses one.
+static void _collect(CommandBuffer *const buffer, CommandFrame *const frame) {
+    for (size_t b = 0; b < buffer->num_batches; ++b) {
+        DrawBatch const*const batch = &buffer->batches[b];
+        for (unsigned i = batch->first; i != NO_COMMAND; i = buffer->next_in_batch[i]) {
+            DrawCommand const*const command = &buffer->recorded[i];
+            if (frame->count > 0 && _merge(&frame->commands[frame->count - 1], command))
+                continue;
+            frame->commands[frame->count++] = *command;
+        }
+    }
+    buffer->num_recorded = 0;
+    buffer->num_batches = 0;
+}
+
+static void _play_back(CommandBuffer *const buffer, CommandFrame const*const frame) {
+    DrawPrimitives const*const target = buffer->target;
+    for (size_t i = 0; i < frame->count; ++i) {
+        DrawCommand const*const command = &frame->commands[i];
+        if (i == 0 || command->kind != frame->commands[i - 1].kind)
+            buffer->num_batches_submitted++;
+
+        switch (command->kind) {
+            case DRAW_RECTANGLE: {
+                int const*const r = command->rectangle;
+                target->rectangle(r[0], r[1], r[2], r[3], command->color);
+                break;
+            }
+            case DRAW_LINE: {
+                int const*const l = command->line;
+                target->line(l[0], l[1], l[2], l[3], command->color);
+                break;
+            }
+            case DRAW_LINE_EX: {
+                float const*const l = command->line_ex;
+                target->line_ex(
+                    (Vector2){l[0], l[1]},
+                    (Vector2){l[2], l[3]},
+                    command->thickness,
+                    command->color
+                );
+                break;
+            }
+            case DRAW_TEXT: {
+                int const*const t = command->text;
+                target->text(frame->text + t[3], t[0], t[1], t[2], command->color);
+                break;
+            }
+        }
+    }
+    buffer->num_submitted += frame->count;
+}
+
+// the arena is full, so what there is so far goes to the target now. The
+// frame is then incomplete and isn't compared against the next one.
+static void _flush(CommandBuffer *const buffer) {
+    CommandFrame *const frame = &buffer->frames[buffer->current];
+    if (!buffer->is_begun) buffer->target->begin_frame(frame->background_color);
+    buffer->is_begun = true;
+    _collect(buffer, frame);
+    _play_back(buffer, frame);
+    frame->count = 0;
+    frame->text_size = 0;
+}
+
+static bool _same_frame(CommandFrame const*const a, CommandFrame const*const b) {
+    return a->screen_width == b->screen_width
+        && a->screen_height == b->screen_height
+        && memcmp(&a->background_color, &b->background_color, sizeof(Color)) == 0
+        && a->count == b->count
+        && a->text_size == b->text_size
+        && memcmp(a->commands, b->commands, a->count * sizeof(DrawCommand)) == 0
+        && memcmp(a->text, b->text, a->text_size) == 0;
+}
+
+// Recording //////////////////////////////////////////////////////////////////
+static inline void _make_room(CommandBuffer *const buffer, size_t const text_size) {
+    CommandFrame const*const frame = &buffer->frames[buffer->current];
+    if (buffer->num_recorded == COMMAND_CAPACITY
+    ||  buffer->num_batches == COMMAND_MAX_BATCHES
+    ||  frame->text_size + text_size > COMMAND_TEXT_CAPACITY
+    ) _flush(buffer);
+}
+
+// joins the latest batch of its kind unless something of another kind that
+// it overlaps was drawn after that batch, otherwise starts a new one
+static void _record(CommandBuffer *const buffer, DrawCommand const*const command) {
+    int bounds[4];
+    _command_bounds(command, buffer->frames[buffer->current].text, bounds);
+    buffer->num_commands++;
+
+    size_t batch_index = COMMAND_MAX_BATCHES;
+    size_t const oldest = buffer->num_batches > COMMAND_BATCH_LOOKBACK
+        ? buffer->num_batches - COMMAND_BATCH_LOOKBACK
+        : 0;
+    for (size_t b = buffer->num_batches; b-- > oldest;) {
+        if (buffer->batches[b].kind == command->kind) {
+            batch_index = b;
+            break;
+        }
+        if (_batch_overlaps(buffer, &buffer->batches[b], bounds)) break;
+    }
+
+    DrawBatch *batch;
+    if (batch_index == COMMAND_MAX_BATCHES) {
+        batch = &buffer->batches[buffer->num_batches++];
+        *batch = (DrawBatch){
+            .kind   = command->kind,
+            .bounds = {bounds[0], bounds[1], bounds[2], bounds[3]},
+            .first  = NO_COMMAND,
+            .last   = NO_COMMAND
+        };
+    }
+    else {
+        batch = &buffer->batches[batch_index];
+        if (bounds[0] < batch->bounds[0]) batch->bounds[0] = bounds[0];
+        if (bounds[1] < batch->bounds[1]) batch->bounds[1] = bounds[1];
+        if (bounds[2] > batch->bounds[2]) batch->bounds[2] = bounds[2];
+        if (bounds[3] > batch->bounds[3]) batch->bounds[3] = bounds[3];
+    }
+
+    unsigned const i = buffer->num_recorded++;
+    buffer->recorded[i] = *command;
+    buffer->next_in_batch[i] = NO_COMMAND;
+    if (batch->last == NO_COMMAND) batch->first = i;
+    else buffer->next_in_batch[batch->last] = i;
+    batch->last = i;
+}
+
+// Recording Primitives ///////////////////////////////////////////////////////
+static int _recording_screen_width(void) {
+    return _buffer->target->screen_width();
+}
+
+static int _recording_screen_height(void) {
+    return _buffer->target->screen_height();
+}
+
+static void _recording_begin_frame(Color const background_color) {
+    CommandBuffer *const buffer = _buffer;
+    CommandFrame *const frame = &buffer->frames[buffer->current];
+    frame->screen_width = buffer->target->screen_width();
+    frame->screen_height = buffer->target->screen_height();
+    frame->background_color = background_color;
+    frame->count = 0;
+    frame->text_size = 0;
+    buffer->num_recorded = 0;
+    buffer->num_batches = 0;
+    buffer->is_begun = false;
+}
+
+static void _recording_end_frame(void) {
+    CommandBuffer *const buffer = _buffer;
+    DrawPrimitives const*const target = buffer->target;
+    CommandFrame *const frame = &buffer->frames[buffer->current];
+    _collect(buffer, frame);
+    buffer->num_frames++;
+
+    if (!buffer->is_begun
+    &&  buffer->has_shown
+    &&  target->keep_frame != NULL
+    &&  _same_frame(frame, &buffer->frames[1 - buffer->current])
+    ) {
+        target->keep_frame();
+        buffer->num_kept_frames++;
+        return;
+    }
+
+    if (!buffer->is_begun) target->begin_frame(frame->background_color);
+    _play_back(buffer, frame);
+    target->end_frame();
+    buffer->has_shown = !buffer->is_begun;
+    buffer->current = 1 - buffer->current;
+}
+
+static void _recording_rectangle(
+    int const x,
+    int const y,
+    int const width,
+    int const height,
+    Color const color
+) {
+    _make_room(_buffer, 0);
+    DrawCommand const command = {
+        .kind      = DRAW_RECTANGLE,
+        .color     = color,
+        .rectangle = {x, y, width, height}
+    };
+    _record(_buffer, &command);
+}
+
+static void _recording_line(
+    int const start_x,
+    int const start_y,
+    int const end_x,
+    int const end_y,
+    Color const color
+) {
+    _make_room(_buffer, 0);
+    DrawCommand const command = {
+        .kind  = DRAW_LINE,
+        .color = color,
+        .line  = {start_x, start_y, end_x, end_y}
+    };
+    _record(_buffer, &command);
+}
+
+static void _recording_line_ex(
+    Vector2 const start,
+    Vector2 const end,
+    float const thickness,
+    Color const color
+) {
+    _make_room(_buffer, 0);
+    DrawCommand const command = {
+        .kind      = DRAW_LINE_EX,
+        .color     = color,
+        .thickness = thickness,
+        .line_ex   = {start.x, start.y, end.x, end.y}
+    };
+    _record(_buffer, &command);
+}
+
+// the string is copied into the frame, longer ones than the whole arena are
+// cut short
+static void _recording_text(
+    char const* text,
+    int const x,
+    int const y,
+    int const font_size,
+    Color const color
+) {
+    size_t length = strlen(text);
+    if (length >= COMMAND_TEXT_CAPACITY) length = COMMAND_TEXT_CAPACITY - 1;
+    _make_room(_buffer, length + 1);
+
+    CommandFrame *const frame = &_buffer->frames[_buffer->current];
+    memcpy(frame->text + frame->text_size, text, length);
+    frame->text[frame->text_size + length] = '\0';
+    DrawCommand const command = {
+        .kind  = DRAW_TEXT,
+        .color = color,
+        .text  = {x, y, font_size, (int)frame->text_size}
+    };
+    frame->text_size += length + 1;
+    _record(_buffer, &command);
+}
+
+static DrawPrimitives const _recording_draw_primitives = {
+    .screen_width  = &_recording_screen_width,
+    .screen_height = &_recording_screen_height,
+    .begin_frame   = &_recording_begin_frame,
+    .end_frame     = &_recording_end_frame,
+    .rectangle     = &_recording_rectangle,
+    .line          = &_recording_line,
+    .line_ex       = &_recording_line_ex,
+    .text          = &_recording_text
+};
+
+// Exposed ////////////////////////////////////////////////////////////////////
+
+// draws through the returned primitives on this thread go into `buffer`, and
+// from there to `target` at the end of each frame
+extern DrawPrimitives const* bind_command_buffer(
+    CommandBuffer *const buffer,
+    DrawPrimitives const*const target
+) {
+    _buffer = buffer;
+    buffer->target = target;
+    return &_recording_draw_primitives;
+}
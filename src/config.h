@@ -1,17 +1,28 @@
 #ifndef CONFIG_H
 #define CONFIG_H
 
+#include <stdbool.h>
 #include <stddef.h>
 
 #define INIT_WIDTH     (size_t) 1000
 #define INIT_HEIGHT    (size_t) 700
 #define FPS            (size_t) 60
 
+// only redraw when something on screen changed, and sleep on input while
+// paused, instead of redrawing every frame
+#define REDRAW_ONLY_ON_CHANGE true
+
 // DEBUG: we will make this one choosable later
 #define INIT_LEVEL  (size_t) 10
 
+#define SPECTATOR_BOARDS (size_t) 64
+
 typedef char const*const litstr_t;
   
-litstr_t libgame_path = "build/libgame.so";
+static litstr_t libgame_path = "build/libgame.so";
+static litstr_t replay_path  = "build/last.replay"; // the last finished game
+static litstr_t persist_path = "build/tetris.log";  // see persist.h
+static litstr_t snapshot_dir = "build";             // KEY_P, see snapshot.h
+static litstr_t metrics_default_address = "9464"; // see metrics.h
 
 #endif // CONFIG_H
@@ -0,0 +1,60 @@
+#ifndef COUNTERS_H
+#define COUNTERS_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+// Hot path event counters for the simulation in game.c. They are compiled in
+// with -DGAME_COUNTERS (`make COUNTERS=1`), otherwise every COUNT() is empty
+// and `read_game_counters` reports them as disabled.
+//
+// Each thread counts into its own block, so the hot path is a plain load, add
+// and store with no locked instructions or shared cache lines. Blocks are
+// registered the first time a thread counts anything and are kept after
+// the thread exits, so batch tools can total them up at the end.
+
+// Constants //////////////////////////////////////////////////////////////////
+#define MAX_COUNTER_THREADS (size_t) 256
+
+// Enums //////////////////////////////////////////////////////////////////////
+typedef enum {
+    COUNTER_FRAMES,
+    COUNTER_COLLISION_CHECKS,
+    COUNTER_REJECTED_ROTATIONS,
+    COUNTER_DAS_REPEATS,
+    COUNTER_DEPOSITS,
+    COUNTER_DEPOSIT_WAIT_FRAMES,
+    COUNTER_CLEARS_1,
+    COUNTER_CLEARS_2,
+    COUNTER_CLEARS_3,
+    COUNTER_CLEARS_4,
+    NUM_GAME_COUNTERS
+} GameCounter;
+
+static char const*const game_counter_names[NUM_GAME_COUNTERS] = {
+    "frames",
+    "collision_checks",
+    "rejected_rotations",
+    "das_repeats",
+    "deposits",
+    "deposit_wait_frames",
+    "single_clears",
+    "double_clears",
+    "triple_clears",
+    "tetris_clears"
+};
+
+// Structs ////////////////////////////////////////////////////////////////////
+typedef struct {
+    bool enabled;
+    size_t num_threads;
+    size_t counts[NUM_GAME_COUNTERS];
+} GameCounters;
+
+// function signitures ////////////////////////////////////////////////////////
+typedef void (*read_game_counters_t)(GameCounters*);
+
+// totals every thread's counters so far
+void read_game_counters(GameCounters *const counters);
+
+#endif // COUNTERS_H
@@ -39,7 +39,7 @@ extern void print_game_state(GameState const*const game_state) {
     fprintf(stderr, "line_num = %zu\n", game_state->line_num);
     fprintf(stderr, "lines = %zu\n", game_state->lines);
     fprintf(stderr, "total_lines = %zu\n", game_state->total_lines);  
-    fprintf(stderr, "wait_time = %zu\n", game_state->wait_time);
+    fprintf(stderr, "gravity = %.4f rows/frame\n", (double)game_state->gravity / GRAVITY_ONE);
     fprintf(stderr, "frame_number = %llu\n", game_state->frame_number);
     fprintf(stderr, "delayed_autoshift_frames = %zu\n", game_state->delayed_autoshift_frames); 
     fprintf(stderr, "deposite_on_next_frame = %s\n", TO_BOOL_STR(game_state->deposite_on_next_frame));
@@ -78,3 +78,20 @@ extern void print_game_state(GameState const*const game_state) {
         fprintf(stderr, "\n");
     }  
 }
+
+extern void print_game_counters(GameCounters const*const counters) {
+    if (!counters->enabled) {
+        fprintf(stderr, "counters: disabled (build with COUNTERS=1)\n");
+        return;
+    }
+
+    size_t const frames = counters->counts[COUNTER_FRAMES];
+    fprintf(stderr, "counters (%zu threads):\n", counters->num_threads);
+    for (size_t i = 0; i < NUM_GAME_COUNTERS; ++i) fprintf(
+        stderr,
+        "\t%-20s %12zu  %10.4f/frame\n",
+        game_counter_names[i],
+        counters->counts[i],
+        frames > 0? (double)counters->counts[i] / frames : 0.0
+    );
+}
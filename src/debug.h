@@ -2,7 +2,9 @@
 #define DEBUG_H
 
 #include "game.h"
+#include "counters.h"
 
 void print_game_state(GameState const*const game_state);
+void print_game_counters(GameCounters const*const counters);
 
 #endif
@@ -1,8 +1,47 @@
 #include "game.h"
+#include "config.h"
+#include "wireframe.h"
 #include <raylib.h>
 #include <stddef.h>
 #include <stdio.h>
 
+// Draw Primitives ////////////////////////////////////////////////////////////
+// Every display function draws through `_draw`, so the same display code can
+// render with raylib or into a CPU framebuffer (see soft.c). It is set from
+// the DisplayConfig at the start of each frame and is per thread so several
+// frames can be rendered in parallel. With a CommandBuffer in the config it
+// is the buffer's recording primitives instead.
+static _Thread_local DrawPrimitives const* _draw;
+
+static void _raylib_begin_frame(Color const background_color) {
+    BeginDrawing();
+    ClearBackground(background_color);
+}
+
+static void _raylib_end_frame(void) {
+    EndDrawing();
+}
+
+// the window keeps showing the last frame if the buffers aren't swapped, so
+// only do the rest of what EndDrawing would: poll input, keep to the frame
+// rate
+static void _raylib_keep_frame(void) {
+    PollInputEvents();
+    WaitTime(1.0 / FPS);
+}
+
+static DrawPrimitives const _raylib_draw_primitives = {
+    .screen_width  = &GetScreenWidth,
+    .screen_height = &GetScreenHeight,
+    .begin_frame   = &_raylib_begin_frame,
+    .end_frame     = &_raylib_end_frame,
+    .rectangle     = &DrawRectangle,
+    .line          = &DrawLine,
+    .line_ex       = &DrawLineEx,
+    .text          = &DrawText,
+    .keep_frame    = &_raylib_keep_frame
+};
+
 // Display Functions ////////////////////////////////////////////////////////// 
 static Color const _tetromino_colors_default[NUM_TETROMINO_TYPES + 1]
     = {RED, YELLOW, GREEN, BLUE, PURPLE, GOLD, SKYBLUE}; 
@@ -21,7 +60,7 @@ static inline void _disp_current_tetromino_default(
     for (size_t i = 0; i < NUM_TETROMINO_BLOCKS; ++i) {
         size_t const x_absolute = tetromino->positions[i][X_AXIS] + x_offset;
         size_t const y_absolute = tetromino->positions[i][Y_AXIS] + y_offset;
-        DrawRectangle(
+        _draw->rectangle(
             x_absolute * BLOCK_SCALE + border_x_offset,
             y_absolute * BLOCK_SCALE + border_y_offset,
             BLOCK_SCALE,
@@ -37,17 +76,17 @@ static inline void _disp_borders_default(
     size_t const border_x_offset,
     size_t const border_y_offset
 ) {
-    DrawLine(border_x_offset, border_y_offset,
-             border_x, border_y_offset, BLACK);
+    _draw->line(border_x_offset, border_y_offset,
+               border_x, border_y_offset, BLACK);
 
-    DrawLine(border_x_offset, border_y_offset,
-             border_x_offset, border_y, BLACK);
+    _draw->line(border_x_offset, border_y_offset,
+               border_x_offset, border_y, BLACK);
 
-    DrawLine(border_x, border_y_offset,
-             border_x, border_y, BLACK);
+    _draw->line(border_x, border_y_offset,
+               border_x, border_y, BLACK);
 
-    DrawLine(border_x_offset, border_y,
-             border_x, border_y, BLACK);  
+    _draw->line(border_x_offset, border_y,
+               border_x, border_y, BLACK);  
 }
 
 static inline void _disp_blocks_default(
@@ -57,7 +96,7 @@ static inline void _disp_blocks_default(
     Color const tetromino_colors[NUM_TETROMINO_TYPES + 1]
 ) {
     for (size_t y = 0; y < ROWS; ++y) {
-        for (size_t x = 0; x < COLS; ++x) DrawRectangle(
+        for (size_t x = 0; x < COLS; ++x) _draw->rectangle(
             x * BLOCK_SCALE + border_x_offset,
             y * BLOCK_SCALE + border_y_offset,
             BLOCK_SCALE,
@@ -67,13 +106,35 @@ static inline void _disp_blocks_default(
     }
 } 
 
+// straight through the pool in one go, every particle is a plain rectangle
+// so raylib keeps them all in one batch.
+static void _disp_particles(
+    ParticlePool const*const pool,
+    size_t const border_x_offset,
+    size_t const border_y_offset,
+    Color const tetromino_colors[NUM_TETROMINO_TYPES + 1]
+) {
+    for (size_t i = 0; i < pool->count; ++i) {
+        Color color = tetromino_colors[pool->type[i]];
+        color.a = color.a * pool->life[i] * pool->fade[i];
+        int const size = pool->size[i] * BLOCK_SCALE;
+        _draw->rectangle(
+            pool->x[i] * BLOCK_SCALE + border_x_offset,
+            pool->y[i] * BLOCK_SCALE + border_y_offset,
+            size > 0? size : 1,
+            size > 0? size : 1,
+            color
+        );
+    }
+}
+
 static inline void _disp_info(
     GameState const*const game_state,
     Color const font_color
 ) {
-    static char temp_str[20];
+    char temp_str[20];
     sprintf(temp_str, "%zu", game_state->level);
-    DrawText(
+    _draw->text(
         temp_str,
         INFO_X_OFFSET,
         INFO_Y_OFFSET,
@@ -82,13 +143,21 @@ static inline void _disp_info(
     );
 
     sprintf(temp_str, "%zu", game_state->score);
-    DrawText(
+    _draw->text(
         temp_str,
         INFO_X_OFFSET + INFO_NEXT_ITEM_X * 1,
         INFO_Y_OFFSET,
         INFO_FONT_SIZE,
         font_color
     ); 
+
+    if (game_state->is_paused) _draw->text(
+        "PAUSED",
+        INFO_X_OFFSET,
+        INFO_Y_OFFSET + INFO_FONT_SIZE * 2,
+        INFO_FONT_SIZE,
+        font_color
+    );
 }
 
 static inline void _draw_wireframe_block(
@@ -97,58 +166,18 @@ static inline void _draw_wireframe_block(
     size_t const y,
     unsigned char show_side_bitmap
 ) { 
-    bool const show_up    = show_side_bitmap & 0x01;
-    bool const show_down  = show_side_bitmap & 0x02;
-    bool const show_left  = show_side_bitmap & 0x04;
-    bool const show_right = show_side_bitmap & 0x08;
-    
-    if (show_up) DrawLineEx(
-        (Vector2){
-            x + LINE_THICKNESS + (show_left? 0 : -2 * LINE_THICKNESS),
-            y + LINE_THICKNESS
-        },
-        (Vector2){
-            x + BLOCK_SCALE - LINE_THICKNESS + (show_right? 0 : 2 * LINE_THICKNESS),
-            y + LINE_THICKNESS
-        },
-        (float)LINE_THICKNESS, color
-    );
-
-    if (show_down) DrawLineEx(
-        (Vector2){
-            x + LINE_THICKNESS + (show_left? 0 : -2 * LINE_THICKNESS),
-            y + BLOCK_SCALE - LINE_THICKNESS
-        },
-            
-        (Vector2){
-            x + BLOCK_SCALE - LINE_THICKNESS + (show_right? 0 : 2 * LINE_THICKNESS),
-            y + BLOCK_SCALE - LINE_THICKNESS
-        },
-            
-        (float)LINE_THICKNESS, color
-    );
-
-    if (show_left) DrawLineEx(
-        (Vector2){
-            x + LINE_THICKNESS,
-            y + LINE_THICKNESS + (show_up? 0 : -2 * LINE_THICKNESS)
-        },
-        (Vector2){
-            x + LINE_THICKNESS,
-            y + BLOCK_SCALE - LINE_THICKNESS + (show_down? 0 : 2 * LINE_THICKNESS)
-        },
-        (float)LINE_THICKNESS, color
+    WireframeSegment segments[EDGE_SIZE];
+    size_t const num_segments = wireframe_block_segments(
+        x, y,
+        BLOCK_SCALE,
+        LINE_THICKNESS,
+        show_side_bitmap,
+        segments
     );
 
-    if (show_right) DrawLineEx(
-        (Vector2){
-            x + BLOCK_SCALE - LINE_THICKNESS,
-            y + LINE_THICKNESS + (show_up? 0 : -2 * LINE_THICKNESS)
-        },
-        (Vector2){
-            x + BLOCK_SCALE - LINE_THICKNESS,
-            y + BLOCK_SCALE - LINE_THICKNESS + (show_down? 0 : 2 * LINE_THICKNESS)
-        },
+    for (size_t i = 0; i < num_segments; ++i) _draw->line_ex(
+        segments[i].start,
+        segments[i].end,
         (float)LINE_THICKNESS, color
     );
 }
@@ -164,33 +193,13 @@ static inline void _disp_current_tetromino_wireframe(
     size_t const y_offset = tetromino->y;
 
     for (size_t i = 0; i < NUM_TETROMINO_BLOCKS; ++i) {
-        bool show_up    = true;
-        bool show_down  = true;
-        bool show_left  = true;
-        bool show_right = true;
-        
-        size_t const x = tetromino->positions[i][X_AXIS];
-        size_t const y = tetromino->positions[i][Y_AXIS];
-        for (size_t j = 0; j < NUM_TETROMINO_BLOCKS; ++j) {
-            if (i == j) continue;
-            size_t const other_x = tetromino->positions[j][X_AXIS];
-            size_t const other_y = tetromino->positions[j][Y_AXIS];
-            if (other_y == y - 1 && other_x == x) show_up    = false;
-            if (other_y == y + 1 && other_x == x) show_down  = false;
-            if (other_x == x - 1 && other_y == y) show_left  = false;
-            if (other_x == x + 1 && other_y == y) show_right = false;
-        }
-        
-        size_t const x_absolute = x + x_offset;
-        size_t const y_absolute = y + y_offset;
+        size_t const x_absolute = tetromino->positions[i][X_AXIS] + x_offset;
+        size_t const y_absolute = tetromino->positions[i][Y_AXIS] + y_offset;
 
         _draw_wireframe_block(color,
             x_absolute * BLOCK_SCALE + border_x_offset,
             y_absolute * BLOCK_SCALE + border_y_offset,
-              show_up * 0x01
-            + show_down * 0x02
-            + show_left * 0x04
-            + show_right * 0x08
+            wireframe_tetromino_sides(tetromino->positions, i)
         );
     } 
 } 
@@ -205,21 +214,21 @@ static inline void _disp_borders_wireframe(
     border_y += 2;
     border_x_offset -= 2;
     border_y_offset -= 2;
-    DrawLineEx((Vector2){border_x_offset, border_y_offset},
-               (Vector2){border_x, border_y_offset},
-               2.0, WHITE);
+    _draw->line_ex((Vector2){border_x_offset, border_y_offset},
+                   (Vector2){border_x, border_y_offset},
+                   2.0, WHITE);
 
-    DrawLineEx((Vector2){border_x_offset, border_y_offset},
-               (Vector2){border_x_offset, border_y},
-               2.0, WHITE);
+    _draw->line_ex((Vector2){border_x_offset, border_y_offset},
+                   (Vector2){border_x_offset, border_y},
+                   2.0, WHITE);
 
-    DrawLineEx((Vector2){border_x, border_y_offset},
-               (Vector2){border_x, border_y},
-               2.0, WHITE);
+    _draw->line_ex((Vector2){border_x, border_y_offset},
+                   (Vector2){border_x, border_y},
+                   2.0, WHITE);
 
-    DrawLineEx((Vector2){border_x_offset, border_y},
-               (Vector2){border_x, border_y},
-               2.0, WHITE);
+    _draw->line_ex((Vector2){border_x_offset, border_y},
+                   (Vector2){border_x, border_y},
+                   2.0, WHITE);
 }
  
 static inline void _disp_blocks_wireframe(
@@ -233,25 +242,11 @@ static inline void _disp_blocks_wireframe(
             TetrominoType tetromino_type = board[y][x];
             if (tetromino_type == NO_TETROMINO) continue;
 
-            Color color = tetromino_colors[tetromino_type];
-            bool show_up    = true;
-            bool show_down  = true;
-            bool show_left  = true;
-            bool show_right = true;
-
-            if (y - 1 >= 0)   show_up    = board[y-1][x] != tetromino_type;
-            if (y + 1 < ROWS) show_down  = board[y+1][x] != tetromino_type;
-            if (x - 1 >= 0)   show_left  = board[y][x-1] != tetromino_type;
-            if (x + 1 < COLS) show_right = board[y][x+1] != tetromino_type;
-            
             _draw_wireframe_block(
-                color,
+                tetromino_colors[tetromino_type],
                 x * BLOCK_SCALE + border_x_offset, 
                 y * BLOCK_SCALE + border_y_offset,
-                  show_up * 0x01
-                + show_down * 0x02
-                + show_left * 0x04
-                + show_right * 0x08 
+                wireframe_board_sides(board, x, y)
             );
         }
     } 
@@ -261,7 +256,8 @@ static inline void _disp_blocks_wireframe(
 extern DisplayConfig init_display_config(DisplayMode const display_mode) {
     DisplayConfig display_config = {
         .border_width  = BLOCK_SCALE * COLS,
-        .border_height = BLOCK_SCALE * ROWS
+        .border_height = BLOCK_SCALE * ROWS,
+        .primitives    = &_raylib_draw_primitives
     };
 
     switch (display_mode) {
@@ -309,8 +305,12 @@ extern void display_game(
     GameState     const*const game_state,
     DisplayConfig const*const display_config
 ) {
-    size_t const screen_height = GetScreenHeight();
-    size_t const screen_width  = GetScreenWidth();
+    _draw = display_config->commands != NULL
+        ? bind_command_buffer(display_config->commands, display_config->primitives)
+        : display_config->primitives;
+
+    size_t const screen_height = _draw->screen_height();
+    size_t const screen_width  = _draw->screen_width();
 
     size_t const border_x_offset
         = screen_width / 2 - display_config->border_width / 2;
@@ -321,9 +321,7 @@ extern void display_game(
     size_t const border_x  = display_config->border_width + border_x_offset;
     size_t const boarder_y = display_config->border_height + border_y_offset;
 
-    BeginDrawing();
-
-    ClearBackground(display_config->background_color);
+    _draw->begin_frame(display_config->background_color);
 
     display_config->disp_blocks(
         game_state->board,
@@ -332,6 +330,16 @@ extern void display_game(
         display_config->tetromino_colors
     );
 
+    if (display_config->particles != NULL) {
+        update_particles(display_config->particles, game_state);
+        _disp_particles(
+            display_config->particles,
+            border_x_offset,
+            border_y_offset,
+            display_config->tetromino_colors
+        );
+    }
+
     display_config->disp_borders(
         border_x,
         boarder_y,
@@ -351,5 +359,5 @@ extern void display_game(
         display_config->font_color
     );
     
-    EndDrawing();
+    _draw->end_frame();
 }
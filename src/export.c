@@ -0,0 +1,485 @@
+#include "game.h"
+#include "config.h"
+#include "counters.h"
+#include "debug.h"
+#include "replay.h"
+#include "soft.h"
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+// Offline replay to video export. A producer thread re-simulates the replay,
+// worker threads render frames with the regular display code into software
+// framebuffers and encode them, and the main thread writes them out in order.
+// Frames move through a fixed ring of slots whose buffers are reused, so
+// memory stays bounded no matter how long the game is.
+//
+// usage: ./export replay output [-f y4m|png] [-j threads] [-s WxH]
+//                 [-m default|wireframe] [-r first:last]
+//   y4m writes one YUV4MPEG2 stream to `output` ("-" for stdout),
+//   png writes `output`/frame_NNNNNN.png
+
+#define EXPORT_SLOTS_PER_WORKER (size_t) 2
+#define PNG_STORED_BLOCK        (size_t) 65535
+#define ADLER_NMAX              (size_t) 5552
+
+typedef enum {
+    Y4M_FORMAT,
+    PNG_FORMAT
+} ExportFormat;
+
+typedef struct {
+    char const* replay_path;
+    char const* output_path;
+    ExportFormat format;
+    size_t num_workers;
+    size_t width;
+    size_t height;
+    DisplayMode display_mode;
+    size_t first_frame; // frame n is the state after n inputs, counting from 1
+    size_t last_frame;
+} ExportOptions;
+
+typedef enum {
+    SLOT_FREE,      // waiting for the producer
+    SLOT_QUEUED,    // has a state, waiting for a worker
+    SLOT_RENDERING,
+    SLOT_DONE       // encoded, waiting for the writer
+} SlotStatus;
+
+typedef struct {
+    SlotStatus status;
+    size_t frame;
+    GameState game_state;
+    SoftFramebuffer framebuffer;
+    unsigned char *scratch; // only used for png
+    unsigned char *encoded;
+    size_t encoded_size;
+} ExportSlot;
+
+typedef struct {
+    ExportOptions const* options;
+    Replay const* replay;
+    DisplayConfig display_config;
+
+    ExportSlot *slots;
+    size_t num_slots;
+    size_t next_render_frame;
+
+    pthread_mutex_t lock;
+    pthread_cond_t changed; // broadcast on every slot status change
+} Exporter;
+
+// Encoding ///////////////////////////////////////////////////////////////////
+static uint32_t _crc_table[256];
+
+static void _init_crc_table(void) {
+    for (uint32_t n = 0; n < 256; ++n) {
+        uint32_t c = n;
+        for (size_t k = 0; k < 8; ++k)
+            c = c & 1? 0xEDB88320u ^ (c >> 1) : c >> 1;
+        _crc_table[n] = c;
+    }
+}
+
+static inline uint32_t _crc32(
+    uint32_t crc,
+    unsigned char const*const bytes,
+    size_t const size
+) {
+    crc = ~crc;
+    for (size_t i = 0; i < size; ++i)
+        crc = _crc_table[(crc ^ bytes[i]) & 0xFF] ^ (crc >> 8);
+    return ~crc;
+}
+
+static inline unsigned char *_put_u32_be(unsigned char *out, uint32_t const value) {
+    *out++ = value >> 24;
+    *out++ = value >> 16;
+    *out++ = value >> 8;
+    *out++ = value;
+    return out;
+}
+
+static inline size_t _png_raw_size(size_t const width, size_t const height) {
+    return height * (1 + 3 * width); // each row starts with a filter byte
+}
+
+static size_t _png_max_size(size_t const width, size_t const height) {
+    size_t const raw = _png_raw_size(width, height);
+    size_t const num_blocks = raw / PNG_STORED_BLOCK + 1;
+    return 8 + 25 + 12 + 2 + raw + 5 * num_blocks + 4 + 12;
+}
+
+// PNG with stored (uncompressed) deflate blocks. Frames are written for a
+// video encoder to pick up, so encode speed matters more than file size.
+static size_t _encode_png(
+    SoftFramebuffer const*const framebuffer,
+    unsigned char *const scratch, // _png_raw_size bytes
+    unsigned char *const encoded
+) {
+    static unsigned char const signature[8]
+        = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n'};
+    unsigned char *out = encoded;
+    memcpy(out, signature, sizeof(signature));
+    out += sizeof(signature);
+
+    // IHDR: 8 bit RGB, no interlace
+    unsigned char *const ihdr = out;
+    out = _put_u32_be(out, 13);
+    memcpy(out, "IHDR", 4); out += 4;
+    out = _put_u32_be(out, framebuffer->width);
+    out = _put_u32_be(out, framebuffer->height);
+    *out++ = 8; *out++ = 2; *out++ = 0; *out++ = 0; *out++ = 0;
+    out = _put_u32_be(out, _crc32(0, ihdr + 4, 17));
+
+    // IDAT: zlib header, stored blocks, adler32
+    unsigned char *const idat = out;
+    out += 4;
+    memcpy(out, "IDAT", 4); out += 4;
+    *out++ = 0x78; *out++ = 0x01;
+
+    // rows with their filter byte (none) go into scratch first
+    size_t const raw_size = _png_raw_size(framebuffer->width, framebuffer->height);
+    unsigned char *raw = scratch;
+    for (size_t y = 0; y < framebuffer->height; ++y) {
+        Color const*const row = framebuffer->pixels + y * framebuffer->width;
+        *raw++ = 0;
+        for (size_t x = 0; x < framebuffer->width; ++x) {
+            *raw++ = row[x].r;
+            *raw++ = row[x].g;
+            *raw++ = row[x].b;
+        }
+    }
+
+    for (size_t offset = 0; offset < raw_size; offset += PNG_STORED_BLOCK) {
+        size_t const remaining = raw_size - offset;
+        size_t const block = remaining < PNG_STORED_BLOCK? remaining : PNG_STORED_BLOCK;
+        *out++ = block == remaining; // final block
+        *out++ = block & 0xFF;
+        *out++ = block >> 8;
+        *out++ = ~block & 0xFF;
+        *out++ = (~block >> 8) & 0xFF;
+        memcpy(out, scratch + offset, block);
+        out += block;
+    }
+
+    // adler32, the modulo only needs doing every ADLER_NMAX bytes
+    uint32_t adler_a = 1, adler_b = 0;
+    for (size_t offset = 0; offset < raw_size; offset += ADLER_NMAX) {
+        size_t const remaining = raw_size - offset;
+        size_t const chunk = remaining < ADLER_NMAX? remaining : ADLER_NMAX;
+        for (size_t i = 0; i < chunk; ++i) {
+            adler_a += scratch[offset + i];
+            adler_b += adler_a;
+        }
+        adler_a %= 65521;
+        adler_b %= 65521;
+    }
+    out = _put_u32_be(out, adler_b << 16 | adler_a);
+    _put_u32_be(idat, out - idat - 8);
+    out = _put_u32_be(out, _crc32(0, idat + 4, out - idat - 4));
+
+    out = _put_u32_be(out, 0);
+    memcpy(out, "IEND", 4); out += 4;
+    out = _put_u32_be(out, _crc32(0, out - 4, 4));
+
+    return out - encoded;
+}
+
+// one Y4M frame in 4:4:4 BT.601 studio range
+static size_t _encode_y4m(
+    SoftFramebuffer const*const framebuffer,
+    unsigned char *const encoded
+) {
+    size_t const num_pixels = framebuffer->width * framebuffer->height;
+    memcpy(encoded, "FRAME\n", 6);
+    unsigned char *const y_plane = encoded + 6;
+    unsigned char *const u_plane = y_plane + num_pixels;
+    unsigned char *const v_plane = u_plane + num_pixels;
+
+    for (size_t i = 0; i < num_pixels; ++i) {
+        int const r = framebuffer->pixels[i].r;
+        int const g = framebuffer->pixels[i].g;
+        int const b = framebuffer->pixels[i].b;
+        y_plane[i] = ((66 * r + 129 * g + 25 * b + 128) >> 8) + 16;
+        u_plane[i] = ((-38 * r - 74 * g + 112 * b + 128) >> 8) + 128;
+        v_plane[i] = ((112 * r - 94 * g - 18 * b + 128) >> 8) + 128;
+    }
+    return 6 + 3 * num_pixels;
+}
+
+// Pipeline ///////////////////////////////////////////////////////////////////
+static void *_produce_states(void *const arg) {
+    Exporter *const exporter = arg;
+    ExportOptions const*const options = exporter->options;
+    Replay const*const replay = exporter->replay;
+
+    GameState game_state = init_gamestate_seeded(replay->level, replay->seed);
+    size_t desynced_by = 0; // the first frame found off, 0 while none is
+    for (size_t frame = 1; frame <= options->last_frame; ++frame) {
+        GameInput const input = unpack_replay_input(replay->inputs[frame - 1]);
+        next_gamestate(&game_state, &input);
+        if (desynced_by == 0 && !matches_replay(replay, frame, &game_state))
+            desynced_by = frame;
+        if (frame < options->first_frame) continue;
+
+        ExportSlot *const slot = &exporter->slots[frame % exporter->num_slots];
+        pthread_mutex_lock(&exporter->lock);
+        while (slot->status != SLOT_FREE)
+            pthread_cond_wait(&exporter->changed, &exporter->lock);
+        slot->game_state = game_state;
+        slot->frame = frame;
+        slot->status = SLOT_QUEUED;
+        pthread_cond_broadcast(&exporter->changed);
+        pthread_mutex_unlock(&exporter->lock);
+    }
+
+    if (desynced_by > 0) fprintf(stderr,
+        "Warning: replay desynced by frame %zu, the export may not match the game from there.\n",
+        desynced_by);
+    else if (options->last_frame == replay->num_frames
+    &&  replay->final_hash != 0
+    &&  hash_gamestate(&game_state) != replay->final_hash
+    ) fprintf(stderr, "Warning: replay desynced, the export may not match the game.\n");
+    return NULL;
+}
+
+// workers take frames strictly in order, so the writer never waits on a
+// frame that nobody has started.
+static void *_render_frames(void *const arg) {
+    Exporter *const exporter = arg;
+    ExportOptions const*const options = exporter->options;
+
+    pthread_mutex_lock(&exporter->lock);
+    for (;;) {
+        size_t const frame = exporter->next_render_frame;
+        if (frame > options->last_frame) break;
+
+        ExportSlot *const slot = &exporter->slots[frame % exporter->num_slots];
+        if (slot->status != SLOT_QUEUED || slot->frame != frame) {
+            pthread_cond_wait(&exporter->changed, &exporter->lock);
+            continue;
+        }
+        slot->status = SLOT_RENDERING;
+        exporter->next_render_frame++;
+        pthread_mutex_unlock(&exporter->lock);
+
+        bind_soft_framebuffer(&slot->framebuffer);
+        display_game(&slot->game_state, &exporter->display_config);
+        slot->encoded_size = options->format == PNG_FORMAT
+            ? _encode_png(&slot->framebuffer, slot->scratch, slot->encoded)
+            : _encode_y4m(&slot->framebuffer, slot->encoded);
+
+        pthread_mutex_lock(&exporter->lock);
+        slot->status = SLOT_DONE;
+        pthread_cond_broadcast(&exporter->changed);
+    }
+    pthread_mutex_unlock(&exporter->lock);
+    return NULL;
+}
+
+static bool _write_frame(
+    ExportOptions const*const options,
+    FILE *const stream,
+    ExportSlot const*const slot
+) {
+    if (options->format == Y4M_FORMAT)
+        return fwrite(slot->encoded, 1, slot->encoded_size, stream)
+            == slot->encoded_size;
+
+    char path[4096];
+    snprintf(path, sizeof(path), "%s/frame_%06zu.png", options->output_path, slot->frame);
+    FILE *const file = fopen(path, "wb");
+    if (file == NULL) return false;
+    bool const ok
+        = fwrite(slot->encoded, 1, slot->encoded_size, file) == slot->encoded_size;
+    return fclose(file) == 0 && ok;
+}
+
+static bool _write_frames(Exporter *const exporter, FILE *const stream) {
+    ExportOptions const*const options = exporter->options;
+
+    for (size_t frame = options->first_frame; frame <= options->last_frame; ++frame) {
+        ExportSlot *const slot = &exporter->slots[frame % exporter->num_slots];
+        pthread_mutex_lock(&exporter->lock);
+        while (slot->status != SLOT_DONE)
+            pthread_cond_wait(&exporter->changed, &exporter->lock);
+        pthread_mutex_unlock(&exporter->lock);
+
+        if (!_write_frame(options, stream, slot)) {
+            fprintf(stderr, "Error: could not write frame %zu.\n", frame);
+            return false;
+        }
+
+        pthread_mutex_lock(&exporter->lock);
+        slot->status = SLOT_FREE;
+        pthread_cond_broadcast(&exporter->changed);
+        pthread_mutex_unlock(&exporter->lock);
+    }
+    return true;
+}
+
+// Options ////////////////////////////////////////////////////////////////////
+static bool _parse_options(int const argc, char **argv, ExportOptions *const options) {
+    long const num_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    *options = (ExportOptions){
+        .format       = Y4M_FORMAT,
+        .num_workers  = num_cpus > 0? num_cpus : 1,
+        .width        = INIT_WIDTH,
+        .height       = INIT_HEIGHT,
+        .display_mode = WIREFRAME_DISPLAY_MODE,
+        .first_frame  = 1,
+        .last_frame   = SIZE_MAX
+    };
+    if (argc < 3) return false;
+    options->replay_path = argv[1];
+    options->output_path = argv[2];
+
+    for (int i = 3; i < argc; ++i) {
+        if (i + 1 >= argc) return false;
+        char const*const value = argv[i + 1];
+
+        if (strcmp(argv[i], "-f") == 0) {
+            if      (strcmp(value, "y4m") == 0) options->format = Y4M_FORMAT;
+            else if (strcmp(value, "png") == 0) options->format = PNG_FORMAT;
+            else return false;
+        }
+        else if (strcmp(argv[i], "-m") == 0) {
+            if      (strcmp(value, "default") == 0)
+                options->display_mode = DEFAULT_DISPLAY_MODE;
+            else if (strcmp(value, "wireframe") == 0)
+                options->display_mode = WIREFRAME_DISPLAY_MODE;
+            else return false;
+        }
+        else if (strcmp(argv[i], "-j") == 0)
+            options->num_workers = strtoul(value, NULL, 10);
+        else if (strcmp(argv[i], "-s") == 0) {
+            if (sscanf(value, "%zux%zu", &options->width, &options->height) != 2)
+                return false;
+        }
+        else if (strcmp(argv[i], "-r") == 0) {
+            if (sscanf(value, "%zu:%zu", &options->first_frame, &options->last_frame) != 2)
+                return false;
+        }
+        else return false;
+        ++i;
+    }
+    return options->num_workers > 0
+        && options->width > 0
+        && options->height > 0
+        && options->first_frame > 0;
+}
+
+static inline double _seconds_since(struct timespec const*const start) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - start->tv_sec) + (now.tv_nsec - start->tv_nsec) * 1e-9;
+}
+
+int main(int argc, char **argv) {
+    ExportOptions options;
+    if (!_parse_options(argc, argv, &options)) {
+        fprintf(stderr,
+            "usage: %s replay output [-f y4m|png] [-j threads] [-s WxH]\n"
+            "          [-m default|wireframe] [-r first:last]\n",
+            argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    Replay replay = { .inputs = NULL };
+    if (!read_replay(&replay, options.replay_path)) {
+        fprintf(stderr, "Error: could not read replay %s.\n", options.replay_path);
+        return EXIT_FAILURE;
+    }
+    if (options.last_frame > replay.num_frames) options.last_frame = replay.num_frames;
+    if (options.first_frame > options.last_frame) {
+        fprintf(stderr, "Error: replay has %zu frames, nothing to export.\n",
+            replay.num_frames);
+        return EXIT_FAILURE;
+    }
+
+    FILE *stream = NULL;
+    if (options.format == Y4M_FORMAT) {
+        bool const to_stdout = strcmp(options.output_path, "-") == 0;
+        stream = to_stdout? stdout : fopen(options.output_path, "wb");
+        if (stream == NULL) {
+            fprintf(stderr, "Error: could not open %s.\n", options.output_path);
+            return EXIT_FAILURE;
+        }
+        fprintf(stream, "YUV4MPEG2 W%zu H%zu F%zu:1 Ip A1:1 C444\n",
+            options.width, options.height, FPS);
+    }
+    _init_crc_table();
+
+    Exporter exporter = {
+        .options = &options,
+        .replay = &replay,
+        .display_config = init_soft_display_config(options.display_mode),
+        .num_slots = options.num_workers * EXPORT_SLOTS_PER_WORKER + 1,
+        .next_render_frame = options.first_frame
+    };
+    size_t const encoded_capacity = options.format == PNG_FORMAT
+        ? _png_max_size(options.width, options.height)
+        : 6 + 3 * options.width * options.height;
+
+    exporter.slots = calloc(exporter.num_slots, sizeof(ExportSlot));
+    for (size_t i = 0; i < exporter.num_slots; ++i) {
+        exporter.slots[i].status = SLOT_FREE;
+        exporter.slots[i].framebuffer
+            = create_soft_framebuffer(options.width, options.height);
+        exporter.slots[i].encoded = malloc(encoded_capacity);
+        exporter.slots[i].scratch = options.format == PNG_FORMAT
+            ? malloc(_png_raw_size(options.width, options.height))
+            : NULL;
+        if (exporter.slots[i].encoded == NULL
+        || (options.format == PNG_FORMAT && exporter.slots[i].scratch == NULL)
+        ) {
+            fprintf(stderr, "Error: could not allocate frame buffers.\n");
+            return EXIT_FAILURE;
+        }
+    }
+    pthread_mutex_init(&exporter.lock, NULL);
+    pthread_cond_init(&exporter.changed, NULL);
+
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    pthread_t producer;
+    pthread_t *const workers = malloc(options.num_workers * sizeof(pthread_t));
+    pthread_create(&producer, NULL, _produce_states, &exporter);
+    for (size_t i = 0; i < options.num_workers; ++i)
+        pthread_create(&workers[i], NULL, _render_frames, &exporter);
+
+    bool const ok = _write_frames(&exporter, stream);
+    if (!ok) exit(EXIT_FAILURE); // threads are blocked on the ring, just leave
+
+    pthread_join(producer, NULL);
+    for (size_t i = 0; i < options.num_workers; ++i)
+        pthread_join(workers[i], NULL);
+
+    double const seconds = _seconds_since(&start);
+    size_t const num_frames = options.last_frame - options.first_frame + 1;
+    fprintf(stderr, "%zu frames in %.2fs, %.1f fps (%.1fx real time)\n",
+        num_frames, seconds, num_frames / seconds, num_frames / seconds / FPS);
+
+    GameCounters counters;
+    read_game_counters(&counters);
+    if (counters.enabled) print_game_counters(&counters);
+
+    if (stream != NULL && stream != stdout) fclose(stream);
+    for (size_t i = 0; i < exporter.num_slots; ++i) {
+        free_soft_framebuffer(&exporter.slots[i].framebuffer);
+        free(exporter.slots[i].encoded);
+        free(exporter.slots[i].scratch);
+    }
+    free(exporter.slots);
+    free(workers);
+    free_replay(&replay);
+    return EXIT_SUCCESS;
+}
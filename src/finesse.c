@@ -0,0 +1,574 @@
+#include "finesse.h"
+#include "game.h"
+#include "replay.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define FINESSE_NO_NODE      UINT32_MAX
+#define FINESSE_INIT_NODES   (size_t) 4096
+#define FINESSE_SLOTS        (2 * FINESSE_MAX_NODES) // at most half of them used
+#define DAS_CHARGED          (AUTOSHIFT_FRAMES_DELAY + 1) // any more acts the same
+#define POSITION_OFFSET      (ptrdiff_t) 4 // x and y can be a little negative
+
+typedef enum {
+    HELD_NONE,
+    HELD_LEFT,
+    HELD_RIGHT,
+    HELD_DOWN
+} HeldKey;
+
+static unsigned char const held_flags[4] = { 0, INPUT_LEFT, INPUT_RIGHT, INPUT_DOWN };
+
+typedef struct {
+    unsigned char pressed;
+    HeldKey held;
+} FinesseAction;
+
+// from a frame with nothing held, or after letting go. The taps come first,
+// they're all the fastest path needs (see _find_paths).
+static FinesseAction const fresh_actions[] = {
+    { 0,            HELD_NONE  },
+    { INPUT_ROTATE, HELD_NONE  },
+    { INPUT_LEFT,   HELD_NONE  },
+    { INPUT_RIGHT,  HELD_NONE  },
+    { INPUT_DOWN,   HELD_NONE  },
+    { INPUT_LEFT,   HELD_LEFT  },
+    { INPUT_RIGHT,  HELD_RIGHT },
+    { INPUT_DOWN,   HELD_DOWN  }
+};
+#define NUM_FRESH_ACTIONS (sizeof(fresh_actions) / sizeof(fresh_actions[0]))
+#define NUM_TAP_ACTIONS   (size_t) 5
+
+// a lock that covers the target, not a node since nothing follows it
+typedef struct {
+    bool found;
+    uint32_t parent;
+    unsigned char input;
+    size_t frames;
+    size_t presses;
+} FinesseHit;
+
+// Packing ////////////////////////////////////////////////////////////////////
+
+// x and y 5 bits each, rotation 2, held key 2, DAS frames 5, then the soft
+// drop and lock wait flags
+static inline uint32_t _pack_state(GameState const*const game_state, HeldKey const held) {
+    Tetromino const*const tetromino = &game_state->current_tetromino;
+    size_t const das = game_state->delayed_autoshift_frames < DAS_CHARGED
+        ? game_state->delayed_autoshift_frames
+        : DAS_CHARGED;
+    return (uint32_t)((ptrdiff_t)tetromino->x + POSITION_OFFSET)
+         | (uint32_t)((ptrdiff_t)tetromino->y + POSITION_OFFSET) << 5
+         | (uint32_t)tetromino->rotation << 10
+         | (uint32_t)held << 12
+         | (uint32_t)das << 14
+         | (uint32_t)game_state->delayed_autoshift_pressed_down << 19
+         | (uint32_t)game_state->deposite_on_next_frame << 20;
+}
+
+// block positions only depend on the rotation, `positions` has them
+static inline HeldKey _unpack_state(
+    GameState *const game_state,
+    uint32_t const state,
+    size_t const positions[MAX_NUM_ROTATIONS][NUM_TETROMINO_BLOCKS][NUM_AXIS]
+) {
+    Tetromino *const tetromino = &game_state->current_tetromino;
+    tetromino->x = (ptrdiff_t)(state & 31) - POSITION_OFFSET;
+    tetromino->y = (ptrdiff_t)(state >> 5 & 31) - POSITION_OFFSET;
+    tetromino->rotation = state >> 10 & 3;
+    memcpy(tetromino->positions, positions[tetromino->rotation], sizeof(tetromino->positions));
+    game_state->delayed_autoshift_frames = state >> 14 & 31;
+    game_state->delayed_autoshift_pressed_down = state >> 19 & 1;
+    game_state->deposite_on_next_frame = state >> 20 & 1;
+    return state >> 12 & 3;
+}
+
+// the board cells a piece covers, sorted, a byte each
+static uint32_t _cells_key(Tetromino const*const tetromino) {
+    unsigned cells[NUM_TETROMINO_BLOCKS];
+    for (size_t i = 0; i < NUM_TETROMINO_BLOCKS; ++i) {
+        size_t const x = tetromino->positions[i][X_AXIS] + tetromino->x;
+        size_t const y = tetromino->positions[i][Y_AXIS] + tetromino->y;
+        cells[i] = (y * COLS + x) & 0xFF;
+        for (size_t j = i; j > 0 && cells[j - 1] > cells[j]; --j) {
+            unsigned const swap = cells[j];
+            cells[j] = cells[j - 1];
+            cells[j - 1] = swap;
+        }
+    }
+    return cells[0] | cells[1] << 8 | cells[2] << 16 | (uint32_t)cells[3] << 24;
+}
+
+// Surface ////////////////////////////////////////////////////////////////////
+
+// column heights, and the board filled in below them
+static void _fill_surface(TetrominoType board[ROWS][COLS], unsigned char heights[COLS]) {
+    for (size_t x = 0; x < COLS; ++x) {
+        size_t top = 0;
+        while (top < ROWS && board[top][x] == NO_TETROMINO) top++;
+        heights[x] = ROWS - top;
+        for (size_t y = top; y < ROWS; ++y) board[y][x] = garbage_tetromino;
+    }
+}
+
+static inline uint64_t _mix(uint64_t x) {
+    x ^= x >> 31;
+    x *= 0x7FB5D329728EA185ULL;
+    x ^= x >> 27;
+    x *= 0x81DADEF4BC2DD44DULL;
+    x ^= x >> 33;
+    return x;
+}
+
+static void _cache_key(
+    GameState const*const game_state,
+    uint32_t const target,
+    uint64_t key[FINESSE_KEY_WORDS]
+) {
+    uint32_t const state = _pack_state(game_state, HELD_NONE);
+    key[0] = (uint64_t)game_state->current_tetromino.type
+           | (uint64_t)state << 3
+           | (uint64_t)(game_state->frame_number % AUTOSHIFT_FRAMESKIP) << 24
+           | (uint64_t)target << 26;
+    key[1] = (uint64_t)game_state->gravity
+           | (uint64_t)game_state->gravity_accumulator << 32;
+
+    TetrominoType board[ROWS][COLS];
+    unsigned char heights[COLS];
+    memcpy(board, game_state->board, sizeof(board));
+    _fill_surface(board, heights);
+    key[2] = 0;
+    for (size_t x = 0; x < COLS; ++x) key[2] |= (uint64_t)heights[x] << (5 * x);
+}
+
+// Goals //////////////////////////////////////////////////////////////////////
+
+// where the piece is when it covers the target in one rotation, symmetric
+// pieces have more than one
+typedef struct {
+    size_t rotation;
+    ptrdiff_t x;
+    ptrdiff_t y;
+} FinesseGoal;
+
+typedef struct {
+    uint32_t cells; // see _cells_key
+    FinesseGoal goals[MAX_NUM_ROTATIONS];
+    size_t num_goals;
+    size_t rows_per_frame; // the fastest it can fall, a tap and gravity or a repeat
+} FinesseTarget;
+
+// the block positions of every rotation, rotated on an empty board so
+// nothing gets in the way
+static void _fill_positions(
+    GameState const*const game_state,
+    size_t positions[MAX_NUM_ROTATIONS][NUM_TETROMINO_BLOCKS][NUM_AXIS]
+) {
+    GameState empty = *game_state;
+    for (size_t y = 0; y < ROWS; ++y) {
+        for (size_t x = 0; x < COLS; ++x) empty.board[y][x] = NO_TETROMINO;
+    }
+    Tetromino *const tetromino = &empty.current_tetromino;
+    tetromino->x = COLS / 2 - 2;
+    tetromino->y = ROWS / 2;
+    for (size_t i = 0; i < MAX_NUM_ROTATIONS; ++i) {
+        memcpy(positions[tetromino->rotation], tetromino->positions, sizeof(tetromino->positions));
+        rotate_tetromino(&empty);
+    }
+}
+
+static inline ptrdiff_t _min_position(
+    size_t const positions[NUM_TETROMINO_BLOCKS][NUM_AXIS],
+    size_t const axis
+) {
+    size_t min = positions[0][axis];
+    for (size_t i = 1; i < NUM_TETROMINO_BLOCKS; ++i) {
+        if (positions[i][axis] < min) min = positions[i][axis];
+    }
+    return min;
+}
+
+static void _fill_target(
+    GameState const*const game_state,
+    Tetromino const*const target_tetromino,
+    size_t const positions[MAX_NUM_ROTATIONS][NUM_TETROMINO_BLOCKS][NUM_AXIS],
+    FinesseTarget *const target
+) {
+    target->cells = _cells_key(target_tetromino);
+    target->rows_per_frame = (game_state->gravity + GRAVITY_ONE - 1) / GRAVITY_ONE + 1;
+    if (target->rows_per_frame < 2) target->rows_per_frame = 2;
+    target->num_goals = 0;
+    ptrdiff_t const x = (ptrdiff_t)target_tetromino->x + _min_position(target_tetromino->positions, X_AXIS);
+    ptrdiff_t const y = (ptrdiff_t)target_tetromino->y + _min_position(target_tetromino->positions, Y_AXIS);
+
+    Tetromino tetromino = game_state->current_tetromino;
+    for (size_t r = 0; r < MAX_NUM_ROTATIONS; ++r) {
+        memcpy(tetromino.positions, positions[r], sizeof(tetromino.positions));
+        FinesseGoal const goal = {
+            .rotation = r,
+            .x = x - _min_position(positions[r], X_AXIS),
+            .y = y - _min_position(positions[r], Y_AXIS)
+        };
+        tetromino.x = goal.x;
+        tetromino.y = goal.y;
+        if (_cells_key(&tetromino) == target->cells) target->goals[target->num_goals++] = goal;
+    }
+}
+
+// lower bounds on the frames and presses still to go from `state`: one
+// rotation a frame and each is a press, at most two columns a frame and a
+// press to start moving unless it's already held that way. False if every
+// goal is above the piece, it never goes back up.
+static inline bool _bounds(
+    FinesseTarget const*const target,
+    uint32_t const state,
+    size_t *const frames,
+    size_t *const presses
+) {
+    ptrdiff_t const x = (ptrdiff_t)(state & 31) - POSITION_OFFSET;
+    ptrdiff_t const y = (ptrdiff_t)(state >> 5 & 31) - POSITION_OFFSET;
+    size_t const rotation = state >> 10 & 3;
+    HeldKey const held = state >> 12 & 3;
+
+    bool reachable = false;
+    *frames = SIZE_MAX;
+    *presses = SIZE_MAX;
+    for (size_t i = 0; i < target->num_goals; ++i) {
+        FinesseGoal const*const goal = &target->goals[i];
+        if (goal->y < y) continue;
+        reachable = true;
+
+        size_t const rotations = (goal->rotation + MAX_NUM_ROTATIONS - rotation) % MAX_NUM_ROTATIONS;
+        ptrdiff_t const dx = goal->x - x;
+        size_t const columns = dx < 0? -dx : dx;
+        size_t const rows = goal->y - y;
+        size_t goal_frames = rotations;
+        if ((columns + 1) / 2 > goal_frames) goal_frames = (columns + 1) / 2;
+        size_t const falling = (rows + target->rows_per_frame - 1) / target->rows_per_frame;
+        if (falling > goal_frames) goal_frames = falling;
+        size_t const goal_presses = rotations
+            + (dx < 0 && held != HELD_LEFT) + (dx > 0 && held != HELD_RIGHT);
+
+        if (goal_frames < *frames) *frames = goal_frames;
+        if (goal_presses < *presses) *presses = goal_presses;
+    }
+    return reachable;
+}
+
+// taps its way to the goal with the fewest rotations: rotate, shift, then
+// soft drop every frame. An upper bound for the fastest path if it gets there.
+static size_t _tapped_frames(
+    GameState const*const surface,
+    FinesseTarget const*const target
+) {
+    GameState played = *surface;
+    Tetromino const*const tetromino = &played.current_tetromino;
+    FinesseGoal const* goal = &target->goals[0];
+    for (size_t i = 1; i < target->num_goals; ++i) {
+        size_t const rotations = (goal->rotation + MAX_NUM_ROTATIONS - tetromino->rotation) % MAX_NUM_ROTATIONS;
+        if ((target->goals[i].rotation + MAX_NUM_ROTATIONS - tetromino->rotation) % MAX_NUM_ROTATIONS < rotations)
+            goal = &target->goals[i];
+    }
+
+    for (size_t frame = 0; frame < FINESSE_MAX_FRAMES; ++frame) {
+        GameInput input = { .pressed = INPUT_DOWN };
+        if (tetromino->rotation != goal->rotation) input.pressed = INPUT_ROTATE;
+        else if ((ptrdiff_t)tetromino->x > goal->x) input.pressed = INPUT_LEFT;
+        else if ((ptrdiff_t)tetromino->x < goal->x) input.pressed = INPUT_RIGHT;
+        if (step_tetromino(&played, &input))
+            return _cells_key(tetromino) == target->cells? frame + 1 : FINESSE_MAX_FRAMES;
+    }
+    return FINESSE_MAX_FRAMES;
+}
+
+// Search /////////////////////////////////////////////////////////////////////
+static inline size_t _slot(uint32_t const key, size_t const mask) {
+    return (key * 0x9E3779B1u) & mask;
+}
+
+// a packed state, the DAS phase and the frames to the next gravity tick.
+// Only the tick after that can tell two frames apart, they're close enough
+// to share a key.
+static inline uint32_t _search_key(
+    uint32_t const state,
+    unsigned long long const frame_number,
+    size_t const accumulator,
+    size_t const gravity
+) {
+    size_t ticks = gravity > 0? (GRAVITY_ONE - accumulator + gravity - 1) / gravity : 511;
+    if (ticks > 511) ticks = 511;
+    return state
+         | (uint32_t)(frame_number % AUTOSHIFT_FRAMESKIP) << 21
+         | (uint32_t)ticks << 23;
+}
+
+// a key seen before, in this frame or an earlier one, with no more presses
+// isn't searched again. Every node is still stepped from its own parent, so
+// paths are exact, but one a frame or a press better can in rare cases be
+// missed. False when out of room.
+static bool _visit(
+    FinesseCache *const cache,
+    uint32_t const key,
+    uint32_t const parent,
+    size_t const presses,
+    unsigned char const input,
+    size_t const layer_end
+) {
+    uint64_t const generation = (uint64_t)cache->generation << 32;
+    size_t slot = _slot(key, cache->slot_mask);
+    while ((cache->slots[slot] & ~(uint64_t)UINT32_MAX) == generation) {
+        uint32_t const index = (uint32_t)cache->slots[slot];
+        FinesseNode *const node = &cache->nodes[index];
+        if (node->state == key) {
+            if (node->presses <= presses) return true;
+            if (index >= layer_end) {
+                *node = (FinesseNode){ key, parent, presses, input };
+                return true;
+            }
+            break; // an earlier frame but more presses, this one's worth a look too
+        }
+        slot = (slot + 1) & cache->slot_mask;
+    }
+
+    if (cache->num_nodes == cache->node_capacity) {
+        if (cache->node_capacity == FINESSE_MAX_NODES) return false;
+        size_t const capacity = 2 * cache->node_capacity;
+        FinesseNode *const nodes = realloc(cache->nodes, capacity * sizeof(FinesseNode));
+        if (nodes == NULL) return false;
+        cache->nodes = nodes;
+        cache->node_capacity = capacity;
+    }
+    cache->nodes[cache->num_nodes] = (FinesseNode){ key, parent, presses, input };
+    cache->slots[slot] = generation | cache->num_nodes++;
+    return true;
+}
+
+static inline void _note_hit(
+    FinesseHit *const hit,
+    uint32_t const parent,
+    unsigned char const input,
+    size_t const frames,
+    size_t const presses
+) {
+    if (hit->found && hit->presses <= presses) return;
+    *hit = (FinesseHit){ true, parent, input, frames, presses };
+}
+
+static void _write_path(
+    FinesseCache const*const cache,
+    FinesseHit const*const hit,
+    FinessePath *const path
+) {
+    path->found = hit->found;
+    if (!hit->found) return;
+    path->num_frames = hit->frames;
+    path->num_presses = hit->presses;
+    size_t frame = hit->frames - 1;
+    path->inputs[frame] = hit->input;
+    for (uint32_t i = hit->parent; cache->nodes[i].parent != FINESSE_NO_NODE; i = cache->nodes[i].parent)
+        path->inputs[--frame] = cache->nodes[i].input;
+}
+
+// one layer per frame on the surface board. For the fastest path it stops
+// at the first frame that locks on the target and drops anything that
+// can't get there within `max_frames`. For the fewest presses it goes on
+// while something could still beat `max_presses`.
+static void _search(
+    FinesseCache *const cache,
+    GameState const*const surface,
+    FinesseTarget const*const target,
+    size_t const positions[MAX_NUM_ROTATIONS][NUM_TETROMINO_BLOCKS][NUM_AXIS],
+    bool const is_fastest,
+    size_t const max_frames,
+    size_t max_presses,
+    FinesseHit *const hit
+) {
+    GameState scratch = *surface; // only the piece and the DAS state change
+    *hit = (FinesseHit){ .found = false };
+    if (++cache->generation == 0) { // wrapped, the slots left over could pass for this one
+        memset(cache->slots, 0, FINESSE_SLOTS * sizeof(uint64_t));
+        cache->generation = 1;
+    }
+    cache->num_nodes = 0;
+    uint32_t const root = _pack_state(surface, HELD_NONE);
+    _visit(
+        cache,
+        _search_key(root, surface->frame_number, surface->gravity_accumulator, surface->gravity),
+        FINESSE_NO_NODE, 0, 0, 0
+    );
+
+    size_t layer_first = 0;
+    size_t layer_end = cache->num_nodes;
+    unsigned long long frame_number = surface->frame_number;
+    size_t accumulator = surface->gravity_accumulator;
+    bool has_room = true;
+    for (size_t frame = 0; frame < max_frames && layer_first < layer_end && has_room; ++frame) {
+        size_t const next_accumulator = (accumulator + surface->gravity) % GRAVITY_ONE;
+        for (size_t i = layer_first; i < layer_end && has_room; ++i) {
+            FinesseNode const node = cache->nodes[i];
+            if (!is_fastest && node.presses >= max_presses) continue;
+            HeldKey const held = node.state >> 12 & 3;
+
+            size_t const num_actions = is_fastest
+                ? NUM_TAP_ACTIONS
+                : NUM_FRESH_ACTIONS + (held != HELD_NONE? 2 : 0);
+            for (size_t a = 0; a < num_actions && has_room; ++a) {
+                FinesseAction const action = a < NUM_FRESH_ACTIONS
+                    ? fresh_actions[a]
+                    : (FinesseAction){ a == NUM_FRESH_ACTIONS? 0 : INPUT_ROTATE, held };
+                size_t const presses = node.presses + (action.pressed != 0);
+                if (!is_fastest && presses >= max_presses) continue;
+
+                _unpack_state(&scratch, node.state, positions);
+                scratch.frame_number = frame_number;
+                scratch.gravity_accumulator = accumulator;
+                GameInput const input = {
+                    .pressed = action.pressed,
+                    .down = held_flags[action.held]
+                };
+                unsigned char const packed = pack_replay_input(&input);
+                if (step_tetromino(&scratch, &input)) {
+                    if (_cells_key(&scratch.current_tetromino) != target->cells) continue;
+                    _note_hit(hit, i, packed, frame + 1, presses);
+                    if (!is_fastest) max_presses = presses;
+                    continue;
+                }
+
+                uint32_t const state = _pack_state(&scratch, action.held);
+                size_t frames_left, presses_left;
+                if (!_bounds(target, state, &frames_left, &presses_left)) continue;
+                if (is_fastest
+                    ? frame + 1 + (frames_left > 0? frames_left : 1) > max_frames
+                    : presses + presses_left >= max_presses
+                ) continue;
+                uint32_t const key = _search_key(state, frame_number + 1, next_accumulator, surface->gravity);
+                has_room = _visit(cache, key, i, presses, packed, layer_end);
+            }
+        }
+
+        if (is_fastest && hit->found) break;
+        layer_first = layer_end;
+        layer_end = cache->num_nodes;
+        frame_number++;
+        accumulator = next_accumulator;
+    }
+}
+
+// the fastest path first, tapping only: a held key takes 20 frames to start
+// repeating and then moves every third frame, a tap a frame is never slower.
+// Its presses bound the second search, which has every action and so can
+// find a path just as fast with fewer presses.
+static void _find_paths(
+    FinesseCache *const cache,
+    GameState const*const game_state,
+    Tetromino const*const target_tetromino,
+    Finesse *const finesse
+) {
+    GameState surface = *game_state;
+    unsigned char heights[COLS];
+    _fill_surface(surface.board, heights);
+
+    size_t positions[MAX_NUM_ROTATIONS][NUM_TETROMINO_BLOCKS][NUM_AXIS];
+    _fill_positions(game_state, positions);
+    FinesseTarget target;
+    _fill_target(game_state, target_tetromino, positions, &target);
+    finesse->fastest.found = false;
+    finesse->fewest_presses.found = false;
+    if (target.num_goals == 0) return;
+
+    FinesseHit hit;
+    size_t const max_frames = _tapped_frames(&surface, &target);
+    _search(cache, &surface, &target, positions, true, max_frames, 0, &hit);
+    if (!hit.found && max_frames < FINESSE_MAX_FRAMES) // dropped too much, look everywhere
+        _search(cache, &surface, &target, positions, true, FINESSE_MAX_FRAMES, 0, &hit);
+    _write_path(cache, &hit, &finesse->fastest);
+    if (!hit.found) return;
+
+    // a press at a time up from the least it could take, a tight bound
+    // leaves far less to search than the fastest path's presses would
+    finesse->fewest_presses = finesse->fastest;
+    size_t frames_left, presses_left;
+    _bounds(&target, _pack_state(&surface, HELD_NONE), &frames_left, &presses_left);
+    for (size_t max_presses = presses_left + 1; max_presses < finesse->fastest.num_presses; ++max_presses) {
+        _search(cache, &surface, &target, positions, false, FINESSE_MAX_FRAMES, max_presses, &hit);
+        if (!hit.found) continue;
+        _write_path(cache, &hit, &finesse->fewest_presses);
+        if (hit.frames <= finesse->fastest.num_frames) finesse->fastest = finesse->fewest_presses;
+        break;
+    }
+}
+
+// the search ran on the surface, anything under an overhang could change
+// how the path plays out on the real board
+static bool _path_holds(
+    GameState const*const game_state,
+    FinessePath const*const path,
+    uint32_t const target
+) {
+    GameState played = *game_state;
+    for (size_t i = 0; i < path->num_frames; ++i) {
+        GameInput const input = finesse_input(path, i);
+        if (step_tetromino(&played, &input))
+            return i + 1 == path->num_frames && _cells_key(&played.current_tetromino) == target;
+    }
+    return false;
+}
+
+// Exposed ////////////////////////////////////////////////////////////////////
+extern bool create_finesse_cache(FinesseCache *const cache, size_t const num_entries) {
+    size_t size = 1;
+    while (size < num_entries) size *= 2;
+    *cache = (FinesseCache){
+        .mask          = size - 1,
+        .entries       = calloc(size, sizeof(FinesseEntry)),
+        .nodes         = malloc(FINESSE_INIT_NODES * sizeof(FinesseNode)),
+        .node_capacity = FINESSE_INIT_NODES,
+        .slots         = calloc(FINESSE_SLOTS, sizeof(uint64_t)),
+        .slot_mask     = FINESSE_SLOTS - 1
+    };
+    if (cache->entries == NULL || cache->nodes == NULL || cache->slots == NULL) {
+        fprintf(stderr, "Error: could not allocate a finesse cache of %zu entries.\n", size);
+        free_finesse_cache(cache);
+        return false;
+    }
+    return true;
+}
+
+extern void free_finesse_cache(FinesseCache *const cache) {
+    free(cache->entries);
+    free(cache->nodes);
+    free(cache->slots);
+    *cache = (FinesseCache){ .entries = NULL };
+}
+
+extern bool find_finesse(
+    FinesseCache *const cache,
+    GameState const*const game_state,
+    Tetromino const*const target,
+    Finesse *const finesse
+) {
+    uint32_t const target_cells = _cells_key(target);
+    uint64_t key[FINESSE_KEY_WORDS];
+    _cache_key(game_state, target_cells, key);
+    uint64_t const hash = _mix(key[0] ^ _mix(key[1] ^ _mix(key[2])));
+
+    FinesseEntry *const entry = &cache->entries[hash & cache->mask];
+    if (entry->is_used && memcmp(entry->key, key, sizeof(key)) == 0) cache->hits++;
+    else {
+        _find_paths(cache, game_state, target, &entry->finesse);
+        entry->is_used = true;
+        memcpy(entry->key, key, sizeof(key));
+        cache->searches++;
+    }
+
+    *finesse = entry->finesse;
+    if (finesse->fastest.found)
+        finesse->fastest.found = _path_holds(game_state, &finesse->fastest, target_cells);
+    if (finesse->fewest_presses.found)
+        finesse->fewest_presses.found = _path_holds(game_state, &finesse->fewest_presses, target_cells);
+    return finesse->fastest.found;
+}
@@ -0,0 +1,102 @@
+#ifndef FINESSE_H
+#define FINESSE_H
+
+#include "game.h"
+#include "replay.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Finesse: the input sequences that get the falling piece to lock in a given
+// placement in the fewest frames, and in the fewest key presses. A breadth
+// first search over the piece's (x, y, rotation) and the held key, one frame
+// per layer, stepped with the game's own movement, DAS and gravity (see
+// `step_tetromino`), so the paths play back exactly in a real game.
+//
+// Each frame is a tap (pressed, not held) of rotate, left, right or down, a
+// press that starts holding left, right or down, carrying on holding (maybe
+// with a rotate), or nothing. Every press counts, holding doesn't. The
+// search starts with no key held. The fastest path only taps, a held key is
+// never quicker, then a search a press at a time looks for fewer presses.
+// Both drop anything that can't beat the best so far (see `_bounds`) and
+// states they've already been in as soon, with no more presses, so on rare
+// boards a path is a frame or a press off the best.
+//
+// Results are memoized per piece, rotation, position, gravity phase and
+// surface profile (column heights, the board searched has everything below
+// each column's top filled in). Placements under an overhang aren't found,
+// and a path is checked against the real board before it is handed out.
+
+// Constants //////////////////////////////////////////////////////////////////
+#define FINESSE_MAX_FRAMES     (size_t) 1024 // longest path searched for
+#define FINESSE_MAX_NODES      (size_t) (1 << 20) // per search
+#define FINESSE_CACHE_ENTRIES  (size_t) 1024
+#define FINESSE_KEY_WORDS      (size_t) 3
+
+// Structs ////////////////////////////////////////////////////////////////////
+typedef struct {
+    bool found;
+    size_t num_frames;  // the last one is the frame it locks on
+    size_t num_presses;
+    unsigned char inputs[FINESSE_MAX_FRAMES]; // see pack_replay_input
+} FinessePath;
+
+typedef struct {
+    FinessePath fastest;        // fewest frames, then fewest presses
+    FinessePath fewest_presses; // fewest presses, then fewest frames
+} Finesse;
+
+typedef struct {
+    bool is_used;
+    uint64_t key[FINESSE_KEY_WORDS];
+    Finesse finesse;
+} FinesseEntry;
+
+// search nodes, see finesse.c
+typedef struct {
+    uint32_t state;
+    uint32_t parent;
+    uint16_t presses;
+    uint8_t input;
+} FinesseNode;
+
+// the memo and the search's working memory, one per thread
+typedef struct {
+    size_t mask; // number of entries - 1
+    FinesseEntry *entries;
+
+    FinesseNode *nodes;
+    size_t num_nodes;
+    size_t node_capacity;
+    uint64_t *slots;      // open addressing, generation << 32 | node index
+    size_t slot_mask;
+    uint32_t generation;  // bumped per search, older slots count as empty
+
+    unsigned long long hits;
+    unsigned long long searches;
+} FinesseCache;
+
+// Functions //////////////////////////////////////////////////////////////////
+
+// `num_entries` is rounded up to a power of 2
+bool create_finesse_cache(FinesseCache *const cache, size_t const num_entries);
+void free_finesse_cache(FinesseCache *const cache);
+
+// both paths for the falling piece of `game_state` to lock covering the same
+// cells as `target`, starting with this frame. False if there is no fastest
+// path within FINESSE_MAX_FRAMES.
+bool find_finesse(
+    FinesseCache *const cache,
+    GameState const*const game_state,
+    Tetromino const*const target,
+    Finesse *const finesse
+);
+
+static inline GameInput finesse_input(
+    FinessePath const*const path,
+    size_t const frame
+) {
+    return unpack_replay_input(path->inputs[frame]);
+}
+
+#endif // FINESSE_H
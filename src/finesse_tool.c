@@ -0,0 +1,183 @@
+#include "game.h"
+#include "config.h"
+#include "finesse.h"
+#include "replay.h"
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Finesse feedback on a recorded game. Replays it and, for every piece that
+// locked, counts the rotate, left and right presses (see GameInput) from the
+// frame it appeared to the frame it locked, and compares them with the ones
+// on the fewest presses path to the same place (see finesse.h). A piece with
+// more is a finesse error. Down isn't counted: that path lets gravity bring
+// the piece down, soft dropping is a matter of speed, not finesse.
+//
+// Frames taken are compared with the fastest path, which is a lower bound
+// rather than a target: it taps the same key on consecutive frames, which a
+// keyboard can't do since the key has to come up in between.
+//
+// Placements the search can't reach on its own (under an overhang) are
+// counted as skipped, not as errors.
+//
+// usage: ./finesse [replay] [-v]
+//   the replay defaults to the last finished game, -v lists every error
+
+static char const piece_names[NUM_TETROMINO_TYPES] = "LJTOIZS";
+
+typedef struct {
+    char const* replay_path;
+    bool verbose;
+} FinesseOptions;
+
+typedef struct {
+    size_t pieces;
+    size_t skipped;
+    size_t errors;
+    unsigned long long presses;       // by the player, pieces not skipped
+    unsigned long long fewest;        // fewest possible for the same pieces
+    unsigned long long frames;
+    unsigned long long fastest;
+} FinesseStats;
+
+#define FINESSE_KEYS (unsigned char) (INPUT_ROTATE | INPUT_LEFT | INPUT_RIGHT)
+
+static inline size_t _count_presses(GameInput const*const input) {
+    size_t count = 0;
+    for (unsigned char pressed = input->pressed & FINESSE_KEYS; pressed != 0; pressed &= pressed - 1)
+        count++;
+    return count;
+}
+
+static inline size_t _count_path_presses(FinessePath const*const path) {
+    size_t count = 0;
+    for (size_t i = 0; i < path->num_frames; ++i) {
+        GameInput const input = finesse_input(path, i);
+        count += _count_presses(&input);
+    }
+    return count;
+}
+
+// the piece that started at `start` locked as `placed` in `frames` frames
+// and `presses` rotate, left and right presses
+static void _check_piece(
+    FinesseCache *const cache,
+    FinesseStats *const stats,
+    GameState const*const start,
+    Tetromino const*const placed,
+    size_t const frames,
+    size_t const presses,
+    bool const verbose
+) {
+    stats->pieces++;
+    Finesse finesse;
+    find_finesse(cache, start, placed, &finesse);
+    if (!finesse.fewest_presses.found) {
+        stats->skipped++;
+        return;
+    }
+
+    size_t const fewest = _count_path_presses(&finesse.fewest_presses);
+    size_t const fastest = finesse.fastest.found? finesse.fastest.num_frames : frames;
+    stats->presses += presses;
+    stats->fewest += fewest;
+    stats->frames += frames;
+    stats->fastest += fastest;
+    if (presses <= fewest) return;
+
+    stats->errors++;
+    if (!verbose) return;
+    printf("piece %6llu %c at frame %7llu: %2zu presses, %2zu needed, %3zu frames, %3zu fastest\n",
+        start->pieces_placed + 1,
+        piece_names[start->current_tetromino.type],
+        start->frame_number,
+        presses,
+        fewest,
+        frames,
+        fastest);
+}
+
+static void _report_stats(FinesseStats const*const stats) {
+    size_t const checked = stats->pieces - stats->skipped;
+    printf("%zu pieces, %zu checked (%zu the search can't reach skipped)\n",
+        stats->pieces, checked, stats->skipped);
+    if (checked == 0) return;
+    printf("finesse errors: %zu (%.1f%%)\n", stats->errors, 100.0 * stats->errors / checked);
+    printf("presses per piece: %.2f, fewest %.2f (%llu extra)\n",
+        (double)stats->presses / checked,
+        (double)stats->fewest / checked,
+        stats->presses - stats->fewest);
+    printf("frames per piece: %.1f, fastest %.1f\n",
+        (double)stats->frames / checked,
+        (double)stats->fastest / checked);
+}
+
+static bool _parse_options(int const argc, char **argv, FinesseOptions *const options) {
+    *options = (FinesseOptions){ .replay_path = replay_path, .verbose = false };
+    bool has_path = false;
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "-v") == 0) options->verbose = true;
+        else if (argv[i][0] == '-' || has_path) return false;
+        else {
+            options->replay_path = argv[i];
+            has_path = true;
+        }
+    }
+    return true;
+}
+
+int main(int argc, char **argv) {
+    FinesseOptions options;
+    if (!_parse_options(argc, argv, &options)) {
+        fprintf(stderr, "usage: %s [replay] [-v]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    Replay replay = { .inputs = NULL };
+    if (!read_replay(&replay, options.replay_path)) {
+        fprintf(stderr, "Error: could not read replay %s.\n", options.replay_path);
+        return EXIT_FAILURE;
+    }
+    static FinesseCache cache;
+    if (!create_finesse_cache(&cache, FINESSE_CACHE_ENTRIES)) {
+        free_replay(&replay);
+        return EXIT_FAILURE;
+    }
+
+    FinesseStats stats = { .pieces = 0 };
+    GameState game_state = init_gamestate_seeded(replay.level, replay.seed);
+    GameState start = game_state;
+    size_t frames = 0;
+    size_t presses = 0;
+    size_t desynced_by = 0; // the first frame found off, 0 while none is
+    for (size_t i = 0; i < replay.num_frames; ++i) {
+        GameInput const input = unpack_replay_input(replay.inputs[i]);
+        unsigned long long const pieces_placed = game_state.pieces_placed;
+        bool const is_game_over = next_gamestate(&game_state, &input);
+        if (desynced_by == 0 && !matches_replay(&replay, i + 1, &game_state))
+            desynced_by = i + 1;
+        frames++;
+        presses += _count_presses(&input);
+        if (game_state.pieces_placed != pieces_placed) {
+            _check_piece(&cache, &stats, &start, &game_state.last_placed, frames, presses, options.verbose);
+            start = game_state;
+            frames = 0;
+            presses = 0;
+        }
+        if (is_game_over) break;
+    }
+
+    bool const desynced = desynced_by > 0
+        || (replay.final_hash != 0 && hash_gamestate(&game_state) != replay.final_hash);
+    if (desynced_by > 0) fprintf(stderr,
+        "Error: %s desynced by frame %zu, the numbers from there are for another game.\n",
+        options.replay_path, desynced_by);
+    else if (desynced) fprintf(stderr, "Error: %s desynced, the numbers are for another game.\n", options.replay_path);
+    _report_stats(&stats);
+    printf("%llu searches, %llu cache hits\n", cache.searches, cache.hits);
+
+    free_finesse_cache(&cache);
+    free_replay(&replay);
+    return desynced? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,272 @@
+#include "fixture.h"
+#include "game.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define FIXTURE_INIT_CAPACITY (size_t) 1024
+
+static char const cell_chars[NUM_TETROMINO_TYPES + 1] = "LJTOIZS.";
+static char const base64_chars[64]
+    = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789-_";
+
+// Characters /////////////////////////////////////////////////////////////////
+
+// the TetrominoType of a cell character plus one, 0 for anything else
+static unsigned char const cell_values[256] = {
+    ['L'] = 1 + L_PIECE, ['J'] = 1 + J_PIECE, ['T'] = 1 + T_PIECE,
+    ['O'] = 1 + O_PIECE, ['I'] = 1 + I_PIECE, ['Z'] = 1 + Z_PIECE,
+    ['S'] = 1 + S_PIECE, ['.'] = 1 + NO_TETROMINO,
+    ['X'] = 1 + O_PIECE, // garbage_tetromino
+};
+
+// base64url digit values, -1 for anything else
+static signed char const base64_values[128] = {
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+    -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 62, -1, -1,
+    52, 53, 54, 55, 56, 57, 58, 59, 60, 61, -1, -1, -1, -1, -1, -1,
+    -1,  0,  1,  2,  3,  4,  5,  6,  7,  8,  9, 10, 11, 12, 13, 14,
+    15, 16, 17, 18, 19, 20, 21, 22, 23, 24, 25, -1, -1, -1, -1, 63,
+    -1, 26, 27, 28, 29, 30, 31, 32, 33, 34, 35, 36, 37, 38, 39, 40,
+    41, 42, 43, 44, 45, 46, 47, 48, 49, 50, 51, -1, -1, -1, -1, -1,
+};
+
+static inline int _base64_value(char const c) {
+    return (unsigned char)c < 128? base64_values[(unsigned char)c] : -1;
+}
+
+static inline bool _is_end(char const c) {
+    return c == '\0' || c == '\n' || c == '\r';
+}
+
+// Text ///////////////////////////////////////////////////////////////////////
+static char const* _parse_text(Fixture *const fixture, char const* text) {
+    TetrominoType rows[ROWS][COLS];
+    size_t num_rows = 0;
+    for (;;) {
+        if (num_rows == ROWS) return NULL;
+        for (size_t x = 0; x < COLS; ++x) {
+            unsigned char const value = cell_values[(unsigned char)text[x]];
+            if (value == 0) return NULL;
+            rows[num_rows][x] = value - 1;
+        }
+        num_rows++;
+        text += COLS;
+        if (*text != '/') break;
+        text++;
+    }
+
+    size_t const first_row = ROWS - num_rows;
+    for (size_t y = 0; y < first_row; ++y) {
+        for (size_t x = 0; x < COLS; ++x) fixture->board[y][x] = NO_TETROMINO;
+    }
+    memcpy(fixture->board[first_row], rows, num_rows * sizeof(rows[0]));
+
+    fixture->queue_length = 0;
+    if (_is_end(*text)) return text;
+    if (*text++ != ' ') return NULL;
+    for (; !_is_end(*text) && *text != ' '; ++text) {
+        // pieces only, no '.' or 'X'
+        unsigned char const value = cell_values[(unsigned char)*text];
+        if (value == 0 || cell_chars[value - 1] != *text || value - 1 == NO_TETROMINO
+        ||  fixture->queue_length == FIXTURE_MAX_QUEUE
+        ) return NULL;
+        fixture->queue[fixture->queue_length++] = value - 1;
+    }
+    return text;
+}
+
+static inline size_t _first_filled_row(Fixture const*const fixture) {
+    for (size_t y = 0; y < ROWS; ++y) {
+        for (size_t x = 0; x < COLS; ++x) {
+            if (fixture->board[y][x] != NO_TETROMINO) return y;
+        }
+    }
+    return ROWS - 1; // the empty board still gets a row
+}
+
+// Packed /////////////////////////////////////////////////////////////////////
+typedef struct {
+    unsigned char *bytes;
+    size_t bit;
+} FixtureBits;
+
+// 3 bits at a time, least significant first. A value may straddle two
+// bytes, so the buffers have one to spare at the end.
+static inline void _put_bits(FixtureBits *const bits, unsigned const value) {
+    unsigned char *const at = &bits->bytes[bits->bit / 8];
+    unsigned const shifted = value << (bits->bit % 8);
+    at[0] |= shifted;
+    at[1] |= shifted >> 8;
+    bits->bit += 3;
+}
+
+static inline unsigned _get_bits(FixtureBits *const bits) {
+    unsigned char const*const at = &bits->bytes[bits->bit / 8];
+    unsigned const value = (at[0] | at[1] << 8) >> (bits->bit % 8) & 7;
+    bits->bit += 3;
+    return value;
+}
+
+static char const* _parse_packed(Fixture *const fixture, char const* text) {
+    unsigned char bytes[(FIXTURE_PACKED_SIZE * 3) / 4 + 1];
+    size_t num_bytes = 0;
+    uint32_t group = 0;
+    size_t num_chars = 0;
+    for (; !_is_end(*text) && *text != ' '; ++text) {
+        int const value = _base64_value(*text);
+        if (value < 0 || num_bytes + 4 > sizeof(bytes)) return NULL;
+        group = group << 6 | value;
+        if (++num_chars % 4 != 0) continue;
+        bytes[num_bytes++] = group >> 16;
+        bytes[num_bytes++] = group >> 8;
+        bytes[num_bytes++] = group;
+        group = 0;
+    }
+    // unpadded tail, 2 or 3 characters for 1 or 2 bytes
+    size_t const tail = num_chars % 4;
+    if (tail == 1) return NULL;
+    if (tail >= 2) bytes[num_bytes++] = group >> (tail == 2? 4 : 10);
+    if (tail == 3) bytes[num_bytes++] = group >> 2;
+
+    if (num_bytes < 2 || bytes[0] == 0 || bytes[0] > ROWS || bytes[1] > FIXTURE_MAX_QUEUE)
+        return NULL;
+    size_t const num_rows = bytes[0];
+    size_t const num_bits = 3 * (num_rows * COLS + bytes[1]);
+    if (num_bytes != 2 + (num_bits + 7) / 8) return NULL;
+    bytes[num_bytes] = 0;
+
+    // decoded into a local first, stores to the board could otherwise alias
+    // the bytes and make every read go back to memory
+    FixtureBits bits = { .bytes = bytes + 2, .bit = 0 };
+    TetrominoType cells[ROWS * COLS + FIXTURE_MAX_QUEUE];
+    size_t const num_cells = num_rows * COLS + bytes[1];
+    for (size_t i = 0; i < num_cells; ++i) cells[i] = _get_bits(&bits);
+
+    size_t const first_row = ROWS - num_rows;
+    for (size_t y = 0; y < first_row; ++y) {
+        for (size_t x = 0; x < COLS; ++x) fixture->board[y][x] = NO_TETROMINO;
+    }
+    memcpy(fixture->board[first_row], cells, num_rows * COLS * sizeof(TetrominoType));
+    fixture->queue_length = bytes[1];
+    for (size_t i = 0; i < fixture->queue_length; ++i) {
+        fixture->queue[i] = cells[num_rows * COLS + i];
+        if (fixture->queue[i] >= NUM_TETROMINO_TYPES) return NULL;
+    }
+    return text;
+}
+
+// Exposed ////////////////////////////////////////////////////////////////////
+extern void init_fixture(Fixture *const fixture) {
+    for (size_t y = 0; y < ROWS; ++y) {
+        for (size_t x = 0; x < COLS; ++x) fixture->board[y][x] = NO_TETROMINO;
+    }
+    fixture->queue_length = 0;
+}
+
+extern char const* parse_fixture(Fixture *const fixture, char const* text) {
+    return *text == FIXTURE_PACKED_PREFIX
+        ? _parse_packed(fixture, text + 1)
+        : _parse_text(fixture, text);
+}
+
+extern size_t format_fixture(Fixture const*const fixture, char *const out) {
+    char *at = out;
+    for (size_t y = _first_filled_row(fixture); y < ROWS; ++y) {
+        for (size_t x = 0; x < COLS; ++x) *at++ = cell_chars[fixture->board[y][x]];
+        *at++ = '/';
+    }
+    at--; // the last '/'
+
+    if (fixture->queue_length > 0) *at++ = ' ';
+    for (size_t i = 0; i < fixture->queue_length; ++i)
+        *at++ = cell_chars[fixture->queue[i]];
+    *at = '\0';
+    return at - out;
+}
+
+extern size_t pack_fixture(Fixture const*const fixture, char *const out) {
+    size_t const first_row = _first_filled_row(fixture);
+    unsigned char bytes[(FIXTURE_PACKED_SIZE * 3) / 4 + 1] = { 0 };
+    bytes[0] = ROWS - first_row;
+    bytes[1] = fixture->queue_length;
+    FixtureBits bits = { .bytes = bytes + 2, .bit = 0 };
+    for (size_t y = first_row; y < ROWS; ++y) {
+        for (size_t x = 0; x < COLS; ++x) _put_bits(&bits, fixture->board[y][x]);
+    }
+    for (size_t i = 0; i < fixture->queue_length; ++i) _put_bits(&bits, fixture->queue[i]);
+    size_t const num_bytes = 2 + (bits.bit + 7) / 8;
+
+    char *at = out;
+    *at++ = FIXTURE_PACKED_PREFIX;
+    for (size_t i = 0; i < num_bytes; i += 3) {
+        uint32_t const group = (uint32_t)bytes[i] << 16
+            | (i + 1 < num_bytes? (uint32_t)bytes[i + 1] << 8 : 0)
+            | (i + 2 < num_bytes? bytes[i + 2] : 0);
+        size_t const num_chars = num_bytes - i >= 3? 4 : num_bytes - i + 1;
+        for (size_t j = 0; j < num_chars; ++j) *at++ = base64_chars[group >> (18 - 6 * j) & 63];
+    }
+    *at = '\0';
+    return at - out;
+}
+
+extern bool read_fixtures(FixtureSet *const set, char const*const path) {
+    FILE *const file = fopen(path, "r");
+    if (file == NULL) {
+        fprintf(stderr, "Error: could not open fixtures %s.\n", path);
+        return false;
+    }
+
+    char line[2 * FIXTURE_TEXT_SIZE];
+    size_t line_number = 0;
+    bool ok = true;
+    while (ok && fgets(line, sizeof(line), file) != NULL) {
+        line_number++;
+        if (_is_end(line[0]) || line[0] == '#') continue;
+
+        if (set->count == set->capacity) {
+            size_t const capacity = set->capacity > 0? 2 * set->capacity : FIXTURE_INIT_CAPACITY;
+            Fixture *const fixtures = realloc(set->fixtures, capacity * sizeof(Fixture));
+            if (fixtures == NULL) {
+                fprintf(stderr, "Error: could not allocate %zu fixtures.\n", capacity);
+                ok = false;
+                break;
+            }
+            set->fixtures = fixtures;
+            set->capacity = capacity;
+        }
+
+        char const*const end = parse_fixture(&set->fixtures[set->count], line);
+        ok = end != NULL && _is_end(*end);
+        if (ok) set->count++;
+        else fprintf(stderr, "Error: line %zu of %s is not a fixture.\n", line_number, path);
+    }
+    fclose(file);
+    return ok;
+}
+
+extern void free_fixtures(FixtureSet *const set) {
+    free(set->fixtures);
+    *set = (FixtureSet){ .fixtures = NULL };
+}
+
+extern bool init_gamestate_fixture(
+    GameState *const game_state,
+    Fixture const*const fixture,
+    size_t const level,
+    unsigned long long const seed
+) {
+    *game_state = init_gamestate_seeded(level, seed);
+    memcpy(game_state->board, fixture->board, sizeof(game_state->board));
+    bool const fits = spawn_tetromino(
+        game_state,
+        fixture->queue_length > 0? fixture->queue[0] : game_state->current_tetromino.type
+    );
+    if (fixture->queue_length > 1) game_state->next_tetromino = fixture->queue[1];
+    rehash_gamestate(game_state);
+    return fits;
+}
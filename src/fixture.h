@@ -0,0 +1,76 @@
+#ifndef FIXTURE_H
+#define FIXTURE_H
+
+#include "game.h"
+#include <stdbool.h>
+#include <stddef.h>
+
+// Board fixtures: a board and a piece queue in one short line, for
+// benchmarks, bot tests and puzzles that want to start from a given
+// position instead of playing their way to it.
+//
+// Text form, rows from the top down to the floor joined by '/', each one
+// character per cell ('.' empty, LJTOIZS for a piece's colour, X for
+// garbage, which is O coloured and written back as O), then optionally a
+// space and the queue:
+//
+//     .....T..../XXXXTTX.XX/XXXXXTXX.X IOJ
+//
+// Rows above the first written one are empty, the empty board is a single
+// row of dots. Packed form, '@' then unpadded base64url of
+//     u8 num_rows | u8 queue_length | 3 bits per cell (top row first),
+//     3 bits per queued piece, zero padded to a byte
+// which keeps the colours too and is about half the length on tall boards.
+//
+// Fixture files hold one per line, blank lines and lines starting with '#'
+// are skipped.
+
+// Constants //////////////////////////////////////////////////////////////////
+#define FIXTURE_MAX_QUEUE     (size_t) 32
+#define FIXTURE_PACKED_PREFIX '@'
+#define FIXTURE_TEXT_SIZE     (ROWS * (COLS + 1) + FIXTURE_MAX_QUEUE + 2)
+#define FIXTURE_PACKED_SIZE   (2 + (2 + (3 * (ROWS * COLS + FIXTURE_MAX_QUEUE) + 7) / 8 + 2) / 3 * 4)
+
+// Structs ////////////////////////////////////////////////////////////////////
+typedef struct {
+    TetrominoType board[ROWS][COLS];
+    size_t queue_length;
+    TetrominoType queue[FIXTURE_MAX_QUEUE]; // the falling piece first
+} Fixture;
+
+typedef struct {
+    Fixture *fixtures;
+    size_t count;
+    size_t capacity;
+} FixtureSet;
+
+// Functions //////////////////////////////////////////////////////////////////
+
+// the empty board and no queue
+void init_fixture(Fixture *const fixture);
+
+// either form, up to the end of the string or the line. Returns where it
+// stopped, NULL if it isn't a fixture.
+char const* parse_fixture(Fixture *const fixture, char const* text);
+
+// both write a terminated string and return its length, `out` must have
+// room for FIXTURE_TEXT_SIZE or FIXTURE_PACKED_SIZE characters
+size_t format_fixture(Fixture const*const fixture, char *const out);
+size_t pack_fixture(Fixture const*const fixture, char *const out);
+
+// appends every fixture in the file, false (after saying which line) if one
+// doesn't parse
+bool read_fixtures(FixtureSet *const set, char const*const path);
+void free_fixtures(FixtureSet *const set);
+
+// a seeded game on the fixture's board, with its first two queued pieces as
+// the falling and next piece (the randomizer deals the rest). False if the
+// first piece has no room to spawn.
+bool init_gamestate_fixture(
+    GameState *const game_state,
+    Fixture const*const fixture,
+    size_t const level,
+    unsigned long long const seed
+);
+
+#endif // FIXTURE_H
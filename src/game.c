@@ -1,11 +1,14 @@
 #include "game.h"
 #include "config.h"
+#include "counters.h"
 #include <raylib.h>
+#include <stdatomic.h>
 #include <stdbool.h>
 #include <stddef.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
+#include <time.h>
 
 // Misc Calculations ////////////////////////////////////////////////////////// 
 
@@ -28,11 +31,75 @@ static inline size_t _calc_score(size_t const level, size_t const row_num) {
     static short const score_multipliers[5] = {0, 40, 100, 300, 1200};
     return (level + 1) * score_multipliers[row_num];
 }
+
+// calculates how many garbage lines a clear sends to the opponent in versus
+static inline size_t _calc_garbage(size_t const row_num) {
+    static unsigned char const garbage_lines[5] = {0, 0, 1, 2, 4};
+    return garbage_lines[row_num];
+}
  
 static inline size_t min(size_t const a, size_t const b) {
     return a < b? a : b;
 } 
 
+// calculates how far a tetromino falls each frame in GRAVITY_ONE fixed point.
+// Up to level 40 this is one row every `_calc_wait` frames, after that it
+// gains a row per frame each level until it reaches 20G.
+static inline size_t _calc_gravity(size_t const level) {
+    if (level < 40) {
+        size_t const wait = _calc_wait(level);
+        return (GRAVITY_ONE + wait - 1) / wait;
+    }
+    return min((level - 39) * GRAVITY_ONE, MAX_GRAVITY);
+}
+
+// Counters ///////////////////////////////////////////////////////////////////
+// (see counters.h)
+#ifdef GAME_COUNTERS
+
+typedef struct {
+    _Atomic size_t counts[NUM_GAME_COUNTERS];
+} CounterBlock;
+
+static CounterBlock *_Atomic _counter_blocks[MAX_COUNTER_THREADS];
+static _Atomic size_t _num_counter_blocks;
+
+// threads past MAX_COUNTER_THREADS all share this one, racing on it only
+// loses counts.
+static CounterBlock _overflow_counters;
+static _Thread_local CounterBlock *_counters = &_overflow_counters;
+static _Thread_local bool _counters_registered = false;
+
+static void _register_counters(void) {
+    _counters_registered = true;
+    size_t const index = atomic_fetch_add(&_num_counter_blocks, 1);
+    if (index >= MAX_COUNTER_THREADS) return;
+
+    CounterBlock *const block = calloc(1, sizeof(CounterBlock));
+    if (block == NULL) return;
+    atomic_store(&_counter_blocks[index], block);
+    _counters = block;
+}
+
+// only the owning thread writes a block, so a relaxed load and store is
+// enough and compiles to a plain increment. A thread registers on its first
+// count, whichever entry point it came through (perft, the searches and the
+// tools move and place pieces without `next_gamestate`).
+static inline void _count(GameCounter const counter) {
+    if (!_counters_registered) _register_counters();
+    _Atomic size_t *const count = &_counters->counts[counter];
+    atomic_store_explicit(
+        count,
+        atomic_load_explicit(count, memory_order_relaxed) + 1,
+        memory_order_relaxed
+    );
+}
+
+#define COUNT(counter) _count(counter)
+#else
+#define COUNT(counter) ((void)0)
+#endif // GAME_COUNTERS
+
 // Tetromino Initialisation ///////////////////////////////////////////////////
 static char const tetromino_templates[NUM_TETROMINO_TYPES][BLOCKS_SIZE] = {
     "XX  "
@@ -74,8 +141,74 @@ static char const tetromino_templates[NUM_TETROMINO_TYPES][BLOCKS_SIZE] = {
 static unsigned char const tetromino_rotate_sizes[NUM_TETROMINO_TYPES]
     = {3, 3, 3, 2, 4, 3, 3};
 
-static inline TetrominoType _random_tetromino_type(void) {
-    return GetRandomValue(first_random_tetromino, last_random_tetromino);
+// xorshift64* kept inside the GameState, so a game is fully determined by its
+// seed and inputs. That is what makes replays and headless re-simulation
+// possible, and keeps separate games on separate threads independent.
+static inline unsigned long long _next_random(GameState *const game_state) {
+    unsigned long long x = game_state->random_state;
+    x ^= x >> 12;
+    x ^= x << 25;
+    x ^= x >> 27;
+    game_state->random_state = x;
+    return x * 0x2545F4914F6CDD1DULL;
+}
+
+static inline TetrominoType _random_tetromino_type(GameState *const game_state) {
+    size_t const num_random_types
+        = last_random_tetromino - first_random_tetromino + 1;
+    return first_random_tetromino
+         + (_next_random(game_state) >> 32) % num_random_types;
+}
+
+// Zobrist Hashing ////////////////////////////////////////////////////////////
+
+// Zobrist keys are usually a table of random numbers. Mixing the (cell, type)
+// or (piece, rotation, x, y) into a key instead gives keys that are just as
+// independent, with no table to fill in, so every copy of the library and
+// every thread agrees on them.
+static inline unsigned long long _mix_zobrist_key(unsigned long long x) {
+    // splitmix64 finaliser
+    x += 0x9E3779B97F4A7C15ULL;
+    x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+    return x ^ (x >> 31);
+}
+
+static inline unsigned long long _cell_zobrist_key(
+    size_t const x,
+    size_t const y,
+    TetrominoType const type
+) {
+    return _mix_zobrist_key(
+        (unsigned long long)type
+        | (unsigned long long)x << 8
+        | (unsigned long long)y << 16
+    );
+}
+
+// position data follows from type and rotation so it doesn't need hashing.
+// x and y can briefly be "-1" so only their low bits are used.
+static inline unsigned long long _tetromino_zobrist_key(
+    Tetromino const*const tetromino
+) {
+    return _mix_zobrist_key(
+        1ULL << 63 // keeps piece keys apart from cell keys
+        | (unsigned long long)tetromino->type
+        | (unsigned long long)tetromino->rotation << 8
+        | (unsigned long long)(tetromino->x & 0xFFFF) << 16
+        | (unsigned long long)(tetromino->y & 0xFFFF) << 32
+    );
+}
+
+static unsigned long long _hash_board(TetrominoType const board[ROWS][COLS]) {
+    unsigned long long hash = 0;
+    for (size_t y = 0; y < ROWS; ++y) {
+        for (size_t x = 0; x < COLS; ++x) {
+            if (board[y][x] != NO_TETROMINO)
+                hash ^= _cell_zobrist_key(x, y, board[y][x]);
+        }
+    }
+    return hash;
 }
 
 // translates the template string into relative position data when creating a
@@ -107,6 +240,7 @@ static inline Tetromino _new_tetromino(TetrominoType type) {
     };
 
     _init_tetromino_block_positions(&tetromino); 
+    tetromino.hash = _tetromino_zobrist_key(&tetromino);
     return tetromino;
 }
 
@@ -243,7 +377,10 @@ static void _rotate_tetromino(
         tetromino->y,
         temp_positions,
         board
-    )) return; 
+    )) {
+        COUNT(COUNTER_REJECTED_ROTATIONS);
+        return; 
+    }
  
     // Copy the simulated positions as tetromino positions
     size_t const coordinate_size = 2UL * sizeof(size_t);
@@ -253,6 +390,7 @@ static void _rotate_tetromino(
     // Update rotation num and wrap to 0 if it becomes 4
     tetromino->rotation++;
     tetromino->rotation %= 4;
+    tetromino->hash = _tetromino_zobrist_key(tetromino);
 }
 
 static void _move_tetromino(
@@ -279,6 +417,7 @@ static void _move_tetromino(
     
     tetromino->x = new_x;
     tetromino->y = new_y;
+    tetromino->hash = _tetromino_zobrist_key(tetromino);
 }
 
 // Event Functions //////////////////////////////////////////////////////////// 
@@ -288,6 +427,7 @@ static inline bool _has_tetromino_collided(
     size_t const positions[NUM_TETROMINO_BLOCKS][NUM_AXIS],
     TetrominoType const board[ROWS][COLS] 
 ) { 
+    COUNT(COUNTER_COLLISION_CHECKS);
     for (size_t i = 0; i < NUM_TETROMINO_BLOCKS; ++i) {
         size_t const block_x = positions[i][X_AXIS] + x;
         size_t const block_y = positions[i][Y_AXIS] + y;
@@ -297,21 +437,37 @@ static inline bool _has_tetromino_collided(
     return false;
 }
 
+// how many rows the tetromino can fall, up to `max_rows`. Each block only
+// looks down its own column, so dropping 20 rows is one pass rather than 20
+// separate `_move_tetromino` collision checks.
+static inline size_t _drop_distance(
+    size_t const x,
+    size_t const y,
+    size_t const positions[NUM_TETROMINO_BLOCKS][NUM_AXIS],
+    TetrominoType const board[ROWS][COLS],
+    size_t const max_rows
+) {
+    size_t distance = max_rows;
+    for (size_t i = 0; i < NUM_TETROMINO_BLOCKS && distance > 0; ++i) {
+        size_t const block_x = positions[i][X_AXIS] + x;
+        size_t const block_y = positions[i][Y_AXIS] + y;
+        size_t free_rows = 0;
+        while (free_rows < distance
+        &&     block_y + free_rows + 1 < ROWS
+        &&     board[block_y + free_rows + 1][block_x] == NO_TETROMINO
+        ) free_rows++;
+        distance = free_rows;
+    }
+    return distance;
+}
+
 static inline bool _has_tetromino_landed(
     size_t const x,
     size_t const y,
     size_t const positions[NUM_TETROMINO_BLOCKS][NUM_AXIS],
     TetrominoType const board[ROWS][COLS] 
 ) {
-    if (y + 1 < ROWS) {
-        for (size_t i = 0; i < NUM_TETROMINO_BLOCKS; ++i) {
-            size_t const block_x = positions[i][X_AXIS] + x;
-            size_t const block_y = positions[i][Y_AXIS] + y + 1;
-            if (board[block_y][block_x] != NO_TETROMINO) return true;
-        }
-        return false;
-    }
-    return true;
+    return _drop_distance(x, y, positions, board, 1) == 0;
 }
  
 static inline bool _is_completed_row(TetrominoType const row[COLS]) {
@@ -322,50 +478,77 @@ static inline bool _is_completed_row(TetrominoType const row[COLS]) {
 }
 
 // Tetromino movement /////////////////////////////////////////////////////////
-static void _handle_user_input_movement(GameState *const game_state) {
-    if (IsKeyPressed(KEY_W)
-    || IsGamepadButtonPressed(GAME_PAD, GAMEPAD_BUTTON_RIGHT_FACE_DOWN)
-    ) _rotate_tetromino(
-        &game_state->current_tetromino,
-        game_state->board
-    );
 
-    else if (IsKeyPressed(KEY_A)
-         || IsGamepadButtonPressed(GAME_PAD, GAMEPAD_BUTTON_LEFT_FACE_LEFT)
-    ) _move_tetromino( 
-        MOVE_LEFT,
-        &game_state->current_tetromino,
-        game_state->board
-    );
+// for the latency probe: if the piece moved since `before_hash`, this frame
+// is the latest move of that kind and `input_ns` is when it was asked for
+static inline void _note_move(
+    GameState *const game_state,
+    LatencyInput const kind,
+    unsigned long long const before_hash,
+    unsigned long long const input_ns
+) {
+    if (game_state->current_tetromino.hash == before_hash) return;
+    game_state->move_frame[kind] = game_state->frame_number;
+    game_state->move_input_ns[kind] = input_ns;
+}
 
-    else if (IsKeyPressed(KEY_D)
-         || IsGamepadButtonPressed(GAME_PAD, GAMEPAD_BUTTON_LEFT_FACE_RIGHT)
-    ) _move_tetromino( 
-        MOVE_RIGHT,
-        &game_state->current_tetromino,
-        game_state->board
-    );
+static void _handle_user_input_movement(
+    GameState *const game_state,
+    GameInput const*const input
+) {
+    unsigned long long const pressed_hash = game_state->current_tetromino.hash;
+    LatencyInput pressed_kind = NUM_LATENCY_INPUTS;
+
+    if (input->pressed & INPUT_ROTATE) {
+        pressed_kind = LATENCY_ROTATE;
+        _rotate_tetromino(
+            &game_state->current_tetromino,
+            game_state->board
+        );
+    }
+
+    else if (input->pressed & INPUT_LEFT) {
+        pressed_kind = LATENCY_SHIFT;
+        _move_tetromino( 
+            MOVE_LEFT,
+            &game_state->current_tetromino,
+            game_state->board
+        );
+    }
+
+    else if (input->pressed & INPUT_RIGHT) {
+        pressed_kind = LATENCY_SHIFT;
+        _move_tetromino( 
+            MOVE_RIGHT,
+            &game_state->current_tetromino,
+            game_state->board
+        );
+    }
     
 
-    else if (IsKeyPressed(KEY_S)
-         || IsGamepadButtonPressed(GAME_PAD, GAMEPAD_BUTTON_LEFT_FACE_DOWN)
-    ) _move_tetromino( 
-        MOVE_DOWN,
-        &game_state->current_tetromino,
-        game_state->board
-    );   
+    else if (input->pressed & INPUT_DOWN) {
+        pressed_kind = LATENCY_SOFT_DROP;
+        _move_tetromino( 
+            MOVE_DOWN,
+            &game_state->current_tetromino,
+            game_state->board
+        );   
+    }
+
+    if (pressed_kind != NUM_LATENCY_INPUTS)
+        _note_move(game_state, pressed_kind, pressed_hash, input->pressed_at);
 
     // Delayed autoshift or DAS
     // after an initial press, wait and then start moving repeatedly much
     // faster. This is handled by a frame counter `delayed_autoshift_frames`
-    if (IsKeyDown(KEY_A)
-    || IsGamepadButtonDown(GAME_PAD, GAMEPAD_BUTTON_LEFT_FACE_LEFT)
-    ) {
+    unsigned long long const held_hash = game_state->current_tetromino.hash;
+    if (input->down & INPUT_LEFT) {
         game_state->delayed_autoshift_frames++;
         game_state->delayed_autoshift_pressed_down = false;
         if (game_state->delayed_autoshift_frames > AUTOSHIFT_FRAMES_DELAY
         &&  game_state->frame_number % AUTOSHIFT_FRAMESKIP == 0
         ) {
+            COUNT(COUNTER_DAS_REPEATS);
             _move_tetromino( 
                 MOVE_LEFT,
                 &game_state->current_tetromino,
@@ -374,14 +557,13 @@ static void _handle_user_input_movement(GameState *const game_state) {
         
         }
     }
-    else if (IsKeyDown(KEY_D)
-          || IsGamepadButtonDown(GAME_PAD, GAMEPAD_BUTTON_LEFT_FACE_RIGHT)
-    ) {
+    else if (input->down & INPUT_RIGHT) {
         game_state->delayed_autoshift_frames++;
         game_state->delayed_autoshift_pressed_down = false;
         if (game_state->delayed_autoshift_frames > AUTOSHIFT_FRAMES_DELAY
         &&  game_state->frame_number % AUTOSHIFT_FRAMESKIP == 0
         ) {
+            COUNT(COUNTER_DAS_REPEATS);
             _move_tetromino( 
                 MOVE_RIGHT,
                 &game_state->current_tetromino,
@@ -389,14 +571,13 @@ static void _handle_user_input_movement(GameState *const game_state) {
             ); 
         }
     }
-    else if (IsKeyDown(KEY_S)
-         || IsGamepadButtonDown(GAME_PAD, GAMEPAD_BUTTON_LEFT_FACE_DOWN)
-    ) {
+    else if (input->down & INPUT_DOWN) {
         game_state->delayed_autoshift_frames++;
         if (game_state->delayed_autoshift_frames > AUTOSHIFT_FRAMES_DELAY
         &&  game_state->frame_number % AUTOSHIFT_FRAMESKIP == 0
         ) {
             game_state->delayed_autoshift_pressed_down = true;
+            COUNT(COUNTER_DAS_REPEATS);
             _move_tetromino( 
                 MOVE_DOWN,
                 &game_state->current_tetromino,
@@ -408,11 +589,16 @@ static void _handle_user_input_movement(GameState *const game_state) {
         game_state->delayed_autoshift_frames = 0;
         game_state->delayed_autoshift_pressed_down = false;
     } 
+    _note_move(game_state, LATENCY_DAS_REPEAT, held_hash, input->down_at);
 }
 
 // if the `_has_tetromino_landed` event has occured, copy the tetromino pieces
 // onto the board.
 static void _deposit_current_tetromino(GameState *const game_state) {
+    COUNT(COUNTER_DEPOSITS);
+    game_state->pieces_placed++;
+    game_state->last_placed = game_state->current_tetromino;
+    game_state->num_cleared_rows = 0;
     Tetromino const*const tetromino = &game_state->current_tetromino;
     size_t const x_offset = tetromino->x;
     size_t const y_offset = tetromino->y;
@@ -421,29 +607,41 @@ static void _deposit_current_tetromino(GameState *const game_state) {
         size_t const x_absolute = tetromino->positions[i][X_AXIS] + x_offset;
         size_t const y_absolute = tetromino->positions[i][Y_AXIS] + y_offset;
         game_state->board[y_absolute][x_absolute] = tetromino->type;
+        game_state->board_hash
+            ^= _cell_zobrist_key(x_absolute, y_absolute, tetromino->type);
     }
 
     game_state->current_tetromino = _new_tetromino(game_state->next_tetromino);
-    game_state->next_tetromino = _random_tetromino_type();
+    game_state->next_tetromino = _random_tetromino_type(game_state);
 }
 
-// after a certain number of frames, the piece should automatically move down.
-static void _handle_tetromino_automatic_movement(GameState *const game_state) {
- 
+// gravity builds up every frame and the piece automatically moves down by
+// however many whole rows it has built up. Returns true when the piece locks
+// this frame, the caller deposits it.
+static bool _handle_tetromino_automatic_movement(GameState *const game_state) {
+    game_state->gravity_accumulator += game_state->gravity;
+    size_t const rows = game_state->gravity_accumulator / GRAVITY_ONE;
+    game_state->gravity_accumulator %= GRAVITY_ONE;
+
     // is this frame one where it moves down?
-    if (game_state->frame_number % game_state->wait_time != 0) return; 
+    if (rows == 0) return false;
 
     // if the player is holding down (DAS) then we dont need to automatically
     // make the piece move down.
-    if (!game_state->delayed_autoshift_pressed_down) _move_tetromino( 
-        MOVE_DOWN,
-        &game_state->current_tetromino,
-        game_state->board
-    );
+    Tetromino *const tetromino = &game_state->current_tetromino;
+    if (!game_state->delayed_autoshift_pressed_down) {
+        tetromino->y += _drop_distance(
+            tetromino->x,
+            tetromino->y,
+            tetromino->positions,
+            game_state->board,
+            rows
+        );
+        tetromino->hash = _tetromino_zobrist_key(tetromino);
+    }
 
     // in order to give an extra frame to the player deposite_on_next_frame
     // is used.
-    Tetromino const*const tetromino = &game_state->current_tetromino;
     if (_has_tetromino_landed(
         tetromino->x,
         tetromino->y,
@@ -452,7 +650,7 @@ static void _handle_tetromino_automatic_movement(GameState *const game_state) {
     &&  !(game_state->deposite_on_next_frame)
     ) {
         game_state->deposite_on_next_frame = true;
-        return;
+        return false;
     }
     
     if (game_state->deposite_on_next_frame) {
@@ -460,13 +658,14 @@ static void _handle_tetromino_automatic_movement(GameState *const game_state) {
 
         // Check to see if the piece is still over something.
         // If it has then deposite the piece.
-        if (_has_tetromino_landed(
+        return _has_tetromino_landed(
             tetromino->x,
             tetromino->y,
             tetromino->positions,
             game_state->board
-        )) _deposit_current_tetromino(game_state);
+        );
     }
+    return false;
 }
 
 // NOTE: This isn't the sort of function that should be run every frame due to computational complexity, so always check if its necessary.
@@ -487,7 +686,7 @@ static inline void _remove_completed_rows(
     }
 }  
 
-static inline void _handle_completed_rows(GameState *const game_state) { 
+static inline size_t _handle_completed_rows(GameState *const game_state) { 
     size_t num_completed_rows = 0;
     size_t completed_rows[MAX_COMPLETED_ROWS] = { 0, 0, 0, 0 };
     for (size_t y = 0; y < ROWS; ++y) {
@@ -497,15 +696,69 @@ static inline void _handle_completed_rows(GameState *const game_state) {
         }
     }
     
-    if (num_completed_rows > 0) _remove_completed_rows(
-        game_state->board,
-        num_completed_rows,
-        completed_rows
-    );
+    // every cell above a cleared row moves, so the hash is rebuilt rather
+    // than updated cell by cell.
+    if (num_completed_rows > 0) {
+        COUNT(COUNTER_CLEARS_1 + num_completed_rows - 1);
+        game_state->num_cleared_rows = num_completed_rows;
+        for (size_t i = 0; i < num_completed_rows; ++i) {
+            game_state->cleared_rows[i] = completed_rows[i];
+            memcpy(
+                game_state->cleared_cells[i],
+                game_state->board[completed_rows[i]],
+                sizeof(game_state->board[0])
+            );
+        }
+        _remove_completed_rows(
+            game_state->board,
+            num_completed_rows,
+            completed_rows
+        );
+        game_state->board_hash = _hash_board(game_state->board);
+    }
 
     game_state->score += _calc_score(game_state->level, num_completed_rows);
     game_state->lines += num_completed_rows;
     game_state->total_lines += num_completed_rows;
+
+    // in versus, clears first cancel garbage that is on its way in and send
+    // whatever is left over to the opponent (see `exchange_garbage`)
+    size_t garbage = _calc_garbage(num_completed_rows);
+    size_t const cancelled = min(garbage, game_state->pending_garbage);
+    game_state->pending_garbage -= cancelled;
+    game_state->outgoing_garbage += garbage - cancelled;
+
+    return num_completed_rows;
+}
+
+// pushes the board up and fills the bottom with garbage lines that have one
+// shared hole. The rows are contiguous so this is one memmove. Returns true if
+// blocks were pushed out of the top, which tops the player out.
+static bool _rise_garbage(GameState *const game_state) {
+    size_t const rise = min(game_state->pending_garbage, ROWS);
+    game_state->pending_garbage = 0;
+    if (rise == 0) return false;
+
+    bool topped_out = false;
+    for (size_t y = 0; y < rise; ++y) {
+        for (size_t x = 0; x < COLS; ++x)
+            topped_out |= game_state->board[y][x] != NO_TETROMINO;
+    }
+
+    memmove(
+        game_state->board,
+        game_state->board + rise,
+        (ROWS - rise) * sizeof(game_state->board[0])
+    );
+
+    size_t const hole = (_next_random(game_state) >> 32) % COLS;
+    for (size_t y = ROWS - rise; y < ROWS; ++y) {
+        for (size_t x = 0; x < COLS; ++x)
+            game_state->board[y][x] = x == hole? NO_TETROMINO : garbage_tetromino;
+    }
+
+    game_state->board_hash = _hash_board(game_state->board);
+    return topped_out;
 }
  
 // changes the level after a certain number of rows have been cleared
@@ -515,40 +768,124 @@ static inline void _handle_level(GameState *const game_state) {
         game_state->line_num = 10;
         game_state->lines = 0;
         game_state->level++;
+        game_state->gravity = _calc_gravity(game_state->level);
     }
 }
   
 // Exposed Functions //////////////////////////////////////////////////////////
-extern GameState init_gamestate(size_t level) {
+extern GameState init_gamestate_seeded(
+    size_t const level,
+    unsigned long long const seed
+) {
     // When defining structs in c all other fields are set to 0
     GameState game_state = {
         .display_mode = WIREFRAME_DISPLAY_MODE,
-        .current_tetromino = _new_tetromino(_random_tetromino_type()),
-        .next_tetromino = _random_tetromino_type(),
+        .seed = seed,
+        // xorshift gets stuck on 0
+        .random_state = seed != 0? seed : 0x9E3779B97F4A7C15ULL,
         .level = level,
         .line_num = _calc_first_line_num(level),
         .frame_number = 1UL,
-        .wait_time = _calc_wait(level),
+        .gravity = _calc_gravity(level),
+        .gravity_accumulator = 0,
         .deposite_on_next_frame = false,
         .delayed_autoshift_pressed_down = false
     };
 
+    game_state.current_tetromino
+        = _new_tetromino(_random_tetromino_type(&game_state));
+    game_state.next_tetromino = _random_tetromino_type(&game_state);
+
     for (size_t y = 0; y < ROWS; ++y) {
         for (size_t x = 0; x < COLS; ++x)
             game_state.board[y][x] = NO_TETROMINO;
     }
+    game_state.board_hash = 0;
   
     return game_state;
 }
+
+extern GameState init_gamestate(size_t const level) {
+    unsigned long long const seed
+        = (unsigned long long)GetRandomValue(0, 0x7FFFFFFF) << 32
+        ^ (unsigned long long)GetRandomValue(0, 0x7FFFFFFF)
+        ^ (unsigned long long)time(NULL);
+    return init_gamestate_seeded(level, seed);
+}
   
-extern bool next_gamestate(GameState *const game_state) {
-    _handle_user_input_movement(game_state);
-    _handle_tetromino_automatic_movement(game_state); 
-    _handle_completed_rows(game_state);
+// Recomputes the hashes from scratch, for code that edits a board or piece
+// directly instead of playing moves (e.g. generated test positions).
+extern void rehash_gamestate(GameState *const game_state) {
+    game_state->board_hash = _hash_board(game_state->board);
+    game_state->current_tetromino.hash
+        = _tetromino_zobrist_key(&game_state->current_tetromino);
+}
+
+// Reads the keyboard and gamepad. Raylib input is only valid on the thread
+// that owns the window, so this must be called there and the result handed
+// to whoever runs `next_gamestate`.
+extern GameInput poll_game_input(void) {
+    GameInput input = { .pressed = 0, .down = 0 };
+
+    // when the game first saw these, for the latency probe
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    unsigned long long const polled_at
+        = now.tv_sec * 1000000000ULL + (unsigned long long)now.tv_nsec;
+
+    if (IsKeyPressed(KEY_W)
+    || IsGamepadButtonPressed(GAME_PAD, GAMEPAD_BUTTON_RIGHT_FACE_DOWN)
+    ) input.pressed |= INPUT_ROTATE;
+    if (IsKeyPressed(KEY_A)
+    || IsGamepadButtonPressed(GAME_PAD, GAMEPAD_BUTTON_LEFT_FACE_LEFT)
+    ) input.pressed |= INPUT_LEFT;
+    if (IsKeyPressed(KEY_D)
+    || IsGamepadButtonPressed(GAME_PAD, GAMEPAD_BUTTON_LEFT_FACE_RIGHT)
+    ) input.pressed |= INPUT_RIGHT;
+    if (IsKeyPressed(KEY_S)
+    || IsGamepadButtonPressed(GAME_PAD, GAMEPAD_BUTTON_LEFT_FACE_DOWN)
+    ) input.pressed |= INPUT_DOWN;
+
+    if (IsKeyDown(KEY_W)
+    || IsGamepadButtonDown(GAME_PAD, GAMEPAD_BUTTON_RIGHT_FACE_DOWN)
+    ) input.down |= INPUT_ROTATE;
+    if (IsKeyDown(KEY_A)
+    || IsGamepadButtonDown(GAME_PAD, GAMEPAD_BUTTON_LEFT_FACE_LEFT)
+    ) input.down |= INPUT_LEFT;
+    if (IsKeyDown(KEY_D)
+    || IsGamepadButtonDown(GAME_PAD, GAMEPAD_BUTTON_LEFT_FACE_RIGHT)
+    ) input.down |= INPUT_RIGHT;
+    if (IsKeyDown(KEY_S)
+    || IsGamepadButtonDown(GAME_PAD, GAMEPAD_BUTTON_LEFT_FACE_DOWN)
+    ) input.down |= INPUT_DOWN;
+
+    if (input.pressed != 0) input.pressed_at = polled_at;
+    input.down_at = polled_at;
+    return input;
+}
+
+extern bool next_gamestate(
+    GameState *const game_state,
+    GameInput const*const input
+) {
+    COUNT(COUNTER_FRAMES);
+    if (game_state->deposite_on_next_frame) COUNT(COUNTER_DEPOSIT_WAIT_FRAMES);
+
+    unsigned long long const pieces_placed = game_state->pieces_placed;
+    _handle_user_input_movement(game_state, input);
+    if (_handle_tetromino_automatic_movement(game_state))
+        _deposit_current_tetromino(game_state);
+    size_t const num_completed_rows = _handle_completed_rows(game_state);
+
+    // garbage only comes up once a piece lands without clearing anything
+    bool topped_out = false;
+    if (game_state->pieces_placed != pieces_placed && num_completed_rows == 0)
+        topped_out = _rise_garbage(game_state);
+
     _handle_level(game_state);
     game_state->frame_number++;
 
-    return _has_tetromino_collided(
+    return topped_out || _has_tetromino_collided(
         game_state->current_tetromino.x,
         game_state->current_tetromino.y,
         game_state->current_tetromino.positions,
@@ -556,3 +893,120 @@ extern bool next_gamestate(GameState *const game_state) {
     );
 }
 
+// Versus /////////////////////////////////////////////////////////////////////
+
+// call once per frame after both players' `next_gamestate`.
+extern void exchange_garbage(GameState *const a, GameState *const b) {
+    a->pending_garbage += b->outgoing_garbage;
+    b->pending_garbage += a->outgoing_garbage;
+    a->outgoing_garbage = 0;
+    b->outgoing_garbage = 0;
+}
+
+// Piece control for bots and tools. These act on the falling piece directly,
+// skipping input handling and gravity, so a search can try out placements on
+// a copy of the game.
+
+// returns false if the piece was blocked
+extern bool move_tetromino(
+    GameState *const game_state,
+    MoveDirection const move_direction
+) {
+    Tetromino const before = game_state->current_tetromino;
+    _move_tetromino(move_direction, &game_state->current_tetromino, game_state->board);
+    return before.x != game_state->current_tetromino.x
+        || before.y != game_state->current_tetromino.y;
+}
+
+// returns false if the piece was blocked
+extern bool rotate_tetromino(GameState *const game_state) {
+    unsigned char const rotation = game_state->current_tetromino.rotation;
+    _rotate_tetromino(&game_state->current_tetromino, game_state->board);
+    return rotation != game_state->current_tetromino.rotation;
+}
+
+// swaps the falling piece for a new `type` at the spawn point, for searches
+// that follow a given piece sequence. Returns false if it doesn't fit there,
+// which in a game would be a top out.
+extern bool spawn_tetromino(GameState *const game_state, TetrominoType const type) {
+    Tetromino *const tetromino = &game_state->current_tetromino;
+    *tetromino = _new_tetromino(type);
+    return !_has_tetromino_collided(
+        tetromino->x,
+        tetromino->y,
+        tetromino->positions,
+        game_state->board
+    );
+}
+
+// the falling piece, the next one and then what the randomizer will deal
+// after them. Garbage draws its holes from the same stream, so in versus the
+// pieces past the next one only hold until garbage comes up.
+extern void peek_tetrominoes(
+    GameState const*const game_state,
+    TetrominoType *const queue,
+    size_t const count
+) {
+    GameState ahead = { .random_state = game_state->random_state };
+    for (size_t i = 0; i < count; ++i) {
+        if      (i == 0) queue[i] = game_state->current_tetromino.type;
+        else if (i == 1) queue[i] = game_state->next_tetromino;
+        else             queue[i] = _random_tetromino_type(&ahead);
+    }
+}
+
+// one frame of `next_gamestate` for the falling piece alone: input, DAS and
+// gravity, but the piece isn't deposited. Returns true on the frame it would
+// lock, where it is then.
+extern bool step_tetromino(GameState *const game_state, GameInput const*const input) {
+    _handle_user_input_movement(game_state, input);
+    bool const locks = _handle_tetromino_automatic_movement(game_state);
+    game_state->frame_number++;
+    return locks;
+}
+
+// moves the piece straight down as far as it goes, returns how many rows
+extern size_t drop_tetromino(GameState *const game_state) {
+    Tetromino *const tetromino = &game_state->current_tetromino;
+    size_t const rows = _drop_distance(
+        tetromino->x,
+        tetromino->y,
+        tetromino->positions,
+        game_state->board,
+        ROWS
+    );
+    tetromino->y += rows;
+    tetromino->hash = _tetromino_zobrist_key(tetromino);
+    return rows;
+}
+
+// locks the piece where it is and carries on the way a landing would:
+// clears rows, raises garbage and brings in the next piece. Returns the
+// number of rows cleared.
+extern size_t place_tetromino(GameState *const game_state) {
+    _deposit_current_tetromino(game_state);
+    game_state->deposite_on_next_frame = false;
+    size_t const num_completed_rows = _handle_completed_rows(game_state);
+    if (num_completed_rows == 0) _rise_garbage(game_state);
+    _handle_level(game_state);
+    return num_completed_rows;
+}
+
+extern void read_game_counters(GameCounters *const counters) {
+    *counters = (GameCounters){ .enabled = false };
+#ifdef GAME_COUNTERS
+    counters->enabled = true;
+    counters->num_threads = min(
+        atomic_load(&_num_counter_blocks),
+        MAX_COUNTER_THREADS
+    );
+    for (size_t i = 0; i < counters->num_threads; ++i) {
+        CounterBlock const*const block = atomic_load(&_counter_blocks[i]);
+        if (block == NULL) continue;
+        for (size_t j = 0; j < NUM_GAME_COUNTERS; ++j) counters->counts[j]
+            += atomic_load_explicit(&block->counts[j], memory_order_relaxed);
+    }
+    for (size_t j = 0; j < NUM_GAME_COUNTERS; ++j) counters->counts[j]
+        += atomic_load_explicit(&_overflow_counters.counts[j], memory_order_relaxed);
+#endif
+}
@@ -29,9 +29,19 @@
 #define INFO_NEXT_ITEM_X       (size_t) 40
 #define AUTOSHIFT_FRAMES_DELAY (size_t) 20
 #define AUTOSHIFT_FRAMESKIP    (size_t) 3
+#define GRAVITY_ONE            (size_t) 0x10000 // one row per tick
+#define MAX_GRAVITY            (size_t) (ROWS * GRAVITY_ONE) // 20G
 #define NEW_BLOCK_POSITIONS    {{0, 0}, {0, 0}, {0, 0}, {0, 0}}
 #define GAME_PAD               (int)    0
 #define LINE_THICKNESS         (size_t) 3
+#define WALL_ATLAS_PAD         (size_t) (2 * LINE_THICKNESS)
+#define WALL_TILE_MARGIN       (size_t) 1
+#define MAX_WALL_BOARDS        (size_t) 256
+#define PARTICLE_CAPACITY      (size_t) 4096
+#define COMMAND_CAPACITY       (size_t) 8192 // draw calls kept per frame
+#define COMMAND_TEXT_CAPACITY  (size_t) 4096
+#define COMMAND_MAX_BATCHES    (size_t) 256
+#define COMMAND_BATCH_LOOKBACK (size_t) 8
 
 // Enums //////////////////////////////////////////////////////////////////////
 typedef enum {
@@ -47,6 +57,7 @@ typedef enum {
 
 static TetrominoType const first_random_tetromino = L_PIECE;
 static TetrominoType const last_random_tetromino  = S_PIECE; 
+static TetrominoType const garbage_tetromino      = O_PIECE; // block color
 
 typedef enum {
     MOVE_UP,
@@ -55,11 +66,37 @@ typedef enum {
     MOVE_RIGHT
 } MoveDirection;
 
+// bits of GameInput.pressed and GameInput.down
+typedef enum {
+    INPUT_ROTATE = 0x01,
+    INPUT_LEFT   = 0x02,
+    INPUT_RIGHT  = 0x04,
+    INPUT_DOWN   = 0x08
+} InputFlag;
+
+// the kinds of move the latency probe keeps apart (see GameState.move_frame)
+typedef enum {
+    LATENCY_ROTATE,
+    LATENCY_SHIFT,
+    LATENCY_DAS_REPEAT,
+    LATENCY_SOFT_DROP,
+    NUM_LATENCY_INPUTS
+} LatencyInput;
+
 typedef enum {
     DEFAULT_DISPLAY_MODE,
     WIREFRAME_DISPLAY_MODE
 } DisplayMode;
 
+// one per DrawPrimitives call, also the batching key (raylib switches draw
+// mode or texture between them)
+typedef enum {
+    DRAW_RECTANGLE,
+    DRAW_LINE,
+    DRAW_LINE_EX,
+    DRAW_TEXT
+} DrawCommandKind;
+
 // Structs ////////////////////////////////////////////////////////////////////
 typedef struct {
     size_t x; // must be between 0-cols
@@ -67,8 +104,23 @@ typedef struct {
     unsigned char rotation; // must always be between 0-3
     TetrominoType type; // the actual type
     size_t positions[NUM_TETROMINO_BLOCKS][NUM_AXIS];
+    unsigned long long hash; // zobrist key of type, rotation and position
 } Tetromino;
 
+// One tick worth of player input. Polled from raylib on the window thread and
+// passed to `next_gamestate`, so the simulation itself never touches raylib's
+// input state and can run anywhere.
+//
+// The timestamps are CLOCK_MONOTONIC nanoseconds of the poll that first saw
+// the presses and of the latest poll of `down`, 0 where unknown (replays,
+// bots, the network). They only feed the latency probe, never the game.
+typedef struct {
+    unsigned char pressed; // InputFlags that went down since the last tick
+    unsigned char down;    // InputFlags currently held
+    unsigned long long pressed_at;
+    unsigned long long down_at;
+} GameInput;
+
 typedef struct {
     DisplayMode display_mode;
 
@@ -76,6 +128,7 @@ typedef struct {
     TetrominoType next_tetromino;
     TetrominoType board[ROWS][COLS]; // to be clear TetrominoType is used for
                                      // block color
+    unsigned long long board_hash;   // zobrist hash of every filled cell
     size_t level;
     size_t score;
     size_t line_num;
@@ -83,15 +136,151 @@ typedef struct {
     size_t total_lines;
 
     unsigned long long frame_number;
-    size_t wait_time;
+    unsigned long long pieces_placed;
+    size_t gravity;             // rows per tick in GRAVITY_ONE fixed point
+    size_t gravity_accumulator; // fraction of a row carried to the next tick
+
+    unsigned long long seed;         // the game replays identically from this
+    unsigned long long random_state; // and the inputs it received
 
     bool deposite_on_next_frame;
     bool delayed_autoshift_pressed_down;
+    bool is_paused; // set by whoever runs the game, the game only shows it
+
+    // versus: lines sent by this frame's clears and lines waiting to come up
+    size_t outgoing_garbage;
+    size_t pending_garbage;
     size_t delayed_autoshift_frames;
 
+    // what the last placement did, for the effects (see ParticlePool). Rows
+    // are removed straight away, these keep what they looked like.
+    Tetromino last_placed;
+    size_t num_cleared_rows;
+    size_t cleared_rows[MAX_COMPLETED_ROWS]; // board rows before removal
+    TetrominoType cleared_cells[MAX_COMPLETED_ROWS][COLS];
+
+    // the latest move of each LatencyInput kind: the frame it happened on and
+    // when its input was polled (0 if not known). The renderer times how
+    // long it took to get on screen from these.
+    unsigned long long move_frame[NUM_LATENCY_INPUTS];
+    unsigned long long move_input_ns[NUM_LATENCY_INPUTS];
+
 } GameState;
 
+// Zobrist hash of the board and the falling piece. It is kept up to date as
+// the game runs, equal positions hash equal however they were reached, so it
+// works both as a transposition key and as a cheap desync checksum.
+static inline unsigned long long hash_gamestate(GameState const*const game_state) {
+    return game_state->board_hash ^ game_state->current_tetromino.hash;
+}
+
+// The handful of drawing calls the display functions need. Raylib provides
+// the default set, other backends (e.g. the software rasterizer) swap in
+// their own to render the same display code somewhere else.
+typedef struct {
+    int  (*screen_width)(void);
+    int  (*screen_height)(void);
+    void (*begin_frame)(Color background_color);
+    void (*end_frame)(void);
+    void (*rectangle)(int x, int y, int width, int height, Color color);
+    void (*line)(int start_x, int start_y, int end_x, int end_y, Color color);
+    void (*line_ex)(Vector2 start, Vector2 end, float thickness, Color color);
+    void (*text)(char const* text, int x, int y, int font_size, Color color);
+
+    // ends a frame that looks exactly like the last one without drawing it
+    // again, NULL if the backend doesn't keep what it last showed
+    void (*keep_frame)(void);
+} DrawPrimitives;
+
+// A retained command buffer between the display functions and a
+// DrawPrimitives backend. Draw calls are recorded into a fixed arena instead
+// of being issued, put into batches of one kind each (a call joins an
+// earlier batch of its kind unless it overlaps something drawn since), and
+// played back batch by batch at the end of the frame, with rows of equal
+// rectangles merged. A frame exactly the same as the last one isn't played
+// back at all if the backend can keep it.
+//
+// No padding in DrawCommand, so frames compare with memcmp.
+typedef struct {
+    unsigned kind;   // DrawCommandKind
+    Color color;
+    float thickness; // DRAW_LINE_EX
+    union {
+        int   rectangle[4]; // x, y, width, height
+        int   line[4];      // start x, start y, end x, end y
+        float line_ex[4];   // start x, start y, end x, end y
+        int   text[4];      // x, y, font size, offset into CommandFrame.text
+    };
+} DrawCommand;
+
+typedef struct {
+    unsigned kind;
+    int bounds[4];  // of every command in it: left, top, right, bottom
+    unsigned first; // index into CommandBuffer.recorded
+    unsigned last;
+} DrawBatch;
+
+// a frame as played back, in batch order
+typedef struct {
+    int screen_width;
+    int screen_height;
+    Color background_color;
+    size_t count;
+    size_t text_size;
+    DrawCommand commands[COMMAND_CAPACITY];
+    char text[COMMAND_TEXT_CAPACITY];
+} CommandFrame;
+
+typedef struct {
+    DrawPrimitives const* target;
+
+    // in the order they were drawn, each linked to the next of its batch
+    size_t num_recorded;
+    DrawCommand recorded[COMMAND_CAPACITY];
+    unsigned next_in_batch[COMMAND_CAPACITY];
+    size_t num_batches;
+    DrawBatch batches[COMMAND_MAX_BATCHES];
+
+    CommandFrame frames[2]; // the one being recorded and the last one shown
+    size_t current;         // index of the one being recorded
+    bool has_shown;  // the target shows frames[!current]
+    bool is_begun;   // begin_frame went to the target already (arena was full)
+
+    unsigned long long num_frames;
+    unsigned long long num_kept_frames;
+    unsigned long long num_commands;  // drawn by the display functions
+    unsigned long long num_submitted; // played back, after merging
+    unsigned long long num_batches_submitted;
+} CommandBuffer;
+
+// Line clear and lock effects. A fixed pool of particles stored as separate
+// arrays per field, so updating them is a few flat loops over floats the
+// compiler can vectorize, and drawing them is one run of plain rectangles
+// raylib batches into a single draw call. Nothing is allocated per frame.
+//
+// Particles live in board units and age in simulation frames, so they follow
+// the game: they freeze while it is paused and a fresh game clears them.
+typedef struct {
+    size_t count; // live particles are packed at the front
+    unsigned long long frame;         // frame_number at the last update
+    unsigned long long pieces_placed; // placements already turned into effects
+    unsigned random_state;
+
+    float x[PARTICLE_CAPACITY];      // top left corner, in blocks
+    float y[PARTICLE_CAPACITY];
+    float velocity_x[PARTICLE_CAPACITY];  // blocks per frame
+    float velocity_y[PARTICLE_CAPACITY];
+    float weight[PARTICLE_CAPACITY]; // gravity, blocks per frame per frame
+    float life[PARTICLE_CAPACITY];   // frames left
+    float fade[PARTICLE_CAPACITY];   // 1 / starting life, for the alpha
+    float size[PARTICLE_CAPACITY];   // in blocks
+    unsigned char type[PARTICLE_CAPACITY]; // TetrominoType for the colour
+} ParticlePool;
+
 typedef struct { 
+    DrawPrimitives const* primitives;
+    ParticlePool *particles; // NULL for no effects
+    CommandBuffer *commands; // NULL to draw straight through `primitives`
     size_t border_width;
     size_t border_height;
     Color font_color;
@@ -122,10 +311,56 @@ typedef struct {
 
 } DisplayConfig;
 
+// The spectator wall draws many boards at once from one texture atlas holding
+// every block look (colour x visible sides), so a whole wall is a handful of
+// batched textured quads instead of one `display_game` per board.
+typedef struct {
+    DisplayMode display_mode;
+    DisplayConfig display_config;
+    RenderTexture2D atlas;
+} WallConfig;
+
 // function signitures ////////////////////////////////////////////////////////
 typedef GameState (*init_gamestate_t)(size_t);
+typedef GameState (*init_gamestate_seeded_t)(size_t, unsigned long long);
 typedef DisplayConfig (*init_display_config_t)(DisplayMode);
-typedef bool (*next_gamestate_t)(GameState*);
-typedef void (*display_game_t)(GameState*, DisplayConfig*);
+typedef GameInput (*poll_game_input_t)(void);
+typedef bool (*next_gamestate_t)(GameState*, GameInput const*);
+typedef void (*display_game_t)(GameState const*, DisplayConfig const*);
+typedef WallConfig (*init_wall_config_t)(DisplayMode);
+typedef void (*unload_wall_config_t)(WallConfig*);
+typedef void (*display_wall_t)(GameState const*, size_t, WallConfig const*);
+typedef void (*exchange_garbage_t)(GameState*, GameState*);
+
+// Exposed functions //////////////////////////////////////////////////////////
+// The game loads these through dlsym (see load.h) so they can be hot
+// reloaded, headless tools link the libgame sources and call them directly.
+GameState init_gamestate(size_t const level);
+GameState init_gamestate_seeded(size_t const level, unsigned long long const seed);
+DisplayConfig init_display_config(DisplayMode const display_mode);
+GameInput poll_game_input(void);
+void rehash_gamestate(GameState *const game_state);
+bool next_gamestate(GameState *const game_state, GameInput const*const input);
+void exchange_garbage(GameState *const a, GameState *const b);
+bool move_tetromino(GameState *const game_state, MoveDirection const move_direction);
+bool rotate_tetromino(GameState *const game_state);
+bool spawn_tetromino(GameState *const game_state, TetrominoType const type);
+void peek_tetrominoes(
+    GameState const*const game_state,
+    TetrominoType *const queue,
+    size_t const count
+);
+bool step_tetromino(GameState *const game_state, GameInput const*const input);
+size_t drop_tetromino(GameState *const game_state);
+size_t place_tetromino(GameState *const game_state);
+void display_game(
+    GameState     const*const game_state,
+    DisplayConfig const*const display_config
+);
+void update_particles(ParticlePool *const pool, GameState const*const game_state);
+DrawPrimitives const* bind_command_buffer(
+    CommandBuffer *const buffer,
+    DrawPrimitives const*const target
+);
   
 #endif //GAME_H 
@@ -2,12 +2,20 @@
 #include "config.h"
 #include "load.h"
 #include "debug.h"
+#include "counters.h"
+#include "metrics.h"
+#include "persist.h"
+#include "publish.h"
+#include "simulation.h"
+#include "snapshot.h"
 #include <stdlib.h>
 #include <stdio.h>
 #include <raylib.h>
 #include <dlfcn.h>
 
-int main(void) {
+// ./tetris [snapshot] carries on from a snapshot (see snapshot.h) instead
+// of the autosave or a fresh game
+int main(int argc, char **argv) {
 
     // Ths ptr opens a shared object file or crashes if it can't find it
     void *libgame = dlopen_safe(libgame_path, RTLD_NOW);
@@ -16,7 +24,12 @@ int main(void) {
     LOAD_FUNC(libgame, init_gamestate);
     LOAD_FUNC(libgame, init_display_config);
     LOAD_FUNC(libgame, next_gamestate);
+    LOAD_FUNC(libgame, poll_game_input);
     LOAD_FUNC(libgame, display_game);
+    LOAD_FUNC(libgame, open_publisher);
+    LOAD_FUNC(libgame, publish_gamestate);
+    LOAD_FUNC(libgame, close_publisher);
+    LOAD_FUNC(libgame, read_game_counters);
 
     // LOAD_FUNC(libgame, next_selection_screen_state);
     // LOAD_FUNC(libgame, disp_selection_screen);
@@ -25,15 +38,94 @@ int main(void) {
     InitWindow(INIT_WIDTH, INIT_HEIGHT, "Game!");
     SetTargetFPS(FPS);
 
-    // Gamestate object holds all game objects, and gameloop updates it each cycle
-    GameState game_state = init_gamestate(INIT_LEVEL);
+    // Shared memory snapshots for external observers (see publish.h),
+    // the game runs fine without it if it can't be created.
+    PublishRing *const publisher = open_publisher();
+
+    // Prometheus metrics for whatever is scraping this cabinet, also
+    // optional (see metrics.h)
+    static Metrics metrics;
+    static MetricsServer metrics_server = { .socket = -1 };
+    init_metrics(&metrics);
+    char const*const metrics_address
+        = metrics_address_from_env(metrics_default_address);
+    if (metrics_address != NULL)
+        start_metrics_server(&metrics_server, &metrics, metrics_address);
+
+    // High scores, stats and autosaves, written by a thread of its own so
+    // the game never waits on the disk (see persist.h). Also optional.
+    static Persistence persistence;
+    bool const is_persisting = open_persistence(&persistence, persist_path);
+    if (is_persisting) print_persisted_data(&persistence.data);
+
+    // The simulation thread owns the gamestate and updates it at a fixed
+    // tick, this thread only renders the newest snapshot it has published.
+    static Simulation simulation = {
+        .pause_lock = PTHREAD_MUTEX_INITIALIZER,
+        .pause_changed = PTHREAD_COND_INITIALIZER
+    };
+    simulation.init_gamestate    = init_gamestate;
+    simulation.next_gamestate    = next_gamestate;
+    simulation.publish_gamestate = publish_gamestate;
+    simulation.publisher         = publisher;
+    simulation.metrics           = &metrics;
+    simulation.tick_rate         = FPS;
+    simulation.init_level        = INIT_LEVEL;
+    simulation.replay_path       = replay_path;
+    simulation.persistence       = is_persisting? &persistence : NULL;
+    simulation.snapshot_dir      = snapshot_dir;
+    simulation.resume_from       = is_persisting && persistence.data.has_autosave
+                                 ? &persistence.data.autosave : NULL;
+
+    static Snapshot snapshot;
+    static GameState snapshot_state;
+    if (argc > 1 && !read_snapshot(&snapshot, argv[1]))
+        fprintf(stderr, "Error: could not read snapshot %s.\n", argv[1]);
+    else if (argc > 1) {
+        size_t missing = 0;
+        if (!load_snapshot(&snapshot_state, &snapshot, init_gamestate, &missing))
+            fprintf(stderr, "Error: snapshot %s holds values out of range.\n", argv[1]);
+        else {
+            if (missing > 0) fprintf(
+                stderr, "%s lacks %zu fields, they start fresh.\n", argv[1], missing
+            );
+            simulation.resume_from = &snapshot_state;
+        }
+    }
+    reset_simulation(&simulation);
+    start_simulation(&simulation);
+
+    // line clear and lock effects, see ParticlePool
+    static ParticlePool particles;
+    // batched drawing, see CommandBuffer
+    static CommandBuffer commands;
+    LatencyProbe latency_probe = { 0 };
+
+    GameState const* game_state = triple_buffer_read(&simulation.states);
     DisplayConfig display_config =
-        init_display_config(game_state.display_mode);
+        init_display_config(game_state->display_mode);
+    display_config.particles = &particles;
+    display_config.commands = &commands;
+    unsigned long long drawn_revision = 0;
+    bool waiting_on_input = false;
+    double last_frame_time = GetTime();
 
     while (!WindowShouldClose()) {
-        double const time = GetTime();
+        // time blocked waiting on input while paused isn't a frame
+        double const frame_time = GetTime();
+        if (!waiting_on_input) record_frame_time(
+            &metrics,
+            (frame_time - last_frame_time) * 1e6,
+            1e6 / FPS
+        );
+        last_frame_time = frame_time;
+
         if (IsKeyPressed(KEY_R)) {
             printf("============== Hot Reload =============\n\n");
+            double const reload_start = GetTime();
+
+            // the simulation thread is running libgame code, stop it first
+            stop_simulation(&simulation);
 
             // close previous shared object link and open a fresh one
             dlclose(libgame);
@@ -42,14 +134,30 @@ int main(void) {
             // reload functions
             RELOAD_FUNC(libgame, init_gamestate);
             RELOAD_FUNC(libgame, next_gamestate);
+            RELOAD_FUNC(libgame, poll_game_input);
             RELOAD_FUNC(libgame, display_game);
             RELOAD_FUNC(libgame, init_display_config);
+            RELOAD_FUNC(libgame, open_publisher);
+            RELOAD_FUNC(libgame, publish_gamestate);
+            RELOAD_FUNC(libgame, close_publisher);
+            RELOAD_FUNC(libgame, read_game_counters);
             // RELOAD_FUNC(libgame, next_selection_screen_state);
             // RELOAD_FUNC(libgame, disp_selection_screen);
 
+            simulation.init_gamestate    = init_gamestate;
+            simulation.next_gamestate    = next_gamestate;
+            simulation.publish_gamestate = publish_gamestate;
+
             // DEBUG: refresh game state (optional)
-            game_state = init_gamestate(INIT_LEVEL);
-            display_config = init_display_config(game_state.display_mode);
+            DisableEventWaiting();
+            waiting_on_input = false;
+            reset_simulation(&simulation);
+            game_state = triple_buffer_read(&simulation.states);
+            display_config = init_display_config(game_state->display_mode);
+            display_config.particles = &particles;
+            display_config.commands = &commands;
+            start_simulation(&simulation);
+            record_hot_reload(&metrics, (GetTime() - reload_start) * 1e6);
         } 
 
         // TODO: add level selection screen
@@ -62,22 +170,73 @@ int main(void) {
         }
         */
         
-        bool is_game_over = next_gamestate(&game_state); // Update game state
-        display_game(&game_state, &display_config);   // Take gamestate and render it
+        if (IsKeyPressed(KEY_SPACE)) {
+            bool const paused = !atomic_load(&simulation.paused);
+            set_simulation_paused(&simulation, paused);
+            if (!paused) {
+                DisableEventWaiting();
+                waiting_on_input = false;
+            }
+        }
+
+        GameInput const input = poll_game_input();
+        feed_simulation_input(&simulation, &input);  // Update game state
+
+        unsigned long long const revision = atomic_load_explicit(
+            &simulation.revision, memory_order_acquire
+        );
+        // effects still playing need every frame drawn, unless paused: they
+        // age with game frames, so they hold still until it resumes
+        if (!REDRAW_ONLY_ON_CHANGE
+        ||  revision != drawn_revision
+        ||  (particles.count > 0 && !game_state->is_paused)
+        ||  IsWindowResized()
+        ) {
+            game_state = triple_buffer_read(&simulation.states);
+            display_game(game_state, &display_config);   // Take gamestate and render it
+            record_input_latency(&metrics, &latency_probe, game_state);
+            drawn_revision = revision;
 
-        if (is_game_over) {
-            // TODO: add gameover screen
-            game_state = init_gamestate(INIT_LEVEL);
+            // once the paused screen is up only input can change anything,
+            // so sleep until some arrives instead of polling
+            if (REDRAW_ONLY_ON_CHANGE
+            &&  game_state->is_paused
+            &&  atomic_load(&simulation.paused)
+            ) {
+                EnableEventWaiting();
+                waiting_on_input = true;
+            }
+        }
+        else {
+            // nothing to draw, do what EndDrawing would: poll input and keep
+            // to the frame rate (PollInputEvents blocks while event waiting)
+            PollInputEvents();
+            if (!waiting_on_input) WaitTime(1.0 / FPS);
         }
 
         if (IsKeyPressed(KEY_P)) {
-            printf("============== DEBUG INFO =============\n\n");
-            print_game_state(&game_state);
-        }
+            // the simulation and persistence threads do the work, so this
+            // frame takes no longer than any other (read it with ./snapshot)
+            request_simulation_snapshot(&simulation);
 
-        double const time_delta = GetTime() - time;
-        WaitTime(1. / GetFPS() - time_delta);
+            GameCounters counters;
+            read_game_counters(&counters);
+            print_game_counters(&counters);
+        }
+    }
+    stop_simulation(&simulation);
+    if (is_persisting) {
+        // picked up again next time
+        persist_autosave(&persistence, &simulation.game_state);
+        close_persistence(&persistence);
+        printf("this session: %llu games, %llu lines\n",
+            (unsigned long long)persistence.session.games,
+            (unsigned long long)persistence.session.lines
+        );
     }
+    stop_metrics_server(&metrics_server);
+    free_replay(&simulation.replay);
+    if (publisher != NULL) close_publisher(publisher);
     CloseWindow();
     dlclose(libgame);
 
@@ -0,0 +1,306 @@
+#include "mcts.h"
+#include "board_features.h"
+#include "bot.h"
+#include "game.h"
+#include <math.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+// Random /////////////////////////////////////////////////////////////////////
+static inline unsigned long long _next_random(MctsWorker *const worker) {
+    unsigned long long x = worker->random_state;
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    worker->random_state = x;
+    return x;
+}
+
+// a piece the way the game's randomizer deals them
+static inline TetrominoType _random_piece(MctsWorker *const worker) {
+    size_t const num_random_types
+        = last_random_tetromino - first_random_tetromino + 1;
+    return first_random_tetromino
+         + (_next_random(worker) >> 32) % num_random_types;
+}
+
+// Scoring ////////////////////////////////////////////////////////////////////
+
+// the game ends when the next piece has nowhere to go
+static inline bool _has_topped_out(GameState *const game_state) {
+    return !spawn_tetromino(game_state, game_state->current_tetromino.type);
+}
+
+// places a known piece every way in `placements`, dealing the piece after
+// it from the worker's stream rather than the game's own so the search can't
+// peek. The boards are scored together.
+static void _place_all(
+    MctsWorker *const worker,
+    MctsNode *const nodes,
+    GameState const*const from,
+    Placement const*const placements,
+    size_t const count
+) {
+    BoardRows const before = pack_board_rows(from->board);
+    BoardRows boards[MAX_PLACEMENTS];
+    size_t rows[MAX_PLACEMENTS];
+    for (size_t i = 0; i < count; ++i) {
+        MctsNode *const node = &nodes[i];
+        node->state = *from;
+        node->state.random_state = _next_random(worker) | 1;
+        rows[i] = play_placement(&node->state, &placements[i]);
+        node->topped_out = _has_topped_out(&node->state);
+        node->visits = 1;
+        node->expanded = false;
+        node->num_children = 0;
+        boards[i] = rows[i] == 0
+            ? place_on_board_rows(&before, &node->state.last_placed)
+            : pack_board_rows(node->state.board);
+    }
+
+    MctsRoot const*const root = worker->root;
+    double scores[MAX_PLACEMENTS];
+    score_boards(root->config->evaluation, root->evaluations, boards, rows, count, scores);
+    for (size_t i = 0; i < count; ++i)
+        nodes[i].total = nodes[i].topped_out? MCTS_TOPOUT_SCORE : scores[i];
+}
+
+// scores a leaf: deals the piece after the next and checks it fits, then
+// plays `played_pieces` more below it, each the best of a few random
+// placements. Lines on the way count, the final board is scored as it is.
+static double _score_leaf(MctsWorker *const worker, GameState const*const from) {
+    MctsConfig const*const config = worker->root->config;
+    GameState state = *from;
+    spawn_tetromino(&state, _random_piece(worker));
+    state.next_tetromino = _random_piece(worker);
+    state.random_state = _next_random(worker) | 1;
+    if (_has_topped_out(&state)) return MCTS_TOPOUT_SCORE;
+
+    double lines = 0;
+    for (size_t piece = 0; piece < config->played_pieces; ++piece) {
+        BoardRows const before = pack_board_rows(state.board);
+        Placement placements[MAX_PLACEMENTS];
+        size_t const num_placements = list_placements(&state, placements);
+
+        GameState placed[MCTS_PLAYED_SAMPLES];
+        size_t rows[MCTS_PLAYED_SAMPLES];
+        BoardRows boards[MCTS_PLAYED_SAMPLES];
+        for (size_t i = 0; i < MCTS_PLAYED_SAMPLES; ++i) {
+            placed[i] = state;
+            Placement const*const placement
+                = &placements[_next_random(worker) % num_placements];
+            rows[i] = play_placement(&placed[i], placement);
+            boards[i] = rows[i] == 0
+                ? place_on_board_rows(&before, &placed[i].last_placed)
+                : pack_board_rows(placed[i].board);
+        }
+        BoardFeatures features[MCTS_PLAYED_SAMPLES];
+        extract_board_features(boards, MCTS_PLAYED_SAMPLES, features);
+
+        size_t best = 0;
+        double best_score = -INFINITY;
+        for (size_t i = 0; i < MCTS_PLAYED_SAMPLES; ++i) {
+            double const score
+                = score_board_features(config->evaluation, &features[i], rows[i]);
+            if (score <= best_score) continue;
+            best = i;
+            best_score = score;
+        }
+
+        state = placed[best];
+        lines += config->evaluation->lines_weight * rows[best];
+        if (_has_topped_out(&state)) return MCTS_TOPOUT_SCORE;
+    }
+    return lines + evaluate_board(config->evaluation, state.board, 0);
+}
+
+// Search /////////////////////////////////////////////////////////////////////
+
+// UCB1, the parent's visits are the sum of its children's
+static size_t _select_child(
+    MctsNode const*const children,
+    size_t const num_children,
+    double const exploration
+) {
+    unsigned long long parent_visits = 0;
+    for (size_t i = 0; i < num_children; ++i) parent_visits += children[i].visits;
+    double const log_visits = log((double)parent_visits);
+
+    size_t best = 0;
+    double best_bound = -INFINITY;
+    for (size_t i = 0; i < num_children; ++i) {
+        double const bound = children[i].total / children[i].visits
+            + exploration * sqrt(log_visits / children[i].visits);
+        if (bound <= best_bound) continue;
+        best = i;
+        best_bound = bound;
+    }
+    return best;
+}
+
+// every placement of the next piece below a placement of the falling one
+static void _expand(MctsWorker *const worker, MctsNode *const node) {
+    node->expanded = true;
+    node->first_child = worker->num_nodes;
+    Placement placements[MAX_PLACEMENTS];
+    node->num_children = list_placements(&node->state, placements);
+    _place_all(
+        worker,
+        &worker->nodes[node->first_child],
+        &node->state,
+        placements,
+        node->num_children
+    );
+    worker->num_nodes += node->num_children;
+}
+
+static void _iterate(MctsWorker *const worker) {
+    MctsRoot const*const root = worker->root;
+    double const exploration = root->config->exploration;
+    MctsNode *const first = &worker->nodes[
+        _select_child(worker->nodes, root->num_placements, exploration)
+    ];
+
+    double score = MCTS_TOPOUT_SCORE;
+    if (!first->topped_out) {
+        if (!first->expanded) _expand(worker, first);
+        MctsNode *const children = &worker->nodes[first->first_child];
+        MctsNode *const second
+            = &children[_select_child(children, first->num_children, exploration)];
+        if (!second->topped_out) score = _score_leaf(worker, &second->state);
+        second->total += score;
+        second->visits++;
+    }
+    first->total += score;
+    first->visits++;
+    worker->iterations++;
+}
+
+static inline bool _is_past(struct timespec const*const deadline) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec > deadline->tv_sec
+       || (now.tv_sec == deadline->tv_sec && now.tv_nsec >= deadline->tv_nsec);
+}
+
+static void *_run_worker(void *const arg) {
+    MctsWorker *const worker = arg;
+    MctsRoot const*const root = worker->root;
+    worker->num_nodes = root->num_placements;
+    worker->iterations = 0;
+    _place_all(worker, worker->nodes, &root->state, root->placements, root->num_placements);
+
+    do {
+        for (size_t i = 0; i < MCTS_CLOCK_INTERVAL; ++i) _iterate(worker);
+    } while (!_is_past(&root->deadline));
+    return NULL;
+}
+
+// the placement visited most over all the trees
+static void _search(MctsBot *const bot, GameState const*const game_state) {
+    MctsRoot *const root = &bot->root;
+    root->config = &bot->config;
+    root->evaluations = &bot->evaluations;
+    root->state = *game_state;
+    root->state.pending_garbage = 0; // same for every placement, leave it out
+    root->num_placements = list_placements(&root->state, root->placements);
+
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    long const think_nanoseconds = bot->config.think_seconds * 1e9;
+    root->deadline.tv_sec = start.tv_sec + think_nanoseconds / 1000000000L;
+    root->deadline.tv_nsec = start.tv_nsec + think_nanoseconds % 1000000000L;
+    if (root->deadline.tv_nsec >= 1000000000L) {
+        root->deadline.tv_nsec -= 1000000000L;
+        root->deadline.tv_sec++;
+    }
+
+    size_t const num_threads = bot->config.num_threads;
+    for (size_t i = 0; i < num_threads; ++i) bot->workers[i].root = root;
+    for (size_t i = 1; i < num_threads; ++i) {
+        if (pthread_create(&bot->workers[i].thread, NULL, _run_worker, &bot->workers[i])) {
+            fprintf(stderr, "Error: could not start search thread.\n");
+            exit(1);
+        }
+    }
+    _run_worker(&bot->workers[0]);
+    for (size_t i = 1; i < num_threads; ++i) pthread_join(bot->workers[i].thread, NULL);
+
+    unsigned long long best_visits = 0;
+    double best_mean = -INFINITY;
+    for (size_t i = 0; i < root->num_placements; ++i) {
+        unsigned long long visits = 0;
+        double total = 0;
+        for (size_t j = 0; j < num_threads; ++j) {
+            visits += bot->workers[j].nodes[i].visits;
+            total += bot->workers[j].nodes[i].total;
+        }
+        double const mean = total / visits;
+        if (visits < best_visits || (visits == best_visits && mean <= best_mean))
+            continue;
+        bot->target = root->placements[i];
+        best_visits = visits;
+        best_mean = mean;
+    }
+
+    struct timespec end;
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    bot->search_seconds
+        += (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) * 1e-9;
+    bot->searches++;
+    for (size_t i = 0; i < num_threads; ++i) bot->iterations += bot->workers[i].iterations;
+}
+
+// Exposed ////////////////////////////////////////////////////////////////////
+extern bool init_mcts_bot(MctsBot *const bot, MctsConfig const*const config) {
+    *bot = (MctsBot){ .config = *config, .has_plan = false };
+    if (bot->config.num_threads == 0) {
+        long const num_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        bot->config.num_threads = num_cpus > 0? num_cpus : 1;
+    }
+
+    size_t const num_threads = bot->config.num_threads;
+    if (!create_transposition_table(&bot->evaluations, MCTS_EVALUATIONS)) {
+        fprintf(stderr, "Error: could not allocate the transposition table.\n");
+        return false;
+    }
+    bot->workers = calloc(num_threads, sizeof(MctsWorker));
+    if (bot->workers == NULL) {
+        fprintf(stderr, "Error: could not allocate %zu search threads.\n", num_threads);
+        free_transposition_table(&bot->evaluations);
+        return false;
+    }
+    for (size_t i = 0; i < num_threads; ++i) {
+        MctsWorker *const worker = &bot->workers[i];
+        worker->random_state = 0x9E3779B97F4A7C15ULL * (i + 1);
+        worker->nodes = malloc(MCTS_MAX_NODES * sizeof(MctsNode));
+        if (worker->nodes == NULL) {
+            fprintf(stderr, "Error: could not allocate a search tree.\n");
+            free_mcts_bot(bot);
+            return false;
+        }
+    }
+    return true;
+}
+
+extern void free_mcts_bot(MctsBot *const bot) {
+    if (bot->workers == NULL) return;
+    for (size_t i = 0; i < bot->config.num_threads; ++i) free(bot->workers[i].nodes);
+    free(bot->workers);
+    bot->workers = NULL;
+    free_transposition_table(&bot->evaluations);
+}
+
+extern GameInput next_mcts_input(MctsBot *const bot, GameState const*const game_state) {
+    if (!bot->has_plan || bot->planned_piece != game_state->pieces_placed) {
+        _search(bot, game_state);
+        bot->has_plan = true;
+        bot->planned_piece = game_state->pieces_placed;
+    }
+    return input_toward_placement(game_state, &bot->target);
+}
@@ -0,0 +1,110 @@
+#ifndef MCTS_H
+#define MCTS_H
+
+#include "game.h"
+#include "bot.h"
+#include "transposition.h"
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <time.h>
+
+// Tree search bot. When a new piece appears it searches for a fixed time
+// and then plays inputs towards the placement it picked, one per tick like
+// the heuristic bot (see bot.h).
+//
+// With the default config the search has no rollouts. It is a two ply UCB
+// search over the pieces that are known, the falling one and the next, with
+// every placement of each (see list_placements), whose leaves are scored
+// with `evaluate_board`. Each visit of a leaf deals the piece after the next
+// from the game's randomizer and only checks whether it tops out.
+//
+// `played_pieces` turns on Monte-Carlo playouts below the leaves: that many
+// more random pieces, each put at the best of a few random placements, with
+// the board they end on scored instead. They are noisy. With a few
+// milliseconds on one core at levels 19, 29 and 45 any played piece made it
+// survive no longer and clear fewer lines than none, so the default is 0.
+// New nodes start with the score of their own board as one visit, so even a
+// very short budget gives the heuristic bot's choice rather than noise.
+//
+// Root parallel: every thread grows its own tree from the same position with
+// its own random stream, and the visits of the first placements are added up
+// at the end. The search runs on the calling thread and `num_threads - 1`
+// more. All they share is a transposition table of board scores (see
+// score_boards): the threads place the same pieces on the same boards, and
+// one search's second placements are the next one's first, so most boards
+// are scored once.
+
+// Constants //////////////////////////////////////////////////////////////////
+#define MCTS_THINK_SECONDS   (double) 0.004 // a quarter of a tick at 60
+#define MCTS_PLAYED_PIECES   (size_t) 0 // no playouts, leaves are only scored
+#define MCTS_PLAYED_SAMPLES  (size_t) 3 // random placements tried per piece
+#define MCTS_EXPLORATION     (double) 2 // in evaluate_board units
+#define MCTS_TOPOUT_SCORE    (double) -1000
+#define MCTS_CLOCK_INTERVAL  (size_t) 8 // iterations between deadline checks
+#define MCTS_MAX_NODES       (MAX_PLACEMENTS + MAX_PLACEMENTS * MAX_PLACEMENTS)
+#define MCTS_EVALUATIONS     (size_t) (1 << 16) // transposition table entries
+
+// Structs ////////////////////////////////////////////////////////////////////
+typedef struct {
+    double think_seconds;  // per piece
+    size_t num_threads;    // 0 for one per core
+    size_t played_pieces;  // random pieces played below the leaves, 0 for none
+    double exploration;
+    BotConfig const* evaluation; // weights for scoring boards
+} MctsConfig;
+
+// a placement of the falling piece (depth 1) or of the next one (depth 2)
+typedef struct {
+    GameState state; // after the placement
+    double total;    // sum of the scores through here
+    unsigned long long visits;
+    size_t first_child; // depth 1 only, into MctsWorker.nodes
+    size_t num_children;
+    bool expanded;
+    bool topped_out;
+} MctsNode;
+
+// the position being searched, read only while the workers run
+typedef struct {
+    MctsConfig const* config;
+    GameState state;
+    Placement placements[MAX_PLACEMENTS];
+    size_t num_placements;
+    struct timespec deadline;
+    TranspositionTable *evaluations;
+} MctsRoot;
+
+typedef struct {
+    MctsRoot const* root;
+    pthread_t thread;
+    MctsNode *nodes; // the first root->num_placements are depth 1
+    size_t num_nodes;
+    unsigned long long random_state;
+    unsigned long long iterations;
+} MctsWorker;
+
+typedef struct {
+    MctsConfig config;
+    MctsWorker *workers;
+    MctsRoot root;
+    TranspositionTable evaluations; // shared by every worker
+
+    bool has_plan;
+    unsigned long long planned_piece; // pieces_placed when the plan was made
+    Placement target;
+
+    // stats
+    unsigned long long searches;
+    unsigned long long iterations;
+    double search_seconds;
+} MctsBot;
+
+// Functions //////////////////////////////////////////////////////////////////
+
+// allocates a tree per thread, prints why and returns false if it can't
+bool init_mcts_bot(MctsBot *const bot, MctsConfig const*const config);
+void free_mcts_bot(MctsBot *const bot);
+GameInput next_mcts_input(MctsBot *const bot, GameState const*const game_state);
+
+#endif // MCTS_H
@@ -0,0 +1,354 @@
+#include "metrics.h"
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+
+// Recording //////////////////////////////////////////////////////////////////
+extern void init_metrics(Metrics *const metrics) {
+    memset(metrics, 0, sizeof(Metrics));
+    clock_gettime(CLOCK_MONOTONIC, &metrics->start);
+}
+
+extern void record_frame_time(
+    Metrics *const metrics,
+    uint64_t const frame_us,
+    uint64_t const target_us
+) {
+    size_t bucket = 0;
+    while (frame_us > frame_time_bucket_bounds[bucket]) bucket++;
+
+    _metrics_add(&metrics->frame_time_buckets[bucket], 1);
+    _metrics_add(&metrics->frame_time_sum_us, frame_us);
+    _metrics_add(&metrics->frames, 1);
+    if (2 * frame_us > 3 * target_us) _metrics_add(&metrics->dropped_frames, 1);
+}
+
+extern void record_hot_reload(Metrics *const metrics, uint64_t const reload_us) {
+    _metrics_add(&metrics->hot_reloads, 1);
+    _metrics_add(&metrics->hot_reload_sum_us, reload_us);
+    atomic_store_explicit(&metrics->last_hot_reload_us, reload_us, memory_order_relaxed);
+}
+
+extern void record_input_latency(
+    Metrics *const metrics,
+    LatencyProbe *const probe,
+    GameState const*const game_state
+) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    unsigned long long const now_ns
+        = now.tv_sec * 1000000000ULL + (unsigned long long)now.tv_nsec;
+
+    for (size_t kind = 0; kind < NUM_LATENCY_INPUTS; ++kind) {
+        if (game_state->move_frame[kind] == probe->drawn_frames[kind]) continue;
+        probe->drawn_frames[kind] = game_state->move_frame[kind];
+
+        unsigned long long const input_ns = game_state->move_input_ns[kind];
+        if (input_ns == 0 || input_ns > now_ns) continue; // not from a poll
+
+        uint64_t const latency_us = (now_ns - input_ns) / 1000;
+        size_t bucket = 0;
+        while (latency_us > latency_bucket_bounds[bucket]) bucket++;
+        _metrics_add(&metrics->latency_buckets[kind][bucket], 1);
+        _metrics_add(&metrics->latency_sum_us[kind], latency_us);
+    }
+}
+
+// Formatting /////////////////////////////////////////////////////////////////
+typedef struct {
+    char *data;
+    size_t size;
+    size_t capacity;
+} TextBuffer;
+
+static void _append(TextBuffer *const text, char const*const format, ...) {
+    va_list args;
+    va_start(args, format);
+    int const written = vsnprintf(
+        text->data + text->size,
+        text->capacity - text->size,
+        format,
+        args
+    );
+    va_end(args);
+    if (written > 0) text->size += (size_t)written;
+    if (text->size >= text->capacity) text->size = text->capacity - 1;
+}
+
+static inline double _seconds_between(
+    struct timespec const*const start,
+    struct timespec const*const end
+) {
+    return (end->tv_sec - start->tv_sec) + (end->tv_nsec - start->tv_nsec) * 1e-9;
+}
+
+static inline uint64_t _load(_Atomic uint64_t *const counter) {
+    return atomic_load_explicit(counter, memory_order_relaxed);
+}
+
+// upper bound of the bucket the quantile falls in, in seconds
+static double _frame_time_quantile(
+    uint64_t const buckets[NUM_FRAME_TIME_BUCKETS],
+    uint64_t const count,
+    double const quantile
+) {
+    if (count == 0) return 0;
+    uint64_t const rank = (uint64_t)(quantile * count);
+    uint64_t seen = 0;
+    for (size_t i = 0; i + 1 < NUM_FRAME_TIME_BUCKETS; ++i) {
+        seen += buckets[i];
+        if (seen > rank) return frame_time_bucket_bounds[i] * 1e-6;
+    }
+    return frame_time_bucket_bounds[NUM_FRAME_TIME_BUCKETS - 2] * 1e-6;
+}
+
+static void _format_metrics(MetricsServer *const server, TextBuffer *const text) {
+    Metrics *const metrics = server->metrics;
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    uint64_t buckets[NUM_FRAME_TIME_BUCKETS];
+    uint64_t frames = 0;
+    for (size_t i = 0; i < NUM_FRAME_TIME_BUCKETS; ++i) {
+        buckets[i] = _load(&metrics->frame_time_buckets[i]);
+        frames += buckets[i];
+    }
+
+    _append(text, "# TYPE tetris_frame_time_seconds summary\n");
+    static double const quantiles[] = {0.5, 0.9, 0.99};
+    for (size_t i = 0; i < sizeof(quantiles) / sizeof(quantiles[0]); ++i)
+        _append(text, "tetris_frame_time_seconds{quantile=\"%g\"} %g\n",
+            quantiles[i], _frame_time_quantile(buckets, frames, quantiles[i]));
+    _append(text, "tetris_frame_time_seconds_sum %g\n",
+        _load(&metrics->frame_time_sum_us) * 1e-6);
+    _append(text, "tetris_frame_time_seconds_count %llu\n",
+        (unsigned long long)frames);
+
+    _append(text, "# TYPE tetris_dropped_frames_total counter\n");
+    _append(text, "tetris_dropped_frames_total %llu\n",
+        (unsigned long long)_load(&metrics->dropped_frames));
+
+    // rates since the last scrape
+    uint64_t const ticks = _load(&metrics->ticks);
+    uint64_t const pieces = _load(&metrics->pieces);
+    uint64_t const lines = _load(&metrics->lines);
+    double const interval = _seconds_between(&server->last_scrape, &now);
+    double const per_second = interval > 0? 1 / interval : 0;
+
+    _append(text, "# TYPE tetris_simulation_ticks_total counter\n");
+    _append(text, "tetris_simulation_ticks_total %llu\n", (unsigned long long)ticks);
+    _append(text, "# TYPE tetris_simulation_ticks_per_second gauge\n");
+    _append(text, "tetris_simulation_ticks_per_second %g\n",
+        (ticks - server->last_ticks) * per_second);
+
+    _append(text, "# TYPE tetris_pieces_total counter\n");
+    _append(text, "tetris_pieces_total %llu\n", (unsigned long long)pieces);
+    _append(text, "# TYPE tetris_pieces_per_minute gauge\n");
+    _append(text, "tetris_pieces_per_minute %g\n",
+        (pieces - server->last_pieces) * per_second * 60);
+
+    _append(text, "# TYPE tetris_lines_total counter\n");
+    _append(text, "tetris_lines_total %llu\n", (unsigned long long)lines);
+    _append(text, "# TYPE tetris_lines_per_minute gauge\n");
+    _append(text, "tetris_lines_per_minute %g\n",
+        (lines - server->last_lines) * per_second * 60);
+
+    _append(text, "# TYPE tetris_hot_reloads_total counter\n");
+    _append(text, "tetris_hot_reloads_total %llu\n",
+        (unsigned long long)_load(&metrics->hot_reloads));
+    _append(text, "# TYPE tetris_hot_reload_seconds_sum counter\n");
+    _append(text, "tetris_hot_reload_seconds_sum %g\n",
+        _load(&metrics->hot_reload_sum_us) * 1e-6);
+    _append(text, "# TYPE tetris_last_hot_reload_seconds gauge\n");
+    _append(text, "tetris_last_hot_reload_seconds %g\n",
+        _load(&metrics->last_hot_reload_us) * 1e-6);
+
+    // cumulative, the way Prometheus histograms count
+    _append(text, "# TYPE tetris_input_latency_seconds histogram\n");
+    for (size_t kind = 0; kind < NUM_LATENCY_INPUTS; ++kind) {
+        char const*const name = latency_input_names[kind];
+        uint64_t count = 0;
+        for (size_t i = 0; i < NUM_LATENCY_BUCKETS; ++i) {
+            count += _load(&metrics->latency_buckets[kind][i]);
+            if (i + 1 < NUM_LATENCY_BUCKETS) _append(text,
+                "tetris_input_latency_seconds_bucket{input=\"%s\",le=\"%g\"} %llu\n",
+                name, latency_bucket_bounds[i] * 1e-6, (unsigned long long)count);
+            else _append(text,
+                "tetris_input_latency_seconds_bucket{input=\"%s\",le=\"+Inf\"} %llu\n",
+                name, (unsigned long long)count);
+        }
+        _append(text, "tetris_input_latency_seconds_sum{input=\"%s\"} %g\n",
+            name, _load(&metrics->latency_sum_us[kind]) * 1e-6);
+        _append(text, "tetris_input_latency_seconds_count{input=\"%s\"} %llu\n",
+            name, (unsigned long long)count);
+    }
+
+    _append(text, "# TYPE tetris_uptime_seconds gauge\n");
+    _append(text, "tetris_uptime_seconds %g\n",
+        _seconds_between(&metrics->start, &now));
+
+    server->last_scrape = now;
+    server->last_ticks = ticks;
+    server->last_pieces = pieces;
+    server->last_lines = lines;
+}
+
+// Serving ////////////////////////////////////////////////////////////////////
+
+// MSG_NOSIGNAL so a scraper hanging up mid-response is an error here rather
+// than a SIGPIPE that takes the game down
+static bool _send_all(int const client, char const* bytes, size_t size) {
+    while (size > 0) {
+        ssize_t const sent = send(client, bytes, size, MSG_NOSIGNAL);
+        if (sent <= 0) return false;
+        bytes += sent;
+        size -= sent;
+    }
+    return true;
+}
+
+// every request gets the metrics, whatever the path. One client at a time is
+// plenty for a scraper, and one that stops reading times out instead of
+// holding the thread.
+static void _serve_client(MetricsServer *const server, int const client) {
+    struct timeval const timeout = {
+        .tv_sec = METRICS_CLIENT_MS / 1000,
+        .tv_usec = METRICS_CLIENT_MS % 1000 * 1000
+    };
+    setsockopt(client, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+    setsockopt(client, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+    // the request itself doesn't matter, just take it off the socket
+    char request[1024];
+    struct pollfd readable = { .fd = client, .events = POLLIN };
+    if (poll(&readable, 1, METRICS_POLL_MS) > 0) {
+        ssize_t const ignored = read(client, request, sizeof(request));
+        (void)ignored;
+    }
+
+    char body[METRICS_BODY_SIZE];
+    TextBuffer text = { .data = body, .size = 0, .capacity = sizeof(body) };
+    _format_metrics(server, &text);
+
+    char header[256];
+    int const header_size = snprintf(header, sizeof(header),
+        "HTTP/1.1 200 OK\r\n"
+        "Content-Type: text/plain; version=0.0.4\r\n"
+        "Content-Length: %zu\r\n"
+        "Connection: close\r\n\r\n",
+        text.size);
+
+    if (_send_all(client, header, header_size)) _send_all(client, body, text.size);
+    close(client);
+}
+
+// wakes up every METRICS_POLL_MS to notice a stop request
+static void *_run_metrics_server(void *const arg) {
+    MetricsServer *const server = arg;
+    while (atomic_load_explicit(&server->running, memory_order_relaxed)) {
+        struct pollfd listening = { .fd = server->socket, .events = POLLIN };
+        if (poll(&listening, 1, METRICS_POLL_MS) <= 0) continue;
+
+        int const client = accept(server->socket, NULL, NULL);
+        if (client >= 0) _serve_client(server, client);
+    }
+    return NULL;
+}
+
+static int _listen_tcp(int const port) {
+    int const fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd < 0) return -1;
+
+    int const reuse = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+
+    struct sockaddr_in address = {
+        .sin_family = AF_INET,
+        .sin_port = htons(port),
+        .sin_addr.s_addr = htonl(INADDR_LOOPBACK) // never off the machine
+    };
+    if (bind(fd, (struct sockaddr*)&address, sizeof(address)) != 0
+    ||  listen(fd, 4) != 0
+    ) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+static int _listen_unix(char const*const path) {
+    struct sockaddr_un address = { .sun_family = AF_UNIX };
+    if (strlen(path) >= sizeof(address.sun_path)) return -1;
+    strcpy(address.sun_path, path);
+
+    int const fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) return -1;
+
+    unlink(path); // left over from a previous run
+    if (bind(fd, (struct sockaddr*)&address, sizeof(address)) != 0
+    ||  listen(fd, 4) != 0
+    ) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+extern bool start_metrics_server(
+    MetricsServer *const server,
+    Metrics *const metrics,
+    char const*const address
+) {
+    *server = (MetricsServer){ .metrics = metrics, .socket = -1 };
+    server->last_scrape = metrics->start;
+
+    if (strncmp(address, "unix:", 5) == 0) {
+        server->unix_path = address + 5;
+        server->socket = _listen_unix(server->unix_path);
+    }
+    else {
+        char const*const port = strncmp(address, "tcp:", 4) == 0? address + 4 : address;
+        server->socket = _listen_tcp(atoi(port));
+    }
+    if (server->socket < 0) {
+        fprintf(stderr, "Error: could not serve metrics on %s.\n", address);
+        return false;
+    }
+
+    atomic_store(&server->running, true);
+    if (pthread_create(&server->thread, NULL, _run_metrics_server, server)) {
+        fprintf(stderr, "Error: could not start the metrics thread.\n");
+        close(server->socket);
+        server->socket = -1;
+        return false;
+    }
+    return true;
+}
+
+extern void stop_metrics_server(MetricsServer *const server) {
+    if (server->socket < 0) return;
+    atomic_store(&server->running, false);
+    pthread_join(server->thread, NULL);
+    close(server->socket);
+    server->socket = -1;
+    if (server->unix_path != NULL) unlink(server->unix_path);
+}
+
+extern char const* metrics_address_from_env(char const*const fallback) {
+    char const*const address = getenv(METRICS_ENV);
+    if (address == NULL || address[0] == '\0') return fallback;
+    if (strcmp(address, "off") == 0) return NULL;
+    return address;
+}
@@ -0,0 +1,140 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include "game.h"
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+
+// Live metrics in the Prometheus text format. The window loop, simulation and
+// batch tools bump lock-free counters in a Metrics block (relaxed atomic adds,
+// any thread), and a background thread serves them over HTTP on a localhost
+// TCP port or a Unix socket:
+//
+//     TETRIS_METRICS=9464                curl localhost:9464/metrics
+//     TETRIS_METRICS=unix:/tmp/tetris    curl --unix-socket /tmp/tetris x/
+//     TETRIS_METRICS=off                 no server
+//
+// Rates (ticks per second, pieces and lines per minute) are worked out over
+// the time since the previous scrape, the raw totals are there as well.
+//
+// Input latency is a histogram per LatencyInput, from the poll that first saw
+// an input to the end of the first frame drawn with the move it made. Only
+// the newest move of each kind is timed when the renderer skips states.
+
+// Constants //////////////////////////////////////////////////////////////////
+#define METRICS_ENV             "TETRIS_METRICS"
+#define NUM_FRAME_TIME_BUCKETS  (size_t) 14
+#define NUM_LATENCY_BUCKETS     (size_t) 12
+#define METRICS_POLL_MS         (int) 200
+#define METRICS_CLIENT_MS       (int) 1000 // a scraper stalled longer is dropped
+#define METRICS_BODY_SIZE       (size_t) 16384
+
+// upper bounds in microseconds, the last bucket catches everything else
+static uint64_t const frame_time_bucket_bounds[NUM_FRAME_TIME_BUCKETS] = {
+    1000, 2000, 4000, 8000, 12000, 16000, 17000, 20000,
+    25000, 33000, 50000, 100000, 250000, UINT64_MAX
+};
+static uint64_t const latency_bucket_bounds[NUM_LATENCY_BUCKETS] = {
+    4000, 8000, 12000, 16000, 20000, 25000,
+    33000, 50000, 67000, 100000, 250000, UINT64_MAX
+};
+static char const*const latency_input_names[NUM_LATENCY_INPUTS] = {
+    "rotate", "shift", "das_repeat", "soft_drop"
+};
+
+// Structs ////////////////////////////////////////////////////////////////////
+typedef struct {
+    struct timespec start;
+
+    _Atomic uint64_t frame_time_buckets[NUM_FRAME_TIME_BUCKETS];
+    _Atomic uint64_t frame_time_sum_us;
+    _Atomic uint64_t frames;
+    _Atomic uint64_t dropped_frames;
+
+    _Atomic uint64_t ticks;
+    _Atomic uint64_t pieces;
+    _Atomic uint64_t lines;
+
+    _Atomic uint64_t hot_reloads;
+    _Atomic uint64_t hot_reload_sum_us;
+    _Atomic uint64_t last_hot_reload_us;
+
+    _Atomic uint64_t latency_buckets[NUM_LATENCY_INPUTS][NUM_LATENCY_BUCKETS];
+    _Atomic uint64_t latency_sum_us[NUM_LATENCY_INPUTS];
+} Metrics;
+
+// which moves the renderer has already timed, render thread only
+typedef struct {
+    unsigned long long drawn_frames[NUM_LATENCY_INPUTS];
+} LatencyProbe;
+
+typedef struct {
+    Metrics *metrics;
+    int socket;
+    char const* unix_path; // unlinked on stop, NULL for TCP
+    _Atomic bool running;
+    pthread_t thread;
+
+    // totals at the previous scrape, for the rates. Server thread only.
+    struct timespec last_scrape;
+    uint64_t last_ticks;
+    uint64_t last_pieces;
+    uint64_t last_lines;
+} MetricsServer;
+
+// Updating ///////////////////////////////////////////////////////////////////
+static inline void _metrics_add(_Atomic uint64_t *const counter, uint64_t const n) {
+    atomic_fetch_add_explicit(counter, n, memory_order_relaxed);
+}
+
+void init_metrics(Metrics *const metrics);
+
+// `target_us` is the frame budget, frames over 1.5x of it count as dropped
+void record_frame_time(
+    Metrics *const metrics,
+    uint64_t const frame_us,
+    uint64_t const target_us
+);
+void record_hot_reload(Metrics *const metrics, uint64_t const reload_us);
+
+// call straight after `display_game` has drawn `game_state`. Times every move
+// in it that hasn't been drawn before (see GameState.move_frame).
+void record_input_latency(
+    Metrics *const metrics,
+    LatencyProbe *const probe,
+    GameState const*const game_state
+);
+
+// call after `next_gamestate` with how many ticks were run and how much
+// pieces_placed and total_lines went up. Busy threads should add up a batch
+// first rather than hitting the shared counters every tick.
+static inline void record_ticks(
+    Metrics *const metrics,
+    uint64_t const ticks,
+    uint64_t const pieces,
+    uint64_t const lines
+) {
+    _metrics_add(&metrics->ticks, ticks);
+    if (pieces > 0) _metrics_add(&metrics->pieces, pieces);
+    if (lines > 0) _metrics_add(&metrics->lines, lines);
+}
+
+// Serving ////////////////////////////////////////////////////////////////////
+
+// `address` is a port number ("9464", "tcp:9464") or "unix:/path". Returns
+// false (after printing why) if it can't listen.
+bool start_metrics_server(
+    MetricsServer *const server,
+    Metrics *const metrics,
+    char const*const address
+);
+void stop_metrics_server(MetricsServer *const server);
+
+// the TETRIS_METRICS address, `fallback` if it isn't set, NULL if it's "off"
+char const* metrics_address_from_env(char const*const fallback);
+
+#endif // METRICS_H
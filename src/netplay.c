@@ -0,0 +1,469 @@
+#include "netplay.h"
+#include "game.h"
+#include "replay.h"
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#define NETPLAY_HEADER_SIZE offsetof(NetplayPacket, inputs)
+
+// Misc ///////////////////////////////////////////////////////////////////////
+static inline double _now(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec * 1e-9;
+}
+
+static inline size_t _min(size_t const a, size_t const b) {
+    return a < b? a : b;
+}
+
+static inline NetplayFrame *_slot(NetplaySession *const session, size_t const frame) {
+    return &session->frames[frame & (NETPLAY_RING - 1)];
+}
+
+static inline bool _same_input(GameInput const*const a, GameInput const*const b) {
+    return a->pressed == b->pressed && a->down == b->down;
+}
+
+static inline unsigned long long _checksum(GameState const players[2]) {
+    return hash_gamestate(&players[0]) * 0x9E3779B97F4A7C15ULL
+         ^ hash_gamestate(&players[1]);
+}
+
+// Shim ///////////////////////////////////////////////////////////////////////
+static inline double _random_unit(NetplaySession *const session) {
+    unsigned x = session->random_state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    session->random_state = x;
+    return (x >> 8) * (1.0 / 16777216.0);
+}
+
+static inline void _send_now(
+    NetplaySession const*const session,
+    NetplayPacket const*const packet,
+    size_t const size
+) {
+    sendto(
+        session->socket,
+        packet,
+        size,
+        0,
+        (struct sockaddr const*)&session->remote_address,
+        sizeof(session->remote_address)
+    );
+}
+
+// drops the packet, holds it back for later or sends it straight away
+static void _send_through_shim(
+    NetplaySession *const session,
+    NetplayPacket const*const packet,
+    size_t const size
+) {
+    NetplayShim const*const shim = &session->shim;
+    if (shim->loss > 0 && _random_unit(session) < shim->loss) return;
+    if (shim->latency <= 0 && shim->jitter <= 0) {
+        _send_now(session, packet, size);
+        return;
+    }
+    if (session->num_delayed == NETPLAY_SHIM_CAPACITY) return; // a full router
+
+    NetplayDelayedPacket *const delayed = &session->delayed[session->num_delayed++];
+    delayed->deliver_at = _now() + shim->latency + shim->jitter * _random_unit(session);
+    delayed->size = size;
+    memcpy(&delayed->packet, packet, size);
+}
+
+// sends whatever the shim has held back long enough. Jitter can reorder them,
+// that is fine for UDP.
+static void _flush_shim(NetplaySession *const session) {
+    double const now = _now();
+    for (size_t i = 0; i < session->num_delayed; ) {
+        NetplayDelayedPacket *const delayed = &session->delayed[i];
+        if (delayed->deliver_at > now) {
+            ++i;
+            continue;
+        }
+        _send_now(session, &delayed->packet, delayed->size);
+        *delayed = session->delayed[--session->num_delayed];
+    }
+}
+
+// Packets ////////////////////////////////////////////////////////////////////
+static void _send_packet(NetplaySession *const session, bool const done) {
+    NetplayPacket packet = {
+        .magic = NETPLAY_MAGIC,
+        .frame = session->frame,
+        .ack = session->num_remote_inputs,
+        .advantage = (int32_t)session->frame - (int32_t)session->remote_frame,
+        .seed = session->seed,
+        .done = done
+    };
+
+    packet.confirmed = session->confirmed;
+    if (session->confirmed > 0)
+        packet.checksum = _slot(session, session->confirmed - 1)->checksum;
+
+    // everything the remote hasn't acknowledged, oldest first
+    packet.first_input = session->remote_acked;
+    size_t const num_inputs = _min(
+        session->num_local_inputs - session->remote_acked,
+        NETPLAY_MAX_SEND
+    );
+    for (size_t i = 0; i < num_inputs; ++i) {
+        size_t const frame = session->remote_acked + i;
+        packet.inputs[i] = pack_replay_input(
+            &session->local_inputs[frame & (NETPLAY_RING - 1)]
+        );
+    }
+    packet.num_inputs = num_inputs;
+
+    _send_through_shim(session, &packet, NETPLAY_HEADER_SIZE + num_inputs);
+}
+
+static void _check_remote_checksum(
+    NetplaySession *const session,
+    NetplayPacket const*const packet
+) {
+    if (packet->confirmed == 0 || packet->confirmed > session->confirmed) return;
+    size_t const frame = packet->confirmed - 1;
+    NetplayFrame const*const slot = _slot(session, frame);
+    if (slot->frame != frame) return; // too old, already overwritten
+
+    session->checksums_verified++;
+    if (slot->checksum != packet->checksum) {
+        if (session->desyncs == 0) fprintf(stderr,
+            "Error: desync at frame %zu (%016llx here, %016llx remote).\n",
+            frame, slot->checksum, (unsigned long long)packet->checksum);
+        session->desyncs++;
+    }
+}
+
+// stores remote input and notes the earliest frame that ran on a wrong guess
+static void _take_remote_inputs(
+    NetplaySession *const session,
+    NetplayPacket const*const packet
+) {
+    for (size_t i = 0; i < packet->num_inputs; ++i) {
+        size_t const frame = packet->first_input + i;
+        if (frame < session->num_remote_inputs
+        ||  frame >= session->num_remote_inputs + NETPLAY_RING
+        ) continue;
+
+        size_t const index = frame & (NETPLAY_RING - 1);
+        session->remote_inputs[index] = unpack_replay_input(packet->inputs[i]);
+        session->remote_input_frames[index] = frame;
+    }
+
+    size_t const remote = 1 - session->local;
+    for (;;) {
+        size_t const frame = session->num_remote_inputs;
+        size_t const index = frame & (NETPLAY_RING - 1);
+        if (session->remote_input_frames[index] != frame) break;
+        session->num_remote_inputs++;
+
+        NetplayFrame const*const slot = _slot(session, frame);
+        if (frame < session->frame
+        &&  slot->frame == frame
+        &&  slot->predicted
+        &&  !_same_input(&slot->inputs[remote], &session->remote_inputs[index])
+        &&  frame < session->rollback_to
+        ) session->rollback_to = frame;
+    }
+}
+
+// returns whether anything valid came in
+static bool _receive_packets(NetplaySession *const session) {
+    bool received = false;
+    NetplayPacket packet;
+    for (;;) {
+        ssize_t const size = recv(session->socket, &packet, sizeof(packet), 0);
+        if (size < 0) break;
+        if ((size_t)size < NETPLAY_HEADER_SIZE
+        ||  packet.magic != NETPLAY_MAGIC
+        ||  packet.num_inputs > NETPLAY_MAX_SEND
+        ||  (size_t)size < NETPLAY_HEADER_SIZE + packet.num_inputs
+        ) continue;
+        if (packet.seed != session->seed) {
+            session->wrong_seed = true;
+            continue;
+        }
+
+        received = true;
+        session->last_received = _now();
+        if (packet.ack > session->remote_acked
+        &&  packet.ack <= session->num_local_inputs
+        ) session->remote_acked = packet.ack;
+        if (packet.frame >= session->remote_frame) {
+            session->remote_frame = packet.frame;
+            session->remote_advantage = packet.advantage;
+        }
+        if (packet.done) session->remote_done = true;
+
+        _take_remote_inputs(session, &packet);
+        _check_remote_checksum(session, &packet);
+    }
+    return received;
+}
+
+// Frames /////////////////////////////////////////////////////////////////////
+
+// the real input if it has arrived, otherwise the last known buttons held
+static inline GameInput _remote_input(
+    NetplaySession const*const session,
+    size_t const frame,
+    bool *const predicted
+) {
+    *predicted = frame >= session->num_remote_inputs;
+    if (!*predicted)
+        return session->remote_inputs[frame & (NETPLAY_RING - 1)];
+    if (session->num_remote_inputs == 0)
+        return (GameInput){ .pressed = 0, .down = 0 };
+
+    GameInput const last
+        = session->remote_inputs[(session->num_remote_inputs - 1) & (NETPLAY_RING - 1)];
+    return (GameInput){ .pressed = 0, .down = last.down };
+}
+
+// runs `session->frame` from its snapshot into the next slot
+static void _run_frame(NetplaySession *const session) {
+    size_t const frame = session->frame;
+    size_t const local = session->local;
+    NetplayFrame *const current = _slot(session, frame);
+    NetplayFrame *const next = _slot(session, frame + 1);
+
+    current->inputs[local] = session->local_inputs[frame & (NETPLAY_RING - 1)];
+    current->inputs[1 - local] = _remote_input(session, frame, &current->predicted);
+
+    next->frame = frame + 1;
+    current->topped_out = 0;
+    for (size_t i = 0; i < 2; ++i) {
+        next->players[i] = current->players[i];
+        if (next_gamestate(&next->players[i], &current->inputs[i]))
+            current->topped_out |= 1 << i;
+    }
+    exchange_garbage(&next->players[0], &next->players[1]);
+    current->checksum = _checksum(next->players);
+
+    session->frame++;
+}
+
+// back to the snapshot before the first wrong guess and forward again
+static void _roll_back(NetplaySession *const session) {
+    if (session->rollback_to >= session->frame) return;
+
+    double const start = _now();
+    size_t const present = session->frame;
+    size_t const depth = present - session->rollback_to;
+    session->frame = session->rollback_to;
+    session->rollback_to = SIZE_MAX;
+    while (session->frame < present) _run_frame(session);
+    double const seconds = _now() - start;
+
+    session->rollbacks++;
+    session->resimulated_frames += depth;
+    if (depth > session->max_rollback) session->max_rollback = depth;
+    if (seconds > session->max_rollback_seconds) session->max_rollback_seconds = seconds;
+    session->total_rollback_seconds += seconds;
+}
+
+// moves the confirmed frame up and ends the match on a confirmed top out
+static void _confirm_frames(NetplaySession *const session) {
+    if (session->end_frame != SIZE_MAX) return;
+
+    size_t const confirmed = _min(
+        _min(session->num_remote_inputs, session->frame),
+        session->max_frames
+    );
+    for (; session->confirmed < confirmed; ++session->confirmed) {
+        NetplayFrame const*const slot = _slot(session, session->confirmed);
+        if (slot->topped_out) {
+            session->end_frame = session->confirmed + 1;
+            session->end_topped_out = slot->topped_out;
+            session->confirmed++;
+            return;
+        }
+    }
+    if (session->confirmed == session->max_frames) session->end_frame = session->max_frames;
+}
+
+// waits a frame now and then when this peer keeps running ahead of the
+// remote, otherwise the one in front ends up predicting all the time.
+static bool _should_wait_for_sync(NetplaySession *const session) {
+    int const local_advantage = (int)session->frame - (int)session->remote_frame;
+    if ((local_advantage - session->remote_advantage) / 2 < 1
+    ||  session->frame < session->last_sync_frame + NETPLAY_SYNC_INTERVAL
+    ) return false;
+    session->last_sync_frame = session->frame;
+    return true;
+}
+
+// Exposed ////////////////////////////////////////////////////////////////////
+extern bool open_netplay_session(
+    NetplaySession *const session,
+    size_t const local,
+    size_t const level,
+    unsigned long long const seed,
+    size_t const input_delay,
+    size_t const max_frames,
+    unsigned short const local_port,
+    char const*const remote_host,
+    unsigned short const remote_port,
+    NetplayShim const*const shim
+) {
+    memset(session, 0, sizeof(NetplaySession));
+    session->seed = seed;
+    session->local = local;
+    session->input_delay = _min(input_delay, NETPLAY_MAX_DELAY);
+    session->max_frames = max_frames;
+    session->shim = *shim;
+    session->random_state = (unsigned)(seed ^ seed >> 32) * 2 + 1 + local_port;
+    session->rollback_to = SIZE_MAX;
+    session->end_frame = SIZE_MAX;
+    for (size_t i = 0; i < NETPLAY_RING; ++i) {
+        session->remote_input_frames[i] = SIZE_MAX;
+        session->frames[i].frame = SIZE_MAX;
+    }
+
+    NetplayFrame *const first = _slot(session, 0);
+    first->frame = 0;
+    first->players[0] = init_gamestate_seeded(level, seed);
+    first->players[1] = first->players[0];
+
+    // the first frames before any delayed input lands are played empty
+    session->num_local_inputs = session->input_delay;
+
+    struct addrinfo const hints = { .ai_family = AF_INET, .ai_socktype = SOCK_DGRAM };
+    struct addrinfo *address = NULL;
+    if (getaddrinfo(remote_host, NULL, &hints, &address) != 0 || address == NULL) {
+        fprintf(stderr, "Error: could not resolve %s.\n", remote_host);
+        return false;
+    }
+    memcpy(&session->remote_address, address->ai_addr, sizeof(struct sockaddr_in));
+    session->remote_address.sin_port = htons(remote_port);
+    freeaddrinfo(address);
+
+    session->socket = socket(AF_INET, SOCK_DGRAM, 0);
+    struct sockaddr_in const bound = {
+        .sin_family = AF_INET,
+        .sin_port = htons(local_port),
+        .sin_addr.s_addr = htonl(INADDR_ANY)
+    };
+    if (session->socket < 0
+    ||  bind(session->socket, (struct sockaddr const*)&bound, sizeof(bound)) != 0
+    ||  fcntl(session->socket, F_SETFL, O_NONBLOCK) != 0
+    ) {
+        fprintf(stderr, "Error: could not open UDP port %u.\n", local_port);
+        if (session->socket >= 0) close(session->socket);
+        session->socket = -1;
+        return false;
+    }
+    return true;
+}
+
+extern void close_netplay_session(NetplaySession *const session) {
+    if (session->socket >= 0) close(session->socket);
+    session->socket = -1;
+}
+
+extern bool connect_netplay_session(NetplaySession *const session, double const timeout) {
+    double const start = _now();
+    while (_now() - start < timeout) {
+        _send_packet(session, false);
+        _flush_shim(session);
+        if (_receive_packets(session)) return true;
+        if (session->wrong_seed) {
+            fprintf(stderr, "Error: the other peer is playing a different seed.\n");
+            return false;
+        }
+
+        struct timespec const wait = { 0, (long)(NETPLAY_HELLO_INTERVAL * 1e9) };
+        nanosleep(&wait, NULL);
+    }
+    return false;
+}
+
+extern bool tick_netplay_session(
+    NetplaySession *const session,
+    GameInput const*const input
+) {
+    _receive_packets(session);
+    _roll_back(session);
+    _confirm_frames(session);
+
+    if (session->end_frame == SIZE_MAX
+    &&  _now() - session->last_received > NETPLAY_DISCONNECT
+    ) {
+        fprintf(stderr, "Error: lost the other peer at frame %zu.\n", session->frame);
+        session->disconnected = true;
+        session->end_frame = session->confirmed;
+    }
+
+    bool ran = false;
+    if (session->end_frame != SIZE_MAX || session->frame >= session->max_frames) {}
+    else if (session->frame - session->confirmed >= NETPLAY_MAX_PREDICTION)
+        session->stalls++;
+    else if (_should_wait_for_sync(session))
+        session->sync_waits++;
+    else {
+        size_t const input_frame = session->frame + session->input_delay;
+        session->local_inputs[input_frame & (NETPLAY_RING - 1)] = *input;
+        session->num_local_inputs = input_frame + 1;
+        _run_frame(session);
+        _confirm_frames(session);
+        ran = true;
+    }
+
+    _send_packet(session, false);
+    _flush_shim(session);
+    return ran;
+}
+
+extern GameState const* netplay_local_state(NetplaySession const*const session) {
+    return &session->frames[session->frame & (NETPLAY_RING - 1)].players[session->local];
+}
+
+extern bool is_netplay_over(NetplaySession const*const session) {
+    return session->end_frame != SIZE_MAX;
+}
+
+extern void finish_netplay_session(NetplaySession *const session, double const timeout) {
+    if (session->disconnected) return;
+    double const start = _now();
+    while (_now() - start < timeout) {
+        _receive_packets(session);
+        _send_packet(session, true);
+        _flush_shim(session);
+        if (session->remote_done
+        &&  session->remote_acked >= _min(session->end_frame, session->num_local_inputs)
+        &&  session->num_delayed == 0
+        ) return;
+
+        struct timespec const wait = { 0, (long)(NETPLAY_HELLO_INTERVAL * 1e9) };
+        nanosleep(&wait, NULL);
+    }
+}
+
+extern size_t netplay_winner(NetplaySession const*const session) {
+    switch (session->end_topped_out) {
+        case 1:  return 1;
+        case 2:  return 0;
+        default: return 2;
+    }
+}
+
+extern unsigned long long netplay_checksum(NetplaySession const*const session) {
+    if (session->end_frame == SIZE_MAX || session->end_frame == 0) return 0;
+    return session->frames[(session->end_frame - 1) & (NETPLAY_RING - 1)].checksum;
+}
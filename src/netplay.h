@@ -0,0 +1,168 @@
+#ifndef NETPLAY_H
+#define NETPLAY_H
+
+#include "game.h"
+#include <netinet/in.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Peer to peer versus over UDP with rollback. Both peers run both boards.
+// Local input goes out straight away, remote input that hasn't arrived yet
+// is predicted (the buttons held last stay held, nothing new is pressed) so
+// the game never waits on the network. When the real input turns up and
+// differs from the guess, the session restores the snapshot from before that
+// frame and runs `next_gamestate` forward again to the present, all inside
+// the same tick.
+//
+// Every frame keeps a snapshot of both GameStates in a ring, which bounds how
+// far ahead of the confirmed input a peer may predict. Past that it stalls
+// until the remote catches up. Each packet repeats every input the other side
+// hasn't acknowledged yet, so losing some doesn't matter, and carries a
+// checksum of a confirmed frame so desyncs are caught as they happen.
+//
+// The socket goes through a shim that can add latency, jitter and loss to
+// outgoing packets, for trying things out over loopback (see netplay_tool.c).
+//
+// Packets are in native byte order, like the games themselves both peers are
+// expected to run the same build.
+
+// Constants //////////////////////////////////////////////////////////////////
+#define NETPLAY_MAGIC          (uint32_t) 0x54524E50 // "TRNP"
+#define NETPLAY_RING           (size_t) 64 // frames of snapshots, power of 2
+#define NETPLAY_MAX_PREDICTION (size_t) 8  // frames ahead of confirmed input
+#define NETPLAY_MAX_SEND       (size_t) 48 // inputs per packet
+#define NETPLAY_MAX_DELAY      (size_t) 8  // frames of input delay
+#define NETPLAY_SYNC_INTERVAL  (size_t) 10 // frames between time sync waits
+#define NETPLAY_SHIM_CAPACITY  (size_t) 256 // packets held back by the shim
+#define NETPLAY_HELLO_INTERVAL (double) 0.05 // seconds
+#define NETPLAY_DISCONNECT     (double) 5 // seconds without a packet
+
+// Structs ////////////////////////////////////////////////////////////////////
+
+// what the shim does to outgoing packets
+typedef struct {
+    double latency;  // seconds, one way
+    double jitter;   // seconds, added at random on top of the latency
+    double loss;     // chance a packet is dropped, 0-1
+} NetplayShim;
+
+typedef struct {
+    uint32_t magic;
+    uint32_t frame;          // the sender's current frame
+    uint32_t ack;            // how many of our inputs the sender has, in order
+    int32_t  advantage;      // sender's frame minus our latest frame it saw
+    uint64_t seed;
+    uint32_t confirmed;      // frames the sender has confirmed
+    uint32_t first_input;    // frame of inputs[0]
+    uint64_t checksum;       // after the last confirmed frame
+    uint8_t  num_inputs;
+    uint8_t  done;           // the sender has finished the match
+    uint8_t  inputs[NETPLAY_MAX_SEND]; // see pack_replay_input
+} NetplayPacket;
+
+typedef struct {
+    size_t frame; // which frame this slot holds, the ring wraps
+    GameState players[2];     // before the frame runs
+    GameInput inputs[2];      // what the frame ran with
+    bool predicted;           // inputs[remote] was a guess
+    unsigned char topped_out; // bit per player, after the frame ran
+    unsigned long long checksum; // after the frame ran
+} NetplayFrame;
+
+typedef struct {
+    double deliver_at;
+    size_t size;
+    NetplayPacket packet;
+} NetplayDelayedPacket;
+
+typedef struct {
+    unsigned long long seed;
+    size_t local;       // which board is ours, 0 or 1
+    size_t input_delay; // frames between reading input and playing it
+    size_t max_frames;  // a draw if nobody has topped out by then
+
+    int socket;
+    struct sockaddr_in remote_address;
+    NetplayShim shim;
+    unsigned random_state; // the shim's dice
+    NetplayDelayedPacket delayed[NETPLAY_SHIM_CAPACITY];
+    size_t num_delayed;
+
+    size_t frame;       // next frame to run
+    size_t confirmed;   // frames whose inputs are all real
+    size_t rollback_to; // earliest frame run on a wrong guess, or SIZE_MAX
+    NetplayFrame frames[NETPLAY_RING];
+
+    GameInput local_inputs[NETPLAY_RING];
+    size_t num_local_inputs;   // local input is decided up to here
+    size_t remote_acked;       // the remote has this many of ours
+    GameInput remote_inputs[NETPLAY_RING];
+    size_t remote_input_frames[NETPLAY_RING]; // frame of each entry
+    size_t num_remote_inputs;  // remote input known up to here, in order
+    size_t remote_frame;       // latest frame the remote said it was on
+    int remote_advantage;
+    size_t last_sync_frame;
+
+    size_t end_frame; // frames in the match once confirmed, else SIZE_MAX
+    unsigned char end_topped_out;
+    bool remote_done;
+    bool disconnected; // the remote went quiet, the match ends where it was
+    bool wrong_seed;   // heard from a peer playing another game
+    double last_received;
+
+    // stats
+    size_t rollbacks;
+    size_t resimulated_frames;
+    size_t max_rollback;
+    double max_rollback_seconds;
+    double total_rollback_seconds;
+    size_t stalls;     // ticks waiting on remote input
+    size_t sync_waits; // ticks given up to let a slower remote catch up
+    size_t checksums_verified;
+    size_t desyncs;
+} NetplaySession;
+
+// Functions //////////////////////////////////////////////////////////////////
+
+// binds `local_port` and talks to `remote_host:remote_port`. Both peers must
+// use the same level and seed and opposite `local` boards. Prints why and
+// returns false if the socket can't be set up.
+bool open_netplay_session(
+    NetplaySession *const session,
+    size_t const local,
+    size_t const level,
+    unsigned long long const seed,
+    size_t const input_delay,
+    size_t const max_frames,
+    unsigned short const local_port,
+    char const*const remote_host,
+    unsigned short const remote_port,
+    NetplayShim const*const shim
+);
+void close_netplay_session(NetplaySession *const session);
+
+// sends hellos until the remote answers, false after `timeout` seconds or if
+// it is playing a different seed
+bool connect_netplay_session(NetplaySession *const session, double const timeout);
+
+// one tick: reads packets, rolls back if a guess was wrong, then plays
+// `input` on the local board and runs a frame unless that would predict too
+// far ahead. Returns whether a frame was run (the input is not used if not).
+bool tick_netplay_session(NetplaySession *const session, GameInput const*const input);
+
+// the local board as of the newest frame (predicted)
+GameState const* netplay_local_state(NetplaySession const*const session);
+
+// true once a confirmed frame topped out a player, max_frames were played or
+// the remote went away
+bool is_netplay_over(NetplaySession const*const session);
+
+// keeps resending until the remote has all our input or `timeout` runs out
+void finish_netplay_session(NetplaySession *const session, double const timeout);
+
+// the confirmed boards at the end: 0 or 1 for the winner, 2 for a draw
+size_t netplay_winner(NetplaySession const*const session);
+unsigned long long netplay_checksum(NetplaySession const*const session);
+
+#endif // NETPLAY_H
@@ -0,0 +1,250 @@
+#include "game.h"
+#include "bot.h"
+#include "config.h"
+#include "mcts.h"
+#include "netplay.h"
+#include <raylib.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// Rollback netplay peer (see netplay.h). Start one per player, on opposite
+// boards and pointing at each other, e.g. over loopback with 60ms of lag,
+// 10ms of jitter and 5% loss each way:
+//
+//     ./netplay -i 0 -p 7000 -r 127.0.0.1:7001 -L 60 -J 10 -X 5 &
+//     ./netplay -i 1 -p 7001 -r 127.0.0.1:7000 -L 60 -J 10 -X 5
+//
+// Both print the same checksum at the end if they stayed in sync. The local
+// board is played by a bot (-b name, see bot.h), the tree search bot (-b mcts
+// thinking -m ms a piece on -j threads, see mcts.h) or from the keyboard in
+// a window (-b keys).
+//
+// usage: ./netplay -i board -p port -r host:port [-b bot|mcts|keys] [-s seed]
+//                  [-l level] [-d delay] [-f frames] [-t ticks/s]
+//                  [-L latency ms] [-J jitter ms] [-X loss %]
+//                  [-m think ms] [-j threads]
+
+#define NETPLAY_SEED       (unsigned long long) 1
+#define NETPLAY_LEVEL      (size_t) 15
+#define NETPLAY_DELAY      (size_t) 1
+#define NETPLAY_MAX_FRAMES (size_t) 36000 // 10 minutes at 60 ticks
+#define NETPLAY_TICK_RATE  (size_t) 60
+#define NETPLAY_TIMEOUT    (double) 10 // seconds to find the other peer
+#define NETPLAY_LINGER     (double) 2  // seconds to make sure it got our input
+
+typedef struct {
+    size_t board;
+    unsigned short port;
+    char remote_host[256];
+    unsigned short remote_port;
+    BotConfig const* bot; // NULL for the keyboard
+    bool mcts;            // search with `bot` scoring the boards
+    MctsConfig mcts_config;
+    unsigned long long seed;
+    size_t level;
+    size_t delay;
+    size_t max_frames;
+    size_t tick_rate;
+    NetplayShim shim;
+} NetplayOptions;
+
+// Options ////////////////////////////////////////////////////////////////////
+static bool _parse_remote(char const*const value, NetplayOptions *const options) {
+    char const*const colon = strrchr(value, ':');
+    if (colon == NULL || colon == value
+    ||  (size_t)(colon - value) >= sizeof(options->remote_host)
+    ) return false;
+    memcpy(options->remote_host, value, colon - value);
+    options->remote_host[colon - value] = '\0';
+    options->remote_port = strtoul(colon + 1, NULL, 10);
+    return options->remote_port > 0;
+}
+
+static bool _parse_bot(char const*const value, NetplayOptions *const options) {
+    if (strcmp(value, "keys") == 0) {
+        options->bot = NULL;
+        return true;
+    }
+    if (strcmp(value, "mcts") == 0) {
+        options->mcts = true;
+        return true;
+    }
+    for (size_t i = 0; i < NUM_BOT_CONFIGS; ++i) {
+        if (strcmp(value, bot_configs[i].name) != 0) continue;
+        options->bot = &bot_configs[i];
+        return true;
+    }
+    return false;
+}
+
+static bool _parse_options(int const argc, char **argv, NetplayOptions *const options) {
+    *options = (NetplayOptions){
+        .board      = 2,
+        .bot        = &bot_configs[0],
+        .seed       = NETPLAY_SEED,
+        .level      = NETPLAY_LEVEL,
+        .delay      = NETPLAY_DELAY,
+        .max_frames = NETPLAY_MAX_FRAMES,
+        .tick_rate  = NETPLAY_TICK_RATE,
+        .mcts_config = {
+            .think_seconds  = MCTS_THINK_SECONDS,
+            .num_threads    = 0,
+            .played_pieces  = MCTS_PLAYED_PIECES,
+            .exploration    = MCTS_EXPLORATION,
+            .evaluation     = &bot_configs[0]
+        }
+    };
+
+    for (int i = 1; i < argc; ++i) {
+        if (i + 1 >= argc) return false;
+        char const*const value = argv[i + 1];
+
+        if      (strcmp(argv[i], "-i") == 0) options->board = strtoul(value, NULL, 10);
+        else if (strcmp(argv[i], "-p") == 0) options->port = strtoul(value, NULL, 10);
+        else if (strcmp(argv[i], "-r") == 0) { if (!_parse_remote(value, options)) return false; }
+        else if (strcmp(argv[i], "-b") == 0) { if (!_parse_bot(value, options)) return false; }
+        else if (strcmp(argv[i], "-s") == 0) options->seed = strtoull(value, NULL, 10);
+        else if (strcmp(argv[i], "-l") == 0) options->level = strtoul(value, NULL, 10);
+        else if (strcmp(argv[i], "-d") == 0) options->delay = strtoul(value, NULL, 10);
+        else if (strcmp(argv[i], "-f") == 0) options->max_frames = strtoul(value, NULL, 10);
+        else if (strcmp(argv[i], "-t") == 0) options->tick_rate = strtoul(value, NULL, 10);
+        else if (strcmp(argv[i], "-L") == 0) options->shim.latency = atof(value) * 1e-3;
+        else if (strcmp(argv[i], "-J") == 0) options->shim.jitter = atof(value) * 1e-3;
+        else if (strcmp(argv[i], "-X") == 0) options->shim.loss = atof(value) * 1e-2;
+        else if (strcmp(argv[i], "-m") == 0) options->mcts_config.think_seconds = atof(value) * 1e-3;
+        else if (strcmp(argv[i], "-j") == 0) options->mcts_config.num_threads = strtoul(value, NULL, 10);
+        else return false;
+        ++i;
+    }
+    return options->board < 2
+        && options->port > 0
+        && options->remote_port > 0
+        && options->delay <= NETPLAY_MAX_DELAY
+        && options->max_frames > 0
+        && options->tick_rate > 0;
+}
+
+// Reporting //////////////////////////////////////////////////////////////////
+static void _report(NetplaySession const*const session, NetplayOptions const*const options) {
+    static char const*const outcomes[3] = { "board 0 won", "board 1 won", "draw" };
+    printf("board %zu (%s), %zu frames, %s\n",
+        options->board,
+        options->mcts? "mcts" : options->bot != NULL? options->bot->name : "keys",
+        session->end_frame,
+        session->disconnected? "disconnected" : outcomes[netplay_winner(session)]);
+    printf("checksum %016llx\n", netplay_checksum(session));
+    printf("rollbacks %zu, %zu frames resimulated, deepest %zu, "
+           "longest %.1fus, mean %.1fus\n",
+        session->rollbacks,
+        session->resimulated_frames,
+        session->max_rollback,
+        session->max_rollback_seconds * 1e6,
+        session->rollbacks > 0
+            ? session->total_rollback_seconds / session->rollbacks * 1e6
+            : 0);
+    printf("stalls %zu, sync waits %zu, checksums verified %zu, desyncs %zu\n",
+        session->stalls,
+        session->sync_waits,
+        session->checksums_verified,
+        session->desyncs);
+}
+
+int main(int argc, char **argv) {
+    NetplayOptions options;
+    if (!_parse_options(argc, argv, &options)) {
+        fprintf(stderr,
+            "usage: %s -i board -p port -r host:port [-b bot|mcts|keys] [-s seed]\n"
+            "          [-l level] [-d delay] [-f frames] [-t ticks/s]\n"
+            "          [-L latency ms] [-J jitter ms] [-X loss %%]\n"
+            "          [-m think ms] [-j threads]\n",
+            argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    static NetplaySession session;
+    if (!open_netplay_session(
+        &session,
+        options.board,
+        options.level,
+        options.seed,
+        options.delay,
+        options.max_frames,
+        options.port,
+        options.remote_host,
+        options.remote_port,
+        &options.shim
+    )) return EXIT_FAILURE;
+
+    if (!connect_netplay_session(&session, NETPLAY_TIMEOUT)) {
+        if (!session.wrong_seed) fprintf(stderr, "Error: no answer from %s:%u.\n",
+            options.remote_host, options.remote_port);
+        close_netplay_session(&session);
+        return EXIT_FAILURE;
+    }
+
+    bool const keyboard = options.bot == NULL && !options.mcts;
+    Bot bot;
+    static MctsBot mcts;
+    DisplayConfig display_config;
+    if (keyboard) {
+        InitWindow(INIT_WIDTH, INIT_HEIGHT, "Netplay");
+        display_config = init_display_config(DEFAULT_DISPLAY_MODE);
+    }
+    else if (options.mcts) {
+        if (!init_mcts_bot(&mcts, &options.mcts_config)) {
+            close_netplay_session(&session);
+            return EXIT_FAILURE;
+        }
+    }
+    else bot = init_bot(options.bot);
+
+    // presses carry over ticks where no frame ran so none get lost
+    GameInput pending = { .pressed = 0, .down = 0 };
+    size_t frames_run = 0;
+
+    struct timespec next_tick;
+    clock_gettime(CLOCK_MONOTONIC, &next_tick);
+    long const tick_nanoseconds = 1000000000L / options.tick_rate;
+
+    while (!is_netplay_over(&session) && !(keyboard && WindowShouldClose())) {
+        GameState const*const local = netplay_local_state(&session);
+        GameInput input;
+        if (keyboard) input = poll_game_input();
+        // one button at a time, then wait for it to come through the delay
+        else if (frames_run % (options.delay + 1) != 0) input = (GameInput){ .pressed = 0, .down = 0 };
+        else if (options.mcts) input = next_mcts_input(&mcts, local);
+        else input = next_bot_input(&bot, local);
+        pending.pressed |= input.pressed;
+        pending.down = input.down;
+
+        if (tick_netplay_session(&session, &pending)) {
+            pending.pressed = 0;
+            frames_run++;
+        }
+        if (keyboard) display_game(netplay_local_state(&session), &display_config);
+
+        next_tick.tv_nsec += tick_nanoseconds;
+        if (next_tick.tv_nsec >= 1000000000L) {
+            next_tick.tv_nsec -= 1000000000L;
+            next_tick.tv_sec++;
+        }
+        clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next_tick, NULL);
+    }
+
+    finish_netplay_session(&session, NETPLAY_LINGER);
+    if (keyboard) CloseWindow();
+    if (options.mcts) {
+        if (mcts.searches > 0) printf("mcts %llu searches, %.0f iterations and %.2fms each\n",
+            mcts.searches,
+            (double)mcts.iterations / mcts.searches,
+            mcts.search_seconds * 1e3 / mcts.searches);
+        free_mcts_bot(&mcts);
+    }
+    close_netplay_session(&session);
+
+    _report(&session, &options);
+    return session.desyncs == 0 && !session.disconnected? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,155 @@
+#include "publish.h"
+#include "game.h"
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+// Reference reader for the shared-memory state publisher (see publish.h).
+// Maps the ring read-only and prints every snapshot it manages to catch,
+// following the game across restarts.
+// usage: ./observer [-b]    (-b also prints the board)
+
+#define OBSERVER_POLL_NS       (long) 4000000 // 4ms, a few polls per frame
+#define OBSERVER_RECHECK_POLLS (size_t) 250   // about a second, see _is_stale
+
+static char const tetromino_chars[NUM_TETROMINO_TYPES + 1] = "LJTOIZS-";
+
+static inline char _tetromino_char(uint8_t const type) {
+    return type <= NUM_TETROMINO_TYPES? tetromino_chars[type] : '?';
+}
+
+static void _print_snapshot(
+    StateSnapshot const*const snapshot,
+    bool const print_board
+) {
+    printf(
+        "frame %llu  score %llu  level %u  lines %u  piece %c (%d, %d) r%u  next %c\n",
+        (unsigned long long)snapshot->frame_number,
+        (unsigned long long)snapshot->score,
+        snapshot->level,
+        snapshot->total_lines,
+        _tetromino_char(snapshot->piece_type),
+        snapshot->piece_x,
+        snapshot->piece_y,
+        snapshot->piece_rotation,
+        _tetromino_char(snapshot->next_type)
+    );
+    if (!print_board) return;
+
+    for (size_t y = 0; y < ROWS; ++y) {
+        putchar('\t');
+        for (size_t x = 0; x < COLS; ++x)
+            printf("%c ", _tetromino_char(snapshot->board[y][x]));
+        putchar('\n');
+    }
+}
+
+// maps the ring read-only and notes which object it is, NULL (after saying
+// why, unless `quiet`) if there is no valid one
+static PublishRing *_map_ring(ino_t *const inode, bool const quiet) {
+    int const fd = shm_open(PUBLISH_SHM_NAME, O_RDONLY, 0);
+    if (fd < 0) {
+        if (!quiet) perror("Error: no game is publishing (shm_open)");
+        return NULL;
+    }
+
+    struct stat stat;
+    PublishRing *ring = MAP_FAILED;
+    if (fstat(fd, &stat) == 0 && (size_t)stat.st_size >= sizeof(PublishRing))
+        ring = mmap(NULL, sizeof(PublishRing), PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (ring == MAP_FAILED) {
+        if (!quiet) perror("Error: mmap");
+        return NULL;
+    }
+    if (!publish_ring_is_valid(ring)) {
+        if (!quiet) fprintf(stderr, "Error: shared memory has an unknown layout.\n");
+        munmap(ring, sizeof(PublishRing));
+        return NULL;
+    }
+    *inode = stat.st_ino;
+    return ring;
+}
+
+// true if the name now points at another object than `inode`, which is
+// what a game restarted after a clean exit (it unlinks the old one) makes
+static bool _is_stale(ino_t const inode) {
+    int const fd = shm_open(PUBLISH_SHM_NAME, O_RDONLY, 0);
+    if (fd < 0) return false; // nothing newer yet, keep the old one
+    struct stat stat;
+    bool const is_stale = fstat(fd, &stat) == 0 && stat.st_ino != inode;
+    close(fd);
+    return is_stale;
+}
+
+int main(int argc, char **argv) {
+    bool const print_board = argc > 1 && strcmp(argv[1], "-b") == 0;
+
+    ino_t inode;
+    PublishRing *ring = _map_ring(&inode, false);
+    if (ring == NULL) return EXIT_FAILURE;
+
+    struct timespec const poll_interval = { 0, OBSERVER_POLL_NS };
+    uint32_t creator_pid = ring->creator_pid;
+    uint64_t next_index = 0;
+    uint64_t missed = 0;
+    StateSnapshot snapshot;
+
+    for (size_t poll = 1;; ++poll) {
+        if (poll % OBSERVER_RECHECK_POLLS == 0 && _is_stale(inode)) {
+            ino_t new_inode;
+            PublishRing *const new_ring = _map_ring(&new_inode, true);
+            if (new_ring != NULL) { // still being set up otherwise, try again later
+                munmap(ring, sizeof(PublishRing));
+                ring = new_ring;
+                inode = new_inode;
+                creator_pid = ring->creator_pid;
+                next_index = 0;
+                fprintf(stderr, "observer: the game restarted, following the new one\n");
+            }
+        }
+
+        uint64_t const published = atomic_load_explicit(
+            &ring->published,
+            memory_order_acquire
+        );
+
+        // the game restarted its publisher in the same memory, start again
+        // from its beginning
+        if (published < next_index || ring->creator_pid != creator_pid) {
+            creator_pid = ring->creator_pid;
+            next_index = 0;
+        }
+
+        // too far behind, everything before the oldest slot is gone
+        if (published - next_index > PUBLISH_RING_SIZE) {
+            missed += published - PUBLISH_RING_SIZE - next_index;
+            next_index = published - PUBLISH_RING_SIZE;
+        }
+
+        for (; next_index < published; ++next_index) {
+            if (!publish_read_snapshot(ring, next_index, &snapshot)) {
+                missed++;
+                continue;
+            }
+            _print_snapshot(&snapshot, print_board);
+        }
+
+        if (missed > 0) {
+            fprintf(stderr, "observer: missed %llu snapshots\n",
+                (unsigned long long)missed);
+            missed = 0;
+        }
+        fflush(stdout);
+        nanosleep(&poll_interval, NULL);
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,179 @@
+#include "game.h"
+#include <stdbool.h>
+#include <stddef.h>
+
+// Effect Tuning //////////////////////////////////////////////////////////////
+#define CLEAR_SHARDS_PER_CELL (size_t) 8
+#define CLEAR_SHARD_LIFE      (float) 40
+#define CLEAR_SHARD_SIZE      (float) 0.25
+#define CLEAR_GHOST_LIFE      (float) 12 // the row itself fading out
+#define LOCK_DUST_PER_BLOCK   (size_t) 3
+#define LOCK_DUST_LIFE        (float) 14
+#define LOCK_DUST_SIZE        (float) 0.12
+#define PARTICLE_GRAVITY      (float) 0.012
+#define MAX_PARTICLE_STEP     (float) 60 // frames, after a long stall
+#define PARTICLE_LANES        (size_t) 8  // PARTICLE_CAPACITY is a multiple
+
+// Spawning ///////////////////////////////////////////////////////////////////
+
+// xorshift, the game's own generator is part of its state so effects keep
+// to this one.
+static inline float _random_float(
+    ParticlePool *const pool,
+    float const low,
+    float const high
+) {
+    unsigned x = pool->random_state? pool->random_state : 0x2545F491u;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    pool->random_state = x;
+    return low + (high - low) * (x >> 8) * (1.0f / 16777216.0f);
+}
+
+// drops particles once the pool is full rather than growing it
+static inline void _spawn_particle(
+    ParticlePool *const pool,
+    float const x,
+    float const y,
+    float const velocity_x,
+    float const velocity_y,
+    float const weight,
+    float const life,
+    float const size,
+    TetrominoType const type
+) {
+    if (pool->count == PARTICLE_CAPACITY) return;
+    size_t const i = pool->count++;
+    pool->x[i] = x;
+    pool->y[i] = y;
+    pool->velocity_x[i] = velocity_x;
+    pool->velocity_y[i] = velocity_y;
+    pool->weight[i] = weight;
+    pool->life[i] = life;
+    pool->fade[i] = 1 / life;
+    pool->size[i] = size;
+    pool->type[i] = type;
+}
+
+// each cleared cell fades out where it was and throws out a few shards
+static void _spawn_clear(ParticlePool *const pool, GameState const*const game_state) {
+    for (size_t i = 0; i < game_state->num_cleared_rows; ++i) {
+        float const y = game_state->cleared_rows[i];
+        for (size_t x = 0; x < COLS; ++x) {
+            TetrominoType const type = game_state->cleared_cells[i][x];
+            _spawn_particle(pool, x, y, 0, 0, 0, CLEAR_GHOST_LIFE, 1, type);
+
+            for (size_t j = 0; j < CLEAR_SHARDS_PER_CELL; ++j) _spawn_particle(
+                pool,
+                x + _random_float(pool, 0, 1 - CLEAR_SHARD_SIZE),
+                y + _random_float(pool, 0, 1 - CLEAR_SHARD_SIZE),
+                _random_float(pool, -0.12f, 0.12f),
+                _random_float(pool, -0.25f, 0.02f),
+                PARTICLE_GRAVITY,
+                _random_float(pool, 0.6f, 1) * CLEAR_SHARD_LIFE,
+                CLEAR_SHARD_SIZE,
+                type
+            );
+        }
+    }
+}
+
+// a puff from under each block of the piece that just locked
+static void _spawn_lock(ParticlePool *const pool, Tetromino const*const tetromino) {
+    for (size_t i = 0; i < NUM_TETROMINO_BLOCKS; ++i) {
+        float const x = tetromino->positions[i][X_AXIS] + tetromino->x;
+        float const y = tetromino->positions[i][Y_AXIS] + tetromino->y;
+        for (size_t j = 0; j < LOCK_DUST_PER_BLOCK; ++j) _spawn_particle(
+            pool,
+            x + _random_float(pool, 0, 1 - LOCK_DUST_SIZE),
+            y + 1 - LOCK_DUST_SIZE,
+            _random_float(pool, -0.05f, 0.05f),
+            _random_float(pool, -0.06f, -0.02f),
+            0,
+            _random_float(pool, 0.5f, 1) * LOCK_DUST_LIFE,
+            LOCK_DUST_SIZE,
+            tetromino->type
+        );
+    }
+}
+
+// Updating ///////////////////////////////////////////////////////////////////
+
+// contiguous floats with no branches, in fixed groups of PARTICLE_LANES so
+// the compiler vectorizes it even at -O2 (no remainder loop to weigh up).
+// The dead slots at the end of the last group are stepped too, harmlessly.
+static void _step_particles(ParticlePool *const pool, float const frames) {
+    size_t const count = (pool->count + PARTICLE_LANES - 1) / PARTICLE_LANES
+                       * PARTICLE_LANES;
+    float *restrict const x = pool->x;
+    float *restrict const y = pool->y;
+    float *restrict const velocity_x = pool->velocity_x;
+    float *restrict const velocity_y = pool->velocity_y;
+    float const*restrict const weight = pool->weight;
+    float *restrict const life = pool->life;
+
+    for (size_t i = 0; i < count; i += PARTICLE_LANES) {
+        for (size_t j = i; j < i + PARTICLE_LANES; ++j) {
+            velocity_y[j] += weight[j] * frames;
+            x[j] += velocity_x[j] * frames;
+            y[j] += velocity_y[j] * frames;
+            life[j] -= frames;
+        }
+    }
+}
+
+// moves the last live particle into each dead one's place
+static void _remove_dead_particles(ParticlePool *const pool) {
+    for (size_t i = 0; i < pool->count; ) {
+        if (pool->life[i] > 0) {
+            ++i;
+            continue;
+        }
+        size_t const last = --pool->count;
+        pool->x[i] = pool->x[last];
+        pool->y[i] = pool->y[last];
+        pool->velocity_x[i] = pool->velocity_x[last];
+        pool->velocity_y[i] = pool->velocity_y[last];
+        pool->weight[i] = pool->weight[last];
+        pool->life[i] = pool->life[last];
+        pool->fade[i] = pool->fade[last];
+        pool->size[i] = pool->size[last];
+        pool->type[i] = pool->type[last];
+    }
+}
+
+// Exposed ////////////////////////////////////////////////////////////////////
+
+// brings the pool up to `game_state`: ages the particles by however many
+// frames went by since the last call and adds effects for a new placement.
+// Only the newest placement gets effects if the renderer skipped states.
+extern void update_particles(
+    ParticlePool *const pool,
+    GameState const*const game_state
+) {
+    // a new game, or a reload
+    if (game_state->frame_number < pool->frame
+    ||  game_state->pieces_placed < pool->pieces_placed
+    ) {
+        pool->count = 0;
+        pool->frame = game_state->frame_number;
+        pool->pieces_placed = game_state->pieces_placed;
+    }
+
+    unsigned long long const frames = game_state->frame_number - pool->frame;
+    pool->frame = game_state->frame_number;
+    if (frames > 0) {
+        _step_particles(
+            pool,
+            frames < MAX_PARTICLE_STEP? (float)frames : MAX_PARTICLE_STEP
+        );
+        _remove_dead_particles(pool);
+    }
+
+    if (game_state->pieces_placed != pool->pieces_placed) {
+        pool->pieces_placed = game_state->pieces_placed;
+        _spawn_lock(pool, &game_state->last_placed);
+        _spawn_clear(pool, game_state);
+    }
+}
@@ -0,0 +1,196 @@
+#include "perfect_clear.h"
+#include "game.h"
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// (entry, pieces placed) pairs known not to work out for the current queue,
+// the same board comes up through placements in different orders
+#define PC_MEMO_SLOTS  (size_t) 1024
+#define PC_MEMO_PROBES (size_t) 8
+#define PC_BOARD_MASK  ((UINT64_C(1) << (PC_MAX_HEIGHT * COLS)) - 1)
+
+typedef struct {
+    PcDatabase const* database;
+    TetrominoType const* queue;
+    size_t queue_length;
+    PcSolution *solution;
+    uint64_t failed[PC_MEMO_SLOTS]; // entry * 16 + depth + 1, 0 for empty
+} PcSearch;
+
+// Reading ////////////////////////////////////////////////////////////////////
+
+// every index in the file stays inside it, so lookups and searches never
+// read past the mapping however the file was damaged
+static bool _has_valid_links(PcDatabase const*const database) {
+    PcHeader const*const header = database->header;
+    for (uint64_t i = 0; i < header->num_slots; ++i) {
+        uint32_t const entry = database->slots[i];
+        if (entry != PC_EMPTY_SLOT && entry >= header->num_entries) return false;
+    }
+    for (uint64_t i = 0; i < header->num_entries; ++i) {
+        PcEntry const*const entry = &database->entries[i];
+        if ((uint64_t)entry->first_edge + entry->num_edges > header->num_edges) return false;
+    }
+    for (uint64_t i = 0; i < header->num_edges; ++i) {
+        PcEdge const*const edge = &database->edges[i];
+        if (edge->child >= header->num_entries
+            || edge->type >= NUM_TETROMINO_TYPES
+            || edge->rotation >= MAX_NUM_ROTATIONS) return false;
+    }
+    return true;
+}
+extern bool open_pc_database(PcDatabase *const database, char const*const path) {
+    int const fd = open(path, O_RDONLY);
+    if (fd < 0) return false;
+
+    struct stat status;
+    if (fstat(fd, &status) != 0 || (size_t)status.st_size < sizeof(PcHeader)) {
+        close(fd);
+        return false;
+    }
+
+    void *const data = mmap(NULL, status.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) return false;
+
+    *database = (PcDatabase){ .data = data, .size = status.st_size, .header = data };
+    PcHeader const*const header = database->header;
+    bool const is_valid
+        =  memcmp(header->magic, PC_MAGIC, 4) == 0
+        && header->version == PC_VERSION
+        && header->height <= PC_MAX_HEIGHT
+        && header->num_slots > 0
+        && (header->num_slots & (header->num_slots - 1)) == 0
+        && header->num_entries < header->num_slots
+        // each count alone fits, so the sum below can't wrap
+        && header->num_slots <= database->size / sizeof(uint32_t)
+        && header->num_entries <= database->size / sizeof(PcEntry)
+        && header->num_edges <= database->size / sizeof(PcEdge)
+        && sizeof(PcHeader)
+           + header->num_slots * sizeof(uint32_t)
+           + header->num_entries * sizeof(PcEntry)
+           + header->num_edges * sizeof(PcEdge) == database->size;
+    if (!is_valid) {
+        close_pc_database(database);
+        return false;
+    }
+
+    database->slots = (uint32_t const*)(database->data + sizeof(PcHeader));
+    database->entries = (PcEntry const*)(database->slots + header->num_slots);
+    database->edges = (PcEdge const*)(database->entries + header->num_entries);
+    if (!_has_valid_links(database)) {
+        close_pc_database(database);
+        return false;
+    }
+
+    // lookups hop all over the slots and entries
+    madvise(data, database->size, MADV_RANDOM);
+    return true;
+}
+
+extern void close_pc_database(PcDatabase *const database) {
+    munmap((void*)database->data, database->size);
+    database->data = NULL;
+}
+
+extern uint32_t find_pc_entry(PcDatabase const*const database, uint64_t const key) {
+    uint64_t const num_slots = database->header->num_slots;
+    uint64_t const mask = num_slots - 1;
+    uint64_t slot = pc_hash_key(key) & mask;
+    // a full pass, a damaged file may have no empty slot to stop at
+    for (uint64_t i = 0; i < num_slots; ++i, slot = (slot + 1) & mask) {
+        uint32_t const entry = database->slots[slot];
+        if (entry == PC_EMPTY_SLOT || database->entries[entry].key == key) return entry;
+    }
+    return PC_EMPTY_SLOT;
+}
+
+// Search /////////////////////////////////////////////////////////////////////
+static inline uint64_t *_memo_slot(PcSearch *const search, uint64_t const key, bool const insert) {
+    for (size_t i = 0; i < PC_MEMO_PROBES; ++i) {
+        uint64_t *const slot = &search->failed[(pc_hash_key(key) + i) & (PC_MEMO_SLOTS - 1)];
+        if (*slot == key) return slot;
+        if (*slot == 0) return insert? slot : NULL;
+    }
+    return NULL;
+}
+
+// depth first along the queue, the first empty board wins
+static bool _search(PcSearch *const search, uint32_t const entry, size_t const depth) {
+    PcDatabase const*const database = search->database;
+    PcEntry const*const from = &database->entries[entry];
+    // the depth check holds even if a damaged file understates num_pieces
+    if (depth == search->queue_length || from->num_pieces > search->queue_length - depth)
+        return false;
+
+    uint64_t const memo_key = (uint64_t)entry * 16 + depth + 1;
+    if (_memo_slot(search, memo_key, false) != NULL) return false;
+
+    TetrominoType const type = search->queue[depth];
+    for (size_t i = 0; i < from->num_edges; ++i) {
+        PcEdge const*const edge = &database->edges[from->first_edge + i];
+        if (edge->type != type) continue;
+        search->solution->placements[depth] = *edge;
+
+        if ((database->entries[edge->child].key & PC_BOARD_MASK) == 0) {
+            search->solution->num_placements = depth + 1;
+            return true;
+        }
+        if (_search(search, edge->child, depth + 1)) return true;
+    }
+
+    uint64_t *const slot = _memo_slot(search, memo_key, true);
+    if (slot != NULL) *slot = memo_key;
+    return false;
+}
+
+// Exposed ////////////////////////////////////////////////////////////////////
+extern bool solve_perfect_clear(
+    PcDatabase const*const database,
+    TetrominoType const board[ROWS][COLS],
+    TetrominoType const*const queue,
+    size_t const queue_length,
+    PcSolution *const solution
+) {
+    uint16_t bottom_rows[PC_MAX_HEIGHT] = { 0 };
+    size_t stack_height = 0;
+    for (size_t i = 0; i < ROWS; ++i) {
+        uint16_t row = 0;
+        for (size_t x = 0; x < COLS; ++x)
+            row |= (uint16_t)(board[ROWS - 1 - i][x] != NO_TETROMINO) << x;
+        if (row == 0) continue;
+        if (i >= database->header->height) return false;
+        bottom_rows[i] = row;
+        stack_height = i + 1;
+    }
+
+    static PcSearch const empty_search = { .database = NULL };
+    PcSearch search = empty_search;
+    search.database = database;
+    search.queue = queue;
+    search.queue_length = queue_length < PC_MAX_PIECES? queue_length : PC_MAX_PIECES;
+    search.solution = solution;
+
+    // the lower the ceiling the fewer pieces it takes
+    for (size_t ceiling = stack_height; ceiling <= database->header->height; ++ceiling) {
+        uint32_t const entry = find_pc_entry(database, pc_board_key(bottom_rows, ceiling));
+        if (entry != PC_EMPTY_SLOT && _search(&search, entry, 0)) return true;
+    }
+    return false;
+}
+
+extern bool find_perfect_clear(
+    PcDatabase const*const database,
+    GameState const*const game_state,
+    PcSolution *const solution
+) {
+    TetrominoType queue[PC_MAX_PIECES];
+    peek_tetrominoes(game_state, queue, PC_MAX_PIECES);
+    return solve_perfect_clear(database, game_state->board, queue, PC_MAX_PIECES, solution);
+}
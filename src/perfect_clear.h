@@ -0,0 +1,132 @@
+#ifndef PERFECT_CLEAR_H
+#define PERFECT_CLEAR_H
+
+#include "game.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Perfect clear solver backed by a precomputed database, read through mmap.
+//
+// A board is looked at under a ceiling of up to `height` rows: pieces only
+// ever go below it and every cleared row lowers it by one, so the pieces
+// left have to fill exactly the empty cells under it. The database holds
+// every board and ceiling that can be finished like that by some sequence
+// of pieces (the same cells can finish under different ceilings, with
+// different numbers of pieces), with every placement, by piece type, that
+// leads to another stored board or clears it. Placements are whatever the
+// movement rules reach from the spawn, tucks and spins included, so garbage
+// boards are covered as well as any other.
+//
+// A query walks those links along the piece queue, a hash lookup and a scan
+// of a few dozen edges per piece, and tries the lowest ceiling first so the
+// answer uses the fewest pieces. Boards that aren't in the database have no
+// perfect clear under `height` rows.
+//
+// File layout (native byte order):
+//     PcHeader
+//     uint32_t slots[num_slots]  open addressing over entries, PC_EMPTY_SLOT
+//     PcEntry entries[num_entries]
+//     PcEdge edges[num_edges]    grouped by entry
+//
+// The database is built by `./perfect_clear build` (see perfect_clear_tool.c)
+// and the Makefile's pc_database target, 2 rows high by default. 4 is
+// more than a build can manage, see there.
+
+// Constants //////////////////////////////////////////////////////////////////
+#define PC_MAGIC       "TPCD"
+#define PC_VERSION     (uint32_t) 1
+#define PC_MAX_HEIGHT  (size_t) 4
+#define PC_MAX_PIECES  (PC_MAX_HEIGHT * COLS / NUM_TETROMINO_BLOCKS)
+#define PC_EMPTY_SLOT  UINT32_MAX
+
+// Structs ////////////////////////////////////////////////////////////////////
+typedef struct {
+    char magic[4];
+    uint32_t version;
+    uint32_t height;   // the highest ceiling
+    uint32_t reserved;
+    uint64_t num_slots; // a power of 2
+    uint64_t num_entries;
+    uint64_t num_edges;
+} PcHeader;
+
+// a board and its ceiling, see `pc_board_key`
+typedef struct {
+    uint64_t key;
+    uint32_t first_edge;
+    uint16_t num_edges;
+    uint8_t num_pieces; // the fewest left to clear it
+    uint8_t reserved;
+} PcEntry;
+
+// a placement and the entry it leads to. x and y are the Tetromino's, x may
+// be negative for pieces hanging off the left of their box.
+typedef struct {
+    uint32_t child;
+    uint8_t type;
+    uint8_t rotation;
+    int8_t x;
+    int8_t y;
+} PcEdge;
+
+typedef struct {
+    unsigned char const* data;
+    size_t size;
+    PcHeader const* header;
+    uint32_t const* slots;
+    PcEntry const* entries;
+    PcEdge const* edges;
+} PcDatabase;
+
+typedef struct {
+    size_t num_placements;
+    PcEdge placements[PC_MAX_PIECES]; // `child` is meaningless here
+} PcSolution;
+
+// The key of the bottom rows of a board under a ceiling: bit x + COLS * i is
+// the cell x of the i-th row from the floor and the ceiling is in the bits
+// above the cells.
+static inline uint64_t pc_board_key(uint16_t const bottom_rows[PC_MAX_HEIGHT], size_t const ceiling) {
+    uint64_t key = (uint64_t)ceiling << (PC_MAX_HEIGHT * COLS);
+    for (size_t i = 0; i < PC_MAX_HEIGHT; ++i) key |= (uint64_t)bottom_rows[i] << (COLS * i);
+    return key;
+}
+
+// splitmix64 finaliser, for the slots
+static inline uint64_t pc_hash_key(uint64_t x) {
+    x += 0x9E3779B97F4A7C15ULL;
+    x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+    return x ^ (x >> 31);
+}
+
+// Functions //////////////////////////////////////////////////////////////////
+bool open_pc_database(PcDatabase *const database, char const*const path);
+void close_pc_database(PcDatabase *const database);
+
+// the entry of a key, PC_EMPTY_SLOT if it isn't there
+uint32_t find_pc_entry(PcDatabase const*const database, uint64_t const key);
+
+// whether `queue` (the falling piece first) can clear `board` completely, and
+// the placements that do it in `solution` if it can
+bool solve_perfect_clear(
+    PcDatabase const*const database,
+    TetrominoType const board[ROWS][COLS],
+    TetrominoType const*const queue,
+    size_t const queue_length,
+    PcSolution *const solution
+);
+
+// the same with the game's falling piece, next piece and randomizer queue
+// (see peek_tetrominoes). Only boards no higher than the database are
+// looked up, so with the shipped 2 row database the standard 4 row openers
+// (10 pieces from an empty board) are never found, just 5 piece clears of
+// the bottom 2 rows.
+bool find_perfect_clear(
+    PcDatabase const*const database,
+    GameState const*const game_state,
+    PcSolution *const solution
+);
+
+#endif // PERFECT_CLEAR_H
@@ -0,0 +1,1154 @@
+#include "game.h"
+#include "fixture.h"
+#include "perfect_clear.h"
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+// Perfect clear database builder and solver (see perfect_clear.h).
+//
+// Building is perft backwards, a piece at a time from the empty board, so
+// only boards that finish are ever looked at. Layer N holds the boards N
+// pieces from done (see `_layer_of`). Its candidates come from the boards of
+// layer N - 1 with bit operations: put back the full rows a placement could
+// have cleared and take out every piece shape that fits in the filled cells.
+// That finds too many, the piece may have no way in, so each candidate is
+// then searched properly: every piece type is placed every way the movement
+// rules reach, and the candidate is kept with the placements that land on a
+// board of layer N - 1 or clear it. Both steps share the boards out to a
+// pool of threads with a buffer each, sorted and merged after.
+//
+// Every finished layer is saved next to the database (db.layer.NN), so an
+// interrupted build picks up after the last one, and they are removed once
+// the database is written.
+//
+// The default height is 2: it builds in about a second, and `bench` plays
+// out 100000 answers from it without a wrong one. 4 rows is as far as the
+// file format goes, but that build doesn't finish. On one core, layer 3 is
+// 2.8M candidates and 0.5M boards in 90s. Layer 4 is 54M candidates and
+// 9.8M boards in 33 minutes and 2.6GB. Each layer up to the middle one is
+// some twenty times the last, which is more than memory holds and more
+// than the file's 32-bit entry and edge numbers can count. Nearly all of
+// that time goes into confirming candidates, the reachability search for
+// every piece type.
+//
+// usage: ./perfect_clear build db [-h height] [-j threads]
+//        ./perfect_clear info db
+//        ./perfect_clear solve db [-b fixture] [-q pieces | -s seed]
+//        ./perfect_clear bench db [-n queries | -f fixtures] [-s seed]
+//
+// The board is a fixture (see fixture.h). Without a piece list, from -q or
+// the fixture, `solve` takes the queue a game with that seed deals (see
+// find_perfect_clear). `bench` queries random boards of the database, or
+// every position of a fixture file with random pieces after its queue.
+
+#define PC_BUILD_HEIGHT  (size_t) 2 // see above, 4 doesn't fit
+#define PC_CHUNK         (size_t) 64 // boards a thread takes at a time
+#define PC_BENCH_QUERIES (size_t) 100000
+#define PC_LAYER_MAGIC   "TPCL"
+
+// a piece position, x and y offset so the ones hanging off the left or top
+// edge ("-1" as a size_t, see Tetromino) still index
+#define PC_EDGE     (size_t) 4
+#define PC_VISITED  (MAX_NUM_ROTATIONS * (ROWS + PC_EDGE) * (COLS + PC_EDGE))
+#define PC_BOARD_BITS (PC_MAX_HEIGHT * COLS)
+
+static char const tetromino_letters[NUM_TETROMINO_TYPES] = {
+    'L', 'J', 'T', 'O', 'I', 'Z', 'S'
+};
+
+// Structs ////////////////////////////////////////////////////////////////////
+
+// a kept board, its edges follow in order
+typedef struct {
+    uint64_t key;
+    uint32_t num_edges;
+    uint32_t num_pieces;
+} PcLayerBoard;
+
+// an edge before the children have entry numbers
+typedef struct {
+    uint64_t child;
+    uint8_t type;
+    uint8_t rotation;
+    int8_t x;
+    int8_t y;
+    uint32_t reserved;
+} PcLayerEdge;
+
+typedef struct {
+    char magic[4];
+    uint32_t height;
+    uint32_t layer;
+    uint32_t reserved;
+    uint64_t num_boards;
+    uint64_t num_edges;
+} PcLayerHeader;
+
+typedef struct {
+    uint64_t *keys;
+    size_t count;
+    size_t capacity;
+} PcKeys;
+
+// open addressing, 0 for empty (the empty board is never a candidate)
+typedef struct {
+    uint64_t *slots;
+    size_t count;
+    size_t capacity; // a power of 2
+} PcKeySet;
+
+typedef struct {
+    PcLayerBoard *boards;
+    size_t num_boards;
+    size_t boards_capacity;
+    PcLayerEdge *edges;
+    size_t num_edges;
+    size_t edges_capacity;
+} PcLayer;
+
+// where a piece gets to from the spawn while it is above the bottom
+// PC_MAX_HEIGHT rows, the same on every board in the database
+typedef struct {
+    bool visited[PC_VISITED];
+    Tetromino frontier[PC_VISITED]; // the ones with a move out of the sky
+    size_t num_frontier;
+} PcSky;
+
+// a piece shape in key bits, in the bottom left corner
+typedef struct {
+    uint64_t cells;
+    size_t width;
+    size_t height;
+} PcShape;
+
+typedef struct {
+    PcKeys const* parents;
+    PcLayer const* below; // NULL to find candidates for `layer` from parents
+    size_t layer;
+    size_t height;
+    _Atomic size_t next_parent;
+} PcPass;
+
+typedef struct {
+    PcPass *pass;
+    pthread_t thread;
+    GameState search;  // the board being searched, reused for every parent
+    PcKeySet candidates;
+    PcLayer kept;      // in the order this worker found them
+    bool out_of_memory;
+} PcWorker;
+
+typedef struct {
+    char const* command;
+    char const* path;
+    size_t height;
+    size_t num_workers;
+    Fixture board;
+    char const* fixtures_path; // NULL for random boards
+    TetrominoType queue[PC_MAX_PIECES];
+    size_t queue_length;
+    size_t num_queries;
+    unsigned long long seed;
+} PcOptions;
+
+static PcSky skies[NUM_TETROMINO_TYPES];
+static PcShape shapes[NUM_TETROMINO_TYPES * MAX_NUM_ROTATIONS];
+static size_t num_shapes;
+
+// Arrays /////////////////////////////////////////////////////////////////////
+static bool _reserve(void **const items, size_t *const capacity, size_t const count, size_t const size) {
+    if (count < *capacity) return true;
+    size_t const grown_capacity = *capacity > 0? 2 * *capacity : 1024;
+    void *const grown = realloc(*items, grown_capacity * size);
+    if (grown == NULL) return false;
+    *items = grown;
+    *capacity = grown_capacity;
+    return true;
+}
+
+static inline bool _push_key(PcKeys *const keys, uint64_t const key) {
+    if (!_reserve((void**)&keys->keys, &keys->capacity, keys->count, sizeof(uint64_t)))
+        return false;
+    keys->keys[keys->count++] = key;
+    return true;
+}
+
+static void _free_layer(PcLayer *const layer) {
+    free(layer->boards);
+    free(layer->edges);
+    *layer = (PcLayer){ .boards = NULL };
+}
+
+static int _compare_keys(void const*const a, void const*const b) {
+    uint64_t const x = *(uint64_t const*)a;
+    uint64_t const y = *(uint64_t const*)b;
+    return (x > y) - (x < y);
+}
+
+static int _compare_boards(void const*const a, void const*const b) {
+    return _compare_keys(&((PcLayerBoard const*)a)->key, &((PcLayerBoard const*)b)->key);
+}
+
+// index of `key` in a layer sorted by key, SIZE_MAX if it isn't there
+static size_t _find_board(PcLayer const*const layer, uint64_t const key) {
+    size_t low = 0;
+    size_t high = layer->num_boards;
+    while (low < high) {
+        size_t const middle = low + (high - low) / 2;
+        if (layer->boards[middle].key < key) low = middle + 1;
+        else high = middle;
+    }
+    return low < layer->num_boards && layer->boards[low].key == key? low : SIZE_MAX;
+}
+
+// Boards /////////////////////////////////////////////////////////////////////
+static inline size_t _ceiling(uint64_t const key) {
+    return key >> PC_BOARD_BITS;
+}
+
+static inline bool _is_empty(uint64_t const key) {
+    return (key & ((UINT64_C(1) << PC_BOARD_BITS) - 1)) == 0;
+}
+
+// pieces left to fill every empty cell under the ceiling, SIZE_MAX if they
+// can't. Empty boards are done whatever their ceiling.
+static inline size_t _layer_of(uint64_t const key) {
+    if (_is_empty(key)) return 0;
+    size_t const empty_cells = COLS * _ceiling(key)
+        - __builtin_popcountll(key & ((UINT64_C(1) << PC_BOARD_BITS) - 1));
+    return empty_cells % NUM_TETROMINO_BLOCKS == 0
+        ? empty_cells / NUM_TETROMINO_BLOCKS
+        : SIZE_MAX;
+}
+
+static void _unpack_key(uint64_t const key, TetrominoType board[ROWS][COLS]) {
+    for (size_t y = 0; y < ROWS; ++y) {
+        size_t const i = ROWS - 1 - y;
+        for (size_t x = 0; x < COLS; ++x) board[y][x]
+            = i < PC_MAX_HEIGHT && key >> (COLS * i + x) & 1
+            ? garbage_tetromino
+            : NO_TETROMINO;
+    }
+}
+
+// Placements /////////////////////////////////////////////////////////////////
+static inline size_t _visited_index(Tetromino const*const tetromino) {
+    size_t const x = tetromino->x + PC_EDGE;
+    size_t const y = tetromino->y + PC_EDGE;
+    return (tetromino->rotation * (ROWS + PC_EDGE) + y) * (COLS + PC_EDGE) + x;
+}
+
+static inline bool _is_in_sky(Tetromino const*const tetromino) {
+    for (size_t i = 0; i < NUM_TETROMINO_BLOCKS; ++i) {
+        if (tetromino->positions[i][Y_AXIS] + tetromino->y >= ROWS - PC_MAX_HEIGHT) return false;
+    }
+    return true;
+}
+
+static inline bool _act(GameState *const search, size_t const action) {
+    switch (action) {
+        case 0 : return move_tetromino(search, MOVE_LEFT);
+        case 1 : return move_tetromino(search, MOVE_RIGHT);
+        case 2 : return rotate_tetromino(search);
+        default: return move_tetromino(search, MOVE_DOWN);
+    }
+}
+
+static void _add_shape(Tetromino const*const tetromino) {
+    size_t min_x = SIZE_MAX, min_y = SIZE_MAX, max_x = 0, max_y = 0;
+    for (size_t i = 0; i < NUM_TETROMINO_BLOCKS; ++i) {
+        size_t const x = tetromino->positions[i][X_AXIS] + tetromino->x;
+        size_t const y = tetromino->positions[i][Y_AXIS] + tetromino->y;
+        if (x < min_x) min_x = x;
+        if (x > max_x) max_x = x;
+        if (y < min_y) min_y = y;
+        if (y > max_y) max_y = y;
+    }
+    PcShape shape = { .cells = 0, .width = max_x - min_x + 1, .height = max_y - min_y + 1 };
+    for (size_t i = 0; i < NUM_TETROMINO_BLOCKS; ++i) {
+        size_t const x = tetromino->positions[i][X_AXIS] + tetromino->x - min_x;
+        size_t const y = max_y - (tetromino->positions[i][Y_AXIS] + tetromino->y);
+        shape.cells |= UINT64_C(1) << (COLS * y + x);
+    }
+    for (size_t i = 0; i < num_shapes; ++i) {
+        if (shapes[i].cells == shape.cells) return;
+    }
+    shapes[num_shapes++] = shape;
+}
+
+// the sky of every piece, from a breadth first search on the empty board that
+// stays in it. Moves out of it are left to `_list_locks`, which starts from
+// the frontier so it only searches the rows that differ. Every shape the
+// pieces take on turns up on the way.
+static void _find_skies(void) {
+    GameState search = init_gamestate_seeded(0, 1);
+    for (TetrominoType type = 0; type < NUM_TETROMINO_TYPES; ++type) {
+        PcSky *const sky = &skies[type];
+        *sky = (PcSky){ .num_frontier = 0 };
+        spawn_tetromino(&search, type);
+
+        Tetromino queue[PC_VISITED];
+        size_t head = 0;
+        size_t tail = 0;
+        queue[tail++] = search.current_tetromino;
+        sky->visited[_visited_index(&search.current_tetromino)] = true;
+        while (head < tail) {
+            Tetromino const position = queue[head++];
+            _add_shape(&position);
+            bool is_frontier = false;
+            for (size_t action = 0; action < 4; ++action) {
+                search.current_tetromino = position;
+                if (!_act(&search, action)) continue;
+                if (!_is_in_sky(&search.current_tetromino)) {
+                    is_frontier = true;
+                    continue;
+                }
+                size_t const index = _visited_index(&search.current_tetromino);
+                if (sky->visited[index]) continue;
+                sky->visited[index] = true;
+                queue[tail++] = search.current_tetromino;
+            }
+            if (is_frontier) sky->frontier[sky->num_frontier++] = position;
+        }
+    }
+}
+
+// breadth first over every position the piece can get to from the spawn, the
+// ones it can't move down from with every block under the ceiling go in
+// `locks`. Returns how many. The board must be empty above the bottom
+// PC_MAX_HEIGHT rows.
+static size_t _list_locks(
+    GameState *const search,
+    TetrominoType const type,
+    size_t const ceiling,
+    Tetromino locks[PC_VISITED]
+) {
+    PcSky const*const sky = &skies[type];
+    bool visited[PC_VISITED];
+    memcpy(visited, sky->visited, sizeof(visited));
+    Tetromino queue[PC_VISITED];
+    memcpy(queue, sky->frontier, sky->num_frontier * sizeof(Tetromino));
+    size_t head = 0;
+    size_t tail = sky->num_frontier;
+    size_t num_locks = 0;
+
+    while (head < tail) {
+        Tetromino const position = queue[head++];
+        for (size_t action = 0; action < 4; ++action) {
+            search->current_tetromino = position;
+            if (_act(search, action)) {
+                size_t const index = _visited_index(&search->current_tetromino);
+                if (visited[index]) continue;
+                visited[index] = true;
+                queue[tail++] = search->current_tetromino;
+            }
+            else if (action == 3) {
+                bool under_ceiling = true;
+                for (size_t i = 0; i < NUM_TETROMINO_BLOCKS; ++i) under_ceiling
+                    = under_ceiling && position.positions[i][Y_AXIS] + position.y >= ROWS - ceiling;
+                if (under_ceiling) locks[num_locks++] = position;
+            }
+        }
+    }
+    return num_locks;
+}
+
+// the key once `lock` is locked on `parent` and the full rows are gone. The
+// bottom rows of the game's own row removal, in bits.
+static uint64_t _place(uint64_t const parent, Tetromino const*const lock) {
+    uint64_t board = parent & ((UINT64_C(1) << PC_BOARD_BITS) - 1);
+    for (size_t i = 0; i < NUM_TETROMINO_BLOCKS; ++i) {
+        size_t const x = lock->positions[i][X_AXIS] + lock->x;
+        size_t const y = lock->positions[i][Y_AXIS] + lock->y;
+        board |= UINT64_C(1) << (COLS * (ROWS - 1 - y) + x);
+    }
+
+    size_t ceiling = _ceiling(parent);
+    uint64_t const full_row = (UINT64_C(1) << COLS) - 1;
+    for (size_t i = PC_MAX_HEIGHT; i-- > 0;) {
+        if ((board >> (COLS * i) & full_row) != full_row) continue;
+        uint64_t const below = board & ((UINT64_C(1) << (COLS * i)) - 1);
+        board = below | (board >> (COLS * (i + 1)) << (COLS * i));
+        ceiling--;
+    }
+    return board | (uint64_t)ceiling << PC_BOARD_BITS;
+}
+
+static inline PcLayerEdge _layer_edge(Tetromino const*const lock, uint64_t const child) {
+    return (PcLayerEdge){
+        .child = child,
+        .type = lock->type,
+        .rotation = lock->rotation,
+        .x = (int8_t)(ptrdiff_t)lock->x,
+        .y = (int8_t)(ptrdiff_t)lock->y
+    };
+}
+
+// Passes /////////////////////////////////////////////////////////////////////
+
+static bool _insert_key(PcKeySet *const set, uint64_t const key) {
+    if (2 * (set->count + 1) > set->capacity) {
+        size_t const capacity = set->capacity > 0? 2 * set->capacity : 1024;
+        uint64_t *const slots = calloc(capacity, sizeof(uint64_t));
+        if (slots == NULL) return false;
+        for (size_t i = 0; i < set->capacity; ++i) {
+            if (set->slots[i] == 0) continue;
+            size_t slot = pc_hash_key(set->slots[i]) & (capacity - 1);
+            while (slots[slot] != 0) slot = (slot + 1) & (capacity - 1);
+            slots[slot] = set->slots[i];
+        }
+        free(set->slots);
+        set->slots = slots;
+        set->capacity = capacity;
+    }
+
+    size_t slot = pc_hash_key(key) & (set->capacity - 1);
+    while (set->slots[slot] != 0 && set->slots[slot] != key)
+        slot = (slot + 1) & (set->capacity - 1);
+    if (set->slots[slot] == 0) set->count++;
+    set->slots[slot] = key;
+    return true;
+}
+
+// every board of `pass->layer` that `board` could be the board after, going
+// by the cells alone
+static bool _push_candidates(PcWorker *const worker, uint64_t const board) {
+    PcPass const*const pass = worker->pass;
+    uint64_t const full_row = (UINT64_C(1) << COLS) - 1;
+    size_t const ceiling = _ceiling(board);
+
+    for (size_t cleared = 0; cleared <= MAX_COMPLETED_ROWS && ceiling + cleared <= pass->height; ++cleared) {
+        size_t const before_ceiling = ceiling + cleared;
+        // each way to put the cleared rows back in among the rows left
+        for (unsigned cleared_rows = 0; cleared_rows < 1u << before_ceiling; ++cleared_rows) {
+            if ((size_t)__builtin_popcount(cleared_rows) != cleared) continue;
+            uint64_t filled = 0;
+            uint64_t rows_left = board;
+            for (size_t row = 0; row < before_ceiling; ++row) {
+                if (cleared_rows >> row & 1) filled |= full_row << (COLS * row);
+                else {
+                    filled |= (rows_left & full_row) << (COLS * row);
+                    rows_left >>= COLS;
+                }
+            }
+
+            for (size_t i = 0; i < num_shapes; ++i) {
+                PcShape const*const shape = &shapes[i];
+                for (size_t y = 0; y + shape->height <= before_ceiling; ++y) {
+                    for (size_t x = 0; x + shape->width <= COLS; ++x) {
+                        uint64_t const cells = shape->cells << (COLS * y + x);
+                        if ((filled & cells) != cells) continue;
+
+                        // a cleared row wasn't full until the piece came
+                        bool fills_cleared_rows = true;
+                        for (size_t row = 0; row < before_ceiling; ++row) fills_cleared_rows
+                            = fills_cleared_rows
+                           && (!(cleared_rows >> row & 1) || (cells >> (COLS * row) & full_row) != 0);
+                        if (!fills_cleared_rows) continue;
+
+                        uint64_t const candidate
+                            = (filled & ~cells) | (uint64_t)before_ceiling << PC_BOARD_BITS;
+                        if (_layer_of(candidate) != pass->layer || _is_empty(candidate)) continue;
+                        if (!_insert_key(&worker->candidates, candidate)) return false;
+                    }
+                }
+            }
+        }
+    }
+    return true;
+}
+
+// every placement from `parent` that clears the board or lands on a board in
+// `pass->below`. The parent is kept if there are any, or if it is empty.
+static bool _expand(PcWorker *const worker, uint64_t const parent) {
+    GameState *const search = &worker->search;
+    PcLayer const*const below = worker->pass->below;
+    PcLayer *const kept = &worker->kept;
+    size_t const ceiling = _ceiling(parent);
+    size_t const first_edge = kept->num_edges;
+    size_t num_pieces = SIZE_MAX;
+
+    Tetromino locks[PC_VISITED];
+    _unpack_key(parent, search->board);
+    for (TetrominoType type = 0; type < NUM_TETROMINO_TYPES; ++type) {
+        size_t const num_locks = _list_locks(search, type, ceiling, locks);
+        for (size_t i = 0; i < num_locks; ++i) {
+            uint64_t const child = _place(parent, &locks[i]);
+            size_t const found = _is_empty(child)? 0 : _find_board(below, child);
+            if (found == SIZE_MAX) continue;
+
+            if (!_reserve((void**)&kept->edges, &kept->edges_capacity, kept->num_edges, sizeof(PcLayerEdge)))
+                return false;
+            kept->edges[kept->num_edges++] = _layer_edge(&locks[i], child);
+            size_t const pieces = _is_empty(child)? 1 : 1 + below->boards[found].num_pieces;
+            if (pieces < num_pieces) num_pieces = pieces;
+        }
+    }
+
+    if (kept->num_edges == first_edge && !_is_empty(parent)) return true;
+    if (!_reserve((void**)&kept->boards, &kept->boards_capacity, kept->num_boards, sizeof(PcLayerBoard)))
+        return false;
+    kept->boards[kept->num_boards++] = (PcLayerBoard){
+        .key = parent,
+        .num_edges = kept->num_edges - first_edge,
+        .num_pieces = num_pieces == SIZE_MAX? 0 : num_pieces
+    };
+    return true;
+}
+
+static void *_run_worker(void *const arg) {
+    PcWorker *const worker = arg;
+    PcPass *const pass = worker->pass;
+    for (;;) {
+        size_t const first = atomic_fetch_add(&pass->next_parent, PC_CHUNK);
+        if (first >= pass->parents->count) return NULL;
+        size_t const last = first + PC_CHUNK < pass->parents->count
+            ? first + PC_CHUNK
+            : pass->parents->count;
+
+        for (size_t i = first; i < last; ++i) {
+            uint64_t const parent = pass->parents->keys[i];
+            if (pass->below == NULL
+                ? _push_candidates(worker, parent)
+                : _expand(worker, parent)
+            ) continue;
+            worker->out_of_memory = true;
+            return NULL;
+        }
+    }
+}
+
+static bool _run_pass(PcWorker *const workers, size_t const num_workers, PcPass *const pass) {
+    for (size_t i = 0; i < num_workers; ++i) {
+        PcWorker *const worker = &workers[i];
+        worker->pass = pass;
+        if (worker->candidates.count > 0) memset(
+            worker->candidates.slots, 0, worker->candidates.capacity * sizeof(uint64_t));
+        worker->candidates.count = 0;
+        worker->kept.num_boards = 0;
+        worker->kept.num_edges = 0;
+        if (pthread_create(&worker->thread, NULL, _run_worker, worker)) {
+            fprintf(stderr, "Error: could not start worker thread.\n");
+            exit(1);
+        }
+    }
+    bool ok = true;
+    for (size_t i = 0; i < num_workers; ++i) {
+        pthread_join(workers[i].thread, NULL);
+        ok = ok && !workers[i].out_of_memory;
+    }
+    return ok;
+}
+
+// the distinct candidates of every worker, sorted
+static bool _merge_candidates(PcWorker const*const workers, size_t const num_workers, PcKeys *const merged) {
+    size_t total = 0;
+    for (size_t i = 0; i < num_workers; ++i) total += workers[i].candidates.count;
+    *merged = (PcKeys){ .keys = malloc((total > 0? total : 1) * sizeof(uint64_t)), .capacity = total };
+    if (merged->keys == NULL) return false;
+    for (size_t i = 0; i < num_workers; ++i) {
+        PcKeySet const*const set = &workers[i].candidates;
+        for (size_t j = 0; j < set->capacity; ++j) {
+            if (set->slots[j] != 0) merged->keys[merged->count++] = set->slots[j];
+        }
+    }
+
+    qsort(merged->keys, merged->count, sizeof(uint64_t), _compare_keys);
+    size_t distinct = 0;
+    for (size_t i = 0; i < merged->count; ++i) {
+        if (distinct == 0 || merged->keys[distinct - 1] != merged->keys[i])
+            merged->keys[distinct++] = merged->keys[i];
+    }
+    merged->count = distinct;
+    return true;
+}
+
+// every worker's kept boards sorted by key, with their edges moved along
+static bool _merge_kept(PcWorker const*const workers, size_t const num_workers, PcLayer *const merged) {
+    size_t num_boards = 0;
+    size_t num_edges = 0;
+    for (size_t i = 0; i < num_workers; ++i) {
+        num_boards += workers[i].kept.num_boards;
+        num_edges += workers[i].kept.num_edges;
+    }
+
+    // sort (key, where its edges start) and then gather the edges behind them
+    typedef struct { PcLayerBoard board; PcLayerEdge const* edges; } Found;
+    Found *const found = malloc((num_boards > 0? num_boards : 1) * sizeof(Found));
+    *merged = (PcLayer){
+        .boards = malloc((num_boards > 0? num_boards : 1) * sizeof(PcLayerBoard)),
+        .boards_capacity = num_boards,
+        .edges = malloc((num_edges > 0? num_edges : 1) * sizeof(PcLayerEdge)),
+        .edges_capacity = num_edges
+    };
+    if (found == NULL || merged->boards == NULL || merged->edges == NULL) {
+        free(found);
+        return false;
+    }
+
+    size_t count = 0;
+    for (size_t i = 0; i < num_workers; ++i) {
+        PcLayer const*const kept = &workers[i].kept;
+        PcLayerEdge const* edges = kept->edges;
+        for (size_t j = 0; j < kept->num_boards; ++j) {
+            found[count++] = (Found){ .board = kept->boards[j], .edges = edges };
+            edges += kept->boards[j].num_edges;
+        }
+    }
+    qsort(found, count, sizeof(Found), _compare_boards);
+
+    for (size_t i = 0; i < count; ++i) {
+        merged->boards[merged->num_boards++] = found[i].board;
+        memcpy(&merged->edges[merged->num_edges], found[i].edges, found[i].board.num_edges * sizeof(PcLayerEdge));
+        merged->num_edges += found[i].board.num_edges;
+    }
+    free(found);
+    return true;
+}
+
+// Checkpoints ////////////////////////////////////////////////////////////////
+static void _layer_path(char *const path, size_t const size, char const*const db, size_t const layer) {
+    snprintf(path, size, "%s.layer.%02zu", db, layer);
+}
+
+// written to a temporary file and renamed, so a layer on disk is whole
+static bool _save_layer(
+    char const*const db,
+    size_t const height,
+    size_t const layer,
+    PcLayer const*const kept
+) {
+    char path[4096];
+    char temporary[4096 + 4];
+    _layer_path(path, sizeof(path), db, layer);
+    snprintf(temporary, sizeof(temporary), "%s.tmp", path);
+    FILE *const file = fopen(temporary, "wb");
+    if (file == NULL) return false;
+
+    PcLayerHeader header = {
+        .height = height,
+        .layer = layer,
+        .num_boards = kept->num_boards,
+        .num_edges = kept->num_edges
+    };
+    memcpy(header.magic, PC_LAYER_MAGIC, 4);
+    bool ok = fwrite(&header, sizeof(header), 1, file) == 1
+        && fwrite(kept->boards, sizeof(PcLayerBoard), kept->num_boards, file) == kept->num_boards
+        && fwrite(kept->edges, sizeof(PcLayerEdge), kept->num_edges, file) == kept->num_edges;
+    ok = fclose(file) == 0 && ok;
+    return ok && rename(temporary, path) == 0;
+}
+
+// false if there is no such layer yet, exits if there is one from another build
+static bool _load_layer(
+    char const*const db,
+    size_t const height,
+    size_t const layer,
+    PcLayer *const kept
+) {
+    char path[4096];
+    _layer_path(path, sizeof(path), db, layer);
+    FILE *const file = fopen(path, "rb");
+    if (file == NULL) return false;
+
+    PcLayerHeader header;
+    bool ok = fread(&header, sizeof(header), 1, file) == 1
+        && memcmp(header.magic, PC_LAYER_MAGIC, 4) == 0
+        && header.height == height
+        && header.layer == layer;
+    if (ok) {
+        *kept = (PcLayer){
+            .boards = malloc((header.num_boards > 0? header.num_boards : 1) * sizeof(PcLayerBoard)),
+            .num_boards = header.num_boards,
+            .boards_capacity = header.num_boards,
+            .edges = malloc((header.num_edges > 0? header.num_edges : 1) * sizeof(PcLayerEdge)),
+            .num_edges = header.num_edges,
+            .edges_capacity = header.num_edges
+        };
+        ok = kept->boards != NULL && kept->edges != NULL
+          && fread(kept->boards, sizeof(PcLayerBoard), kept->num_boards, file) == kept->num_boards
+          && fread(kept->edges, sizeof(PcLayerEdge), kept->num_edges, file) == kept->num_edges;
+    }
+    fclose(file);
+    if (!ok) {
+        fprintf(stderr, "Error: %s is not from this build, remove it to start over.\n", path);
+        exit(1);
+    }
+    return true;
+}
+
+static void _remove_layers(char const*const db, size_t const num_layers) {
+    char path[4096];
+    for (size_t layer = 1; layer < num_layers; ++layer) {
+        _layer_path(path, sizeof(path), db, layer);
+        remove(path);
+    }
+}
+
+// Database ///////////////////////////////////////////////////////////////////
+
+// numbers the kept boards layer by layer and writes the slots, entries and
+// edges behind a header
+static bool _write_database(
+    char const*const path,
+    size_t const height,
+    PcLayer const*const layers,
+    size_t const num_layers
+) {
+    size_t num_entries = 0;
+    size_t num_edges = 0;
+    size_t first_entry[PC_MAX_PIECES + 1];
+    for (size_t layer = 0; layer < num_layers; ++layer) {
+        first_entry[layer] = num_entries;
+        num_entries += layers[layer].num_boards;
+        num_edges += layers[layer].num_edges;
+    }
+    size_t num_slots = 1024;
+    while (num_slots < 2 * num_entries) num_slots *= 2;
+
+    uint32_t *const slots = malloc(num_slots * sizeof(uint32_t));
+    if (slots == NULL) return false;
+    memset(slots, 0xFF, num_slots * sizeof(uint32_t));
+
+    char temporary[4096 + 4];
+    snprintf(temporary, sizeof(temporary), "%s.tmp", path);
+    FILE *const file = fopen(temporary, "wb");
+    if (file == NULL) {
+        free(slots);
+        return false;
+    }
+
+    PcHeader header = {
+        .version = PC_VERSION,
+        .height = height,
+        .num_slots = num_slots,
+        .num_entries = num_entries,
+        .num_edges = num_edges
+    };
+    memcpy(header.magic, PC_MAGIC, 4);
+
+    for (size_t layer = 0; layer < num_layers; ++layer) {
+        for (size_t i = 0; i < layers[layer].num_boards; ++i) {
+            size_t slot = pc_hash_key(layers[layer].boards[i].key) & (num_slots - 1);
+            while (slots[slot] != PC_EMPTY_SLOT) slot = (slot + 1) & (num_slots - 1);
+            slots[slot] = first_entry[layer] + i;
+        }
+    }
+    bool ok = fwrite(&header, sizeof(header), 1, file) == 1
+           && fwrite(slots, sizeof(uint32_t), num_slots, file) == num_slots;
+    free(slots);
+
+    size_t edge = 0;
+    for (size_t layer = 0; layer < num_layers && ok; ++layer) {
+        for (size_t i = 0; i < layers[layer].num_boards && ok; ++i) {
+            PcLayerBoard const*const board = &layers[layer].boards[i];
+            PcEntry const entry = {
+                .key = board->key,
+                .first_edge = edge,
+                .num_edges = board->num_edges,
+                .num_pieces = board->num_pieces
+            };
+            ok = fwrite(&entry, sizeof(entry), 1, file) == 1;
+            edge += board->num_edges;
+        }
+    }
+
+    for (size_t layer = 0; layer < num_layers && ok; ++layer) {
+        for (size_t i = 0; i < layers[layer].num_edges && ok; ++i) {
+            PcLayerEdge const*const from = &layers[layer].edges[i];
+            size_t const child_layer = _layer_of(from->child);
+            PcEdge const to = {
+                .child = first_entry[child_layer] + _find_board(&layers[child_layer], from->child),
+                .type = from->type,
+                .rotation = from->rotation,
+                .x = from->x,
+                .y = from->y
+            };
+            ok = fwrite(&to, sizeof(to), 1, file) == 1;
+        }
+    }
+    ok = fclose(file) == 0 && ok;
+    return ok && rename(temporary, path) == 0;
+}
+
+// Reporting //////////////////////////////////////////////////////////////////
+static inline double _seconds_since(struct timespec const*const start) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - start->tv_sec) + (now.tv_nsec - start->tv_nsec) * 1e-9;
+}
+
+static void _print_board(TetrominoType const board[ROWS][COLS], size_t const rows) {
+    for (size_t y = ROWS - rows; y < ROWS; ++y) {
+        for (size_t x = 0; x < COLS; ++x) putchar(board[y][x] == NO_TETROMINO? '.' : '#');
+        putchar('\n');
+    }
+}
+
+// Commands ///////////////////////////////////////////////////////////////////
+static int _build(PcOptions const*const options) {
+    size_t const height = options->height;
+    size_t const num_layers = height * COLS / NUM_TETROMINO_BLOCKS + 1;
+    PcWorker *const workers = calloc(options->num_workers, sizeof(PcWorker));
+    PcLayer *const layers = calloc(num_layers, sizeof(PcLayer));
+    PcKeys done = { .keys = NULL }; // the empty board under every ceiling
+    for (size_t ceiling = 0; ceiling <= height; ++ceiling) {
+        uint16_t const empty[PC_MAX_HEIGHT] = { 0 };
+        if (!_push_key(&done, pc_board_key(empty, ceiling))) done.count = 0;
+    }
+    if (workers == NULL || layers == NULL || done.count == 0) {
+        fprintf(stderr, "Error: could not allocate %zu workers.\n", options->num_workers);
+        return EXIT_FAILURE;
+    }
+    GameState const template = init_gamestate_seeded(0, 1);
+    for (size_t i = 0; i < options->num_workers; ++i) workers[i].search = template;
+
+    printf("%5s %14s %14s %14s %9s\n", "layer", "candidates", "boards", "edges", "seconds");
+    struct timespec build_start;
+    clock_gettime(CLOCK_MONOTONIC, &build_start);
+
+    // layer 0 is the empty boards until their own placements are known
+    static PcLayer const nothing = { .boards = NULL };
+    PcPass finish = { .parents = &done, .below = &nothing, .next_parent = 0 };
+    if (!_run_pass(workers, 1, &finish) || !_merge_kept(workers, 1, &layers[0])) {
+        fprintf(stderr, "Error: ran out of memory.\n");
+        return EXIT_FAILURE;
+    }
+
+    for (size_t layer = 1; layer < num_layers; ++layer) {
+        struct timespec start;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        char candidates_found[32] = "loaded";
+        if (!_load_layer(options->path, height, layer, &layers[layer])) {
+            // an empty board can come after a board of any layer
+            PcKeys parents = { .keys = NULL };
+            bool ok = true;
+            for (size_t i = 0; i < layers[layer - 1].num_boards && ok; ++i)
+                ok = _push_key(&parents, layers[layer - 1].boards[i].key);
+            for (size_t i = 0; i < done.count && ok && layer > 1; ++i)
+                ok = _push_key(&parents, done.keys[i]);
+
+            PcPass find = { .parents = &parents, .below = NULL, .layer = layer, .height = height, .next_parent = 0 };
+            PcKeys candidates = { .keys = NULL };
+            ok = ok
+              && _run_pass(workers, options->num_workers, &find)
+              && _merge_candidates(workers, options->num_workers, &candidates);
+            snprintf(candidates_found, sizeof(candidates_found), "%zu", candidates.count);
+
+            PcPass expand = { .parents = &candidates, .below = &layers[layer - 1], .next_parent = 0 };
+            ok = ok
+              && _run_pass(workers, options->num_workers, &expand)
+              && _merge_kept(workers, options->num_workers, &layers[layer]);
+            free(parents.keys);
+            free(candidates.keys);
+            if (!ok) {
+                fprintf(stderr, "Error: ran out of memory at layer %zu.\n", layer);
+                return EXIT_FAILURE;
+            }
+            if (!_save_layer(options->path, height, layer, &layers[layer])) {
+                fprintf(stderr, "Error: could not save layer %zu.\n", layer);
+                return EXIT_FAILURE;
+            }
+        }
+        printf("%5zu %14s %14zu %14zu %9.2f\n",
+            layer, candidates_found, layers[layer].num_boards, layers[layer].num_edges, _seconds_since(&start));
+        fflush(stdout);
+    }
+
+    // and the empty boards last, a placement from one leads up to the layer
+    // of its ceiling
+    _free_layer(&layers[0]);
+    workers[0].kept.num_boards = 0;
+    workers[0].kept.num_edges = 0;
+    for (size_t i = 0; i < done.count; ++i) {
+        size_t const pieces = COLS * _ceiling(done.keys[i]);
+        PcKeys const one = { .keys = &done.keys[i], .count = 1 };
+        PcPass last = {
+            .parents = &one,
+            .below = pieces % NUM_TETROMINO_BLOCKS == 0 && pieces > 0
+                ? &layers[pieces / NUM_TETROMINO_BLOCKS - 1]
+                : &nothing,
+            .next_parent = 0
+        };
+        workers[0].pass = &last;
+        if (!_expand(&workers[0], done.keys[i])) {
+            fprintf(stderr, "Error: ran out of memory.\n");
+            return EXIT_FAILURE;
+        }
+    }
+    layers[0] = workers[0].kept;
+    workers[0].kept = (PcLayer){ .boards = NULL };
+
+    if (!_write_database(options->path, height, layers, num_layers)) {
+        fprintf(stderr, "Error: could not write %s.\n", options->path);
+        return EXIT_FAILURE;
+    }
+    _remove_layers(options->path, num_layers);
+    printf("wrote %s in %.1fs with %zu threads\n",
+        options->path, _seconds_since(&build_start), options->num_workers);
+
+    for (size_t i = 0; i < options->num_workers; ++i) {
+        free(workers[i].candidates.slots);
+        _free_layer(&workers[i].kept);
+    }
+    for (size_t i = 0; i < num_layers; ++i) _free_layer(&layers[i]);
+    free(workers);
+    free(layers);
+    free(done.keys);
+    return EXIT_SUCCESS;
+}
+
+static int _info(PcDatabase const*const database) {
+    PcHeader const*const header = database->header;
+    printf("height %u, %llu boards, %llu placements, %llu slots, %zu bytes\n",
+        header->height,
+        (unsigned long long)header->num_entries,
+        (unsigned long long)header->num_edges,
+        (unsigned long long)header->num_slots,
+        database->size);
+
+    size_t by_pieces[PC_MAX_PIECES + 1] = { 0 };
+    for (size_t i = 0; i < header->num_entries; ++i) by_pieces[database->entries[i].num_pieces]++;
+    for (size_t pieces = 0; pieces <= PC_MAX_PIECES; ++pieces) {
+        if (by_pieces[pieces] > 0) printf("%3zu pieces %12zu boards\n", pieces, by_pieces[pieces]);
+    }
+    return EXIT_SUCCESS;
+}
+
+// finds the placement again from the spawn and locks it, which checks the
+// piece really gets there. Returns false if it doesn't.
+static bool _play_placement(GameState *const game_state, PcEdge const*const placement) {
+    Tetromino locks[PC_VISITED];
+    size_t const num_locks = _list_locks(game_state, placement->type, PC_MAX_HEIGHT, locks);
+    for (size_t i = 0; i < num_locks; ++i) {
+        if (locks[i].rotation != placement->rotation
+        ||  (int8_t)(ptrdiff_t)locks[i].x != placement->x
+        ||  (int8_t)(ptrdiff_t)locks[i].y != placement->y
+        ) continue;
+        game_state->current_tetromino = locks[i];
+        place_tetromino(game_state);
+        return true;
+    }
+    return false;
+}
+
+static int _solve(PcDatabase const*const database, PcOptions const*const options) {
+    GameState game_state = init_gamestate_seeded(0, options->seed);
+    memcpy(game_state.board, options->board.board, sizeof(game_state.board));
+
+    TetrominoType queue[PC_MAX_PIECES];
+    peek_tetrominoes(&game_state, queue, PC_MAX_PIECES);
+    printf("queue ");
+    for (size_t i = 0; i < PC_MAX_PIECES; ++i) {
+        if (options->queue_length == 0) putchar(tetromino_letters[queue[i]]);
+        else if (i < options->queue_length) putchar(tetromino_letters[options->queue[i]]);
+    }
+    putchar('\n');
+
+    PcSolution solution;
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    bool const found = options->queue_length == 0
+        ? find_perfect_clear(database, &game_state, &solution)
+        : solve_perfect_clear(
+            database,
+            game_state.board,
+            options->queue,
+            options->queue_length,
+            &solution
+        );
+    double const seconds = _seconds_since(&start);
+    if (!found) {
+        printf("no perfect clear (%.1fus)\n", seconds * 1e6);
+        return EXIT_FAILURE;
+    }
+
+    printf("perfect clear in %zu pieces (%.1fus)\n", solution.num_placements, seconds * 1e6);
+    for (size_t i = 0; i < solution.num_placements; ++i) {
+        PcEdge const*const placement = &solution.placements[i];
+        printf("\n%c rotation %u x %d y %d\n",
+            tetromino_letters[placement->type], placement->rotation, placement->x, placement->y);
+        if (!_play_placement(&game_state, placement)) {
+            fprintf(stderr, "Error: the piece can't get there.\n");
+            return EXIT_FAILURE;
+        }
+        _print_board(game_state.board, database->header->height);
+    }
+    return EXIT_SUCCESS;
+}
+
+static inline unsigned long long _next_random(unsigned long long *const state) {
+    unsigned long long x = *state;
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    *state = x;
+    return x;
+}
+
+// random stored boards with random queues, then the solutions played out
+static int _bench(PcDatabase const*const database, PcOptions const*const options) {
+    FixtureSet fixtures = { .fixtures = NULL };
+    if (options->fixtures_path != NULL && !read_fixtures(&fixtures, options->fixtures_path))
+        return EXIT_FAILURE;
+    size_t const num_queries = options->fixtures_path != NULL
+        ? fixtures.count
+        : options->num_queries;
+    size_t const num_entries = database->header->num_entries;
+    uint32_t *const entries = malloc(num_queries * sizeof(uint32_t));
+    TetrominoType (*const queues)[PC_MAX_PIECES] = malloc(num_queries * sizeof(*queues));
+    PcSolution *const solutions = malloc(num_queries * sizeof(PcSolution));
+    bool *const found = malloc(num_queries * sizeof(bool));
+    if (entries == NULL || queues == NULL || solutions == NULL || found == NULL) {
+        fprintf(stderr, "Error: could not allocate %zu queries.\n", num_queries);
+        return EXIT_FAILURE;
+    }
+
+    unsigned long long random_state = options->seed | 1;
+    for (size_t i = 0; i < num_queries; ++i) {
+        entries[i] = (_next_random(&random_state) >> 32) % num_entries;
+        for (size_t j = 0; j < PC_MAX_PIECES; ++j) queues[i][j]
+            = fixtures.count > 0 && j < fixtures.fixtures[i].queue_length
+            ? fixtures.fixtures[i].queue[j]
+            : (_next_random(&random_state) >> 32) % NUM_TETROMINO_TYPES;
+    }
+
+    GameState *const boards = malloc(num_queries * sizeof(GameState));
+    if (boards == NULL) {
+        fprintf(stderr, "Error: could not allocate %zu queries.\n", num_queries);
+        return EXIT_FAILURE;
+    }
+    for (size_t i = 0; i < num_queries; ++i) {
+        boards[i] = init_gamestate_seeded(0, 1);
+        if (fixtures.count > 0) memcpy(
+            boards[i].board, fixtures.fixtures[i].board, sizeof(boards[i].board)
+        );
+        else _unpack_key(database->entries[entries[i]].key, boards[i].board);
+    }
+
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    size_t num_found = 0;
+    for (size_t i = 0; i < num_queries; ++i) {
+        found[i] = solve_perfect_clear(database, boards[i].board, queues[i], PC_MAX_PIECES, &solutions[i]);
+        num_found += found[i];
+    }
+    double const seconds = _seconds_since(&start);
+
+    // every solution has to clear the board when it is actually played
+    size_t num_wrong = 0;
+    for (size_t i = 0; i < num_queries; ++i) {
+        if (!found[i]) continue;
+        GameState *const game_state = &boards[i];
+        bool ok = true;
+        for (size_t j = 0; j < solutions[i].num_placements && ok; ++j) ok
+            = solutions[i].placements[j].type == queues[i][j]
+           && _play_placement(game_state, &solutions[i].placements[j]);
+        for (size_t y = 0; y < ROWS && ok; ++y) {
+            for (size_t x = 0; x < COLS; ++x) ok = ok && game_state->board[y][x] == NO_TETROMINO;
+        }
+        num_wrong += !ok;
+    }
+
+    printf("%zu queries, %zu perfect clears, %zu wrong, %.2fus a query\n",
+        num_queries, num_found, num_wrong, seconds / num_queries * 1e6);
+    free(entries);
+    free(queues);
+    free(solutions);
+    free(found);
+    free(boards);
+    free_fixtures(&fixtures);
+    return num_wrong == 0? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+// Options ////////////////////////////////////////////////////////////////////
+static bool _parse_queue(char const*const value, PcOptions *const options) {
+    size_t const length = strlen(value);
+    if (length == 0 || length > PC_MAX_PIECES) return false;
+    for (size_t i = 0; i < length; ++i) {
+        char const*const letter
+            = memchr(tetromino_letters, value[i], NUM_TETROMINO_TYPES);
+        if (letter == NULL) return false;
+        options->queue[i] = (TetrominoType)(letter - tetromino_letters);
+    }
+    options->queue_length = length;
+    return true;
+}
+
+static bool _parse_options(int const argc, char **argv, PcOptions *const options) {
+    long const num_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    *options = (PcOptions){
+        .height      = PC_BUILD_HEIGHT,
+        .num_workers = num_cpus > 0? num_cpus : 1,
+        .num_queries = PC_BENCH_QUERIES,
+        .seed        = 1
+    };
+    init_fixture(&options->board);
+    if (argc < 3) return false;
+    options->command = argv[1];
+    options->path = argv[2];
+
+    for (int i = 3; i < argc; ++i) {
+        if (i + 1 >= argc) return false;
+        char const*const value = argv[i + 1];
+
+        if      (strcmp(argv[i], "-h") == 0) options->height = strtoul(value, NULL, 10);
+        else if (strcmp(argv[i], "-j") == 0) options->num_workers = strtoul(value, NULL, 10);
+        else if (strcmp(argv[i], "-b") == 0) {
+            char const*const end = parse_fixture(&options->board, value);
+            if (end == NULL || *end != '\0') return false;
+        }
+        else if (strcmp(argv[i], "-q") == 0) { if (!_parse_queue(value, options)) return false; }
+        else if (strcmp(argv[i], "-n") == 0) options->num_queries = strtoul(value, NULL, 10);
+        else if (strcmp(argv[i], "-f") == 0) options->fixtures_path = value;
+        else if (strcmp(argv[i], "-s") == 0) options->seed = strtoull(value, NULL, 10);
+        else return false;
+        ++i;
+    }
+    if (options->queue_length == 0) {
+        options->queue_length = options->board.queue_length < PC_MAX_PIECES
+            ? options->board.queue_length : PC_MAX_PIECES;
+        memcpy(options->queue, options->board.queue, options->queue_length * sizeof(TetrominoType));
+    }
+    // the empty board has to take whole pieces to fill up to the ceiling
+    return options->height > 0
+        && options->height <= PC_MAX_HEIGHT
+        && options->height * COLS % NUM_TETROMINO_BLOCKS == 0
+        && options->num_workers > 0
+        && options->num_queries > 0;
+}
+
+int main(int argc, char **argv) {
+    PcOptions options;
+    if (!_parse_options(argc, argv, &options)) {
+        fprintf(stderr,
+            "usage: %s build db [-h height] [-j threads]\n"
+            "       %s info db\n"
+            "       %s solve db [-b fixture] [-q pieces | -s seed]\n"
+            "       %s bench db [-n queries | -f fixtures] [-s seed]\n",
+            argv[0], argv[0], argv[0], argv[0]);
+        return EXIT_FAILURE;
+    }
+    _find_skies();
+    if (strcmp(options.command, "build") == 0) return _build(&options);
+
+    PcDatabase database;
+    if (!open_pc_database(&database, options.path)) {
+        fprintf(stderr, "Error: could not open database %s.\n", options.path);
+        return EXIT_FAILURE;
+    }
+    int status = EXIT_FAILURE;
+    if      (strcmp(options.command, "info") == 0) status = _info(&database);
+    else if (strcmp(options.command, "solve") == 0) status = _solve(&database, &options);
+    else if (strcmp(options.command, "bench") == 0) status = _bench(&database, &options);
+    else fprintf(stderr, "Error: unknown command %s.\n", options.command);
+    close_pc_database(&database);
+    return status;
+}
@@ -0,0 +1,395 @@
+#include "game.h"
+#include "fixture.h"
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+// Placement perft, after the chess engine move generator check. Starting from
+// a board and a piece sequence it finds every placement of each piece the
+// movement rules allow (shifts, rotation and soft drop through
+// `move_tetromino` and `rotate_tetromino`, so tucks and spins count too),
+// locks it with `place_tetromino` and counts the distinct boards after each
+// number of pieces.
+//
+// It goes a piece at a time: the distinct boards after N pieces are shared
+// out to a pool of threads, each explores every placement from its boards
+// into a buffer of its own, and the buffers are merged into the distinct
+// boards after N + 1. Counts don't depend on the thread count.
+//
+// Any change to movement, rotation or collision that changes the counts
+// changes what players can do. From the empty board with the default
+// sequence (LJTOIZS) it is:
+//     depth 1: 34       depth 2: 1168     depth 3: 41818    depth 4: 402533
+// `-c count` checks the last depth against an expected count.
+//
+// A start board is a fixture (see fixture.h), its queue is the sequence
+// unless -q gives one.
+//
+// usage: ./perft [-d depth] [-q pieces] [-b fixture] [-j threads] [-c count]
+
+#define PERFT_DEPTH     (size_t) 3
+#define PERFT_SEQUENCE  "LJTOIZS"
+#define PERFT_CHUNK     (size_t) 64 // boards a thread takes at a time
+#define PERFT_MAX_PIECES (size_t) 64
+
+// a piece position, x and y offset so the ones hanging off the left or top
+// edge ("-1" as a size_t, see Tetromino) still index
+#define PERFT_EDGE     (size_t) 4
+#define PERFT_VISITED  (MAX_NUM_ROTATIONS * (ROWS + PERFT_EDGE) * (COLS + PERFT_EDGE))
+
+static char const tetromino_letters[NUM_TETROMINO_TYPES] = {
+    'L', 'J', 'T', 'O', 'I', 'Z', 'S'
+};
+
+// Structs ////////////////////////////////////////////////////////////////////
+
+// a board without colours, bit x of rows[y] is the cell at (x, y)
+typedef struct {
+    uint16_t rows[ROWS];
+} PerftBoard;
+
+typedef struct {
+    PerftBoard *boards;
+    size_t count;
+    size_t capacity;
+} PerftBoards;
+
+typedef struct {
+    PerftBoards const* parents;
+    TetrominoType type;
+    _Atomic size_t next_parent;
+} PerftLevel;
+
+typedef struct {
+    PerftLevel *level;
+    pthread_t thread;
+    GameState search; // the board being searched, reused for every parent
+    PerftBoards children;
+    unsigned long long nodes;      // piece positions visited
+    unsigned long long placements; // positions the piece can lock in
+    bool out_of_memory;
+} PerftWorker;
+
+typedef struct {
+    size_t depth;
+    TetrominoType sequence[PERFT_MAX_PIECES];
+    size_t sequence_length;
+    bool has_sequence; // from -q
+    Fixture board;
+    size_t num_workers;
+    unsigned long long expected; // 0 to skip the check
+} PerftOptions;
+
+// Boards /////////////////////////////////////////////////////////////////////
+static inline PerftBoard _pack_board(TetrominoType const board[ROWS][COLS]) {
+    PerftBoard packed;
+    for (size_t y = 0; y < ROWS; ++y) {
+        uint16_t row = 0;
+        for (size_t x = 0; x < COLS; ++x)
+            row |= (uint16_t)(board[y][x] != NO_TETROMINO) << x;
+        packed.rows[y] = row;
+    }
+    return packed;
+}
+
+static inline void _unpack_board(
+    PerftBoard const*const packed,
+    TetrominoType board[ROWS][COLS]
+) {
+    for (size_t y = 0; y < ROWS; ++y) {
+        for (size_t x = 0; x < COLS; ++x) board[y][x]
+            = packed->rows[y] >> x & 1? garbage_tetromino : NO_TETROMINO;
+    }
+}
+
+static bool _push_board(PerftBoards *const boards, PerftBoard const*const board) {
+    if (boards->count == boards->capacity) {
+        size_t const capacity = boards->capacity > 0? 2 * boards->capacity : 1024;
+        PerftBoard *const grown
+            = realloc(boards->boards, capacity * sizeof(PerftBoard));
+        if (grown == NULL) return false;
+        boards->boards = grown;
+        boards->capacity = capacity;
+    }
+    boards->boards[boards->count++] = *board;
+    return true;
+}
+
+static inline uint64_t _hash_board(PerftBoard const*const board) {
+    uint64_t hash = 0x9E3779B97F4A7C15ULL;
+    for (size_t y = 0; y < ROWS; ++y) {
+        hash = (hash ^ board->rows[y]) * 0xBF58476D1CE4E5B9ULL;
+        hash ^= hash >> 31;
+    }
+    return hash;
+}
+
+// Search /////////////////////////////////////////////////////////////////////
+static inline size_t _visited_index(Tetromino const*const tetromino) {
+    size_t const x = tetromino->x + PERFT_EDGE;
+    size_t const y = tetromino->y + PERFT_EDGE;
+    return (tetromino->rotation * (ROWS + PERFT_EDGE) + y) * (COLS + PERFT_EDGE) + x;
+}
+
+// breadth first over every position the piece can get to from the spawn,
+// every one it can't move down from is a placement
+static bool _expand_board(
+    PerftWorker *const worker,
+    PerftBoard const*const parent,
+    TetrominoType const type
+) {
+    GameState *const search = &worker->search;
+    _unpack_board(parent, search->board);
+    if (!spawn_tetromino(search, type)) return true; // topped out
+
+    bool visited[PERFT_VISITED] = { false };
+    Tetromino queue[PERFT_VISITED];
+    size_t head = 0;
+    size_t tail = 0;
+    queue[tail++] = search->current_tetromino;
+    visited[_visited_index(&search->current_tetromino)] = true;
+
+    while (head < tail) {
+        Tetromino const position = queue[head++];
+        worker->nodes++;
+
+        for (size_t action = 0; action < 4; ++action) {
+            search->current_tetromino = position;
+            bool moved;
+            switch (action) {
+                case 0 : moved = move_tetromino(search, MOVE_LEFT); break;
+                case 1 : moved = move_tetromino(search, MOVE_RIGHT); break;
+                case 2 : moved = rotate_tetromino(search); break;
+                default: moved = move_tetromino(search, MOVE_DOWN); break;
+            }
+
+            if (moved) {
+                size_t const index = _visited_index(&search->current_tetromino);
+                if (visited[index]) continue;
+                visited[index] = true;
+                queue[tail++] = search->current_tetromino;
+            }
+            else if (action == 3) {
+                worker->placements++;
+                GameState placed = *search;
+                placed.current_tetromino = position;
+                place_tetromino(&placed);
+                PerftBoard const child = _pack_board(placed.board);
+                if (!_push_board(&worker->children, &child)) return false;
+            }
+        }
+    }
+    return true;
+}
+
+static void *_run_worker(void *const arg) {
+    PerftWorker *const worker = arg;
+    PerftLevel *const level = worker->level;
+    for (;;) {
+        size_t const first = atomic_fetch_add(&level->next_parent, PERFT_CHUNK);
+        if (first >= level->parents->count) return NULL;
+        size_t const last = first + PERFT_CHUNK < level->parents->count
+            ? first + PERFT_CHUNK
+            : level->parents->count;
+
+        for (size_t i = first; i < last; ++i) {
+            if (_expand_board(worker, &level->parents->boards[i], level->type))
+                continue;
+            worker->out_of_memory = true;
+            return NULL;
+        }
+    }
+}
+
+// Merging ////////////////////////////////////////////////////////////////////
+
+// open addressing over indices into `distinct`, SIZE_MAX for empty
+static bool _merge_children(
+    PerftWorker const*const workers,
+    size_t const num_workers,
+    PerftBoards *const distinct
+) {
+    size_t total = 0;
+    for (size_t i = 0; i < num_workers; ++i) total += workers[i].children.count;
+    size_t capacity = 1024;
+    while (capacity < 2 * total) capacity *= 2;
+
+    size_t *const slots = malloc(capacity * sizeof(size_t));
+    if (slots == NULL) return false;
+    memset(slots, 0xFF, capacity * sizeof(size_t));
+
+    bool ok = true;
+    for (size_t i = 0; i < num_workers && ok; ++i) {
+        PerftBoards const*const children = &workers[i].children;
+        for (size_t j = 0; j < children->count && ok; ++j) {
+            PerftBoard const*const child = &children->boards[j];
+            size_t slot = _hash_board(child) & (capacity - 1);
+            while (slots[slot] != SIZE_MAX && memcmp(
+                &distinct->boards[slots[slot]],
+                child,
+                sizeof(PerftBoard)
+            ) != 0) slot = (slot + 1) & (capacity - 1);
+
+            if (slots[slot] != SIZE_MAX) continue; // seen it
+            slots[slot] = distinct->count;
+            ok = _push_board(distinct, child);
+        }
+    }
+    free(slots);
+    return ok;
+}
+
+// Options ////////////////////////////////////////////////////////////////////
+static bool _parse_sequence(char const*const value, PerftOptions *const options) {
+    size_t const length = strlen(value);
+    if (length == 0 || length > PERFT_MAX_PIECES) return false;
+    for (size_t i = 0; i < length; ++i) {
+        char const*const letter
+            = memchr(tetromino_letters, value[i], NUM_TETROMINO_TYPES);
+        if (letter == NULL) return false;
+        options->sequence[i] = (TetrominoType)(letter - tetromino_letters);
+    }
+    options->sequence_length = length;
+    return true;
+}
+
+static bool _parse_options(int const argc, char **argv, PerftOptions *const options) {
+    long const num_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    *options = (PerftOptions){
+        .depth       = PERFT_DEPTH,
+        .num_workers = num_cpus > 0? num_cpus : 1
+    };
+    _parse_sequence(PERFT_SEQUENCE, options);
+    init_fixture(&options->board);
+
+    for (int i = 1; i < argc; ++i) {
+        if (i + 1 >= argc) return false;
+        char const*const value = argv[i + 1];
+
+        if      (strcmp(argv[i], "-d") == 0) options->depth = strtoul(value, NULL, 10);
+        else if (strcmp(argv[i], "-q") == 0) {
+            if (!_parse_sequence(value, options)) return false;
+            options->has_sequence = true;
+        }
+        else if (strcmp(argv[i], "-b") == 0) {
+            char const*const end = parse_fixture(&options->board, value);
+            if (end == NULL || *end != '\0') return false;
+        }
+        else if (strcmp(argv[i], "-j") == 0) options->num_workers = strtoul(value, NULL, 10);
+        else if (strcmp(argv[i], "-c") == 0) options->expected = strtoull(value, NULL, 10);
+        else return false;
+        ++i;
+    }
+    if (!options->has_sequence && options->board.queue_length > 0) {
+        options->sequence_length = options->board.queue_length;
+        memcpy(options->sequence, options->board.queue, options->board.queue_length * sizeof(TetrominoType));
+    }
+    return options->num_workers > 0;
+}
+
+// Reporting //////////////////////////////////////////////////////////////////
+static inline double _seconds_since(struct timespec const*const start) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - start->tv_sec) + (now.tv_nsec - start->tv_nsec) * 1e-9;
+}
+
+int main(int argc, char **argv) {
+    PerftOptions options;
+    if (!_parse_options(argc, argv, &options)) {
+        fprintf(stderr,
+            "usage: %s [-d depth] [-q pieces] [-b fixture] [-j threads] [-c count]\n",
+            argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    PerftBoard start = _pack_board(options.board.board);
+
+    PerftWorker *const workers = calloc(options.num_workers, sizeof(PerftWorker));
+    PerftBoards parents = { .boards = NULL };
+    if (workers == NULL || !_push_board(&parents, &start)) {
+        fprintf(stderr, "Error: could not allocate %zu workers.\n", options.num_workers);
+        return EXIT_FAILURE;
+    }
+    GameState const template = init_gamestate_seeded(0, 1);
+    for (size_t i = 0; i < options.num_workers; ++i) workers[i].search = template;
+
+    printf("%5s %5s %14s %14s %14s %9s %12s\n",
+        "depth", "piece", "boards", "placements", "nodes", "seconds", "nodes/s");
+
+    unsigned long long total_nodes = 0;
+    double total_seconds = 0;
+    bool ok = true;
+    for (size_t depth = 1; depth <= options.depth && ok; ++depth) {
+        PerftLevel level = {
+            .parents = &parents,
+            .type = options.sequence[(depth - 1) % options.sequence_length],
+            .next_parent = 0
+        };
+
+        struct timespec start_time;
+        clock_gettime(CLOCK_MONOTONIC, &start_time);
+        for (size_t i = 0; i < options.num_workers; ++i) {
+            PerftWorker *const worker = &workers[i];
+            worker->level = &level;
+            worker->children.count = 0;
+            worker->nodes = 0;
+            worker->placements = 0;
+            if (pthread_create(&worker->thread, NULL, _run_worker, worker)) {
+                fprintf(stderr, "Error: could not start worker thread.\n");
+                exit(1);
+            }
+        }
+
+        unsigned long long nodes = 0;
+        unsigned long long placements = 0;
+        for (size_t i = 0; i < options.num_workers; ++i) {
+            pthread_join(workers[i].thread, NULL);
+            nodes += workers[i].nodes;
+            placements += workers[i].placements;
+            ok = ok && !workers[i].out_of_memory;
+        }
+
+        PerftBoards children = { .boards = NULL };
+        ok = ok && _merge_children(workers, options.num_workers, &children);
+        if (!ok) {
+            fprintf(stderr, "Error: ran out of memory at depth %zu.\n", depth);
+            free(children.boards);
+            break;
+        }
+        double const seconds = _seconds_since(&start_time);
+        total_nodes += nodes;
+        total_seconds += seconds;
+
+        printf("%5zu %5c %14zu %14llu %14llu %9.3f %12.0f\n",
+            depth,
+            tetromino_letters[level.type],
+            children.count,
+            placements,
+            nodes,
+            seconds,
+            seconds > 0? nodes / seconds : 0);
+        free(parents.boards);
+        parents = children;
+    }
+
+    if (ok) printf("%zu threads, %.0f nodes/s overall\n",
+        options.num_workers,
+        total_seconds > 0? total_nodes / total_seconds : 0);
+    if (ok && options.expected != 0 && parents.count != options.expected) {
+        fprintf(stderr, "Error: expected %llu boards, found %zu.\n",
+            options.expected, parents.count);
+        ok = false;
+    }
+
+    for (size_t i = 0; i < options.num_workers; ++i) free(workers[i].children.boards);
+    free(workers);
+    free(parents.boards);
+    return ok? EXIT_SUCCESS : EXIT_FAILURE;
+}
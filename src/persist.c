@@ -0,0 +1,523 @@
+#include "persist.h"
+#include "config.h"
+#include "game.h"
+#include "replay.h"
+#include "snapshot.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#define PERSIST_GAME_SIZE    (size_t) 56 // 7 * u64
+#define PERSIST_SUMMARY_SIZE (size_t) (40 + PERSIST_HIGH_SCORES * PERSIST_GAME_SIZE)
+#define PERSIST_MAX_PAYLOAD  (sizeof(GameState) > PERSIST_SUMMARY_SIZE \
+                              ? sizeof(GameState) : PERSIST_SUMMARY_SIZE)
+
+// Little endian helpers //////////////////////////////////////////////////////
+static inline void _put_u32(unsigned char *const bytes, uint32_t const value) {
+    for (size_t i = 0; i < 4; ++i) bytes[i] = value >> (8 * i);
+}
+
+static inline void _put_u64(unsigned char *const bytes, uint64_t const value) {
+    for (size_t i = 0; i < 8; ++i) bytes[i] = value >> (8 * i);
+}
+
+static inline uint32_t _get_u32(unsigned char const*const bytes) {
+    uint32_t value = 0;
+    for (size_t i = 0; i < 4; ++i) value |= (uint32_t)bytes[i] << (8 * i);
+    return value;
+}
+
+static inline uint64_t _get_u64(unsigned char const*const bytes) {
+    uint64_t value = 0;
+    for (size_t i = 0; i < 8; ++i) value |= (uint64_t)bytes[i] << (8 * i);
+    return value;
+}
+
+// crc32 (IEEE), the table is filled on first open
+static uint32_t _crc_table[256];
+
+static void _init_crc_table(void) {
+    for (uint32_t n = 0; n < 256; ++n) {
+        uint32_t c = n;
+        for (size_t k = 0; k < 8; ++k)
+            c = c & 1? 0xEDB88320u ^ (c >> 1) : c >> 1;
+        _crc_table[n] = c;
+    }
+}
+
+static inline uint32_t _crc32(unsigned char const*const bytes, size_t const size) {
+    uint32_t crc = ~(uint32_t)0;
+    for (size_t i = 0; i < size; ++i)
+        crc = _crc_table[(crc ^ bytes[i]) & 0xFF] ^ (crc >> 8);
+    return ~crc;
+}
+
+// Records ////////////////////////////////////////////////////////////////////
+static inline void _put_game(unsigned char *const bytes, PersistGame const*const game) {
+    _put_u64(bytes + 0, game->score);
+    _put_u64(bytes + 8, game->lines);
+    _put_u64(bytes + 16, game->level);
+    _put_u64(bytes + 24, game->pieces);
+    _put_u64(bytes + 32, game->frames);
+    _put_u64(bytes + 40, game->seed);
+    _put_u64(bytes + 48, (uint64_t)game->finished_at);
+}
+
+static inline PersistGame _get_game(unsigned char const*const bytes) {
+    return (PersistGame){
+        .score       = _get_u64(bytes + 0),
+        .lines       = _get_u64(bytes + 8),
+        .level       = _get_u64(bytes + 16),
+        .pieces      = _get_u64(bytes + 24),
+        .frames      = _get_u64(bytes + 32),
+        .seed        = _get_u64(bytes + 40),
+        .finished_at = (int64_t)_get_u64(bytes + 48),
+    };
+}
+
+static void _put_summary(unsigned char *const bytes, PersistData const*const data) {
+    memset(bytes, 0, PERSIST_SUMMARY_SIZE);
+    _put_u64(bytes + 0, data->lifetime.games);
+    _put_u64(bytes + 8, data->lifetime.lines);
+    _put_u64(bytes + 16, data->lifetime.pieces);
+    _put_u64(bytes + 24, data->lifetime.frames);
+    _put_u64(bytes + 32, data->num_high_scores);
+    for (size_t i = 0; i < data->num_high_scores; ++i)
+        _put_game(bytes + 40 + i * PERSIST_GAME_SIZE, &data->high_scores[i]);
+}
+
+static void _get_summary(unsigned char const*const bytes, PersistData *const data) {
+    data->lifetime = (PersistStats){
+        .games  = _get_u64(bytes + 0),
+        .lines  = _get_u64(bytes + 8),
+        .pieces = _get_u64(bytes + 16),
+        .frames = _get_u64(bytes + 24),
+    };
+    uint64_t const num_high_scores = _get_u64(bytes + 32);
+    data->num_high_scores = num_high_scores < PERSIST_HIGH_SCORES
+        ? num_high_scores : PERSIST_HIGH_SCORES;
+    for (size_t i = 0; i < data->num_high_scores; ++i)
+        data->high_scores[i] = _get_game(bytes + 40 + i * PERSIST_GAME_SIZE);
+}
+
+static void _add_game(PersistData *const data, PersistGame const*const game) {
+    data->lifetime.games++;
+    data->lifetime.lines += game->lines;
+    data->lifetime.pieces += game->pieces;
+    data->lifetime.frames += game->frames;
+    data->has_autosave = false; // the saved game is the one that just ended
+
+    // ties go to the earlier game
+    size_t rank = data->num_high_scores;
+    while (rank > 0 && data->high_scores[rank - 1].score < game->score) rank--;
+    if (rank == PERSIST_HIGH_SCORES) return;
+    if (data->num_high_scores < PERSIST_HIGH_SCORES) data->num_high_scores++;
+    memmove(
+        &data->high_scores[rank + 1],
+        &data->high_scores[rank],
+        (data->num_high_scores - 1 - rank) * sizeof(PersistGame)
+    );
+    data->high_scores[rank] = *game;
+}
+
+// folds a record into `data`, false for ones this build can't read
+static bool _apply_record(
+    PersistData *const data,
+    uint32_t const kind,
+    unsigned char const*const payload,
+    size_t const size
+) {
+    switch (kind) {
+    case PERSIST_GAME_OVER: {
+        if (size != PERSIST_GAME_SIZE) return false;
+        PersistGame const game = _get_game(payload);
+        _add_game(data, &game);
+        return true;
+    }
+    case PERSIST_AUTOSAVE:
+        if (size != sizeof(GameState)) return false;
+        memcpy(&data->autosave, payload, sizeof(GameState));
+        data->has_autosave = true;
+        return true;
+    case PERSIST_SUMMARY:
+        if (size != PERSIST_SUMMARY_SIZE) return false;
+        _get_summary(payload, data);
+        return true;
+    default:
+        return false;
+    }
+}
+
+// Files //////////////////////////////////////////////////////////////////////
+static bool _write_all(int const fd, unsigned char const* bytes, size_t size) {
+    while (size > 0) {
+        ssize_t const written = write(fd, bytes, size);
+        if (written < 0) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        bytes += written;
+        size -= written;
+    }
+    return true;
+}
+
+static bool _write_record(
+    int const fd,
+    uint32_t const kind,
+    unsigned char const*const payload,
+    size_t const size
+) {
+    unsigned char header[PERSIST_RECORD_HEADER];
+    memcpy(header, PERSIST_MAGIC, 4);
+    _put_u32(header + 4, kind);
+    _put_u32(header + 8, size);
+    _put_u32(header + 12, _crc32(payload, size));
+    return _write_all(fd, header, sizeof(header)) && _write_all(fd, payload, size);
+}
+
+// the rename itself only sticks once the directory is synced
+static void _sync_directory(char const*const path) {
+    char directory[PATH_MAX] = ".";
+    char const*const slash = strrchr(path, '/');
+    if (slash == path) strcpy(directory, "/");
+    else if (slash != NULL && (size_t)(slash - path) < sizeof(directory)) {
+        memcpy(directory, path, slash - path);
+        directory[slash - path] = '\0';
+    }
+    int const fd = open(directory, O_RDONLY | O_DIRECTORY);
+    if (fd < 0) return;
+    fsync(fd);
+    close(fd);
+}
+
+// replays the log into `persistence->data` and gives the length of its
+// readable part, everything after that is a torn or corrupt write. False if
+// it couldn't be read at all, then nothing may be cut off.
+static bool _read_log(Persistence *const persistence, size_t *const readable) {
+    struct stat status;
+    if (fstat(persistence->fd, &status) != 0) return false;
+    *readable = 0;
+    if (status.st_size == 0) return true;
+
+    size_t const size = status.st_size;
+    unsigned char *const bytes = malloc(size);
+    if (bytes == NULL) return false;
+    size_t done = 0;
+    while (done < size) {
+        ssize_t const got = pread(persistence->fd, bytes + done, size - done, done);
+        if (got < 0 && errno == EINTR) continue;
+        if (got <= 0) break;
+        done += got;
+    }
+    if (done < size) {
+        free(bytes);
+        return false;
+    }
+
+    size_t skipped = 0;
+    size_t offset = 0;
+    while (offset + PERSIST_RECORD_HEADER <= size) {
+        unsigned char const*const header = bytes + offset;
+        size_t const payload_size = _get_u32(header + 8);
+        if (memcmp(header, PERSIST_MAGIC, 4) != 0
+        ||  payload_size > size - offset - PERSIST_RECORD_HEADER
+        ||  _crc32(header + PERSIST_RECORD_HEADER, payload_size) != _get_u32(header + 12)
+        ) break;
+
+        if (!_apply_record(
+            &persistence->data,
+            _get_u32(header + 4),
+            header + PERSIST_RECORD_HEADER,
+            payload_size
+        )) skipped++;
+        offset += PERSIST_RECORD_HEADER + payload_size;
+    }
+    free(bytes);
+
+    if (offset < size) fprintf(
+        stderr,
+        "Error: %s is damaged after byte %zu, dropping the last %zu bytes.\n",
+        persistence->path, offset, size - offset
+    );
+    if (skipped > 0) fprintf(
+        stderr,
+        "Error: skipped %zu records of %s from another version.\n",
+        skipped, persistence->path
+    );
+    *readable = offset;
+    return true;
+}
+
+// rewrites the log as a summary and the autosave, I/O thread only
+static bool _compact_log(Persistence *const persistence) {
+    char temporary[PATH_MAX];
+    if (snprintf(temporary, sizeof(temporary), "%s.tmp", persistence->path)
+        >= (int)sizeof(temporary)
+    ) return false;
+
+    int const fd = open(temporary, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) return false;
+
+    PersistData const*const data = &persistence->data;
+    unsigned char summary[PERSIST_SUMMARY_SIZE];
+    _put_summary(summary, data);
+    size_t const size = PERSIST_RECORD_HEADER + PERSIST_SUMMARY_SIZE
+        + (data->has_autosave? PERSIST_RECORD_HEADER + sizeof(GameState) : 0);
+    bool const ok
+        =  _write_record(fd, PERSIST_SUMMARY, summary, sizeof(summary))
+        && (!data->has_autosave || _write_record(
+               fd, PERSIST_AUTOSAVE, (unsigned char const*)&data->autosave, sizeof(GameState)
+           ))
+        && fsync(fd) == 0;
+    if (!ok || rename(temporary, persistence->path) != 0) {
+        close(fd);
+        unlink(temporary);
+        return false;
+    }
+    _sync_directory(persistence->path);
+
+    close(persistence->fd);
+    persistence->fd = fd;
+    persistence->log_size = size;
+    return true;
+}
+
+// I/O Thread /////////////////////////////////////////////////////////////////
+
+// writes one queued record, false if the ring is empty
+static bool _write_next(Persistence *const persistence, bool *const failed) {
+    size_t const tail = atomic_load_explicit(&persistence->tail, memory_order_relaxed);
+    if (tail == atomic_load_explicit(&persistence->head, memory_order_acquire))
+        return false;
+
+    PersistRecord const*const record = &persistence->queue[tail & (PERSIST_QUEUE_SLOTS - 1)];
+    static unsigned char payload[PERSIST_MAX_PAYLOAD]; // I/O thread only
+    PersistKind const kind = record->kind;
+    if (kind == PERSIST_SNAPSHOT) {
+        static GameState state; // I/O thread only
+        static char path[SNAPSHOT_PATH_SIZE];
+        state = record->state;
+        memcpy(path, record->path, sizeof(path));
+        atomic_store_explicit(&persistence->tail, tail + 1, memory_order_release);
+
+        if (write_snapshot(&state, path)) fprintf(stderr, "wrote %s\n", path);
+        else fprintf(stderr, "Error: could not write snapshot %s.\n", path);
+        return true;
+    }
+    if (kind == PERSIST_REPLAY) {
+        static Replay replay; // I/O thread only
+        static char path[SNAPSHOT_PATH_SIZE];
+        replay = record->replay;
+        memcpy(path, record->path, sizeof(path));
+        atomic_store_explicit(&persistence->tail, tail + 1, memory_order_release);
+
+        if (!write_replay(&replay, path))
+            fprintf(stderr, "Error: could not save replay to %s.\n", path);
+        free_replay(&replay);
+        return true;
+    }
+
+    size_t size = 0;
+    if (kind == PERSIST_GAME_OVER) {
+        _put_game(payload, &record->game);
+        size = PERSIST_GAME_SIZE;
+        _add_game(&persistence->data, &record->game);
+    }
+    else {
+        memcpy(payload, &record->state, sizeof(GameState));
+        size = sizeof(GameState);
+        persistence->data.autosave = record->state;
+        persistence->data.has_autosave = true;
+    }
+    atomic_store_explicit(&persistence->tail, tail + 1, memory_order_release);
+
+    if (!*failed && !_write_record(persistence->fd, kind, payload, size)) {
+        fprintf(stderr, "Error: could not append to %s.\n", persistence->path);
+        *failed = true;
+    }
+    persistence->log_size += PERSIST_RECORD_HEADER + size;
+    return true;
+}
+
+// one sync per batch of whatever queued up meanwhile
+static void *_run_persistence(void *const arg) {
+    Persistence *const persistence = arg;
+    bool failed = false;
+    while (true) {
+        while (sem_wait(&persistence->queued) != 0 && errno == EINTR)
+            ;
+        bool wrote = false;
+        while (_write_next(persistence, &failed)) wrote = true;
+        if (wrote && !failed) fdatasync(persistence->fd);
+
+        if (wrote && !failed && persistence->log_size > PERSIST_COMPACT_SIZE
+        &&  !_compact_log(persistence)
+        ) fprintf(stderr, "Error: could not compact %s.\n", persistence->path);
+
+        if (!atomic_load(&persistence->running)
+        &&  atomic_load(&persistence->tail) == atomic_load(&persistence->head)
+        ) return NULL;
+    }
+}
+
+// Queue //////////////////////////////////////////////////////////////////////
+static inline PersistRecord *_claim_slot(Persistence *const persistence) {
+    size_t const head = atomic_load_explicit(&persistence->head, memory_order_relaxed);
+    size_t const tail = atomic_load_explicit(&persistence->tail, memory_order_acquire);
+    if (head - tail == PERSIST_QUEUE_SLOTS) {
+        atomic_fetch_add_explicit(&persistence->dropped, 1, memory_order_relaxed);
+        return NULL;
+    }
+    return &persistence->queue[head & (PERSIST_QUEUE_SLOTS - 1)];
+}
+
+static inline void _publish_slot(Persistence *const persistence) {
+    atomic_fetch_add_explicit(&persistence->head, 1, memory_order_release);
+    sem_post(&persistence->queued);
+}
+
+// Exposed ////////////////////////////////////////////////////////////////////
+extern bool open_persistence(Persistence *const persistence, char const*const path) {
+    _init_crc_table();
+    persistence->path = path;
+    persistence->data = (PersistData){ .has_autosave = false };
+    persistence->session = (PersistStats){ 0 };
+    atomic_store(&persistence->head, 0);
+    atomic_store(&persistence->tail, 0);
+    atomic_store(&persistence->dropped, 0);
+
+    persistence->fd = open(path, O_RDWR | O_CREAT, 0644);
+    if (persistence->fd < 0) {
+        fprintf(stderr, "Error: could not open %s, nothing will be saved.\n", path);
+        return false;
+    }
+    if (!_read_log(persistence, &persistence->log_size)
+    ||  ftruncate(persistence->fd, persistence->log_size) != 0
+    ||  lseek(persistence->fd, persistence->log_size, SEEK_SET) < 0
+    ||  sem_init(&persistence->queued, 0, 0) != 0
+    ) {
+        fprintf(stderr, "Error: could not read %s, nothing will be saved.\n", path);
+        close(persistence->fd);
+        return false;
+    }
+
+    atomic_store(&persistence->running, true);
+    if (pthread_create(&persistence->thread, NULL, _run_persistence, persistence)) {
+        fprintf(stderr, "Error: could not start the persistence thread.\n");
+        sem_destroy(&persistence->queued);
+        close(persistence->fd);
+        return false;
+    }
+    return true;
+}
+
+extern void close_persistence(Persistence *const persistence) {
+    atomic_store(&persistence->running, false);
+    sem_post(&persistence->queued);
+    pthread_join(persistence->thread, NULL);
+    sem_destroy(&persistence->queued);
+    close(persistence->fd);
+
+    uint64_t const dropped = atomic_load(&persistence->dropped);
+    if (dropped > 0) fprintf(
+        stderr, "Error: %llu saves were dropped, the disk kept falling behind.\n",
+        (unsigned long long)dropped
+    );
+}
+
+extern void persist_game_over(Persistence *const persistence, GameState const*const game_state) {
+    PersistGame const game = {
+        .score = game_state->score,
+        .lines = game_state->total_lines,
+        .level = game_state->level,
+        .pieces = game_state->pieces_placed,
+        .frames = game_state->frame_number,
+        .seed = game_state->seed,
+        .finished_at = time(NULL),
+    };
+    persistence->session.games++;
+    persistence->session.lines += game.lines;
+    persistence->session.pieces += game.pieces;
+    persistence->session.frames += game.frames;
+
+    PersistRecord *const record = _claim_slot(persistence);
+    if (record == NULL) return;
+    record->kind = PERSIST_GAME_OVER;
+    record->game = game;
+    _publish_slot(persistence);
+}
+
+extern void persist_autosave(Persistence *const persistence, GameState const*const game_state) {
+    PersistRecord *const record = _claim_slot(persistence);
+    if (record == NULL) return;
+    record->kind = PERSIST_AUTOSAVE;
+    record->state = *game_state;
+    _publish_slot(persistence);
+}
+
+extern void persist_snapshot(
+    Persistence *const persistence,
+    GameState const*const game_state,
+    char const*const path
+) {
+    PersistRecord *const record = _claim_slot(persistence);
+    if (record == NULL) return;
+    record->kind = PERSIST_SNAPSHOT;
+    record->state = *game_state;
+    snprintf(record->path, sizeof(record->path), "%s", path);
+    _publish_slot(persistence);
+}
+
+extern void persist_replay(
+    Persistence *const persistence,
+    Replay *const replay,
+    char const*const path
+) {
+    PersistRecord *const record = _claim_slot(persistence);
+    if (record == NULL) return;
+    record->kind = PERSIST_REPLAY;
+    record->replay = *replay;
+    snprintf(record->path, sizeof(record->path), "%s", path);
+    _publish_slot(persistence);
+    *replay = (Replay){ .inputs = NULL };
+}
+
+extern void print_persisted_data(PersistData const*const data) {
+    PersistStats const*const lifetime = &data->lifetime;
+    printf(
+        "%llu games, %llu lines, %llu pieces, %.1f hours played\n",
+        (unsigned long long)lifetime->games,
+        (unsigned long long)lifetime->lines,
+        (unsigned long long)lifetime->pieces,
+        lifetime->frames / (double)FPS / 3600.0
+    );
+    for (size_t i = 0; i < data->num_high_scores; ++i) {
+        PersistGame const*const game = &data->high_scores[i];
+        char date[32] = "?";
+        time_t const finished_at = game->finished_at;
+        struct tm day;
+        if (localtime_r(&finished_at, &day) != NULL)
+            strftime(date, sizeof(date), "%Y-%m-%d", &day);
+        printf(
+            "\t%2zu. %10llu  %4llu lines  level %2llu  %s\n",
+            i + 1,
+            (unsigned long long)game->score,
+            (unsigned long long)game->lines,
+            (unsigned long long)game->level,
+            date
+        );
+    }
+}
@@ -0,0 +1,140 @@
+#ifndef PERSIST_H
+#define PERSIST_H
+
+#include "game.h"
+#include "replay.h"
+#include "snapshot.h"
+#include <pthread.h>
+#include <semaphore.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// High scores, lifetime stats and autosaves, kept across runs in an append
+// only log written by a thread of its own.
+//
+// The simulation thread copies what it wants saved (a finished game or a
+// GameState snapshot) into a fixed ring of records and posts a semaphore,
+// neither of which can block; if the ring is full the record is dropped and
+// counted. The I/O thread drains the ring, appends the records and syncs
+// once per batch, so however slow the disk the game never waits on it.
+//
+// Every record carries a checksum. Opening the log replays it up to the
+// first torn or corrupt record and cuts it off there, so a crash mid-write
+// loses at most the records of the batch being written. Once the log grows
+// past PERSIST_COMPACT_SIZE it is rewritten as one record of each kind (to a
+// temporary file, synced, then renamed over it).
+//
+// Record layout (little endian):
+//     "TPLG" | u32 kind | u32 size | u32 crc32 of the payload
+//     size * u8 payload
+// A game over is its PersistGame fields in order, an autosave is the raw
+// GameState (skipped when loaded by a build with a different GameState
+// size), a compacted summary is PersistData without the autosave.
+//
+// The same thread writes GameState snapshots (see snapshot.h) and the
+// replays of finished games to files of their own, those never go in the
+// log.
+
+// Constants //////////////////////////////////////////////////////////////////
+#define PERSIST_MAGIC          "TPLG"
+#define PERSIST_RECORD_HEADER  (size_t) 16
+#define PERSIST_QUEUE_SLOTS    (size_t) 8 // a power of 2
+#define PERSIST_HIGH_SCORES    (size_t) 10
+#define PERSIST_COMPACT_SIZE   (size_t) (1 << 20)
+#define PERSIST_AUTOSAVE_TICKS (size_t) 600 // 10s at 60 ticks per second
+
+// Structs ////////////////////////////////////////////////////////////////////
+typedef enum {
+    PERSIST_GAME_OVER = 1,
+    PERSIST_AUTOSAVE  = 2,
+    PERSIST_SUMMARY   = 3,
+    PERSIST_SNAPSHOT  = 4, // queued only, written with write_snapshot
+    PERSIST_REPLAY    = 5, // queued only, written with write_replay
+} PersistKind;
+
+typedef struct {
+    uint64_t score;
+    uint64_t lines;
+    uint64_t level;
+    uint64_t pieces;
+    uint64_t frames;
+    uint64_t seed;
+    int64_t  finished_at; // unix seconds
+} PersistGame;
+
+typedef struct {
+    uint64_t games;
+    uint64_t lines;
+    uint64_t pieces;
+    uint64_t frames;
+} PersistStats;
+
+// everything the log adds up to
+typedef struct {
+    PersistStats lifetime;
+    size_t num_high_scores;
+    PersistGame high_scores[PERSIST_HIGH_SCORES]; // best first
+
+    bool has_autosave; // a game in progress when the last run stopped
+    GameState autosave;
+} PersistData;
+
+typedef struct {
+    PersistKind kind;
+    union {
+        PersistGame game;
+        GameState state;
+        Replay replay; // owns its inputs until the I/O thread frees them
+    };
+    char path[SNAPSHOT_PATH_SIZE]; // PERSIST_SNAPSHOT and PERSIST_REPLAY only
+} PersistRecord;
+
+typedef struct {
+    int fd;
+    char const* path;
+    size_t log_size;
+    PersistData data; // I/O thread only once anything has been queued
+
+    // simulation thread -> I/O thread
+    PersistRecord queue[PERSIST_QUEUE_SLOTS];
+    _Atomic size_t head; // next slot to write, producer only
+    _Atomic size_t tail; // next slot to read, consumer only
+    sem_t queued;
+    _Atomic uint64_t dropped;
+
+    PersistStats session; // games finished this run, simulation thread only
+    _Atomic bool running;
+    pthread_t thread;
+} Persistence;
+
+// Functions //////////////////////////////////////////////////////////////////
+
+// reads the log (creating it if need be) and starts the I/O thread. Returns
+// false, after saying why, if the log can't be opened; the game just runs
+// without persistence then.
+bool open_persistence(Persistence *const persistence, char const*const path);
+
+// writes whatever is still queued and stops the thread
+void close_persistence(Persistence *const persistence);
+
+// these only copy into the queue, call them from one thread at a time
+void persist_game_over(Persistence *const persistence, GameState const*const game_state);
+void persist_autosave(Persistence *const persistence, GameState const*const game_state);
+void persist_snapshot(
+    Persistence *const persistence,
+    GameState const*const game_state,
+    char const*const path
+);
+// takes the replay's inputs rather than copying them, leaving it with none
+// (see init_replay). If the queue is full it is dropped and left as it was.
+void persist_replay(
+    Persistence *const persistence,
+    Replay *const replay,
+    char const*const path
+);
+
+void print_persisted_data(PersistData const*const data);
+
+#endif // PERSIST_H
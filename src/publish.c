@@ -0,0 +1,116 @@
+#include "publish.h"
+#include "game.h"
+#include <fcntl.h>
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+// Snapshot Conversion ////////////////////////////////////////////////////////
+static inline void _fill_snapshot(
+    StateSnapshot *const snapshot,
+    GameState const*const game_state
+) {
+    Tetromino const*const tetromino = &game_state->current_tetromino;
+
+    snapshot->frame_number   = game_state->frame_number;
+    snapshot->score          = game_state->score;
+    snapshot->level          = game_state->level;
+    snapshot->total_lines    = game_state->total_lines;
+    snapshot->piece_x        = (int8_t)(long)tetromino->x;
+    snapshot->piece_y        = (int8_t)(long)tetromino->y;
+    snapshot->piece_type     = tetromino->type;
+    snapshot->piece_rotation = tetromino->rotation;
+    snapshot->next_type      = game_state->next_tetromino;
+
+    for (size_t i = 0; i < NUM_TETROMINO_BLOCKS; ++i) {
+        snapshot->piece_positions[i][X_AXIS] = tetromino->positions[i][X_AXIS];
+        snapshot->piece_positions[i][Y_AXIS] = tetromino->positions[i][Y_AXIS];
+    }
+
+    for (size_t y = 0; y < ROWS; ++y) {
+        for (size_t x = 0; x < COLS; ++x)
+            snapshot->board[y][x] = game_state->board[y][x];
+    }
+}
+
+// Publisher Exposed //////////////////////////////////////////////////////////
+
+// Creates (or takes over) the shared memory ring. The ring is owned by the
+// caller so it survives hot reloads of libgame. Returns NULL on failure, in
+// which case the game should carry on without publishing.
+extern PublishRing *open_publisher(void) {
+    int const fd = shm_open(PUBLISH_SHM_NAME, O_CREAT | O_RDWR, 0644);
+    if (fd < 0) {
+        perror("Error: shm_open for state publisher");
+        return NULL;
+    }
+
+    if (ftruncate(fd, sizeof(PublishRing)) != 0) {
+        perror("Error: ftruncate for state publisher");
+        close(fd);
+        return NULL;
+    }
+
+    PublishRing *const ring = mmap(
+        NULL,
+        sizeof(PublishRing),
+        PROT_READ | PROT_WRITE,
+        MAP_SHARED,
+        fd,
+        0
+    );
+    close(fd);
+    if (ring == MAP_FAILED) {
+        perror("Error: mmap for state publisher");
+        return NULL;
+    }
+
+    // a previous run may have left slots behind, so start from scratch
+    // before advertising the layout to readers.
+    ring->magic = 0;
+    atomic_store_explicit(&ring->published, 0, memory_order_relaxed);
+    for (size_t i = 0; i < PUBLISH_RING_SIZE; ++i)
+        atomic_store_explicit(&ring->slots[i].sequence, 0, memory_order_relaxed);
+
+    ring->version       = PUBLISH_VERSION;
+    ring->ring_size     = PUBLISH_RING_SIZE;
+    ring->snapshot_size = sizeof(StateSnapshot);
+    ring->creator_pid   = (uint32_t)getpid();
+    atomic_thread_fence(memory_order_release);
+    ring->magic         = PUBLISH_MAGIC;
+
+    return ring;
+}
+
+// Single writer seqlock: mark the slot odd, write, mark it even again. Never
+// waits on readers, so a slow observer can't hold up the game loop.
+extern void publish_gamestate(
+    PublishRing *const ring,
+    GameState const*const game_state
+) {
+    uint64_t const published = atomic_load_explicit(
+        &ring->published,
+        memory_order_relaxed
+    );
+    PublishSlot *const slot = &ring->slots[published & (PUBLISH_RING_SIZE - 1)];
+    uint64_t const sequence = atomic_load_explicit(
+        &slot->sequence,
+        memory_order_relaxed
+    );
+
+    atomic_store_explicit(&slot->sequence, sequence + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+
+    _fill_snapshot(&slot->snapshot, game_state);
+
+    atomic_store_explicit(&slot->sequence, sequence + 2, memory_order_release);
+    atomic_store_explicit(&ring->published, published + 1, memory_order_release);
+}
+
+extern void close_publisher(PublishRing *const ring) {
+    munmap(ring, sizeof(PublishRing));
+    shm_unlink(PUBLISH_SHM_NAME);
+}
@@ -0,0 +1,119 @@
+#ifndef PUBLISH_H
+#define PUBLISH_H
+
+#include "game.h"
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+// Shared-memory state publishing. The game writes a compact snapshot of every
+// frame into a ring of seqlocked slots in POSIX shared memory. Observers map
+// the same memory read-only and pick up the newest slot whenever they like.
+// The writer never waits: a reader that falls behind just gets lapped and
+// notices it from the sequence numbers.
+//
+// A clean exit unlinks the memory, so a restarted game publishes into a new
+// object while old readers still see the one they mapped. Readers check the
+// name now and then (see observer.c) and remap when it points elsewhere,
+// `creator_pid` tells them apart when the game took over a leftover one.
+
+// Constants //////////////////////////////////////////////////////////////////
+#define PUBLISH_SHM_NAME  "/tetris_raylib_state"
+#define PUBLISH_MAGIC     (uint32_t) 0x54524C53 // "TRLS"
+#define PUBLISH_VERSION   (uint32_t) 2
+#define PUBLISH_RING_SIZE (size_t) 64 // must be a power of 2
+
+// Structs ////////////////////////////////////////////////////////////////////
+typedef struct {
+    uint64_t frame_number;
+    uint64_t score;
+    uint32_t level;
+    uint32_t total_lines;
+    int8_t  piece_x;
+    int8_t  piece_y; // can be -1 while a piece spawns above the board
+    uint8_t piece_type;
+    uint8_t piece_rotation;
+    uint8_t piece_positions[NUM_TETROMINO_BLOCKS][NUM_AXIS];
+    uint8_t next_type;
+    uint8_t board[ROWS][COLS]; // TetrominoType of every cell
+} StateSnapshot;
+
+// sequence is odd while the writer is inside the slot
+typedef struct {
+    _Atomic uint64_t sequence;
+    StateSnapshot snapshot;
+} PublishSlot;
+
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t ring_size;
+    uint32_t snapshot_size;
+    uint32_t creator_pid; // the game process that opened the ring
+    _Atomic uint64_t published; // total snapshots written so far
+    PublishSlot slots[PUBLISH_RING_SIZE];
+} PublishRing;
+
+// function signitures ////////////////////////////////////////////////////////
+typedef PublishRing *(*open_publisher_t)(void);
+typedef void (*publish_gamestate_t)(PublishRing*, GameState const*);
+typedef void (*close_publisher_t)(PublishRing*);
+
+// Reading ////////////////////////////////////////////////////////////////////
+
+// checks a mapped ring was written by a compatible publisher
+static inline bool publish_ring_is_valid(PublishRing const*const ring) {
+    return ring->magic == PUBLISH_MAGIC
+        && ring->version == PUBLISH_VERSION
+        && ring->ring_size == PUBLISH_RING_SIZE
+        && ring->snapshot_size == sizeof(StateSnapshot);
+}
+
+// copies snapshot number `index` (counting from 0) out of the ring. Returns
+// false if it hasn't been written yet or has already been overwritten.
+static inline bool publish_read_snapshot(
+    PublishRing *const ring,
+    uint64_t const index,
+    StateSnapshot *const snapshot
+) {
+    PublishSlot *const slot = &ring->slots[index & (PUBLISH_RING_SIZE - 1)];
+
+    // the slot's n-th write (counting from 0) leaves the sequence at 2n + 2
+    uint64_t const expected = 2 * (index / PUBLISH_RING_SIZE) + 2;
+    uint64_t const before = atomic_load_explicit(
+        &slot->sequence,
+        memory_order_acquire
+    );
+    if (before != expected) return false;
+
+    memcpy(snapshot, &slot->snapshot, sizeof(StateSnapshot));
+
+    atomic_thread_fence(memory_order_acquire);
+    uint64_t const after = atomic_load_explicit(
+        &slot->sequence,
+        memory_order_relaxed
+    );
+    return after == before;
+}
+
+// copies the newest snapshot, retrying if the writer laps the read.
+// Returns how many snapshots had been published (so the copied one is number
+// `returned - 1`) or 0 if nothing has been published yet.
+static inline uint64_t publish_read_latest(
+    PublishRing *const ring,
+    StateSnapshot *const snapshot
+) {
+    for (;;) {
+        uint64_t const published = atomic_load_explicit(
+            &ring->published,
+            memory_order_acquire
+        );
+        if (published == 0) return 0;
+        if (publish_read_snapshot(ring, published - 1, snapshot))
+            return published;
+    }
+}
+
+#endif // PUBLISH_H
@@ -0,0 +1,225 @@
+#include "game.h"
+#include "config.h"
+#include "soft.h"
+#include <raylib.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// Headless render benchmark. Draws generated game states with the regular
+// display code into a software framebuffer, reports per-frame render times
+// and optionally checks the first frame against a golden image. With -e every
+// frame also clears that many rows, which keeps the particle pool busy. With
+// -c it draws through a CommandBuffer, showing each state for `held` frames.
+//
+// usage: ./render_bench [-m default|wireframe] [-n frames] [-s WxH] [-e rows]
+//                       [-c held] [-w write.ppm] [-g golden.ppm] [-t tolerance]
+
+#define BENCH_FRAMES     (size_t) 1000
+#define BENCH_STATES     (size_t) 64
+#define BENCH_SEED       (unsigned) 1234
+
+typedef struct {
+    DisplayMode display_mode;
+    size_t num_frames;
+    size_t width;
+    size_t height;
+    size_t effect_rows;
+    size_t held_frames; // 0 draws straight to the framebuffer
+    char const* write_path;
+    char const* golden_path;
+    unsigned char tolerance;
+} BenchOptions;
+
+// Test States ////////////////////////////////////////////////////////////////
+
+// a half full board with one hole per row, so both the block and the
+// wireframe edge code have plenty to do.
+static GameState _generate_state(size_t const index) {
+    SetRandomSeed(BENCH_SEED + index);
+    GameState game_state = init_gamestate_seeded(INIT_LEVEL, BENCH_SEED + index);
+    game_state.score = index * 1200;
+
+    for (size_t y = ROWS / 2; y < ROWS; ++y) {
+        size_t const hole = GetRandomValue(0, COLS - 1);
+        for (size_t x = 0; x < COLS; ++x) {
+            game_state.board[y][x] = x == hole
+                ? NO_TETROMINO
+                : (TetrominoType)GetRandomValue(first_random_tetromino,
+                                                last_random_tetromino);
+        }
+    }
+    game_state.current_tetromino.y = 2 + index % (ROWS / 2 - 4);
+    rehash_gamestate(&game_state);
+    return game_state;
+}
+
+// pretends the bottom `rows` rows were just cleared by a new piece
+static void _add_effects(
+    GameState *const game_state,
+    size_t const frame,
+    size_t const rows
+) {
+    game_state->frame_number = frame;
+    game_state->pieces_placed = frame;
+    game_state->last_placed = game_state->current_tetromino;
+    game_state->num_cleared_rows = rows;
+    for (size_t i = 0; i < rows; ++i) {
+        game_state->cleared_rows[i] = ROWS - 1 - i;
+        for (size_t x = 0; x < COLS; ++x)
+            game_state->cleared_cells[i][x] = game_state->board[ROWS - 1 - i][x];
+    }
+}
+
+// Reporting //////////////////////////////////////////////////////////////////
+static inline double _seconds_between(
+    struct timespec const*const start,
+    struct timespec const*const end
+) {
+    return (end->tv_sec - start->tv_sec) + (end->tv_nsec - start->tv_nsec) * 1e-9;
+}
+
+static int _compare_times(void const* a, void const* b) {
+    double const time_a = *(double const*)a;
+    double const time_b = *(double const*)b;
+    return (time_a > time_b) - (time_a < time_b);
+}
+
+static void _report_times(double *const frame_times, size_t const num_frames) {
+    double total = 0;
+    for (size_t i = 0; i < num_frames; ++i) total += frame_times[i];
+    qsort(frame_times, num_frames, sizeof(double), _compare_times);
+
+    printf("frames  %zu\n", num_frames);
+    printf("total   %.3f ms\n", total * 1e3);
+    printf("mean    %.2f us\n", total / num_frames * 1e6);
+    printf("min     %.2f us\n", frame_times[0] * 1e6);
+    printf("p50     %.2f us\n", frame_times[num_frames / 2] * 1e6);
+    printf("p99     %.2f us\n", frame_times[num_frames * 99 / 100] * 1e6);
+    printf("max     %.2f us\n", frame_times[num_frames - 1] * 1e6);
+}
+
+// Options ////////////////////////////////////////////////////////////////////
+static bool _parse_options(int const argc, char **argv, BenchOptions *const options) {
+    *options = (BenchOptions){
+        .display_mode = WIREFRAME_DISPLAY_MODE,
+        .num_frames   = BENCH_FRAMES,
+        .width        = INIT_WIDTH,
+        .height       = INIT_HEIGHT,
+        .tolerance    = 0
+    };
+
+    for (int i = 1; i < argc; ++i) {
+        if (i + 1 >= argc) return false;
+        char const*const value = argv[i + 1];
+
+        if (strcmp(argv[i], "-m") == 0) {
+            if      (strcmp(value, "default") == 0)
+                options->display_mode = DEFAULT_DISPLAY_MODE;
+            else if (strcmp(value, "wireframe") == 0)
+                options->display_mode = WIREFRAME_DISPLAY_MODE;
+            else return false;
+        }
+        else if (strcmp(argv[i], "-n") == 0)
+            options->num_frames = strtoul(value, NULL, 10);
+        else if (strcmp(argv[i], "-s") == 0) {
+            if (sscanf(value, "%zux%zu", &options->width, &options->height) != 2)
+                return false;
+        }
+        else if (strcmp(argv[i], "-e") == 0)
+            options->effect_rows = strtoul(value, NULL, 10);
+        else if (strcmp(argv[i], "-c") == 0)
+            options->held_frames = strtoul(value, NULL, 10);
+        else if (strcmp(argv[i], "-w") == 0) options->write_path = value;
+        else if (strcmp(argv[i], "-g") == 0) options->golden_path = value;
+        else if (strcmp(argv[i], "-t") == 0) options->tolerance = atoi(value);
+        else return false;
+        ++i;
+    }
+    return options->num_frames > 0
+        && options->width > 0
+        && options->height > 0
+        && options->effect_rows <= MAX_COMPLETED_ROWS;
+}
+
+int main(int argc, char **argv) {
+    BenchOptions options;
+    if (!_parse_options(argc, argv, &options)) {
+        fprintf(stderr,
+            "usage: %s [-m default|wireframe] [-n frames] [-s WxH] [-e rows]\n"
+            "          [-c held] [-w write.ppm] [-g golden.ppm] [-t tolerance]\n",
+            argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    GameState game_states[BENCH_STATES];
+    for (size_t i = 0; i < BENCH_STATES; ++i) game_states[i] = _generate_state(i);
+
+    SoftFramebuffer framebuffer
+        = create_soft_framebuffer(options.width, options.height);
+    bind_soft_framebuffer(&framebuffer);
+    DisplayConfig display_config = init_soft_display_config(options.display_mode);
+    static ParticlePool particles;
+    if (options.effect_rows > 0) display_config.particles = &particles;
+    static CommandBuffer commands;
+    if (options.held_frames > 0) display_config.commands = &commands;
+
+    // the first frame is the reference image
+    display_game(&game_states[0], &display_config);
+
+    int exit_code = EXIT_SUCCESS;
+    if (options.write_path != NULL
+    && !write_soft_framebuffer_ppm(&framebuffer, options.write_path)
+    ) {
+        fprintf(stderr, "Error: could not write %s.\n", options.write_path);
+        exit_code = EXIT_FAILURE;
+    }
+    if (options.golden_path != NULL) {
+        SoftFramebuffer golden;
+        if (!read_soft_framebuffer_ppm(&golden, options.golden_path)) {
+            fprintf(stderr, "Error: could not read %s.\n", options.golden_path);
+            return EXIT_FAILURE;
+        }
+        size_t const differences
+            = compare_soft_framebuffers(&framebuffer, &golden, options.tolerance);
+        if (differences == 0) printf("golden  match\n");
+        else {
+            printf("golden  MISMATCH (%zu pixels)\n", differences);
+            exit_code = EXIT_FAILURE;
+        }
+        free_soft_framebuffer(&golden);
+    }
+
+    double *const frame_times = malloc(options.num_frames * sizeof(double));
+    size_t total_particles = 0;
+    for (size_t i = 0; i < options.num_frames; ++i) {
+        size_t const shown = options.held_frames > 0? i / options.held_frames : i;
+        GameState game_state = game_states[shown % BENCH_STATES];
+        if (options.effect_rows > 0)
+            _add_effects(&game_state, shown + 1, options.effect_rows);
+
+        struct timespec start, end;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        display_game(&game_state, &display_config);
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        frame_times[i] = _seconds_between(&start, &end);
+        total_particles += particles.count;
+    }
+    _report_times(frame_times, options.num_frames);
+    if (options.effect_rows > 0) printf("particles %.0f on average\n",
+        (double)total_particles / options.num_frames);
+    if (options.held_frames > 0) printf(
+        "commands %.1f drawn, %.1f submitted in %.1f batches a frame, %llu of %llu frames kept\n",
+        (double)commands.num_commands / commands.num_frames,
+        (double)commands.num_submitted / commands.num_frames,
+        (double)commands.num_batches_submitted / commands.num_frames,
+        commands.num_kept_frames,
+        commands.num_frames
+    );
+
+    free(frame_times);
+    free_soft_framebuffer(&framebuffer);
+    return exit_code;
+}
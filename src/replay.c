@@ -0,0 +1,161 @@
+#include "replay.h"
+#include "game.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Little endian helpers //////////////////////////////////////////////////////
+static inline void _put_u32(unsigned char *const bytes, uint32_t const value) {
+    for (size_t i = 0; i < 4; ++i) bytes[i] = value >> (8 * i);
+}
+
+static inline void _put_u64(unsigned char *const bytes, uint64_t const value) {
+    for (size_t i = 0; i < 8; ++i) bytes[i] = value >> (8 * i);
+}
+
+static inline uint32_t _get_u32(unsigned char const*const bytes) {
+    uint32_t value = 0;
+    for (size_t i = 0; i < 4; ++i) value |= (uint32_t)bytes[i] << (8 * i);
+    return value;
+}
+
+static inline uint64_t _get_u64(unsigned char const*const bytes) {
+    uint64_t value = 0;
+    for (size_t i = 0; i < 8; ++i) value |= (uint64_t)bytes[i] << (8 * i);
+    return value;
+}
+
+#define REPLAY_HEADER_SIZE (size_t) 44
+
+// Replay Exposed /////////////////////////////////////////////////////////////
+extern void init_replay(
+    Replay *const replay,
+    size_t const level,
+    unsigned long long const seed
+) {
+    replay->level = level;
+    replay->seed = seed;
+    replay->num_frames = 0;
+    replay->final_hash = 0;
+    replay->num_hashes = 0;
+    if (replay->inputs == NULL) {
+        replay->capacity = REPLAY_INIT_CAPACITY;
+        replay->inputs = malloc(replay->capacity);
+        replay->hashes_capacity = REPLAY_INIT_CAPACITY / REPLAY_HASH_INTERVAL;
+        replay->hashes = malloc(replay->hashes_capacity * sizeof(unsigned long long));
+        if (replay->inputs == NULL || replay->hashes == NULL) {
+            fprintf(stderr, "Error: could not allocate replay buffer.\n");
+            exit(1);
+        }
+    }
+}
+
+extern void free_replay(Replay *const replay) {
+    free(replay->inputs);
+    free(replay->hashes);
+    replay->inputs = NULL;
+    replay->hashes = NULL;
+    replay->num_frames = 0;
+    replay->capacity = 0;
+    replay->num_hashes = 0;
+    replay->hashes_capacity = 0;
+}
+
+extern void record_replay_input(
+    Replay *const replay,
+    GameInput const*const input
+) {
+    if (replay->num_frames == replay->capacity) {
+        size_t const capacity = replay->capacity * 2;
+        unsigned char *const inputs = realloc(replay->inputs, capacity);
+        if (inputs == NULL) {
+            fprintf(stderr, "Error: could not grow replay buffer.\n");
+            exit(1);
+        }
+        replay->inputs = inputs;
+        replay->capacity = capacity;
+    }
+    replay->inputs[replay->num_frames++] = pack_replay_input(input);
+}
+
+extern void record_replay_hash(
+    Replay *const replay,
+    GameState const*const game_state
+) {
+    if (replay->num_frames % REPLAY_HASH_INTERVAL != 0) return;
+    if (replay->num_hashes == replay->hashes_capacity) {
+        size_t const capacity = replay->hashes_capacity * 2;
+        unsigned long long *const hashes
+            = realloc(replay->hashes, capacity * sizeof(unsigned long long));
+        if (hashes == NULL) {
+            fprintf(stderr, "Error: could not grow replay buffer.\n");
+            exit(1);
+        }
+        replay->hashes = hashes;
+        replay->hashes_capacity = capacity;
+    }
+    replay->hashes[replay->num_hashes++] = hash_gamestate(game_state);
+}
+
+extern bool write_replay(Replay const*const replay, char const*const path) {
+    FILE *const file = fopen(path, "wb");
+    if (file == NULL) return false;
+
+    unsigned char header[REPLAY_HEADER_SIZE];
+    memcpy(header, REPLAY_MAGIC, 4);
+    _put_u32(header + 4, REPLAY_VERSION);
+    _put_u32(header + 8, replay->level);
+    _put_u64(header + 12, replay->seed);
+    _put_u64(header + 20, replay->num_frames);
+    _put_u64(header + 28, replay->final_hash);
+    _put_u64(header + 36, replay->num_hashes);
+
+    bool ok
+        = fwrite(header, 1, sizeof(header), file) == sizeof(header)
+       && fwrite(replay->inputs, 1, replay->num_frames, file) == replay->num_frames;
+    for (size_t i = 0; i < replay->num_hashes && ok; ++i) {
+        unsigned char hash[8];
+        _put_u64(hash, replay->hashes[i]);
+        ok = fwrite(hash, 1, sizeof(hash), file) == sizeof(hash);
+    }
+    return fclose(file) == 0 && ok;
+}
+
+extern bool read_replay(Replay *const replay, char const*const path) {
+    FILE *const file = fopen(path, "rb");
+    if (file == NULL) return false;
+
+    unsigned char header[REPLAY_HEADER_SIZE];
+    if (fread(header, 1, sizeof(header), file) != sizeof(header)
+    ||  memcmp(header, REPLAY_MAGIC, 4) != 0
+    ||  _get_u32(header + 4) != REPLAY_VERSION
+    ) {
+        fclose(file);
+        return false;
+    }
+
+    replay->level = _get_u32(header + 8);
+    replay->seed = _get_u64(header + 12);
+    replay->num_frames = _get_u64(header + 20);
+    replay->final_hash = _get_u64(header + 28);
+    replay->num_hashes = _get_u64(header + 36);
+    replay->capacity = replay->num_frames > 0? replay->num_frames : 1;
+    replay->hashes_capacity = replay->num_hashes > 0? replay->num_hashes : 1;
+    replay->inputs = malloc(replay->capacity);
+    replay->hashes = replay->num_hashes <= replay->num_frames / REPLAY_HASH_INTERVAL
+        ? malloc(replay->hashes_capacity * sizeof(unsigned long long))
+        : NULL;
+    bool ok = replay->inputs != NULL && replay->hashes != NULL
+        && fread(replay->inputs, 1, replay->num_frames, file) == replay->num_frames;
+    for (size_t i = 0; i < replay->num_hashes && ok; ++i) {
+        unsigned char hash[8];
+        ok = fread(hash, 1, sizeof(hash), file) == sizeof(hash);
+        if (ok) replay->hashes[i] = _get_u64(hash);
+    }
+    fclose(file);
+    if (!ok) free_replay(replay);
+    return ok;
+}
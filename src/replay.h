@@ -0,0 +1,74 @@
+#ifndef REPLAY_H
+#define REPLAY_H
+
+#include "game.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// A recorded game: the level and seed it started from plus one byte of input
+// per frame. Games are deterministic given those (see `init_gamestate_seeded`)
+// so this is all that is needed to rebuild every frame: start from
+// `init_gamestate_seeded(level, seed)` and call `next_gamestate` with
+// `unpack_replay_input(inputs[i])` for each frame. `final_hash` is
+// `hash_gamestate` of the last frame, so anything replaying the game can tell
+// if it desynced (0 if unknown), and `hashes` has it every
+// REPLAY_HASH_INTERVAL frames to tell where (see `matches_replay`).
+//
+// File layout (little endian):
+//     "TRRP" | u32 version | u32 level | u64 seed | u64 num_frames
+//     u64 final_hash | u64 num_hashes
+//     num_frames * u8 input (pressed in the low nibble, down in the high)
+//     num_hashes * u64 hash (after frame REPLAY_HASH_INTERVAL * (i + 1))
+
+#define REPLAY_MAGIC    "TRRP"
+#define REPLAY_VERSION  (uint32_t) 4
+#define REPLAY_INIT_CAPACITY (size_t) 4096
+#define REPLAY_HASH_INTERVAL (size_t) 60 // a second at 60 ticks per second
+
+typedef struct {
+    size_t level;
+    unsigned long long seed;
+    size_t num_frames;
+    unsigned long long final_hash;
+    size_t capacity;
+    unsigned char *inputs;
+    size_t num_hashes;
+    size_t hashes_capacity;
+    unsigned long long *hashes;
+} Replay;
+
+static inline unsigned char pack_replay_input(GameInput const*const input) {
+    return (input->pressed & 0x0F) | (input->down & 0x0F) << 4;
+}
+
+static inline GameInput unpack_replay_input(unsigned char const packed) {
+    return (GameInput){ .pressed = packed & 0x0F, .down = packed >> 4 };
+}
+
+void init_replay(
+    Replay *const replay,
+    size_t const level,
+    unsigned long long const seed
+);
+void free_replay(Replay *const replay);
+void record_replay_input(Replay *const replay, GameInput const*const input);
+// after the frame of the last input is played, keeps its hash every
+// REPLAY_HASH_INTERVAL frames
+void record_replay_hash(Replay *const replay, GameState const*const game_state);
+bool write_replay(Replay const*const replay, char const*const path);
+bool read_replay(Replay *const replay, char const*const path);
+
+// whether `game_state`, `frames` frames into the replay, is the one that was
+// recorded. True where nothing was.
+static inline bool matches_replay(
+    Replay const*const replay,
+    size_t const frames,
+    GameState const*const game_state
+) {
+    if (frames == 0 || frames % REPLAY_HASH_INTERVAL != 0) return true;
+    size_t const i = frames / REPLAY_HASH_INTERVAL - 1;
+    return i >= replay->num_hashes || replay->hashes[i] == hash_gamestate(game_state);
+}
+
+#endif // REPLAY_H
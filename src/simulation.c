@@ -0,0 +1,272 @@
+#include "simulation.h"
+#include "game.h"
+#include "persist.h"
+#include "snapshot.h"
+#include "triple_buffer.h"
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define NANOSECONDS (long) 1000000000
+
+// Timing /////////////////////////////////////////////////////////////////////
+static inline void _add_nanoseconds(struct timespec *const time, long const ns) {
+    time->tv_nsec += ns;
+    while (time->tv_nsec >= NANOSECONDS) {
+        time->tv_nsec -= NANOSECONDS;
+        time->tv_sec++;
+    }
+}
+
+static inline long _nanoseconds_between(
+    struct timespec const*const start,
+    struct timespec const*const end
+) {
+    return (end->tv_sec - start->tv_sec) * NANOSECONDS
+         + (end->tv_nsec - start->tv_nsec);
+}
+
+// Games //////////////////////////////////////////////////////////////////////
+static void _new_game(Simulation *const simulation) {
+    GameState *const game_state = &simulation->game_state;
+    simulation->is_resumed = simulation->resume_from != NULL;
+    if (simulation->is_resumed) {
+        *game_state = *simulation->resume_from;
+        game_state->is_paused = false;
+        simulation->resume_from = NULL;
+    }
+    else *game_state = simulation->init_gamestate(simulation->init_level);
+    init_replay(&simulation->replay, game_state->level, game_state->seed);
+}
+
+// written by the persistence thread when there is one, which takes the
+// inputs buffer and leaves the next game to allocate its own
+static void _save_replay(Simulation *const simulation) {
+    if (simulation->replay_path == NULL || simulation->is_resumed) return;
+    if (simulation->persistence != NULL) persist_replay(
+        simulation->persistence,
+        &simulation->replay,
+        simulation->replay_path
+    );
+    else if (!write_replay(&simulation->replay, simulation->replay_path)) fprintf(
+        stderr,
+        "Error: could not save replay to %s.\n",
+        simulation->replay_path
+    );
+}
+
+// the state exactly as the simulation has it, written by the persistence
+// thread when there is one
+static void _take_snapshot(Simulation *const simulation) {
+    if (!atomic_exchange(&simulation->snapshot_requested, false)) return;
+
+    GameState const*const game_state = &simulation->game_state;
+    char path[SNAPSHOT_PATH_SIZE];
+    snprintf(path, sizeof(path), SNAPSHOT_PATH_FORMAT,
+        simulation->snapshot_dir, game_state->frame_number
+    );
+    if (simulation->persistence != NULL)
+        persist_snapshot(simulation->persistence, game_state, path);
+    else if (write_snapshot(game_state, path)) fprintf(stderr, "wrote %s\n", path);
+    else fprintf(stderr, "Error: could not write snapshot %s.\n", path);
+}
+
+// Handoff ////////////////////////////////////////////////////////////////////
+
+// mixes together everything display_game draws
+static inline unsigned long long _visible_key(GameState const*const game_state) {
+    return hash_gamestate(game_state)
+         ^ game_state->score * 0x9E3779B97F4A7C15ULL
+         ^ game_state->level * 0xC2B2AE3D27D4EB4FULL
+         ^ game_state->display_mode * 0x165667B19E3779F9ULL
+         ^ (game_state->is_paused? 0x27D4EB2F165667C5ULL : 0);
+}
+
+// the revision is bumped after the state is published, so a reader that sees
+// a new revision is sure to find the matching state in the triple buffer.
+static void _hand_off_state(Simulation *const simulation) {
+    GameState const*const game_state = &simulation->game_state;
+    *triple_buffer_write_slot(&simulation->states) = *game_state;
+    triple_buffer_publish(&simulation->states);
+
+    unsigned long long const key = _visible_key(game_state);
+    if (key == simulation->drawn_key) return;
+    simulation->drawn_key = key;
+    atomic_fetch_add_explicit(&simulation->revision, 1, memory_order_release);
+}
+
+// Simulation Thread //////////////////////////////////////////////////////////
+
+// blocks until unpaused (or stopped). Returns whether it had to wait.
+static bool _wait_while_paused(Simulation *const simulation) {
+    if (!atomic_load_explicit(&simulation->paused, memory_order_relaxed))
+        return false;
+
+    simulation->game_state.is_paused = true;
+    _hand_off_state(simulation);
+
+    // a snapshot is taken with the lock let go, writing one without a
+    // persistence thread mustn't hold up pausing on the render thread
+    pthread_mutex_lock(&simulation->pause_lock);
+    while (atomic_load(&simulation->paused) && atomic_load(&simulation->running)) {
+        if (atomic_load(&simulation->snapshot_requested)) {
+            pthread_mutex_unlock(&simulation->pause_lock);
+            _take_snapshot(simulation);
+            pthread_mutex_lock(&simulation->pause_lock);
+            continue;
+        }
+        pthread_cond_wait(&simulation->pause_changed, &simulation->pause_lock);
+    }
+    pthread_mutex_unlock(&simulation->pause_lock);
+
+    // presses made while paused shouldn't all land on the first tick
+    atomic_store(&simulation->pressed, 0);
+    atomic_store(&simulation->pressed_at, 0);
+    simulation->game_state.is_paused = false;
+    _hand_off_state(simulation);
+    return true;
+}
+
+static void _tick(Simulation *const simulation) {
+    _take_snapshot(simulation);
+
+    // presses are taken before their timestamp, so one fed in between at
+    // worst loses its latency sample
+    GameInput input = {
+        .pressed = atomic_exchange_explicit(
+            &simulation->pressed, 0, memory_order_relaxed
+        ),
+        .down = atomic_load_explicit(&simulation->down, memory_order_relaxed)
+    };
+    input.pressed_at = atomic_exchange_explicit(
+        &simulation->pressed_at, 0, memory_order_relaxed
+    );
+    input.down_at = atomic_load_explicit(&simulation->down_at, memory_order_relaxed);
+
+    GameState *const game_state = &simulation->game_state;
+    record_replay_input(&simulation->replay, &input);
+    unsigned long long const pieces_placed = game_state->pieces_placed;
+    size_t const total_lines = game_state->total_lines;
+    bool const is_game_over = simulation->next_gamestate(game_state, &input);
+    record_replay_hash(&simulation->replay, game_state);
+    if (simulation->metrics != NULL) record_ticks(
+        simulation->metrics,
+        1,
+        game_state->pieces_placed - pieces_placed,
+        game_state->total_lines - total_lines
+    );
+    if (simulation->publisher != NULL)
+        simulation->publish_gamestate(simulation->publisher, game_state);
+
+    // TODO: add gameover screen
+    if (is_game_over) {
+        simulation->replay.final_hash = hash_gamestate(game_state);
+        _save_replay(simulation);
+        if (simulation->persistence != NULL)
+            persist_game_over(simulation->persistence, game_state);
+        _new_game(simulation);
+    }
+    else if (simulation->persistence != NULL
+         &&  game_state->frame_number % PERSIST_AUTOSAVE_TICKS == 0
+    ) persist_autosave(simulation->persistence, game_state);
+
+    _hand_off_state(simulation);
+}
+
+// Sleeps to absolute deadlines rather than for a duration, so time spent in a
+// tick doesn't accumulate as drift. Late ticks run back to back to catch up.
+static void *_run_simulation(void *const arg) {
+    Simulation *const simulation = arg;
+    long const tick_ns = NANOSECONDS / simulation->tick_rate;
+
+    struct timespec deadline;
+    clock_gettime(CLOCK_MONOTONIC, &deadline);
+
+    while (atomic_load_explicit(&simulation->running, memory_order_relaxed)) {
+        // ticks missed while paused are not made up
+        if (_wait_while_paused(simulation)) clock_gettime(CLOCK_MONOTONIC, &deadline);
+        _add_nanoseconds(&deadline, tick_ns);
+
+        struct timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        if (_nanoseconds_between(&deadline, &now) > SIM_MAX_LAG_TICKS * tick_ns)
+            deadline = now;
+
+        while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &deadline, NULL))
+            ; // interrupted by a signal, go back to sleep
+
+        _tick(simulation);
+    }
+    return NULL;
+}
+
+// Exposed ////////////////////////////////////////////////////////////////////
+extern void start_simulation(Simulation *const simulation) {
+    atomic_store(&simulation->pressed, 0);
+    atomic_store(&simulation->down, 0);
+    atomic_store(&simulation->pressed_at, 0);
+    atomic_store(&simulation->down_at, 0);
+    atomic_store(&simulation->running, true);
+    if (pthread_create(&simulation->thread, NULL, _run_simulation, simulation)) {
+        fprintf(stderr, "Error: could not start the simulation thread.\n");
+        exit(1);
+    }
+}
+
+extern void stop_simulation(Simulation *const simulation) {
+    pthread_mutex_lock(&simulation->pause_lock);
+    atomic_store(&simulation->running, false);
+    pthread_cond_broadcast(&simulation->pause_changed);
+    pthread_mutex_unlock(&simulation->pause_lock);
+    pthread_join(simulation->thread, NULL);
+}
+
+extern void set_simulation_paused(
+    Simulation *const simulation,
+    bool const paused
+) {
+    pthread_mutex_lock(&simulation->pause_lock);
+    atomic_store(&simulation->paused, paused);
+    pthread_cond_broadcast(&simulation->pause_changed);
+    pthread_mutex_unlock(&simulation->pause_lock);
+}
+
+// the next tick (or straight away while paused) saves a snapshot
+extern void request_simulation_snapshot(Simulation *const simulation) {
+    pthread_mutex_lock(&simulation->pause_lock);
+    atomic_store(&simulation->snapshot_requested, true);
+    pthread_cond_broadcast(&simulation->pause_changed);
+    pthread_mutex_unlock(&simulation->pause_lock);
+}
+
+// starts a fresh game. Only call while the thread is stopped.
+extern void reset_simulation(Simulation *const simulation) {
+    _new_game(simulation);
+    init_triple_buffer(&simulation->states, &simulation->game_state);
+    simulation->drawn_key = _visible_key(&simulation->game_state);
+    atomic_fetch_add(&simulation->revision, 1);
+}
+
+// called from the window thread every render frame. Presses are collected
+// until the next tick so none get lost when the two run at different rates,
+// and keep the time of the first of them.
+extern void feed_simulation_input(
+    Simulation *const simulation,
+    GameInput const*const input
+) {
+    if (input->pressed != 0) {
+        unsigned long long unset = 0;
+        atomic_compare_exchange_strong_explicit(
+            &simulation->pressed_at, &unset, input->pressed_at,
+            memory_order_relaxed, memory_order_relaxed
+        );
+    }
+    atomic_store_explicit(&simulation->down_at, input->down_at, memory_order_relaxed);
+    atomic_fetch_or_explicit(
+        &simulation->pressed, input->pressed, memory_order_relaxed
+    );
+    atomic_store_explicit(&simulation->down, input->down, memory_order_relaxed);
+}
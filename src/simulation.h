@@ -0,0 +1,73 @@
+#ifndef SIMULATION_H
+#define SIMULATION_H
+
+#include "game.h"
+#include "metrics.h"
+#include "persist.h"
+#include "publish.h"
+#include "replay.h"
+#include "triple_buffer.h"
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+// The simulation runs `next_gamestate` on its own thread at a fixed tick and
+// hands finished states to the render thread through a triple buffer, so a
+// slow frame never delays gravity and the renderer can take as long as the
+// display needs.
+//
+// `revision` only moves when something that is drawn changes (board, piece,
+// HUD, pause), so the renderer can skip frames where it hasn't. While paused
+// the thread blocks instead of ticking.
+
+// if the thread falls this many ticks behind (e.g. after a suspend) it stops
+// trying to catch up and just carries on from now.
+#define SIM_MAX_LAG_TICKS (long) 30
+
+typedef struct {
+    // libgame functions. Only swap them while the thread is stopped.
+    init_gamestate_t init_gamestate;
+    next_gamestate_t next_gamestate;
+    publish_gamestate_t publish_gamestate;
+    PublishRing *publisher; // may be NULL
+    Metrics *metrics;       // may be NULL
+    Persistence *persistence; // may be NULL
+
+    size_t tick_rate; // ticks per second
+    size_t init_level;
+
+    GameState game_state; // only touched by the simulation thread
+    Replay replay;        // inputs of the current game so far
+    char const* replay_path; // where finished games are saved, may be NULL
+    GameState const* resume_from; // the next reset carries on from it, may be NULL
+    char const* snapshot_dir; // where requested snapshots go (see snapshot.h)
+    bool is_resumed; // the replay misses the start of the game, it isn't saved
+    TripleBuffer states;  // simulation -> render handoff
+
+    _Atomic unsigned long long revision;
+    unsigned long long drawn_key; // last visible state, simulation thread only
+
+    _Atomic bool running;
+    _Atomic bool paused;
+    _Atomic bool snapshot_requested;
+    pthread_mutex_t pause_lock; // initialise both before the first start
+    pthread_cond_t pause_changed;
+    _Atomic unsigned char pressed; // InputFlags collected since the last tick
+    _Atomic unsigned char down;
+    _Atomic unsigned long long pressed_at; // GameInput timestamps, see there
+    _Atomic unsigned long long down_at;
+    pthread_t thread;
+} Simulation;
+
+void start_simulation(Simulation *const simulation);
+void stop_simulation(Simulation *const simulation);
+void reset_simulation(Simulation *const simulation);
+void set_simulation_paused(Simulation *const simulation, bool const paused);
+void request_simulation_snapshot(Simulation *const simulation);
+void feed_simulation_input(
+    Simulation *const simulation,
+    GameInput const*const input
+);
+
+#endif // SIMULATION_H
@@ -0,0 +1,280 @@
+#include "snapshot.h"
+#include "game.h"
+#include <stdbool.h>
+#include <limits.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#define SNAPSHOT_HEADER_SIZE (size_t) 12
+
+// where each field lives in a GameState
+typedef struct {
+    char const* name;
+    size_t offset;
+    SnapshotKind kind;
+    size_t count;
+} SnapshotLayout;
+
+#define FIELD(member, kind) \
+    { #member, offsetof(GameState, member), kind, 1 }
+#define ARRAY(member, kind, count) \
+    { #member, offsetof(GameState, member), kind, count }
+
+static SnapshotLayout const layout[] = {
+    FIELD(display_mode,                   SNAPSHOT_MODE),
+    FIELD(current_tetromino.x,            SNAPSHOT_SIZE),
+    FIELD(current_tetromino.y,            SNAPSHOT_SIZE),
+    FIELD(current_tetromino.rotation,     SNAPSHOT_UCHAR),
+    FIELD(current_tetromino.type,         SNAPSHOT_PIECE),
+    ARRAY(current_tetromino.positions,    SNAPSHOT_SIZE, NUM_TETROMINO_BLOCKS * NUM_AXIS),
+    FIELD(current_tetromino.hash,         SNAPSHOT_ULL),
+    FIELD(next_tetromino,                 SNAPSHOT_PIECE),
+    ARRAY(board,                          SNAPSHOT_PIECE, ROWS * COLS),
+    FIELD(board_hash,                     SNAPSHOT_ULL),
+    FIELD(level,                          SNAPSHOT_SIZE),
+    FIELD(score,                          SNAPSHOT_SIZE),
+    FIELD(line_num,                       SNAPSHOT_SIZE),
+    FIELD(lines,                          SNAPSHOT_SIZE),
+    FIELD(total_lines,                    SNAPSHOT_SIZE),
+    FIELD(frame_number,                   SNAPSHOT_ULL),
+    FIELD(pieces_placed,                  SNAPSHOT_ULL),
+    FIELD(gravity,                        SNAPSHOT_SIZE),
+    FIELD(gravity_accumulator,            SNAPSHOT_SIZE),
+    FIELD(seed,                           SNAPSHOT_ULL),
+    FIELD(random_state,                   SNAPSHOT_ULL),
+    FIELD(deposite_on_next_frame,         SNAPSHOT_BOOL),
+    FIELD(delayed_autoshift_pressed_down, SNAPSHOT_BOOL),
+    FIELD(is_paused,                      SNAPSHOT_BOOL),
+    FIELD(outgoing_garbage,               SNAPSHOT_SIZE),
+    FIELD(pending_garbage,                SNAPSHOT_SIZE),
+    FIELD(delayed_autoshift_frames,       SNAPSHOT_SIZE),
+    FIELD(last_placed.x,                  SNAPSHOT_SIZE),
+    FIELD(last_placed.y,                  SNAPSHOT_SIZE),
+    FIELD(last_placed.rotation,           SNAPSHOT_UCHAR),
+    FIELD(last_placed.type,               SNAPSHOT_PIECE),
+    ARRAY(last_placed.positions,          SNAPSHOT_SIZE, NUM_TETROMINO_BLOCKS * NUM_AXIS),
+    FIELD(last_placed.hash,               SNAPSHOT_ULL),
+    FIELD(num_cleared_rows,               SNAPSHOT_SIZE),
+    ARRAY(cleared_rows,                   SNAPSHOT_SIZE, MAX_COMPLETED_ROWS),
+    ARRAY(cleared_cells,                  SNAPSHOT_PIECE, MAX_COMPLETED_ROWS * COLS),
+    ARRAY(move_frame,                     SNAPSHOT_ULL, NUM_LATENCY_INPUTS),
+    ARRAY(move_input_ns,                  SNAPSHOT_ULL, NUM_LATENCY_INPUTS),
+};
+static size_t const num_layout_fields = sizeof(layout) / sizeof(layout[0]);
+
+// Little endian helpers //////////////////////////////////////////////////////
+static inline void _put_u32(unsigned char *const bytes, uint32_t const value) {
+    for (size_t i = 0; i < 4; ++i) bytes[i] = value >> (8 * i);
+}
+
+static inline void _put_u64(unsigned char *const bytes, uint64_t const value) {
+    for (size_t i = 0; i < 8; ++i) bytes[i] = value >> (8 * i);
+}
+
+static inline uint32_t _get_u32(unsigned char const*const bytes) {
+    uint32_t value = 0;
+    for (size_t i = 0; i < 4; ++i) value |= (uint32_t)bytes[i] << (8 * i);
+    return value;
+}
+
+static inline uint64_t _get_u64(unsigned char const*const bytes) {
+    uint64_t value = 0;
+    for (size_t i = 0; i < 8; ++i) value |= (uint64_t)bytes[i] << (8 * i);
+    return value;
+}
+
+// Values /////////////////////////////////////////////////////////////////////
+static inline size_t _value_size(SnapshotKind const kind) {
+    switch (kind) {
+        case SNAPSHOT_SIZE:  return sizeof(size_t);
+        case SNAPSHOT_ULL:   return sizeof(unsigned long long);
+        case SNAPSHOT_BOOL:  return sizeof(bool);
+        case SNAPSHOT_UCHAR: return sizeof(unsigned char);
+        case SNAPSHOT_PIECE: return sizeof(TetrominoType);
+        case SNAPSHOT_MODE:  return sizeof(DisplayMode);
+    }
+    return 0;
+}
+
+static uint64_t _get_value(void const*const at, SnapshotKind const kind) {
+    switch (kind) {
+        case SNAPSHOT_SIZE:  return *(size_t const*)at;
+        case SNAPSHOT_ULL:   return *(unsigned long long const*)at;
+        case SNAPSHOT_BOOL:  return *(bool const*)at;
+        case SNAPSHOT_UCHAR: return *(unsigned char const*)at;
+        case SNAPSHOT_PIECE: return *(TetrominoType const*)at;
+        case SNAPSHOT_MODE:  return *(DisplayMode const*)at;
+    }
+    return 0;
+}
+
+static void _set_value(void *const at, SnapshotKind const kind, uint64_t const value) {
+    switch (kind) {
+        case SNAPSHOT_SIZE:  *(size_t*)at = value; break;
+        case SNAPSHOT_ULL:   *(unsigned long long*)at = value; break;
+        case SNAPSHOT_BOOL:  *(bool*)at = value != 0; break;
+        case SNAPSHOT_UCHAR: *(unsigned char*)at = value; break;
+        case SNAPSHOT_PIECE: *(TetrominoType*)at = value; break;
+        case SNAPSHOT_MODE:  *(DisplayMode*)at = value; break;
+    }
+}
+
+// values a field of that kind can hold, whatever the file says
+static inline bool _is_valid_value(SnapshotKind const kind, uint64_t const value) {
+    switch (kind) {
+        case SNAPSHOT_SIZE:  return value <= SIZE_MAX;
+        case SNAPSHOT_ULL:   return true;
+        case SNAPSHOT_BOOL:  return value <= 1;
+        case SNAPSHOT_UCHAR: return value <= UCHAR_MAX;
+        case SNAPSHOT_PIECE: return value <= NO_TETROMINO;
+        case SNAPSHOT_MODE:  return value <= WIREFRAME_DISPLAY_MODE;
+    }
+    return false;
+}
+
+// a real piece with its blocks inside the board. Block offsets and x wrap
+// below 0 after some rotations, the sums land on the board as in game.c.
+static bool _is_valid_tetromino(Tetromino const*const tetromino) {
+    if (tetromino->type >= NO_TETROMINO || tetromino->rotation >= MAX_NUM_ROTATIONS)
+        return false;
+    for (size_t i = 0; i < NUM_TETROMINO_BLOCKS; ++i) {
+        if (tetromino->positions[i][X_AXIS] + tetromino->x >= COLS
+        ||  tetromino->positions[i][Y_AXIS] + tetromino->y >= ROWS
+        ) return false;
+    }
+    return true;
+}
+
+// the fields the simulation indexes with or loops on are in range, the rest
+// (scores, counts, hashes) can't do worse than look odd
+static bool _is_valid_gamestate(GameState const*const game_state) {
+    if (!_is_valid_tetromino(&game_state->current_tetromino)
+    ||  !_is_valid_tetromino(&game_state->last_placed)
+    ||  game_state->next_tetromino >= NO_TETROMINO
+    ||  game_state->num_cleared_rows > MAX_COMPLETED_ROWS
+    ||  game_state->gravity > MAX_GRAVITY
+    ||  game_state->gravity_accumulator >= GRAVITY_ONE
+    ) return false;
+    for (size_t i = 0; i < game_state->num_cleared_rows; ++i)
+        if (game_state->cleared_rows[i] >= ROWS) return false;
+    return true;
+}
+
+static bool _read_field(FILE *const file, Snapshot *const snapshot, SnapshotField *const field) {
+    unsigned char bytes[8];
+    int const name_length = fgetc(file);
+    if (name_length == EOF
+    ||  (size_t)name_length >= SNAPSHOT_NAME_SIZE
+    ||  fread(field->name, 1, name_length, file) != (size_t)name_length
+    ||  fread(bytes, 1, 5, file) != 5
+    ||  bytes[0] > SNAPSHOT_MODE
+    ) return false;
+
+    field->name[name_length] = '\0';
+    field->kind = bytes[0];
+    field->count = _get_u32(bytes + 1);
+    field->first_value = snapshot->num_values;
+    if (field->count > SNAPSHOT_MAX_VALUES - snapshot->num_values) return false;
+
+    for (size_t i = 0; i < field->count; ++i) {
+        if (fread(bytes, 1, 8, file) != 8) return false;
+        snapshot->values[snapshot->num_values++] = _get_u64(bytes);
+    }
+    return true;
+}
+
+// Exposed ////////////////////////////////////////////////////////////////////
+
+// built in memory and written in one go, it is only a few KB
+extern bool write_snapshot(GameState const*const game_state, char const*const path) {
+    unsigned char buffer[SNAPSHOT_HEADER_SIZE + SNAPSHOT_MAX_FIELDS * (SNAPSHOT_NAME_SIZE + 6) + SNAPSHOT_MAX_VALUES * 8];
+    unsigned char *out = buffer;
+    memcpy(out, SNAPSHOT_MAGIC, 4);
+    _put_u32(out + 4, SNAPSHOT_VERSION);
+    _put_u32(out + 8, num_layout_fields);
+    out += SNAPSHOT_HEADER_SIZE;
+
+    for (size_t i = 0; i < num_layout_fields; ++i) {
+        SnapshotLayout const*const field = &layout[i];
+        size_t const name_length = strlen(field->name);
+        *out++ = name_length;
+        memcpy(out, field->name, name_length);
+        out += name_length;
+        *out++ = field->kind;
+        _put_u32(out, field->count);
+        out += 4;
+
+        unsigned char const*const at = (unsigned char const*)game_state + field->offset;
+        for (size_t j = 0; j < field->count; ++j) {
+            _put_u64(out, _get_value(at + j * _value_size(field->kind), field->kind));
+            out += 8;
+        }
+    }
+
+    FILE *const file = fopen(path, "wb");
+    if (file == NULL) return false;
+    bool const ok = fwrite(buffer, 1, out - buffer, file) == (size_t)(out - buffer);
+    return fclose(file) == 0 && ok;
+}
+
+extern bool read_snapshot(Snapshot *const snapshot, char const*const path) {
+    FILE *const file = fopen(path, "rb");
+    if (file == NULL) return false;
+
+    unsigned char header[SNAPSHOT_HEADER_SIZE];
+    if (fread(header, 1, sizeof(header), file) != sizeof(header)
+    ||  memcmp(header, SNAPSHOT_MAGIC, 4) != 0
+    ||  _get_u32(header + 4) != SNAPSHOT_VERSION
+    ||  _get_u32(header + 8) > SNAPSHOT_MAX_FIELDS
+    ) {
+        fclose(file);
+        return false;
+    }
+
+    snapshot->num_fields = _get_u32(header + 8);
+    snapshot->num_values = 0;
+    bool ok = true;
+    for (size_t i = 0; ok && i < snapshot->num_fields; ++i)
+        ok = _read_field(file, snapshot, &snapshot->fields[i]);
+    fclose(file);
+    return ok;
+}
+
+extern SnapshotField const* find_snapshot_field(
+    Snapshot const*const snapshot,
+    char const*const name
+) {
+    for (size_t i = 0; i < snapshot->num_fields; ++i) {
+        if (strcmp(snapshot->fields[i].name, name) == 0) return &snapshot->fields[i];
+    }
+    return NULL;
+}
+
+extern bool load_snapshot(
+    GameState *const game_state,
+    Snapshot const*const snapshot,
+    init_gamestate_t const init_gamestate,
+    size_t *const missing
+) {
+    SnapshotField const*const level = find_snapshot_field(snapshot, "level");
+    *game_state = init_gamestate(level != NULL? snapshot->values[level->first_value] : 0);
+
+    *missing = 0;
+    for (size_t i = 0; i < num_layout_fields; ++i) {
+        SnapshotLayout const*const to = &layout[i];
+        SnapshotField const*const from = find_snapshot_field(snapshot, to->name);
+        if (from == NULL || from->count != to->count) {
+            (*missing)++;
+            continue;
+        }
+        unsigned char *const at = (unsigned char*)game_state + to->offset;
+        for (size_t j = 0; j < to->count; ++j) {
+            uint64_t const value = snapshot->values[from->first_value + j];
+            if (!_is_valid_value(to->kind, value)) return false;
+            _set_value(at + j * _value_size(to->kind), to->kind, value);
+        }
+    }
+    return _is_valid_gamestate(game_state);
+}
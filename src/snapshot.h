@@ -0,0 +1,78 @@
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include "game.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// A GameState written out field by field, for looking at a cabinet's state
+// later without printing anything while it runs (see ./snapshot).
+//
+// Fields are stored by name, so a build with fields added or removed can
+// still read an older snapshot: unknown names are kept for printing and
+// diffing, and loading one back into a game starts from `init_gamestate` at
+// its level and overwrites whatever fields the snapshot has.
+//
+// File layout (little endian):
+//     "TSNP" | u32 version | u32 num_fields
+//     per field: u8 name_length | name | u8 SnapshotKind | u32 count
+//                count * u64 value
+
+// Constants //////////////////////////////////////////////////////////////////
+#define SNAPSHOT_MAGIC       "TSNP"
+#define SNAPSHOT_VERSION     (uint32_t) 1
+#define SNAPSHOT_NAME_SIZE   (size_t) 48
+#define SNAPSHOT_MAX_FIELDS  (size_t) 64
+#define SNAPSHOT_MAX_VALUES  (size_t) 1024
+#define SNAPSHOT_PATH_SIZE   (size_t) 256
+#define SNAPSHOT_PATH_FORMAT "%s/snapshot-%llu.tsnap" // directory, frame
+
+// how a value is stored in GameState, and how it is shown
+typedef enum {
+    SNAPSHOT_SIZE,  // size_t
+    SNAPSHOT_ULL,   // unsigned long long
+    SNAPSHOT_BOOL,
+    SNAPSHOT_UCHAR,
+    SNAPSHOT_PIECE, // TetrominoType
+    SNAPSHOT_MODE,  // DisplayMode
+} SnapshotKind;
+
+// Structs ////////////////////////////////////////////////////////////////////
+typedef struct {
+    char name[SNAPSHOT_NAME_SIZE];
+    SnapshotKind kind;
+    size_t count;
+    size_t first_value; // into Snapshot.values
+} SnapshotField;
+
+typedef struct {
+    size_t num_fields;
+    SnapshotField fields[SNAPSHOT_MAX_FIELDS];
+    size_t num_values;
+    uint64_t values[SNAPSHOT_MAX_VALUES];
+} Snapshot;
+
+// Functions //////////////////////////////////////////////////////////////////
+bool write_snapshot(GameState const*const game_state, char const*const path);
+bool read_snapshot(Snapshot *const snapshot, char const*const path);
+
+// the field of that name, NULL if the snapshot doesn't have it
+SnapshotField const* find_snapshot_field(
+    Snapshot const*const snapshot,
+    char const*const name
+);
+
+// a game as it was when the snapshot was taken, with how many of this
+// build's fields the snapshot didn't have in `missing` (those keep their
+// initial value). Returns false if any value it has is out of range for its
+// field: a piece type, a board cell, a rotation, a position off the board,
+// a display mode and so on. `game_state` is then unusable.
+bool load_snapshot(
+    GameState *const game_state,
+    Snapshot const*const snapshot,
+    init_gamestate_t const init_gamestate,
+    size_t *const missing
+);
+
+#endif // SNAPSHOT_H
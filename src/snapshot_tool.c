@@ -0,0 +1,146 @@
+#include "game.h"
+#include "snapshot.h"
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+// GameState snapshot inspector (see snapshot.h), KEY_P in the game writes
+// them. Output is one `name = value` line per field so it diffs as text too.
+// usage: ./snapshot print snapshot.tsnap
+//        ./snapshot diff before.tsnap after.tsnap
+//        ./snapshot load snapshot.tsnap    runs ./tetris from it
+
+#define GAME_PATH "./tetris"
+
+// Formatting /////////////////////////////////////////////////////////////////
+static void _print_value(
+    FILE *const out,
+    SnapshotField const*const field,
+    uint64_t const value
+) {
+    static char const piece_chars[NUM_TETROMINO_TYPES + 1] = "LJTOIZS-";
+    switch (field->kind) {
+        case SNAPSHOT_SIZE:
+        case SNAPSHOT_ULL:
+            // hashes read better as bits
+            if (strstr(field->name, "hash") != NULL)
+                fprintf(out, "0x%016llx", (unsigned long long)value);
+            else fprintf(out, "%llu", (unsigned long long)value);
+            break;
+        case SNAPSHOT_BOOL:
+            fprintf(out, "%s", value? "true" : "false");
+            break;
+        case SNAPSHOT_UCHAR:
+            fprintf(out, "%llu", (unsigned long long)value);
+            break;
+        case SNAPSHOT_PIECE:
+            fprintf(out, "%c", value <= NO_TETROMINO? piece_chars[value] : '?');
+            break;
+        case SNAPSHOT_MODE:
+            fprintf(out, "%s",
+                value == DEFAULT_DISPLAY_MODE? "default"
+              : value == WIREFRAME_DISPLAY_MODE? "wireframe"
+              : "?"
+            );
+            break;
+    }
+}
+
+// boards print a row per line, other arrays on one line
+static void _print_field(Snapshot const*const snapshot, SnapshotField const*const field) {
+    uint64_t const*const values = &snapshot->values[field->first_value];
+    printf("%s =", field->name);
+    bool const is_grid = field->kind == SNAPSHOT_PIECE && field->count % COLS == 0 && field->count > 1;
+    for (size_t i = 0; i < field->count; ++i) {
+        if (is_grid && i % COLS == 0) printf("\n\t");
+        else printf(" ");
+        _print_value(stdout, field, values[i]);
+    }
+    printf("\n");
+}
+
+// Commands ///////////////////////////////////////////////////////////////////
+static int _print(Snapshot const*const snapshot) {
+    for (size_t i = 0; i < snapshot->num_fields; ++i)
+        _print_field(snapshot, &snapshot->fields[i]);
+    return EXIT_SUCCESS;
+}
+
+// every field that isn't the same in both, element by element for arrays.
+// Exits 1 if there were any, like diff.
+static int _diff(Snapshot const*const before, Snapshot const*const after) {
+    size_t num_differences = 0;
+    for (size_t i = 0; i < before->num_fields; ++i) {
+        SnapshotField const*const from = &before->fields[i];
+        SnapshotField const*const to = find_snapshot_field(after, from->name);
+        if (to == NULL || to->count != from->count || to->kind != from->kind) {
+            printf("%s: only in the first\n", from->name);
+            num_differences++;
+            continue;
+        }
+
+        for (size_t j = 0; j < from->count; ++j) {
+            uint64_t const a = before->values[from->first_value + j];
+            uint64_t const b = after->values[to->first_value + j];
+            if (a == b) continue;
+
+            printf("%s", from->name);
+            if (from->count > 1 && from->kind == SNAPSHOT_PIECE && from->count % COLS == 0)
+                printf("[%zu][%zu]", j / COLS, j % COLS);
+            else if (from->count > 1) printf("[%zu]", j);
+            printf(": ");
+            _print_value(stdout, from, a);
+            printf(" -> ");
+            _print_value(stdout, from, b);
+            printf("\n");
+            num_differences++;
+        }
+    }
+    for (size_t i = 0; i < after->num_fields; ++i) {
+        SnapshotField const*const to = &after->fields[i];
+        SnapshotField const*const from = find_snapshot_field(before, to->name);
+        if (from != NULL && from->count == to->count && from->kind == to->kind) continue;
+        printf("%s: only in the second\n", to->name);
+        num_differences++;
+    }
+    return num_differences == 0? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+static bool _read(Snapshot *const snapshot, char const*const path) {
+    if (read_snapshot(snapshot, path)) return true;
+    fprintf(stderr, "Error: %s is not a readable snapshot.\n", path);
+    return false;
+}
+
+int main(int argc, char **argv) {
+    if (argc < 3) {
+        fprintf(stderr,
+            "usage: %s print snapshot.tsnap\n"
+            "       %s diff before.tsnap after.tsnap\n"
+            "       %s load snapshot.tsnap\n",
+            argv[0], argv[0], argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    static Snapshot snapshot;
+    static Snapshot other;
+    if (!_read(&snapshot, argv[2])) return EXIT_FAILURE;
+
+    if (strcmp(argv[1], "print") == 0) return _print(&snapshot);
+    if (strcmp(argv[1], "diff") == 0 && argc >= 4) {
+        if (!_read(&other, argv[3])) return EXIT_FAILURE;
+        return _diff(&snapshot, &other);
+    }
+    if (strcmp(argv[1], "load") == 0) {
+        // the game reads it through load_snapshot, from init_gamestate at
+        // the snapshot's level
+        execl(GAME_PATH, GAME_PATH, argv[2], (char*)NULL);
+        fprintf(stderr, "Error: could not run %s.\n", GAME_PATH);
+        return EXIT_FAILURE;
+    }
+    fprintf(stderr, "Error: unknown command %s.\n", argv[1]);
+    return EXIT_FAILURE;
+}
@@ -0,0 +1,376 @@
+#include "soft.h"
+#include "game.h"
+#include <math.h>
+#include <raylib.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// per thread, so separate threads can render separate frames
+static _Thread_local SoftFramebuffer *_target;
+
+// Font ///////////////////////////////////////////////////////////////////////
+// A 5x7 bitmap of just the characters the display prints: the digits and
+// the letters of PAUSED. Anything else is drawn as a blank. Each row is 5
+// bits, most significant bit on the left.
+#define GLYPH_WIDTH      (size_t) 5
+#define GLYPH_HEIGHT     (size_t) 7
+#define FONT_BASE_SIZE   (int) 10 // same as raylib's default font
+
+static unsigned char const _glyphs[128][GLYPH_HEIGHT] = {
+    ['0'] = {0x0E, 0x11, 0x13, 0x15, 0x19, 0x11, 0x0E},
+    ['1'] = {0x04, 0x0C, 0x04, 0x04, 0x04, 0x04, 0x0E},
+    ['2'] = {0x0E, 0x11, 0x01, 0x02, 0x04, 0x08, 0x1F},
+    ['3'] = {0x1F, 0x02, 0x04, 0x02, 0x01, 0x11, 0x0E},
+    ['4'] = {0x02, 0x06, 0x0A, 0x12, 0x1F, 0x02, 0x02},
+    ['5'] = {0x1F, 0x10, 0x1E, 0x01, 0x01, 0x11, 0x0E},
+    ['6'] = {0x06, 0x08, 0x10, 0x1E, 0x11, 0x11, 0x0E},
+    ['7'] = {0x1F, 0x01, 0x02, 0x04, 0x08, 0x08, 0x08},
+    ['8'] = {0x0E, 0x11, 0x11, 0x0E, 0x11, 0x11, 0x0E},
+    ['9'] = {0x0E, 0x11, 0x11, 0x0F, 0x01, 0x02, 0x0C},
+    ['A'] = {0x0E, 0x11, 0x11, 0x1F, 0x11, 0x11, 0x11},
+    ['D'] = {0x1C, 0x12, 0x11, 0x11, 0x11, 0x12, 0x1C},
+    ['E'] = {0x1F, 0x10, 0x10, 0x1E, 0x10, 0x10, 0x1F},
+    ['P'] = {0x1E, 0x11, 0x11, 0x1E, 0x10, 0x10, 0x10},
+    ['S'] = {0x0F, 0x10, 0x10, 0x0E, 0x01, 0x01, 0x1E},
+    ['U'] = {0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x0E}
+};
+
+// Spans //////////////////////////////////////////////////////////////////////
+
+// fills `count` pixels by writing one and then doubling the filled region
+// with memcpy, which turns into wide stores for long spans.
+static inline void _fill_span_opaque(
+    Color *const span,
+    size_t const count,
+    Color const color
+) {
+    if (count == 0) return;
+    span[0] = color;
+    size_t filled = 1;
+    while (filled < count) {
+        size_t const chunk = filled < count - filled? filled : count - filled;
+        memcpy(span + filled, span, chunk * sizeof(Color));
+        filled += chunk;
+    }
+}
+
+static inline void _fill_span_blended(
+    Color *const span,
+    size_t const count,
+    Color const color
+) {
+    unsigned const alpha = color.a;
+    unsigned const inverse = 255 - alpha;
+    for (size_t i = 0; i < count; ++i) {
+        span[i].r = (color.r * alpha + span[i].r * inverse) / 255;
+        span[i].g = (color.g * alpha + span[i].g * inverse) / 255;
+        span[i].b = (color.b * alpha + span[i].b * inverse) / 255;
+        span[i].a = alpha + span[i].a * inverse / 255;
+    }
+}
+
+// fills pixels [x_start, x_end) of row y, clipped to the framebuffer
+static inline void _fill_span(
+    long const y,
+    long x_start,
+    long x_end,
+    Color const color
+) {
+    if (y < 0 || y >= (long)_target->height || color.a == 0) return;
+    if (x_start < 0) x_start = 0;
+    if (x_end > (long)_target->width) x_end = _target->width;
+    if (x_start >= x_end) return;
+
+    Color *const span = _target->pixels + y * _target->width + x_start;
+    if (color.a == 255) _fill_span_opaque(span, x_end - x_start, color);
+    else _fill_span_blended(span, x_end - x_start, color);
+}
+
+// fills every pixel whose centre lies inside [left, right) x [top, bottom)
+static inline void _fill_area(
+    float const left,
+    float const top,
+    float const right,
+    float const bottom,
+    Color const color
+) {
+    long const x_start = ceilf(left - 0.5f);
+    long const x_end   = ceilf(right - 0.5f);
+    long const y_start = ceilf(top - 0.5f);
+    long const y_end   = ceilf(bottom - 0.5f);
+    for (long y = y_start; y < y_end; ++y) _fill_span(y, x_start, x_end, color);
+}
+
+// scanline fill of a convex quad given in drawing order
+static void _fill_quad(Vector2 const quad[4], Color const color) {
+    float top = quad[0].y, bottom = quad[0].y;
+    for (size_t i = 1; i < 4; ++i) {
+        if (quad[i].y < top)    top = quad[i].y;
+        if (quad[i].y > bottom) bottom = quad[i].y;
+    }
+
+    long const y_start = ceilf(top - 0.5f);
+    long const y_end   = ceilf(bottom - 0.5f);
+    for (long y = y_start; y < y_end; ++y) {
+        float const centre_y = y + 0.5f;
+        float left = INFINITY, right = -INFINITY;
+        for (size_t i = 0; i < 4; ++i) {
+            Vector2 const a = quad[i];
+            Vector2 const b = quad[(i + 1) % 4];
+            if ((a.y <= centre_y) == (b.y <= centre_y)) continue;
+            float const x = a.x + (centre_y - a.y) * (b.x - a.x) / (b.y - a.y);
+            if (x < left)  left = x;
+            if (x > right) right = x;
+        }
+        if (left < right)
+            _fill_span(y, ceilf(left - 0.5f), ceilf(right - 0.5f), color);
+    }
+}
+
+// Primitives /////////////////////////////////////////////////////////////////
+static int _soft_screen_width(void) {
+    return _target->width;
+}
+
+static int _soft_screen_height(void) {
+    return _target->height;
+}
+
+static void _soft_begin_frame(Color const background_color) {
+    _fill_span_opaque(
+        _target->pixels,
+        _target->width * _target->height,
+        (Color){background_color.r, background_color.g, background_color.b, 255}
+    );
+}
+
+static void _soft_end_frame(void) {}
+
+// the framebuffer still holds the last frame, as long as nothing else drew
+// into it (one CommandBuffer per framebuffer)
+static void _soft_keep_frame(void) {}
+
+static void _soft_rectangle(
+    int const x,
+    int const y,
+    int const width,
+    int const height,
+    Color const color
+) {
+    for (long row = y; row < (long)y + height; ++row)
+        _fill_span(row, x, (long)x + width, color);
+}
+
+// one pixel wide Bresenham line, horizontal lines go straight to a span
+static void _soft_line(
+    int const start_x,
+    int const start_y,
+    int const end_x,
+    int const end_y,
+    Color const color
+) {
+    if (start_y == end_y) {
+        long const left  = start_x < end_x? start_x : end_x;
+        long const right = start_x < end_x? end_x : start_x;
+        _fill_span(start_y, left, right + 1, color);
+        return;
+    }
+
+    long x = start_x, y = start_y;
+    long const dx = labs((long)end_x - start_x);
+    long const dy = -labs((long)end_y - start_y);
+    long const step_x = start_x < end_x? 1 : -1;
+    long const step_y = start_y < end_y? 1 : -1;
+    long error = dx + dy;
+    for (;;) {
+        _fill_span(y, x, x + 1, color);
+        if (x == end_x && y == end_y) break;
+        long const double_error = 2 * error;
+        if (double_error >= dy) { error += dy; x += step_x; }
+        if (double_error <= dx) { error += dx; y += step_y; }
+    }
+}
+
+// a thick line is a rectangle along the line, axis aligned ones (all the
+// display code draws) skip the general quad fill.
+static void _soft_line_ex(
+    Vector2 const start,
+    Vector2 const end,
+    float const thickness,
+    Color const color
+) {
+    float const dx = end.x - start.x;
+    float const dy = end.y - start.y;
+    float const half = thickness / 2;
+
+    if (dy == 0) {
+        _fill_area(fminf(start.x, end.x), start.y - half,
+                   fmaxf(start.x, end.x), start.y + half, color);
+        return;
+    }
+    if (dx == 0) {
+        _fill_area(start.x - half, fminf(start.y, end.y),
+                   start.x + half, fmaxf(start.y, end.y), color);
+        return;
+    }
+
+    float const length = sqrtf(dx * dx + dy * dy);
+    float const normal_x = -dy / length * half;
+    float const normal_y =  dx / length * half;
+    Vector2 const quad[4] = {
+        {start.x + normal_x, start.y + normal_y},
+        {end.x   + normal_x, end.y   + normal_y},
+        {end.x   - normal_x, end.y   - normal_y},
+        {start.x - normal_x, start.y - normal_y}
+    };
+    _fill_quad(quad, color);
+}
+
+static void _soft_text(
+    char const* text,
+    int const x,
+    int const y,
+    int const font_size,
+    Color const color
+) {
+    int const scale = font_size < FONT_BASE_SIZE? 1 : font_size / FONT_BASE_SIZE;
+    int const advance = (GLYPH_WIDTH + 1) * scale;
+
+    for (int pen_x = x; *text != '\0'; ++text, pen_x += advance) {
+        unsigned char const character = *text;
+        if (character >= 128) continue;
+        unsigned char const*const glyph = _glyphs[character];
+        for (size_t row = 0; row < GLYPH_HEIGHT; ++row) {
+            for (size_t col = 0; col < GLYPH_WIDTH; ++col) {
+                if (!(glyph[row] & (0x10 >> col))) continue;
+                _soft_rectangle(
+                    pen_x + col * scale,
+                    y + row * scale,
+                    scale,
+                    scale,
+                    color
+                );
+            }
+        }
+    }
+}
+
+static DrawPrimitives const _soft_draw_primitives = {
+    .screen_width  = &_soft_screen_width,
+    .screen_height = &_soft_screen_height,
+    .begin_frame   = &_soft_begin_frame,
+    .end_frame     = &_soft_end_frame,
+    .rectangle     = &_soft_rectangle,
+    .line          = &_soft_line,
+    .line_ex       = &_soft_line_ex,
+    .text          = &_soft_text,
+    .keep_frame    = &_soft_keep_frame
+};
+
+// Soft Exposed ///////////////////////////////////////////////////////////////
+extern SoftFramebuffer create_soft_framebuffer(
+    size_t const width,
+    size_t const height
+) {
+    SoftFramebuffer framebuffer = {
+        .width  = width,
+        .height = height,
+        .pixels = calloc(width * height, sizeof(Color))
+    };
+    if (framebuffer.pixels == NULL) {
+        fprintf(stderr, "Error: could not allocate a %zux%zu framebuffer.\n",
+            width, height);
+        exit(1);
+    }
+    return framebuffer;
+}
+
+extern void free_soft_framebuffer(SoftFramebuffer *const framebuffer) {
+    free(framebuffer->pixels);
+    framebuffer->pixels = NULL;
+}
+
+extern void bind_soft_framebuffer(SoftFramebuffer *const framebuffer) {
+    _target = framebuffer;
+}
+
+extern DisplayConfig init_soft_display_config(DisplayMode const display_mode) {
+    DisplayConfig display_config = init_display_config(display_mode);
+    display_config.primitives = &_soft_draw_primitives;
+    return display_config;
+}
+
+extern bool write_soft_framebuffer_ppm(
+    SoftFramebuffer const*const framebuffer,
+    char const*const path
+) {
+    FILE *const file = fopen(path, "wb");
+    if (file == NULL) return false;
+
+    fprintf(file, "P6\n%zu %zu\n255\n", framebuffer->width, framebuffer->height);
+    size_t const num_pixels = framebuffer->width * framebuffer->height;
+    for (size_t i = 0; i < num_pixels; ++i) {
+        Color const pixel = framebuffer->pixels[i];
+        unsigned char const rgb[3] = {pixel.r, pixel.g, pixel.b};
+        fwrite(rgb, 1, sizeof(rgb), file);
+    }
+    return fclose(file) == 0;
+}
+
+// allocates `framebuffer` to match the image, free it with
+// `free_soft_framebuffer`.
+extern bool read_soft_framebuffer_ppm(
+    SoftFramebuffer *const framebuffer,
+    char const*const path
+) {
+    FILE *const file = fopen(path, "rb");
+    if (file == NULL) return false;
+
+    size_t width, height;
+    unsigned max_value;
+    if (fscanf(file, "P6 %zu %zu %u", &width, &height, &max_value) != 3
+    ||  max_value != 255
+    ||  fgetc(file) == EOF
+    ) {
+        fclose(file);
+        return false;
+    }
+
+    *framebuffer = create_soft_framebuffer(width, height);
+    size_t const num_pixels = width * height;
+    for (size_t i = 0; i < num_pixels; ++i) {
+        unsigned char rgb[3];
+        if (fread(rgb, 1, sizeof(rgb), file) != sizeof(rgb)) {
+            free_soft_framebuffer(framebuffer);
+            fclose(file);
+            return false;
+        }
+        framebuffer->pixels[i] = (Color){rgb[0], rgb[1], rgb[2], 255};
+    }
+    fclose(file);
+    return true;
+}
+
+extern size_t compare_soft_framebuffers(
+    SoftFramebuffer const*const a,
+    SoftFramebuffer const*const b,
+    unsigned char const tolerance
+) {
+    if (a->width != b->width || a->height != b->height) return SIZE_MAX;
+
+    size_t differences = 0;
+    size_t const num_pixels = a->width * a->height;
+    for (size_t i = 0; i < num_pixels; ++i) {
+        Color const pa = a->pixels[i];
+        Color const pb = b->pixels[i];
+        if (abs(pa.r - pb.r) > tolerance
+        ||  abs(pa.g - pb.g) > tolerance
+        ||  abs(pa.b - pb.b) > tolerance
+        ) differences++;
+    }
+    return differences;
+}
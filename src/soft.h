@@ -0,0 +1,48 @@
+#ifndef SOFT_H
+#define SOFT_H
+
+#include "game.h"
+#include <raylib.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+// Software rasterizer. Renders the regular display code (display.c) into an
+// RGBA framebuffer in memory instead of going through raylib and OpenGL, so
+// rendering can be checked and timed on machines without a GPU or display.
+
+typedef struct {
+    size_t width;
+    size_t height;
+    Color *pixels; // width * height, row major
+} SoftFramebuffer;
+
+SoftFramebuffer create_soft_framebuffer(size_t const width, size_t const height);
+void free_soft_framebuffer(SoftFramebuffer *const framebuffer);
+
+// every soft draw call on this thread goes into `framebuffer`
+void bind_soft_framebuffer(SoftFramebuffer *const framebuffer);
+
+// same as `init_display_config` but drawing through the software rasterizer.
+// Use with `display_game` after binding a framebuffer. A CommandBuffer in the
+// config skips frames that haven't changed, so give each framebuffer its own.
+DisplayConfig init_soft_display_config(DisplayMode const display_mode);
+
+// golden images are binary PPMs (alpha is dropped)
+bool write_soft_framebuffer_ppm(
+    SoftFramebuffer const*const framebuffer,
+    char const*const path
+);
+bool read_soft_framebuffer_ppm(
+    SoftFramebuffer *const framebuffer,
+    char const*const path
+);
+
+// number of pixels whose channels differ by more than `tolerance`, or
+// SIZE_MAX if the framebuffers are different sizes.
+size_t compare_soft_framebuffers(
+    SoftFramebuffer const*const a,
+    SoftFramebuffer const*const b,
+    unsigned char const tolerance
+);
+
+#endif // SOFT_H
@@ -0,0 +1,74 @@
+#include "game.h"
+#include "config.h"
+#include "load.h"
+#include "counters.h"
+#include "debug.h"
+#include <stdlib.h>
+#include <stdio.h>
+#include <raylib.h>
+#include <dlfcn.h>
+
+// Spectator wall: runs many games side by side and shows them all in one
+// window with `display_wall`.
+// usage: ./spectator [number of boards]
+
+int main(int argc, char **argv) {
+    size_t num_boards = SPECTATOR_BOARDS;
+    if (argc > 1) num_boards = strtoul(argv[1], NULL, 10);
+    if (num_boards == 0 || num_boards > MAX_WALL_BOARDS) {
+        fprintf(stderr, "Error: number of boards must be 1-%zu.\n", MAX_WALL_BOARDS);
+        return EXIT_FAILURE;
+    }
+
+    void *libgame = dlopen_safe(libgame_path, RTLD_NOW);
+
+    LOAD_FUNC(libgame, init_gamestate);
+    LOAD_FUNC(libgame, next_gamestate);
+    LOAD_FUNC(libgame, poll_game_input);
+    LOAD_FUNC(libgame, init_wall_config);
+    LOAD_FUNC(libgame, unload_wall_config);
+    LOAD_FUNC(libgame, display_wall);
+    LOAD_FUNC(libgame, read_game_counters);
+
+    InitWindow(INIT_WIDTH, INIT_HEIGHT, "Spectator");
+    SetTargetFPS(FPS);
+
+    GameState *const game_states = malloc(num_boards * sizeof(GameState));
+    if (game_states == NULL) {
+        fprintf(stderr, "Error: could not allocate %zu boards.\n", num_boards);
+        return EXIT_FAILURE;
+    }
+    for (size_t i = 0; i < num_boards; ++i)
+        game_states[i] = init_gamestate(INIT_LEVEL);
+
+    WallConfig wall_config = init_wall_config(game_states[0].display_mode);
+
+    unsigned long long frames = 0;
+    double render_time = 0;
+    while (!WindowShouldClose()) {
+        GameInput const input = poll_game_input();
+        for (size_t i = 0; i < num_boards; ++i) {
+            bool const is_game_over = next_gamestate(&game_states[i], &input);
+            if (is_game_over) game_states[i] = init_gamestate(INIT_LEVEL);
+        }
+
+        double const time = GetTime();
+        display_wall(game_states, num_boards, &wall_config);
+        render_time += GetTime() - time;
+        frames++;
+    }
+
+    printf("%zu boards, %llu frames, %.3f ms average render\n",
+        num_boards, frames, frames? 1000. * render_time / frames : 0.);
+
+    GameCounters counters;
+    read_game_counters(&counters);
+    if (counters.enabled) print_game_counters(&counters);
+
+    unload_wall_config(&wall_config);
+    free(game_states);
+    CloseWindow();
+    dlclose(libgame);
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,32 @@
+#include "transposition.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+extern bool create_transposition_table(
+    TranspositionTable *const table,
+    size_t const num_entries
+) {
+    size_t size = 1;
+    while (size < num_entries) size <<= 1;
+
+    // zeroed entries have check == value == 0, which only matches key 0
+    *table = (TranspositionTable){
+        .mask = size - 1,
+        .entries = calloc(size, sizeof(TranspositionEntry))
+    };
+    return table->entries != NULL;
+}
+
+extern void free_transposition_table(TranspositionTable *const table) {
+    free(table->entries);
+    table->entries = NULL;
+}
+
+extern void clear_transposition_table(TranspositionTable *const table) {
+    for (size_t i = 0; i <= table->mask; ++i) {
+        atomic_store_explicit(&table->entries[i].check, 0, memory_order_relaxed);
+        atomic_store_explicit(&table->entries[i].value, 0, memory_order_relaxed);
+    }
+}
@@ -0,0 +1,69 @@
+#ifndef TRANSPOSITION_H
+#define TRANSPOSITION_H
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Transposition table: a fixed size map from position hashes (see
+// `hash_gamestate`) to a 64 bit value, e.g. a packed evaluation, so searches
+// and analysis don't evaluate the same position twice.
+//
+// It is lock-free and can be shared by any number of threads. Each entry
+// stores `key ^ value` next to `value`; if two writers race on an entry the
+// halves no longer match and the probe reads as a miss instead of handing
+// back another position's value. Stores always replace whatever is there, it
+// is a cache and may forget.
+//
+// The MCTS bot keeps its board scores in one (see score_boards in bot.h) and
+// `archive positions` counts repeated positions with one.
+
+// Constants //////////////////////////////////////////////////////////////////
+#define TRANSPOSITION_DEFAULT_ENTRIES (size_t) (1 << 20)
+
+// Structs ////////////////////////////////////////////////////////////////////
+typedef struct {
+    _Atomic uint64_t check; // key ^ value
+    _Atomic uint64_t value;
+} TranspositionEntry;
+
+typedef struct {
+    size_t mask; // number of entries - 1
+    TranspositionEntry *entries;
+} TranspositionTable;
+
+// Functions //////////////////////////////////////////////////////////////////
+
+// `num_entries` is rounded up to a power of 2.
+bool create_transposition_table(
+    TranspositionTable *const table,
+    size_t const num_entries
+);
+void free_transposition_table(TranspositionTable *const table);
+void clear_transposition_table(TranspositionTable *const table);
+
+static inline bool probe_transposition_table(
+    TranspositionTable const*const table,
+    uint64_t const key,
+    uint64_t *const value
+) {
+    TranspositionEntry *const entry = &table->entries[key & table->mask];
+    uint64_t const check = atomic_load_explicit(&entry->check, memory_order_relaxed);
+    uint64_t const found = atomic_load_explicit(&entry->value, memory_order_relaxed);
+    if ((check ^ found) != key) return false;
+    *value = found;
+    return true;
+}
+
+static inline void store_transposition_table(
+    TranspositionTable *const table,
+    uint64_t const key,
+    uint64_t const value
+) {
+    TranspositionEntry *const entry = &table->entries[key & table->mask];
+    atomic_store_explicit(&entry->check, key ^ value, memory_order_relaxed);
+    atomic_store_explicit(&entry->value, value, memory_order_relaxed);
+}
+
+#endif // TRANSPOSITION_H
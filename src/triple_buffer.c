@@ -0,0 +1,48 @@
+#include "triple_buffer.h"
+#include "game.h"
+#include <stdatomic.h>
+
+extern void init_triple_buffer(
+    TripleBuffer *const buffer,
+    GameState const*const state
+) {
+    for (unsigned char i = 0; i < TRIPLE_BUFFER_SLOTS; ++i)
+        buffer->slots[i] = *state;
+
+    buffer->write_index = 0;
+    buffer->read_index  = 1;
+    atomic_store_explicit(&buffer->middle, 2, memory_order_relaxed);
+}
+
+// the slot the writer may fill in, it stays private until published
+extern GameState *triple_buffer_write_slot(TripleBuffer *const buffer) {
+    return &buffer->slots[buffer->write_index];
+}
+
+// hands the freshly written slot over and takes the middle one to write next
+extern void triple_buffer_publish(TripleBuffer *const buffer) {
+    unsigned char const previous = atomic_exchange_explicit(
+        &buffer->middle,
+        buffer->write_index | TRIPLE_BUFFER_FRESH,
+        memory_order_acq_rel
+    );
+    buffer->write_index = previous & ~TRIPLE_BUFFER_FRESH;
+}
+
+// returns the newest published state, or the one returned last time if
+// nothing new has been published since. Stays valid until the next call.
+extern GameState const* triple_buffer_read(TripleBuffer *const buffer) {
+    unsigned char const middle = atomic_load_explicit(
+        &buffer->middle,
+        memory_order_relaxed
+    );
+    if (middle & TRIPLE_BUFFER_FRESH) {
+        unsigned char const previous = atomic_exchange_explicit(
+            &buffer->middle,
+            buffer->read_index,
+            memory_order_acq_rel
+        );
+        buffer->read_index = previous & ~TRIPLE_BUFFER_FRESH;
+    }
+    return &buffer->slots[buffer->read_index];
+}
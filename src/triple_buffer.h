@@ -0,0 +1,27 @@
+#ifndef TRIPLE_BUFFER_H
+#define TRIPLE_BUFFER_H
+
+#include "game.h"
+#include <stdatomic.h>
+
+// Lock-free single producer / single consumer handoff of GameState snapshots.
+// The writer always has a private slot to fill, the reader always has a
+// private slot to look at, and the third slot is swapped between them. Neither
+// side ever waits; the reader just sees the newest finished state.
+
+#define TRIPLE_BUFFER_SLOTS (unsigned char) 3
+#define TRIPLE_BUFFER_FRESH (unsigned char) 0x04 // set on `middle` when unread
+
+typedef struct {
+    GameState slots[TRIPLE_BUFFER_SLOTS];
+    _Atomic unsigned char middle; // slot index | TRIPLE_BUFFER_FRESH
+    unsigned char write_index;    // only touched by the writer
+    unsigned char read_index;     // only touched by the reader
+} TripleBuffer;
+
+void init_triple_buffer(TripleBuffer *const buffer, GameState const*const state);
+GameState *triple_buffer_write_slot(TripleBuffer *const buffer);
+void triple_buffer_publish(TripleBuffer *const buffer);
+GameState const* triple_buffer_read(TripleBuffer *const buffer);
+
+#endif // TRIPLE_BUFFER_H
@@ -0,0 +1,313 @@
+#include "game.h"
+#include "bot.h"
+#include "counters.h"
+#include "debug.h"
+#include "finesse.h"
+#include "metrics.h"
+#include <math.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+// Headless versus match scheduler. Plays bot against bot matches (see bot.h)
+// on a pool of threads, every pairing from both sides, and ranks the bots by
+// Elo. Seeds come from the match number, and the ratings are worked out in
+// match order after everything has finished, so results don't depend on the
+// thread count or scheduling.
+//
+// usage: ./versus [-n matches] [-j threads] [-s seed] [-l level] [-f frames]
+//                 [-i tap|finesse]
+//
+// With -i finesse the bots move their pieces along the fastest paths (see
+// finesse.h) instead of one button a tick, each worker has its own cache.
+//
+// Set TETRIS_METRICS to watch a long run live (see metrics.h).
+
+#define VERSUS_MATCHES    (size_t) 1000
+#define VERSUS_SEED       (unsigned long long) 1
+#define VERSUS_LEVEL      (size_t) 15
+#define VERSUS_MAX_FRAMES (size_t) 36000 // 10 minutes at 60 ticks
+#define ELO_START         (double) 1500
+#define ELO_K             (double) 16
+
+typedef enum {
+    MATCH_DRAW,
+    MATCH_WIN_A,
+    MATCH_WIN_B
+} MatchResult;
+
+typedef struct {
+    size_t bot_a;
+    size_t bot_b;
+    unsigned long long seed;
+    MatchResult result;
+    size_t frames;
+} Match;
+
+typedef struct {
+    size_t num_matches;
+    size_t num_workers;
+    unsigned long long seed;
+    size_t level;
+    size_t max_frames;
+    bool use_finesse;
+} VersusOptions;
+
+typedef struct {
+    VersusOptions const* options;
+    Metrics *metrics;
+    Match *matches;
+    _Atomic size_t next_match;
+} Scheduler;
+
+typedef struct {
+    double elo;
+    size_t wins;
+    size_t draws;
+    size_t losses;
+} Standing;
+
+// Matches ////////////////////////////////////////////////////////////////////
+static inline unsigned long long _mix_seed(unsigned long long x) {
+    x += 0x9E3779B97F4A7C15ULL;
+    x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+    return x ^ (x >> 31);
+}
+
+// cycles through every pair of bots, playing each pair from both sides on
+// the same seed so neither gets the luckier piece sequence.
+static void _schedule_matches(Scheduler *const scheduler) {
+    size_t const num_pairs = NUM_BOT_CONFIGS * (NUM_BOT_CONFIGS - 1) / 2;
+    for (size_t i = 0; i < scheduler->options->num_matches; ++i) {
+        size_t pair = (i / 2) % num_pairs;
+        size_t a = 0;
+        while (pair >= NUM_BOT_CONFIGS - 1 - a) pair -= NUM_BOT_CONFIGS - 1 - a++;
+        size_t const b = a + 1 + pair;
+
+        bool const swap = i % 2 == 1;
+        scheduler->matches[i] = (Match){
+            .bot_a = swap? b : a,
+            .bot_b = swap? a : b,
+            .seed = _mix_seed(scheduler->options->seed + i / 2),
+            .result = MATCH_DRAW
+        };
+    }
+}
+
+static void _play_match(
+    Match *const match,
+    VersusOptions const*const options,
+    Metrics *const metrics,
+    FinesseCache *const finesse
+) {
+    GameState players[2] = {
+        init_gamestate_seeded(options->level, match->seed),
+        init_gamestate_seeded(options->level, match->seed)
+    };
+    Bot bots[2] = {
+        init_bot(&bot_configs[match->bot_a]),
+        init_bot(&bot_configs[match->bot_b])
+    };
+    bots[0].finesse = finesse;
+    bots[1].finesse = finesse;
+
+    match->result = MATCH_DRAW;
+    for (size_t frame = 1; frame <= options->max_frames; ++frame) {
+        bool is_game_over[2];
+        for (size_t i = 0; i < 2; ++i) {
+            GameInput const input = next_bot_input(&bots[i], &players[i]);
+            is_game_over[i] = next_gamestate(&players[i], &input);
+        }
+        exchange_garbage(&players[0], &players[1]);
+
+        match->frames = frame;
+        if (is_game_over[0] || is_game_over[1]) {
+            if (!(is_game_over[0] && is_game_over[1]))
+                match->result = is_game_over[0]? MATCH_WIN_B : MATCH_WIN_A;
+            break;
+        }
+    }
+
+    // once per match, so workers don't fight over the counters every tick
+    record_ticks(
+        metrics,
+        2 * match->frames,
+        players[0].pieces_placed + players[1].pieces_placed,
+        players[0].total_lines + players[1].total_lines
+    );
+}
+
+static void *_run_worker(void *const arg) {
+    Scheduler *const scheduler = arg;
+    FinesseCache cache;
+    FinesseCache *finesse = NULL;
+    if (scheduler->options->use_finesse) {
+        if (!create_finesse_cache(&cache, FINESSE_CACHE_ENTRIES)) exit(1);
+        finesse = &cache;
+    }
+
+    for (;;) {
+        size_t const i = atomic_fetch_add(&scheduler->next_match, 1);
+        if (i >= scheduler->options->num_matches) break;
+        _play_match(&scheduler->matches[i], scheduler->options, scheduler->metrics, finesse);
+    }
+    if (finesse != NULL) free_finesse_cache(finesse);
+    return NULL;
+}
+
+// Ratings ////////////////////////////////////////////////////////////////////
+static void _rate_matches(
+    Match const*const matches,
+    size_t const num_matches,
+    Standing standings[NUM_BOT_CONFIGS]
+) {
+    for (size_t i = 0; i < NUM_BOT_CONFIGS; ++i)
+        standings[i] = (Standing){ .elo = ELO_START };
+
+    for (size_t i = 0; i < num_matches; ++i) {
+        Standing *const a = &standings[matches[i].bot_a];
+        Standing *const b = &standings[matches[i].bot_b];
+
+        double score_a = 0.5;
+        switch (matches[i].result) {
+            case MATCH_WIN_A: score_a = 1; a->wins++; b->losses++; break;
+            case MATCH_WIN_B: score_a = 0; a->losses++; b->wins++; break;
+            case MATCH_DRAW:  a->draws++; b->draws++; break;
+        }
+
+        double const expected_a = 1 / (1 + pow(10, (b->elo - a->elo) / 400));
+        a->elo += ELO_K * (score_a - expected_a);
+        b->elo -= ELO_K * (score_a - expected_a);
+    }
+}
+
+static void _report_standings(Standing const standings[NUM_BOT_CONFIGS]) {
+    size_t order[NUM_BOT_CONFIGS];
+    for (size_t i = 0; i < NUM_BOT_CONFIGS; ++i) order[i] = i;
+    for (size_t i = 1; i < NUM_BOT_CONFIGS; ++i) {
+        for (size_t j = i; j > 0
+        &&   standings[order[j]].elo > standings[order[j - 1]].elo; --j) {
+            size_t const temp = order[j];
+            order[j] = order[j - 1];
+            order[j - 1] = temp;
+        }
+    }
+
+    printf("%-10s %8s %6s %6s %6s\n", "bot", "elo", "won", "drawn", "lost");
+    for (size_t i = 0; i < NUM_BOT_CONFIGS; ++i) {
+        Standing const*const standing = &standings[order[i]];
+        printf("%-10s %8.1f %6zu %6zu %6zu\n",
+            bot_configs[order[i]].name,
+            standing->elo,
+            standing->wins,
+            standing->draws,
+            standing->losses);
+    }
+}
+
+// Options ////////////////////////////////////////////////////////////////////
+static bool _parse_options(int const argc, char **argv, VersusOptions *const options) {
+    long const num_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    *options = (VersusOptions){
+        .num_matches = VERSUS_MATCHES,
+        .num_workers = num_cpus > 0? num_cpus : 1,
+        .seed        = VERSUS_SEED,
+        .level       = VERSUS_LEVEL,
+        .max_frames  = VERSUS_MAX_FRAMES,
+        .use_finesse = false
+    };
+
+    for (int i = 1; i < argc; ++i) {
+        if (i + 1 >= argc) return false;
+        char const*const value = argv[i + 1];
+
+        if      (strcmp(argv[i], "-n") == 0) options->num_matches = strtoul(value, NULL, 10);
+        else if (strcmp(argv[i], "-j") == 0) options->num_workers = strtoul(value, NULL, 10);
+        else if (strcmp(argv[i], "-s") == 0) options->seed = strtoull(value, NULL, 10);
+        else if (strcmp(argv[i], "-l") == 0) options->level = strtoul(value, NULL, 10);
+        else if (strcmp(argv[i], "-f") == 0) options->max_frames = strtoul(value, NULL, 10);
+        else if (strcmp(argv[i], "-i") == 0) {
+            if      (strcmp(value, "tap") == 0)     options->use_finesse = false;
+            else if (strcmp(value, "finesse") == 0) options->use_finesse = true;
+            else return false;
+        }
+        else return false;
+        ++i;
+    }
+    return options->num_matches > 0
+        && options->num_workers > 0
+        && options->max_frames > 0;
+}
+
+int main(int argc, char **argv) {
+    VersusOptions options;
+    if (!_parse_options(argc, argv, &options)) {
+        fprintf(stderr,
+            "usage: %s [-n matches] [-j threads] [-s seed] [-l level] [-f frames]"
+            " [-i tap|finesse]\n",
+            argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    static Metrics metrics;
+    MetricsServer metrics_server = { .socket = -1 };
+    init_metrics(&metrics);
+    char const*const metrics_address = metrics_address_from_env(NULL);
+    if (metrics_address != NULL)
+        start_metrics_server(&metrics_server, &metrics, metrics_address);
+
+    Scheduler scheduler = {
+        .options = &options,
+        .metrics = &metrics,
+        .matches = malloc(options.num_matches * sizeof(Match)),
+        .next_match = 0
+    };
+    pthread_t *const workers = malloc(options.num_workers * sizeof(pthread_t));
+    if (scheduler.matches == NULL || workers == NULL) {
+        fprintf(stderr, "Error: could not allocate %zu matches.\n", options.num_matches);
+        return EXIT_FAILURE;
+    }
+    _schedule_matches(&scheduler);
+
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (size_t i = 0; i < options.num_workers; ++i) {
+        if (pthread_create(&workers[i], NULL, _run_worker, &scheduler)) {
+            fprintf(stderr, "Error: could not start worker thread.\n");
+            exit(1);
+        }
+    }
+    for (size_t i = 0; i < options.num_workers; ++i) pthread_join(workers[i], NULL);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    Standing standings[NUM_BOT_CONFIGS];
+    _rate_matches(scheduler.matches, options.num_matches, standings);
+    _report_standings(standings);
+
+    unsigned long long total_frames = 0;
+    for (size_t i = 0; i < options.num_matches; ++i)
+        total_frames += scheduler.matches[i].frames;
+    double const seconds = (end.tv_sec - start.tv_sec)
+                         + (end.tv_nsec - start.tv_nsec) * 1e-9;
+    printf("\n%zu matches on %zu threads in %.2fs, %.1f matches/s, "
+           "%.0f board frames/s, %.0f frames per match\n",
+        options.num_matches, options.num_workers, seconds,
+        options.num_matches / seconds,
+        2 * total_frames / seconds,
+        (double)total_frames / options.num_matches);
+
+    GameCounters counters;
+    read_game_counters(&counters);
+    if (counters.enabled) print_game_counters(&counters);
+
+    stop_metrics_server(&metrics_server);
+    free(workers);
+    free(scheduler.matches);
+    return EXIT_SUCCESS;
+}
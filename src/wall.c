@@ -0,0 +1,258 @@
+#include "game.h"
+#include "wireframe.h"
+#include <raylib.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+// Atlas Layout ///////////////////////////////////////////////////////////////
+// One row per tetromino colour, one column per visible side bitmap. The extra
+// last row holds a solid white tile which is tinted for backgrounds so they
+// share the atlas texture and don't break the quad batch.
+#define ATLAS_TILE      (BLOCK_SCALE + 2 * WALL_ATLAS_PAD)
+#define ATLAS_COLS      NUM_WIREFRAME_SIDE_BITMAPS
+#define ATLAS_ROWS      (NUM_TETROMINO_TYPES + 1)
+#define ATLAS_SOLID_ROW NUM_TETROMINO_TYPES
+
+typedef struct {
+    size_t grid_cols;
+    float cell;      // size of one block on screen
+    float tile_width;
+    float tile_height;
+    float x_offset;  // centres the grid on screen
+    float y_offset;
+} WallLayout;
+
+// render textures are stored upside down, so the source rectangle is flipped
+static inline Rectangle _atlas_source(
+    size_t const atlas_col,
+    size_t const atlas_row
+) {
+    return (Rectangle){
+        atlas_col * ATLAS_TILE,
+        (ATLAS_ROWS - atlas_row - 1) * ATLAS_TILE,
+        ATLAS_TILE,
+        -(float)ATLAS_TILE
+    };
+}
+
+// the solid tile is sampled away from its edges so bilinear filtering never
+// picks up the transparent neighbours.
+static inline Rectangle _atlas_solid_source(void) {
+    Rectangle source = _atlas_source(0, ATLAS_SOLID_ROW);
+    source.x += WALL_ATLAS_PAD;
+    source.y += WALL_ATLAS_PAD;
+    source.width -= 2 * WALL_ATLAS_PAD;
+    source.height += 2 * WALL_ATLAS_PAD;
+    return source;
+}
+
+static void _draw_atlas_tiles(
+    DisplayMode const display_mode,
+    Color const tetromino_colors[NUM_TETROMINO_TYPES + 1]
+) {
+    for (size_t type = 0; type < NUM_TETROMINO_TYPES; ++type) {
+        Color const color = tetromino_colors[type];
+        for (size_t sides = 0; sides < ATLAS_COLS; ++sides) {
+            size_t const x = sides * ATLAS_TILE + WALL_ATLAS_PAD;
+            size_t const y = type * ATLAS_TILE + WALL_ATLAS_PAD;
+
+            if (display_mode == DEFAULT_DISPLAY_MODE) {
+                DrawRectangle(x, y, BLOCK_SCALE, BLOCK_SCALE, color);
+                continue;
+            }
+
+            WireframeSegment segments[EDGE_SIZE];
+            size_t const num_segments = wireframe_block_segments(
+                x, y,
+                BLOCK_SCALE,
+                LINE_THICKNESS,
+                sides,
+                segments
+            );
+            for (size_t i = 0; i < num_segments; ++i) DrawLineEx(
+                segments[i].start,
+                segments[i].end,
+                (float)LINE_THICKNESS, color
+            );
+        }
+    }
+
+    DrawRectangle(0, ATLAS_SOLID_ROW * ATLAS_TILE, ATLAS_TILE, ATLAS_TILE, WHITE);
+}
+
+// Layout /////////////////////////////////////////////////////////////////////
+
+// tries every column count and keeps the one giving the biggest blocks.
+// Only ever runs over at most MAX_WALL_BOARDS options, once per frame.
+static WallLayout _calc_wall_layout(
+    size_t const num_boards,
+    float const screen_width,
+    float const screen_height
+) {
+    float const tile_cols = COLS + 2 * WALL_TILE_MARGIN;
+    float const tile_rows = ROWS + 2 * WALL_TILE_MARGIN;
+    WallLayout layout = { .grid_cols = 1, .cell = 0 };
+
+    for (size_t grid_cols = 1; grid_cols <= num_boards; ++grid_cols) {
+        size_t const grid_rows = (num_boards + grid_cols - 1) / grid_cols;
+        float const cell_x = screen_width / (grid_cols * tile_cols);
+        float const cell_y = screen_height / (grid_rows * tile_rows);
+        float const cell = cell_x < cell_y? cell_x : cell_y;
+        if (cell > layout.cell) {
+            layout.grid_cols = grid_cols;
+            layout.cell = cell;
+        }
+    }
+
+    size_t const grid_rows
+        = (num_boards + layout.grid_cols - 1) / layout.grid_cols;
+    layout.tile_width  = tile_cols * layout.cell;
+    layout.tile_height = tile_rows * layout.cell;
+    layout.x_offset = (screen_width - layout.grid_cols * layout.tile_width) / 2;
+    layout.y_offset = (screen_height - grid_rows * layout.tile_height) / 2;
+    return layout;
+}
+
+// Drawing ////////////////////////////////////////////////////////////////////
+static inline void _draw_wall_block(
+    Texture2D const atlas,
+    size_t const type,
+    unsigned char const sides,
+    float const x,
+    float const y,
+    float const cell
+) {
+    float const scale = cell / BLOCK_SCALE;
+    DrawTexturePro(
+        atlas,
+        _atlas_source(sides, type),
+        (Rectangle){
+            x - WALL_ATLAS_PAD * scale,
+            y - WALL_ATLAS_PAD * scale,
+            ATLAS_TILE * scale,
+            ATLAS_TILE * scale
+        },
+        (Vector2){0, 0},
+        0.0f,
+        WHITE
+    );
+}
+
+static void _draw_wall_board(
+    GameState const*const game_state,
+    WallConfig const*const wall_config,
+    float const x_offset,
+    float const y_offset,
+    float const cell
+) {
+    Texture2D const atlas = wall_config->atlas.texture;
+    DisplayConfig const*const display_config = &wall_config->display_config;
+    bool const is_wireframe = wall_config->display_mode == WIREFRAME_DISPLAY_MODE;
+    float const border = cell / 4;
+
+    DrawTexturePro(atlas, _atlas_solid_source(),
+        (Rectangle){
+            x_offset - border,
+            y_offset - border,
+            COLS * cell + 2 * border,
+            ROWS * cell + 2 * border
+        },
+        (Vector2){0, 0}, 0.0f, display_config->font_color
+    );
+    DrawTexturePro(atlas, _atlas_solid_source(),
+        (Rectangle){x_offset, y_offset, COLS * cell, ROWS * cell},
+        (Vector2){0, 0}, 0.0f,
+        display_config->tetromino_colors[NUM_TETROMINO_TYPES]
+    );
+
+    for (size_t y = 0; y < ROWS; ++y) {
+        for (size_t x = 0; x < COLS; ++x) {
+            TetrominoType const type = game_state->board[y][x];
+            if (type == NO_TETROMINO) continue;
+            _draw_wall_block(
+                atlas,
+                type,
+                is_wireframe? wireframe_board_sides(game_state->board, x, y) : 0,
+                x_offset + x * cell,
+                y_offset + y * cell,
+                cell
+            );
+        }
+    }
+
+    Tetromino const*const tetromino = &game_state->current_tetromino;
+    for (size_t i = 0; i < NUM_TETROMINO_BLOCKS; ++i) {
+        size_t const x_absolute = tetromino->positions[i][X_AXIS] + tetromino->x;
+        size_t const y_absolute = tetromino->positions[i][Y_AXIS] + tetromino->y;
+        if (x_absolute >= COLS || y_absolute >= ROWS) continue;
+        _draw_wall_block(
+            atlas,
+            tetromino->type,
+            is_wireframe? wireframe_tetromino_sides(tetromino->positions, i) : 0,
+            x_offset + x_absolute * cell,
+            y_offset + y_absolute * cell,
+            cell
+        );
+    }
+}
+
+// Wall Exposed ///////////////////////////////////////////////////////////////
+
+// NOTE: needs a window (and so a GL context) to exist already.
+extern WallConfig init_wall_config(DisplayMode const display_mode) {
+    WallConfig wall_config = {
+        .display_mode = display_mode,
+        .display_config = init_display_config(display_mode),
+        .atlas = LoadRenderTexture(
+            ATLAS_COLS * ATLAS_TILE,
+            ATLAS_ROWS * ATLAS_TILE
+        )
+    };
+
+    BeginTextureMode(wall_config.atlas);
+    ClearBackground(BLANK);
+    _draw_atlas_tiles(display_mode, wall_config.display_config.tetromino_colors);
+    EndTextureMode();
+
+    // boards are usually scaled down a lot, filtering keeps thin lines visible
+    SetTextureFilter(wall_config.atlas.texture, TEXTURE_FILTER_BILINEAR);
+    return wall_config;
+}
+
+extern void unload_wall_config(WallConfig *const wall_config) {
+    UnloadRenderTexture(wall_config->atlas);
+}
+
+// Every quad drawn here samples the same atlas texture, so raylib keeps them
+// all in one render batch and flushes only when its vertex buffer fills up.
+extern void display_wall(
+    GameState  const*const game_states,
+    size_t     const num_game_states,
+    WallConfig const*const wall_config
+) {
+    size_t const num_boards = num_game_states < MAX_WALL_BOARDS
+        ? num_game_states
+        : MAX_WALL_BOARDS;
+
+    BeginDrawing();
+    ClearBackground(wall_config->display_config.background_color);
+
+    if (num_boards > 0) {
+        WallLayout const layout = _calc_wall_layout(
+            num_boards,
+            GetScreenWidth(),
+            GetScreenHeight()
+        );
+        float const margin = WALL_TILE_MARGIN * layout.cell;
+
+        for (size_t i = 0; i < num_boards; ++i) _draw_wall_board(
+            &game_states[i],
+            wall_config,
+            layout.x_offset + (i % layout.grid_cols) * layout.tile_width + margin,
+            layout.y_offset + (i / layout.grid_cols) * layout.tile_height + margin,
+            layout.cell
+        );
+    }
+
+    EndDrawing();
+}
@@ -0,0 +1,113 @@
+#ifndef WIREFRAME_H
+#define WIREFRAME_H
+
+#include "game.h"
+#include <raylib.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+// Shared edge logic for the wireframe look. Every renderer that wants the
+// wireframe style (single board, spectator wall, ...) decides which sides of
+// a block to draw here, so they all agree on what a block looks like.
+
+// Constants //////////////////////////////////////////////////////////////////
+#define WIREFRAME_SIDE_UP      (unsigned char) 0x01
+#define WIREFRAME_SIDE_DOWN    (unsigned char) 0x02
+#define WIREFRAME_SIDE_LEFT    (unsigned char) 0x04
+#define WIREFRAME_SIDE_RIGHT   (unsigned char) 0x08
+#define WIREFRAME_ALL_SIDES    (unsigned char) 0x0F
+#define NUM_WIREFRAME_SIDE_BITMAPS (size_t) 16
+
+// Structs ////////////////////////////////////////////////////////////////////
+typedef struct {
+    Vector2 start;
+    Vector2 end;
+} WireframeSegment;
+
+// Side Bitmaps ///////////////////////////////////////////////////////////////
+
+// a side of a board block is shown if the neighbour on that side is a
+// different colour (or the board edge).
+static inline unsigned char wireframe_board_sides(
+    TetrominoType const board[ROWS][COLS],
+    size_t const x,
+    size_t const y
+) {
+    TetrominoType const type = board[y][x];
+    bool const show_up    = y == 0        || board[y - 1][x] != type;
+    bool const show_down  = y + 1 >= ROWS || board[y + 1][x] != type;
+    bool const show_left  = x == 0        || board[y][x - 1] != type;
+    bool const show_right = x + 1 >= COLS || board[y][x + 1] != type;
+
+    return show_up    * WIREFRAME_SIDE_UP
+         | show_down  * WIREFRAME_SIDE_DOWN
+         | show_left  * WIREFRAME_SIDE_LEFT
+         | show_right * WIREFRAME_SIDE_RIGHT;
+}
+
+// a side of a falling tetromino block is shown unless another block of the
+// same tetromino touches it.
+static inline unsigned char wireframe_tetromino_sides(
+    size_t const positions[NUM_TETROMINO_BLOCKS][NUM_AXIS],
+    size_t const block_index
+) {
+    unsigned char sides = WIREFRAME_ALL_SIDES;
+    size_t const x = positions[block_index][X_AXIS];
+    size_t const y = positions[block_index][Y_AXIS];
+
+    for (size_t j = 0; j < NUM_TETROMINO_BLOCKS; ++j) {
+        if (j == block_index) continue;
+        size_t const other_x = positions[j][X_AXIS];
+        size_t const other_y = positions[j][Y_AXIS];
+        if (other_y == y - 1 && other_x == x) sides &= ~WIREFRAME_SIDE_UP;
+        if (other_y == y + 1 && other_x == x) sides &= ~WIREFRAME_SIDE_DOWN;
+        if (other_x == x - 1 && other_y == y) sides &= ~WIREFRAME_SIDE_LEFT;
+        if (other_x == x + 1 && other_y == y) sides &= ~WIREFRAME_SIDE_RIGHT;
+    }
+    return sides;
+}
+
+// Geometry ///////////////////////////////////////////////////////////////////
+
+// fills `segments` with the lines making up one wireframe block whose top left
+// corner is at (x, y) and returns how many there are. Hidden sides let the
+// neighbouring lines run on by two thicknesses so adjacent blocks join up.
+static inline size_t wireframe_block_segments(
+    float const x,
+    float const y,
+    float const scale,
+    float const thickness,
+    unsigned char const show_side_bitmap,
+    WireframeSegment segments[EDGE_SIZE]
+) {
+    bool const show_up    = show_side_bitmap & WIREFRAME_SIDE_UP;
+    bool const show_down  = show_side_bitmap & WIREFRAME_SIDE_DOWN;
+    bool const show_left  = show_side_bitmap & WIREFRAME_SIDE_LEFT;
+    bool const show_right = show_side_bitmap & WIREFRAME_SIDE_RIGHT;
+
+    float const near_x = x + thickness + (show_left?  0 : -2 * thickness);
+    float const far_x  = x + scale - thickness + (show_right? 0 : 2 * thickness);
+    float const near_y = y + thickness + (show_up?    0 : -2 * thickness);
+    float const far_y  = y + scale - thickness + (show_down?  0 : 2 * thickness);
+
+    size_t num_segments = 0;
+    if (show_up) segments[num_segments++] = (WireframeSegment){
+        (Vector2){near_x, y + thickness},
+        (Vector2){far_x,  y + thickness}
+    };
+    if (show_down) segments[num_segments++] = (WireframeSegment){
+        (Vector2){near_x, y + scale - thickness},
+        (Vector2){far_x,  y + scale - thickness}
+    };
+    if (show_left) segments[num_segments++] = (WireframeSegment){
+        (Vector2){x + thickness, near_y},
+        (Vector2){x + thickness, far_y}
+    };
+    if (show_right) segments[num_segments++] = (WireframeSegment){
+        (Vector2){x + scale - thickness, near_y},
+        (Vector2){x + scale - thickness, far_y}
+    };
+    return num_segments;
+}
+
+#endif // WIREFRAME_H